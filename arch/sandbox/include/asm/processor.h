@@ -0,0 +1,12 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef __SANDBOX_PROCESSOR_H__
+#define __SANDBOX_PROCESSOR_H__
+
+/* Nothing processor-specific is needed on sandbox */
+
+#endif /* __SANDBOX_PROCESSOR_H__ */
@@ -6,6 +6,7 @@
 #include <common.h>
 #include <cros_ec.h>
 #include <dm.h>
+#include <netdev.h>
 #include <os.h>
 #include <asm/u-boot-sandbox.h>
 
@@ -30,12 +31,26 @@ unsigned long timer_read_counter(void)
 	return os_get_nsec() / 1000;
 }
 
+int checkboard(void)
+{
+	puts("Board: sandbox\n");
+
+	return 0;
+}
+
 int dram_init(void)
 {
 	gd->ram_size = CONFIG_SYS_SDRAM_SIZE;
 	return 0;
 }
 
+#ifdef CONFIG_SANDBOX_ETH
+int board_eth_init(bd_t *bis)
+{
+	return sandbox_eth_initialize(bis);
+}
+#endif
+
 #ifdef CONFIG_BOARD_EARLY_INIT_F
 int board_early_init_f(void)
 {
@@ -273,10 +273,20 @@ static int initr_malloc(void)
 #ifdef CONFIG_DM
 static int initr_dm(void)
 {
+	int ret;
+
 	/* Save the pre-reloc driver model and start a new one */
 	gd->dm_root_f = gd->dm_root;
 	gd->dm_root = NULL;
-	return dm_init_and_scan(false);
+	ret = dm_init_and_scan(false);
+	if (ret)
+		return ret;
+#ifdef CONFIG_DM_PROBE_ALL
+	/* A device which fails to probe need not stop the boot */
+	dm_probe_all();
+#endif
+
+	return 0;
 }
 #endif
 
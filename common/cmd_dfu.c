@@ -38,6 +38,7 @@ static int do_dfu(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 	int controller_index = simple_strtoul(usb_controller, NULL, 0);
 	board_usb_init(controller_index, USB_INIT_DEVICE);
 
+	dfu_set_write_overlap(true);
 	g_dnl_register("usb_dnl_dfu");
 	while (1) {
 		if (dfu_reset())
@@ -53,6 +54,9 @@ static int do_dfu(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 			goto exit;
 
 		usb_gadget_handle_interrupts();
+
+		/* Write to the medium while the host sends the next blocks */
+		dfu_write_poll();
 	}
 exit:
 	g_dnl_unregister();
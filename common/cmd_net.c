@@ -11,6 +11,7 @@
 #include <common.h>
 #include <command.h>
 #include <net.h>
+#include <part.h>
 
 static int netboot_common(enum proto_t, cmd_tbl_t *, int, char * const []);
 
@@ -113,6 +114,54 @@ U_BOOT_CMD(
 );
 #endif
 
+#if defined(CONFIG_CMD_NETSINK)
+static int do_netsink(cmd_tbl_t *cmdtp, int flag, int argc,
+		      char * const argv[])
+{
+	block_dev_desc_t *dev_desc;
+	disk_partition_t info;
+	ulong blk;
+	int repeatable;
+	int ret;
+
+	if (argc < 5)
+		return CMD_RET_USAGE;
+
+	if (get_device_and_partition(argv[1], argv[2], &dev_desc, &info,
+				     1) < 0)
+		return CMD_RET_FAILURE;
+
+	blk = simple_strtoul(argv[3], NULL, 16);
+	if (blk >= info.size) {
+		printf("Block %#lx is past the end of %s %s\n", blk, argv[1],
+		       argv[2]);
+		return CMD_RET_FAILURE;
+	}
+
+	if (net_sink_start(dev_desc, info.start + blk, info.size - blk)) {
+		puts("Cannot allocate netsink buffers\n");
+		return CMD_RET_FAILURE;
+	}
+
+	ret = cmd_process(flag, argc - 4, argv + 4, &repeatable, NULL);
+	if (ret == CMD_RET_SUCCESS && net_sink_finish())
+		ret = CMD_RET_FAILURE;
+
+	net_sink_stop();
+
+	return ret;
+}
+
+U_BOOT_CMD(
+	netsink,	CONFIG_SYS_MAXARGS,	0,	do_netsink,
+	"write a network download directly to a block device",
+	"<interface> <dev[:part]> <blk#> <command ...>\n"
+	"    - run a download command (tftpboot, nfs, ...) writing the\n"
+	"      received file to 'interface' device 'dev' (or partition\n"
+	"      'part'), starting at hex block 'blk#', instead of memory"
+);
+#endif
+
 static void netboot_update_env(void)
 {
 	char tmp[22];
@@ -243,6 +292,12 @@ static int netboot_common(enum proto_t proto, cmd_tbl_t *cmdtp, int argc,
 		return 0;
 	}
 
+#ifdef CONFIG_CMD_NETSINK
+	/* The file went to a block device, there is nothing to boot */
+	if (net_sink_active())
+		return 0;
+#endif
+
 	/* flush cache */
 	flush_cache(load_addr, size);
 
@@ -284,6 +339,47 @@ U_BOOT_CMD(
 );
 #endif
 
+#if defined(CONFIG_CMD_ETHSTATS)
+static int do_ethstats(cmd_tbl_t *cmdtp, int flag, int argc,
+		       char * const argv[])
+{
+	struct eth_device *dev, *first;
+	int reset = 0;
+
+	if (argc > 2)
+		return CMD_RET_USAGE;
+	if (argc == 2) {
+		if (strcmp(argv[1], "reset"))
+			return CMD_RET_USAGE;
+		reset = 1;
+	}
+
+	first = eth_get_dev_by_index(0);
+	if (!first) {
+		puts("No ethernet found.\n");
+		return CMD_RET_FAILURE;
+	}
+
+	dev = first;
+	do {
+		if (reset)
+			eth_reset_stats(dev);
+		else
+			eth_print_stats(dev);
+		dev = dev->next;
+	} while (dev != first);
+
+	return CMD_RET_SUCCESS;
+}
+
+U_BOOT_CMD(
+	ethstats,	2,	1,	do_ethstats,
+	"show per-interface network traffic statistics",
+	"       - show packet/byte counters and throughput of each interface\n"
+	"ethstats reset - clear the counters"
+);
+#endif
+
 #if defined(CONFIG_CMD_CDP)
 
 static void cdp_update_env(void)
@@ -10,6 +10,7 @@
  */
 #include <common.h>
 #include <command.h>
+#include <asm/io.h>
 #include <asm/processor.h>
 #include <scsi.h>
 #include <image.h>
@@ -67,6 +68,10 @@ static ulong scsi_read(int device, lbaint_t blknr, lbaint_t blkcnt,
 		       void *buffer);
 static ulong scsi_write(int device, lbaint_t blknr,
 			lbaint_t blkcnt, const void *buffer);
+#ifdef CONFIG_SCSI_AHCI
+static ulong scsi_read_sg(int device, lbaint_t blknr,
+			  const struct blk_sg *sg, int nsg);
+#endif
 
 
 /*********************************************************************************
@@ -100,6 +105,9 @@ void scsi_scan(int mode)
 		scsi_dev_desc[i].part_type=PART_TYPE_UNKNOWN;
 		scsi_dev_desc[i].block_read=scsi_read;
 		scsi_dev_desc[i].block_write = scsi_write;
+#ifdef CONFIG_SCSI_AHCI
+		scsi_dev_desc[i].block_read_sg = scsi_read_sg;
+#endif
 	}
 	scsi_max_devs=0;
 	for(i=0;i<CONFIG_SYS_SCSI_MAX_SCSI_ID;i++) {
@@ -327,9 +335,12 @@ int do_scsi (cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 				ulong blk  = simple_strtoul(argv[3], NULL, 16);
 				ulong cnt  = simple_strtoul(argv[4], NULL, 16);
 				ulong n;
+				void *buf;
 				printf ("\nSCSI read: device %d block # %ld, count %ld ... ",
 						scsi_curr_dev, blk, cnt);
-				n = scsi_read(scsi_curr_dev, blk, cnt, (ulong *)addr);
+				buf = map_sysmem(addr, cnt * 512);
+				n = scsi_read(scsi_curr_dev, blk, cnt, buf);
+				unmap_sysmem(buf);
 				printf ("%ld blocks read: %s\n",n,(n==cnt) ? "OK" : "ERROR");
 				return 0;
 			} else if (strcmp(argv[1], "write") == 0) {
@@ -337,11 +348,13 @@ int do_scsi (cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 				ulong blk = simple_strtoul(argv[3], NULL, 16);
 				ulong cnt = simple_strtoul(argv[4], NULL, 16);
 				ulong n;
+				void *buf;
 				printf("\nSCSI write: device %d block # %ld, "
 				       "count %ld ... ",
 				       scsi_curr_dev, blk, cnt);
-				n = scsi_write(scsi_curr_dev, blk, cnt,
-					       (ulong *)addr);
+				buf = map_sysmem(addr, cnt * 512);
+				n = scsi_write(scsi_curr_dev, blk, cnt, buf);
+				unmap_sysmem(buf);
 				printf("%ld blocks written: %s\n", n,
 				       (n == cnt) ? "OK" : "ERROR");
 				return 0;
@@ -405,6 +418,59 @@ static ulong scsi_read(int device, lbaint_t blknr, lbaint_t blkcnt,
 	return(blkcnt);
 }
 
+#ifdef CONFIG_SCSI_AHCI
+/*
+ * The AHCI driver takes the data of a command as a scatter-gather list,
+ * so a read into several fragments needs no more commands than one into
+ * a single buffer.
+ */
+static ulong scsi_read_sg(int device, lbaint_t blknr,
+			  const struct blk_sg *sg, int nsg)
+{
+	lbaint_t done = 0, blks;
+	unsigned long skip = 0;
+	ccb *pccb = (ccb *)&tempccb;
+	int i, ok;
+
+	device &= 0xff;
+	pccb->target = scsi_dev_desc[device].target;
+	pccb->lun = scsi_dev_desc[device].lun;
+	debug("\n%s: dev %d startblk " LBAF ", %d fragments\n", __func__,
+	      device, blknr, nsg);
+	while (nsg) {
+		blks = sg[0].blkcnt - skip;
+		for (i = 1; i < nsg && blks < SCSI_MAX_READ_BLK; i++)
+			blks += sg[i].blkcnt;
+		blks = min(blks, (lbaint_t)SCSI_MAX_READ_BLK);
+		if (!blks)
+			break;
+
+		pccb->pdata = NULL;
+		pccb->sg = sg;
+		pccb->sg_count = nsg;
+		pccb->sg_skip = skip;
+		pccb->datalen = scsi_dev_desc[device].blksz * blks;
+		scsi_setup_read_ext(pccb, blknr + done, blks);
+		ok = scsi_exec(pccb);
+		pccb->sg = NULL;
+		if (ok != true) {
+			scsi_print_error(pccb);
+			break;
+		}
+
+		done += blks;
+		skip += blks;
+		while (nsg && skip >= sg->blkcnt) {
+			skip -= sg->blkcnt;
+			sg++;
+			nsg--;
+		}
+	}
+
+	return done;
+}
+#endif
+
 /*******************************************************************************
  * scsi_write
  */
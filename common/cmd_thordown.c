@@ -39,6 +39,7 @@ int do_thor_down(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 		goto exit;
 	}
 
+	dfu_set_write_overlap(true);
 	g_dnl_register("usb_dnl_thor");
 
 	ret = thor_init();
@@ -11,6 +11,7 @@
 #include <common.h>
 #include <command.h>
 #include <asm/byteorder.h>
+#include <asm/io.h>
 #include <asm/unaligned.h>
 #include <part.h>
 #include <usb.h>
@@ -582,11 +583,15 @@ static int do_usb(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 			unsigned long blk  = simple_strtoul(argv[3], NULL, 16);
 			unsigned long cnt  = simple_strtoul(argv[4], NULL, 16);
 			unsigned long n;
+			void *buf;
+
 			printf("\nUSB read: device %d block # %ld, count %ld"
 				" ... ", usb_stor_curr_dev, blk, cnt);
 			stor_dev = usb_stor_get_dev(usb_stor_curr_dev);
+			buf = map_sysmem(addr, cnt * stor_dev->blksz);
 			n = stor_dev->block_read(usb_stor_curr_dev, blk, cnt,
-						 (ulong *)addr);
+						 buf);
+			unmap_sysmem(buf);
 			printf("%ld blocks read: %s\n", n,
 				(n == cnt) ? "OK" : "ERROR");
 			if (n == cnt)
@@ -604,11 +609,15 @@ static int do_usb(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 			unsigned long blk  = simple_strtoul(argv[3], NULL, 16);
 			unsigned long cnt  = simple_strtoul(argv[4], NULL, 16);
 			unsigned long n;
+			void *buf;
+
 			printf("\nUSB write: device %d block # %ld, count %ld"
 				" ... ", usb_stor_curr_dev, blk, cnt);
 			stor_dev = usb_stor_get_dev(usb_stor_curr_dev);
+			buf = map_sysmem(addr, cnt * stor_dev->blksz);
 			n = stor_dev->block_write(usb_stor_curr_dev, blk, cnt,
-						(ulong *)addr);
+						  buf);
+			unmap_sysmem(buf);
 			printf("%ld blocks write: %s\n", n,
 				(n == cnt) ? "OK" : "ERROR");
 			if (n == cnt)
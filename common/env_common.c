@@ -249,6 +249,115 @@ int env_export(env_t *env_out)
 	return 0;
 }
 
+#ifdef CONFIG_ENV_INCREMENTAL
+/*
+ * What each copy of the environment in storage holds, as last read or
+ * written, and whether the hash table then held the same, at which count
+ * of changes. Encrypted environments are decrypted in place when they are
+ * imported, so for those nothing is kept and every save writes the lot.
+ */
+static env_t *env_shadow[2];
+static int env_shadow_current[2];
+static unsigned int env_shadow_changes[2];
+#endif
+
+void env_shadow_set(int copy, const env_t *env, int current)
+{
+#if defined(CONFIG_ENV_INCREMENTAL) && !defined(CONFIG_ENV_AES)
+	if (env && !env_shadow[copy])
+		env_shadow[copy] = malloc(CONFIG_ENV_SIZE);
+	if (!env || !env_shadow[copy]) {
+		free(env_shadow[copy]);
+		env_shadow[copy] = NULL;
+		return;
+	}
+	memcpy(env_shadow[copy], env, CONFIG_ENV_SIZE);
+	env_shadow_current[copy] = current;
+	env_shadow_changes[copy] = env_htab.changes;
+#endif
+}
+
+env_t *env_shadow_get(int copy)
+{
+#ifdef CONFIG_ENV_INCREMENTAL
+	return env_shadow[copy];
+#else
+	return NULL;
+#endif
+}
+
+int env_unchanged(int copy)
+{
+#ifdef CONFIG_ENV_INCREMENTAL
+	return env_shadow[copy] && env_shadow_current[copy] &&
+		env_shadow_changes[copy] == env_htab.changes;
+#else
+	return 0;
+#endif
+}
+
+static int env_block_same(const char *old, const char *new, uint blk,
+			  uint blk_size)
+{
+	uint offset = blk * blk_size;
+
+	return !memcmp(old + offset, new + offset,
+		       min(blk_size, CONFIG_ENV_SIZE - offset));
+}
+
+int env_write_changed(int copy, const env_t *env_new, uint blk_size,
+		      int (*write)(void *priv, uint start, uint count,
+				   const void *buf),
+		      void *priv)
+{
+	const char *old = (const char *)env_shadow_get(copy);
+	const char *new = (const char *)env_new;
+	uint blks = DIV_ROUND_UP(CONFIG_ENV_SIZE, blk_size);
+	uint start, end;
+	int count = 0;
+	int ret = 0;
+
+	if (!old) {
+		count = blks;
+		ret = write(priv, 0, blks, new);
+		goto done;
+	}
+
+	/*
+	 * The first block, with the CRC and flags, goes last, so that the
+	 * copy is not taken as valid if the other writes do not finish.
+	 */
+	for (start = 1; start < blks; start = end) {
+		if (env_block_same(old, new, start, blk_size)) {
+			end = start + 1;
+			continue;
+		}
+		for (end = start + 1; end < blks; end++) {
+			if (env_block_same(old, new, end, blk_size))
+				break;
+		}
+		count += end - start;
+		ret = write(priv, start, end - start, new + start * blk_size);
+		if (ret)
+			goto done;
+	}
+	if (!env_block_same(old, new, 0, blk_size)) {
+		count++;
+		ret = write(priv, 0, 1, new);
+	}
+
+done:
+	if (ret) {
+		/* Whatever is in storage now is not known */
+		env_shadow_set(copy, NULL, 0);
+		return ret < 0 ? ret : -EIO;
+	}
+	env_shadow_set(copy, env_new, 1);
+	debug("Wrote %d of %u environment blocks\n", count, blks);
+
+	return count;
+}
+
 void env_relocate(void)
 {
 #if defined(CONFIG_NEEDS_MANUAL_RELOC)
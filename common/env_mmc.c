@@ -133,6 +133,21 @@ static inline int write_env(struct mmc *mmc, unsigned long size,
 	return (n == blk_cnt) ? 0 : -1;
 }
 
+struct env_mmc_copy {
+	struct mmc *mmc;
+	u32 offset;
+};
+
+static int write_env_blocks(void *priv, uint start, uint count,
+			    const void *buffer)
+{
+	struct env_mmc_copy *env_copy = priv;
+	uint bl_len = env_copy->mmc->write_bl_len;
+
+	return write_env(env_copy->mmc, count * bl_len,
+			 env_copy->offset + start * bl_len, buffer);
+}
+
 #ifdef CONFIG_ENV_OFFSET_REDUND
 static unsigned char env_flags;
 #endif
@@ -141,31 +156,42 @@ int saveenv(void)
 {
 	ALLOC_CACHE_ALIGN_BUFFER(env_t, env_new, 1);
 	struct mmc *mmc = find_mmc_device(CONFIG_SYS_MMC_ENV_DEV);
-	u32	offset;
+	struct env_mmc_copy env_copy;
 	int	ret, copy = 0;
 
 	if (init_mmc_for_env(mmc))
 		return 1;
 
-	ret = env_export(env_new);
-	if (ret)
-		goto fini;
-
 #ifdef CONFIG_ENV_OFFSET_REDUND
-	env_new->flags	= ++env_flags; /* increase the serial */
-
 	if (gd->env_valid == 1)
 		copy = 1;
 #endif
 
-	if (mmc_get_env_addr(mmc, copy, &offset)) {
+	if (mmc_get_env_addr(mmc, copy, &env_copy.offset)) {
 		ret = 1;
 		goto fini;
 	}
+	env_copy.mmc = mmc;
 
 	printf("Writing to %sMMC(%d)... ", copy ? "redundant " : "",
 	       CONFIG_SYS_MMC_ENV_DEV);
-	if (write_env(mmc, CONFIG_ENV_SIZE, offset, (u_char *)env_new)) {
+	if (env_unchanged(copy)) {
+		puts("unchanged\n");
+		ret = 0;
+		goto fini;
+	}
+
+	ret = env_export(env_new);
+	if (ret)
+		goto fini;
+
+#ifdef CONFIG_ENV_OFFSET_REDUND
+	env_new->flags	= ++env_flags; /* increase the serial */
+#endif
+
+	/* Only the blocks which differ from what is there are written */
+	if (env_write_changed(copy, env_new, mmc->write_bl_len,
+			      write_env_blocks, &env_copy) < 0) {
 		puts("failed\n");
 		ret = 1;
 		goto fini;
@@ -277,7 +303,11 @@ void env_relocate_spec(void)
 		ep = tmp_env2;
 
 	env_flags = ep->flags;
-	env_import((char *)ep, 0);
+	ret = env_import((char *)ep, 0);
+	env_shadow_set(0, read1_fail ? NULL : tmp_env1,
+		       ret && gd->env_valid == 1);
+	env_shadow_set(1, read2_fail ? NULL : tmp_env2,
+		       ret && gd->env_valid == 2);
 	ret = 0;
 
 fini:
@@ -319,7 +349,8 @@ void env_relocate_spec(void)
 		goto fini;
 	}
 
-	env_import(buf, 1);
+	ret = env_import(buf, 1);
+	env_shadow_set(0, (env_t *)buf, ret);
 	ret = 0;
 
 fini:
@@ -43,13 +43,55 @@ char *env_name_spec = "SPI Flash";
 
 static struct spi_flash *env_flash;
 
+/*
+ * Erase and write @count sectors of a copy of the environment, at offset
+ * *@priv in the flash. Whatever shares the last sector with the
+ * environment is read first and written back.
+ */
+static int env_sf_write(void *priv, uint start, uint count, const void *buf)
+{
+	u32	offset = *(u32 *)priv + start * CONFIG_ENV_SECT_SIZE;
+	u32	size = count * CONFIG_ENV_SECT_SIZE;
+	u32	len = min(size, CONFIG_ENV_SIZE - start * CONFIG_ENV_SECT_SIZE);
+	char	*saved_buffer = NULL;
+	int	ret;
+
+	if (len < size) {
+		saved_buffer = malloc(size - len);
+		if (!saved_buffer)
+			return -ENOMEM;
+		ret = spi_flash_read(env_flash, offset + len, size - len,
+				     saved_buffer);
+		if (ret)
+			goto done;
+	}
+
+	ret = spi_flash_erase(env_flash, offset, size);
+	if (ret)
+		goto done;
+
+	ret = spi_flash_write(env_flash, offset, len, buf);
+	if (ret)
+		goto done;
+
+	if (saved_buffer)
+		ret = spi_flash_write(env_flash, offset + len, size - len,
+				      saved_buffer);
+
+ done:
+	free(saved_buffer);
+
+	return ret;
+}
+
 #if defined(CONFIG_ENV_OFFSET_REDUND)
 int saveenv(void)
 {
 	env_t	env_new;
-	char	*saved_buffer = NULL, flag = OBSOLETE_FLAG;
-	u32	saved_size, saved_offset, sector = 1;
-	int	ret;
+	env_t	*shadow;
+	char	flag = OBSOLETE_FLAG;
+	u32	offset;
+	int	copy, ret;
 
 	if (!env_flash) {
 		env_flash = spi_flash_probe(CONFIG_ENV_SPI_BUS,
@@ -61,64 +103,43 @@ int saveenv(void)
 		}
 	}
 
-	ret = env_export(&env_new);
-	if (ret)
-		return ret;
-	env_new.flags	= ACTIVE_FLAG;
-
 	if (gd->env_valid == 1) {
 		env_new_offset = CONFIG_ENV_OFFSET_REDUND;
 		env_offset = CONFIG_ENV_OFFSET;
+		copy = 1;
 	} else {
 		env_new_offset = CONFIG_ENV_OFFSET;
 		env_offset = CONFIG_ENV_OFFSET_REDUND;
+		copy = 0;
 	}
 
-	/* Is the sector larger than the env (i.e. embedded) */
-	if (CONFIG_ENV_SECT_SIZE > CONFIG_ENV_SIZE) {
-		saved_size = CONFIG_ENV_SECT_SIZE - CONFIG_ENV_SIZE;
-		saved_offset = env_new_offset + CONFIG_ENV_SIZE;
-		saved_buffer = malloc(saved_size);
-		if (!saved_buffer) {
-			ret = 1;
-			goto done;
-		}
-		ret = spi_flash_read(env_flash, saved_offset,
-					saved_size, saved_buffer);
-		if (ret)
-			goto done;
+	if (env_unchanged(copy)) {
+		puts("Environment unchanged\n");
+		return 0;
 	}
 
-	if (CONFIG_ENV_SIZE > CONFIG_ENV_SECT_SIZE) {
-		sector = CONFIG_ENV_SIZE / CONFIG_ENV_SECT_SIZE;
-		if (CONFIG_ENV_SIZE % CONFIG_ENV_SECT_SIZE)
-			sector++;
-	}
-
-	puts("Erasing SPI flash...");
-	ret = spi_flash_erase(env_flash, env_new_offset,
-				sector * CONFIG_ENV_SECT_SIZE);
+	ret = env_export(&env_new);
 	if (ret)
-		goto done;
+		return ret;
+	env_new.flags	= ACTIVE_FLAG;
 
+	/* Only the sectors which differ from what is there are rewritten */
 	puts("Writing to SPI flash...");
-
-	ret = spi_flash_write(env_flash, env_new_offset,
-		CONFIG_ENV_SIZE, &env_new);
-	if (ret)
-		goto done;
-
-	if (CONFIG_ENV_SECT_SIZE > CONFIG_ENV_SIZE) {
-		ret = spi_flash_write(env_flash, saved_offset,
-					saved_size, saved_buffer);
-		if (ret)
-			goto done;
-	}
+	offset = env_new_offset;
+	ret = env_write_changed(copy, &env_new, CONFIG_ENV_SECT_SIZE,
+				env_sf_write, &offset);
+	if (ret < 0)
+		return ret;
 
 	ret = spi_flash_write(env_flash, env_offset + offsetof(env_t, flags),
 				sizeof(env_new.flags), &flag);
-	if (ret)
-		goto done;
+	if (ret) {
+		env_shadow_set(!copy, NULL, 0);
+		return ret;
+	}
+	shadow = env_shadow_get(!copy);
+	if (shadow)
+		shadow->flags = flag;
 
 	puts("done\n");
 
@@ -126,17 +147,13 @@ int saveenv(void)
 
 	printf("Valid environment: %d\n", (int)gd->env_valid);
 
- done:
-	if (saved_buffer)
-		free(saved_buffer);
-
-	return ret;
+	return 0;
 }
 
 void env_relocate_spec(void)
 {
 	int ret;
-	int crc1_ok = 0, crc2_ok = 0;
+	int crc1_ok = 0, crc2_ok = 0, read2_ok = 0;
 	env_t *tmp_env1 = NULL;
 	env_t *tmp_env2 = NULL;
 	env_t *ep = NULL;
@@ -169,6 +186,7 @@ void env_relocate_spec(void)
 	ret = spi_flash_read(env_flash, CONFIG_ENV_OFFSET_REDUND,
 				CONFIG_ENV_SIZE, tmp_env2);
 	if (!ret) {
+		read2_ok = 1;
 		if (crc32(0, tmp_env2->data, ENV_SIZE) == tmp_env2->crc)
 			crc2_ok = 1;
 	}
@@ -208,6 +226,9 @@ void env_relocate_spec(void)
 		error("Cannot import environment: errno = %d\n", errno);
 		set_default_env("env_import failed");
 	}
+	env_shadow_set(0, tmp_env1, ret && gd->env_valid == 1);
+	env_shadow_set(1, read2_ok ? tmp_env2 : NULL,
+		       ret && gd->env_valid == 2);
 
 err_read:
 	spi_flash_free(env_flash);
@@ -219,9 +240,8 @@ out:
 #else
 int saveenv(void)
 {
-	u32	saved_size, saved_offset, sector = 1;
-	char	*saved_buffer = NULL;
-	int	ret = 1;
+	u32	offset = CONFIG_ENV_OFFSET;
+	int	ret;
 	env_t	env_new;
 
 	if (!env_flash) {
@@ -234,57 +254,25 @@ int saveenv(void)
 		}
 	}
 
-	/* Is the sector larger than the env (i.e. embedded) */
-	if (CONFIG_ENV_SECT_SIZE > CONFIG_ENV_SIZE) {
-		saved_size = CONFIG_ENV_SECT_SIZE - CONFIG_ENV_SIZE;
-		saved_offset = CONFIG_ENV_OFFSET + CONFIG_ENV_SIZE;
-		saved_buffer = malloc(saved_size);
-		if (!saved_buffer)
-			goto done;
-
-		ret = spi_flash_read(env_flash, saved_offset,
-			saved_size, saved_buffer);
-		if (ret)
-			goto done;
-	}
-
-	if (CONFIG_ENV_SIZE > CONFIG_ENV_SECT_SIZE) {
-		sector = CONFIG_ENV_SIZE / CONFIG_ENV_SECT_SIZE;
-		if (CONFIG_ENV_SIZE % CONFIG_ENV_SECT_SIZE)
-			sector++;
+	if (env_unchanged(0)) {
+		puts("Environment unchanged\n");
+		return 0;
 	}
 
 	ret = env_export(&env_new);
 	if (ret)
-		goto done;
-
-	puts("Erasing SPI flash...");
-	ret = spi_flash_erase(env_flash, CONFIG_ENV_OFFSET,
-		sector * CONFIG_ENV_SECT_SIZE);
-	if (ret)
-		goto done;
+		return ret;
 
+	/* Only the sectors which differ from what is there are rewritten */
 	puts("Writing to SPI flash...");
-	ret = spi_flash_write(env_flash, CONFIG_ENV_OFFSET,
-		CONFIG_ENV_SIZE, &env_new);
-	if (ret)
-		goto done;
-
-	if (CONFIG_ENV_SECT_SIZE > CONFIG_ENV_SIZE) {
-		ret = spi_flash_write(env_flash, saved_offset,
-			saved_size, saved_buffer);
-		if (ret)
-			goto done;
-	}
+	ret = env_write_changed(0, &env_new, CONFIG_ENV_SECT_SIZE,
+				env_sf_write, &offset);
+	if (ret < 0)
+		return ret;
 
-	ret = 0;
 	puts("done\n");
 
- done:
-	if (saved_buffer)
-		free(saved_buffer);
-
-	return ret;
+	return 0;
 }
 
 void env_relocate_spec(void)
@@ -312,6 +300,7 @@ void env_relocate_spec(void)
 	ret = env_import(buf, 1);
 	if (ret)
 		gd->env_valid = 1;
+	env_shadow_set(0, (env_t *)buf, ret);
 out:
 	spi_flash_free(env_flash);
 	if (buf)
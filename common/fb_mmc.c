@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Fastboot flashing to GPT partitions of a block device, normally eMMC
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <fb_mmc.h>
+#include <malloc.h>
+#include <part.h>
+#include <sparse_format.h>
+#include <asm/unaligned.h>
+
+#ifndef CONFIG_FASTBOOT_FLASH_IF
+#define CONFIG_FASTBOOT_FLASH_IF	"mmc"
+#endif
+#ifndef CONFIG_FASTBOOT_FLASH_MMC_DEV
+#define CONFIG_FASTBOOT_FLASH_MMC_DEV	0
+#endif
+
+/* FILL chunks are written from a buffer this big */
+#define FILL_BUF_SIZE		(64 << 10)
+
+static void fastboot_resp(char *response, const char *tag, const char *s)
+{
+	snprintf(response, FASTBOOT_RESPONSE_LEN, "%s%s", tag, s);
+}
+
+static int fb_write_blocks(block_dev_desc_t *dev_desc, lbaint_t start,
+			   lbaint_t blkcnt, const void *buffer)
+{
+	lbaint_t ret;
+
+	ret = dev_desc->block_write(dev_desc->dev, start, blkcnt, buffer);
+
+	return ret == blkcnt ? 0 : -EIO;
+}
+
+static int fb_fill_blocks(block_dev_desc_t *dev_desc, lbaint_t start,
+			  lbaint_t blkcnt, u32 fill)
+{
+	lbaint_t buf_blks = FILL_BUF_SIZE / dev_desc->blksz;
+	lbaint_t n;
+	u32 *buf;
+	int i, ret = 0;
+
+	buf = memalign(ARCH_DMA_MINALIGN, FILL_BUF_SIZE);
+	if (!buf)
+		return -ENOMEM;
+	for (i = 0; i < FILL_BUF_SIZE / sizeof(u32); i++)
+		buf[i] = fill;
+
+	for (; blkcnt && !ret; start += n, blkcnt -= n) {
+		n = min(blkcnt, buf_blks);
+		ret = fb_write_blocks(dev_desc, start, n, buf);
+	}
+	free(buf);
+
+	return ret;
+}
+
+static void write_raw_image(block_dev_desc_t *dev_desc, disk_partition_t *info,
+			    void *buffer, unsigned int download_bytes,
+			    char *response)
+{
+	lbaint_t blkcnt;
+
+	/* The last block is padded with whatever follows the download */
+	blkcnt = DIV_ROUND_UP(download_bytes, info->blksz);
+	if (blkcnt > info->size) {
+		fastboot_resp(response, "FAIL", "too large for partition");
+		return;
+	}
+
+	puts("Flashing raw image\n");
+	if (fb_write_blocks(dev_desc, info->start, blkcnt, buffer)) {
+		fastboot_resp(response, "FAIL", "flash write failure");
+		return;
+	}
+	printf("........ wrote " LBAFU " blocks to '%s'\n", blkcnt, info->name);
+	fastboot_resp(response, "OKAY", "");
+}
+
+/*
+ * Expand a sparse image into the partition. RAW chunks go to the device
+ * straight from the download buffer and DONT_CARE chunks are skipped, so
+ * the fastboot host tool can split an image bigger than the buffer into
+ * several sparse images, each covering the others' data as DONT_CARE.
+ */
+static void write_sparse_image(block_dev_desc_t *dev_desc,
+			       disk_partition_t *info, void *buffer,
+			       unsigned int download_bytes, char *response)
+{
+	sparse_header_t *sparse = buffer;
+	chunk_header_t *chunk;
+	uchar *data = buffer;
+	uchar *end = data + download_bytes;
+	lbaint_t blk = info->start;
+	lbaint_t part_end = info->start + info->size;
+	lbaint_t blks_per_chunk_blk, blkcnt, written = 0, skipped = 0;
+	u32 blk_sz, chunk_hdr_sz, chunk_data_sz;
+	unsigned int i;
+	int ret = 0;
+
+	blk_sz = le32_to_cpu(sparse->blk_sz);
+	chunk_hdr_sz = le16_to_cpu(sparse->chunk_hdr_sz);
+	if (le16_to_cpu(sparse->major_version) != SPARSE_HEADER_MAJOR_VER ||
+	    le16_to_cpu(sparse->file_hdr_sz) < sizeof(sparse_header_t) ||
+	    le16_to_cpu(sparse->file_hdr_sz) > download_bytes ||
+	    chunk_hdr_sz < sizeof(chunk_header_t) ||
+	    !blk_sz || blk_sz % info->blksz) {
+		fastboot_resp(response, "FAIL", "unsupported sparse image");
+		return;
+	}
+	blks_per_chunk_blk = blk_sz / info->blksz;
+	if ((u64)le32_to_cpu(sparse->total_blks) * blks_per_chunk_blk >
+	    info->size) {
+		fastboot_resp(response, "FAIL", "too large for partition");
+		return;
+	}
+
+	printf("Flashing sparse image, %u chunks\n",
+	       le32_to_cpu(sparse->total_chunks));
+	/* Each step below stays inside the download, so data <= end */
+	data += le16_to_cpu(sparse->file_hdr_sz);
+	for (i = 0; i < le32_to_cpu(sparse->total_chunks); i++) {
+		if ((size_t)(end - data) < chunk_hdr_sz)
+			break;
+		chunk = (chunk_header_t *)data;
+		data += chunk_hdr_sz;
+		if (le32_to_cpu(chunk->total_sz) < chunk_hdr_sz)
+			break;
+		chunk_data_sz = le32_to_cpu(chunk->total_sz) - chunk_hdr_sz;
+		if ((size_t)(end - data) < chunk_data_sz)
+			break;
+
+		blkcnt = (lbaint_t)le32_to_cpu(chunk->chunk_sz) *
+			blks_per_chunk_blk;
+		if (blkcnt > part_end - blk) {
+			fastboot_resp(response, "FAIL",
+				      "too large for partition");
+			return;
+		}
+
+		switch (le16_to_cpu(chunk->chunk_type)) {
+		case CHUNK_TYPE_RAW:
+			if (chunk_data_sz != (u64)blkcnt * info->blksz) {
+				ret = -EINVAL;
+				break;
+			}
+			ret = fb_write_blocks(dev_desc, blk, blkcnt, data);
+			written += blkcnt;
+			break;
+		case CHUNK_TYPE_FILL:
+			if (chunk_data_sz != sizeof(u32)) {
+				ret = -EINVAL;
+				break;
+			}
+			ret = fb_fill_blocks(dev_desc, blk, blkcnt,
+					     get_unaligned((u32 *)data));
+			written += blkcnt;
+			break;
+		case CHUNK_TYPE_DONT_CARE:
+			skipped += blkcnt;
+			break;
+		case CHUNK_TYPE_CRC32:
+			break;
+		default:
+			ret = -EINVAL;
+			break;
+		}
+		if (ret) {
+			fastboot_resp(response, "FAIL", ret == -EINVAL ?
+				      "bad sparse chunk" :
+				      "flash write failure");
+			return;
+		}
+		blk += blkcnt;
+		data += chunk_data_sz;
+	}
+	if (i != le32_to_cpu(sparse->total_chunks)) {
+		fastboot_resp(response, "FAIL", "truncated sparse image");
+		return;
+	}
+
+	printf("........ wrote " LBAFU " blocks, skipped " LBAFU " to '%s'\n",
+	       written, skipped, info->name);
+	fastboot_resp(response, "OKAY", "");
+}
+
+void fb_mmc_flash_write(const char *cmd, void *download_buffer,
+			unsigned int download_bytes, char *response)
+{
+	block_dev_desc_t *dev_desc;
+	disk_partition_t info;
+	sparse_header_t *sparse = download_buffer;
+
+	dev_desc = get_dev(CONFIG_FASTBOOT_FLASH_IF,
+			   CONFIG_FASTBOOT_FLASH_MMC_DEV);
+	if (!dev_desc || dev_desc->type == DEV_TYPE_UNKNOWN) {
+		error("invalid flash device");
+		fastboot_resp(response, "FAIL", "invalid flash device");
+		return;
+	}
+
+	if (get_partition_info_efi_by_name(dev_desc, cmd, &info)) {
+		error("cannot find partition: '%s'", cmd);
+		fastboot_resp(response, "FAIL", "cannot find partition");
+		return;
+	}
+
+	if (download_bytes >= sizeof(*sparse) &&
+	    le32_to_cpu(sparse->magic) == SPARSE_HEADER_MAGIC)
+		write_sparse_image(dev_desc, &info, download_buffer,
+				   download_bytes, response);
+	else
+		write_raw_image(dev_desc, &info, download_buffer,
+				download_bytes, response);
+}
@@ -0,0 +1,599 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Batched changes to a device tree
+ *
+ * A batch records properties and nodes to add, change or delete, and
+ * writes the tree out once, when it is committed.
+ *
+ * The tree is left alone until then, so node offsets found before or
+ * during the batch stay valid. The result is the tree that the same calls
+ * to libfdt would have made, with new properties and nodes in the same
+ * places.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <errno.h>
+#include <malloc.h>
+#include <libfdt.h>
+#include <fdt_support.h>
+
+#define FDT_BATCH_MAX_DEPTH	32
+
+enum {
+	FDT_BATCH_SET,		/* set a property */
+	FDT_BATCH_DEL,		/* delete a property */
+	FDT_BATCH_NODE,		/* add a subnode */
+};
+
+/* One recorded change */
+struct fdt_batch_edit {
+	int node;		/* offset, or handle of a node added */
+	int seq;		/* order in which the changes were made */
+	int op;			/* FDT_BATCH_... */
+	int handle;		/* handle of the node, for FDT_BATCH_NODE */
+	const char *name;	/* property or node name */
+	const void *val;	/* property value, after the name */
+	int len;		/* length of property value */
+	int nameoff;		/* name's offset in strings, when committed */
+	int first;		/* seq of the change creating the property */
+	bool fresh;		/* property was deleted in the batch first */
+	bool superseded;	/* replaced by a later change to the property */
+	bool emitted;		/* to be written out as a new property */
+	bool written;		/* and now it has been */
+};
+
+/* Where the new structure block is being written */
+struct fdt_batch_out {
+	char *ptr;
+	char *end;
+};
+
+int fdt_batch_init(struct fdt_batch *batch, void *fdt)
+{
+	int err;
+
+	memset(batch, '\0', sizeof(*batch));
+	err = fdt_check_header(fdt);
+	if (err)
+		return err;
+	batch->fdt = fdt;
+	batch->end = fdt_size_dt_struct(fdt);
+
+	return 0;
+}
+
+void fdt_batch_discard(struct fdt_batch *batch)
+{
+	int i;
+
+	for (i = 0; i < batch->count; i++)
+		free((void *)batch->edit[i].name);
+	free(batch->edit);
+	batch->edit = NULL;
+	batch->count = 0;
+	batch->size = 0;
+	batch->nodes = 0;
+}
+
+static bool fdt_batch_is_new(struct fdt_batch *batch, int node)
+{
+	return node >= batch->end;
+}
+
+/* Check that an offset is a node in the tree, or a node added */
+static int fdt_batch_check_node(struct fdt_batch *batch, int node)
+{
+	int len;
+
+	if (fdt_batch_is_new(batch, node))
+		return node < batch->end + batch->nodes ? 0 :
+			-FDT_ERR_BADOFFSET;
+	if (!fdt_get_name(batch->fdt, node, &len))
+		return len;
+
+	return 0;
+}
+
+/* Find the last change made so far to a property, or NULL if none */
+static struct fdt_batch_edit *fdt_batch_find(struct fdt_batch *batch,
+					     int node, const char *name)
+{
+	struct fdt_batch_edit *edit;
+	int i;
+
+	for (i = batch->count - 1; i >= 0; i--) {
+		edit = &batch->edit[i];
+		if (edit->node == node && edit->op != FDT_BATCH_NODE &&
+		    !strcmp(edit->name, name))
+			return edit;
+	}
+
+	return NULL;
+}
+
+static int fdt_batch_add(struct fdt_batch *batch, int node, int op,
+			 const char *name, const void *val, int len)
+{
+	struct fdt_batch_edit *edit;
+	int namelen = strlen(name) + 1;
+	char *buf;
+
+	if (batch->count == batch->size) {
+		int size = max(batch->size * 2, 16);
+
+		edit = realloc(batch->edit, size * sizeof(*edit));
+		if (!edit)
+			return -FDT_ERR_NOSPACE;
+		batch->edit = edit;
+		batch->size = size;
+	}
+	buf = malloc(namelen + len);
+	if (!buf)
+		return -FDT_ERR_NOSPACE;
+	memcpy(buf, name, namelen);
+	if (len)
+		memcpy(buf + namelen, val, len);
+
+	edit = &batch->edit[batch->count];
+	memset(edit, '\0', sizeof(*edit));
+	edit->node = node;
+	edit->seq = batch->count++;
+	edit->op = op;
+	edit->name = buf;
+	edit->val = buf + namelen;
+	edit->len = len;
+	edit->first = edit->seq;
+	if (op == FDT_BATCH_NODE)
+		edit->handle = batch->end + batch->nodes++;
+
+	return op == FDT_BATCH_NODE ? edit->handle : 0;
+}
+
+int fdt_batch_setprop(struct fdt_batch *batch, int nodeoffset,
+		      const char *name, const void *val, int len)
+{
+	const struct fdt_property *prop;
+	int err, oldlen;
+
+	err = fdt_batch_check_node(batch, nodeoffset);
+	if (err)
+		return err;
+
+	/*
+	 * A value of the same size can be written now, as libfdt would,
+	 * unless the batch has changed the property already
+	 */
+	if (!fdt_batch_is_new(batch, nodeoffset)) {
+		prop = fdt_get_property(batch->fdt, nodeoffset, name, &oldlen);
+		if (prop && oldlen == len &&
+		    !fdt_batch_find(batch, nodeoffset, name))
+			return fdt_setprop_inplace(batch->fdt, nodeoffset,
+						   name, val, len);
+	}
+
+	return fdt_batch_add(batch, nodeoffset, FDT_BATCH_SET, name, val, len);
+}
+
+int fdt_batch_delprop(struct fdt_batch *batch, int nodeoffset,
+		      const char *name)
+{
+	struct fdt_batch_edit *edit;
+	int err, len;
+
+	err = fdt_batch_check_node(batch, nodeoffset);
+	if (err)
+		return err;
+	edit = fdt_batch_find(batch, nodeoffset, name);
+	if (edit ? edit->op == FDT_BATCH_DEL :
+	    fdt_batch_is_new(batch, nodeoffset) ||
+	    !fdt_get_property(batch->fdt, nodeoffset, name, &len))
+		return -FDT_ERR_NOTFOUND;
+
+	return fdt_batch_add(batch, nodeoffset, FDT_BATCH_DEL, name, NULL, 0);
+}
+
+int fdt_batch_add_subnode(struct fdt_batch *batch, int parentoffset,
+			  const char *name)
+{
+	struct fdt_batch_edit *edit;
+	int err, i;
+
+	err = fdt_batch_check_node(batch, parentoffset);
+	if (err)
+		return err;
+	if (!fdt_batch_is_new(batch, parentoffset) &&
+	    fdt_subnode_offset(batch->fdt, parentoffset, name) >= 0)
+		return -FDT_ERR_EXISTS;
+	for (i = 0; i < batch->count; i++) {
+		edit = &batch->edit[i];
+		if (edit->node == parentoffset && edit->op == FDT_BATCH_NODE &&
+		    !strcmp(edit->name, name))
+			return -FDT_ERR_EXISTS;
+	}
+
+	return fdt_batch_add(batch, parentoffset, FDT_BATCH_NODE, name, NULL,
+			     0);
+}
+
+/* Find a string in a strings block, as libfdt does */
+static int fdt_batch_find_string(const char *strtab, int size, const char *s)
+{
+	int len = strlen(s) + 1;
+	int i;
+
+	for (i = 0; i <= size - len; i++) {
+		if (!memcmp(strtab + i, s, len))
+			return i;
+	}
+
+	return -1;
+}
+
+/*
+ * Give each property name its place in the strings block, in the order
+ * libfdt would have added them. The new names are put in extra.
+ */
+static int fdt_batch_strings(struct fdt_batch *batch, char *extra)
+{
+	const void *fdt = batch->fdt;
+	const char *strtab = (const char *)fdt + fdt_off_dt_strings(fdt);
+	int oldsize = fdt_size_dt_strings(fdt);
+	struct fdt_batch_edit *edit;
+	int size = 0;
+	int i, pos;
+
+	for (i = 0; i < batch->count; i++) {
+		edit = &batch->edit[i];
+		if (edit->op != FDT_BATCH_SET)
+			continue;
+		pos = fdt_batch_find_string(strtab, oldsize, edit->name);
+		if (pos < 0) {
+			pos = fdt_batch_find_string(extra, size, edit->name);
+			if (pos < 0) {
+				pos = size;
+				strcpy(extra + size, edit->name);
+				size += strlen(edit->name) + 1;
+			}
+			pos += oldsize;
+		}
+		edit->nameoff = pos;
+	}
+
+	return size;
+}
+
+static int fdt_batch_cmp(const void *a, const void *b)
+{
+	const struct fdt_batch_edit *ea = a, *eb = b;
+
+	if (ea->node != eb->node)
+		return ea->node < eb->node ? -1 : 1;
+
+	return ea->seq - eb->seq;
+}
+
+/*
+ * Work out which change to each property is the one that counts, once the
+ * changes are sorted by node
+ */
+static void fdt_batch_resolve(struct fdt_batch *batch)
+{
+	struct fdt_batch_edit *edit, *next;
+	int i, j;
+
+	for (i = 0; i < batch->count; i++) {
+		edit = &batch->edit[i];
+		if (edit->op == FDT_BATCH_NODE)
+			continue;
+		for (j = i + 1; j < batch->count; j++) {
+			next = &batch->edit[j];
+			if (next->node != edit->node)
+				break;
+			if (next->op == FDT_BATCH_NODE ||
+			    strcmp(next->name, edit->name))
+				continue;
+			if (edit->op == FDT_BATCH_DEL) {
+				next->fresh = true;
+			} else {
+				next->fresh = edit->fresh;
+				if (next->op == FDT_BATCH_SET)
+					next->first = edit->first;
+			}
+			edit->superseded = true;
+			break;
+		}
+	}
+}
+
+/* Find the changes to a node, returning the index of the first */
+static int fdt_batch_range(struct fdt_batch *batch, int node, int *lastp)
+{
+	int lo, hi, mid, first;
+
+	for (lo = 0, hi = batch->count; lo < hi;) {
+		mid = (lo + hi) / 2;
+		if (batch->edit[mid].node < node)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	first = lo;
+	while (lo < batch->count && batch->edit[lo].node == node)
+		lo++;
+	*lastp = lo;
+
+	return first;
+}
+
+static int fdt_batch_put(struct fdt_batch_out *out, const void *data,
+			 int len)
+{
+	int size = ALIGN(len, FDT_TAGSIZE);
+
+	if (out->end - out->ptr < size)
+		return -FDT_ERR_NOSPACE;
+	memcpy(out->ptr, data, len);
+	memset(out->ptr + len, '\0', size - len);
+	out->ptr += size;
+
+	return 0;
+}
+
+static int fdt_batch_put_tag(struct fdt_batch_out *out, uint32_t tag)
+{
+	fdt32_t val = cpu_to_fdt32(tag);
+
+	return fdt_batch_put(out, &val, sizeof(val));
+}
+
+static int fdt_batch_put_prop(struct fdt_batch_out *out,
+			      const struct fdt_batch_edit *edit)
+{
+	fdt32_t hdr[3];
+
+	hdr[0] = cpu_to_fdt32(FDT_PROP);
+	hdr[1] = cpu_to_fdt32(edit->len);
+	hdr[2] = cpu_to_fdt32(edit->nameoff);
+	if (fdt_batch_put(out, hdr, sizeof(hdr)))
+		return -FDT_ERR_NOSPACE;
+
+	return fdt_batch_put(out, edit->val, edit->len);
+}
+
+/*
+ * Write out the properties added to a node. libfdt puts each new property
+ * first in its node, so the last one added comes first.
+ */
+static int fdt_batch_put_new_props(struct fdt_batch *batch,
+				   struct fdt_batch_out *out, int node,
+				   int first, int last)
+{
+	struct fdt_batch_edit *edit, *best;
+	int i, err;
+
+	for (i = first; i < last; i++) {
+		edit = &batch->edit[i];
+		if (edit->op != FDT_BATCH_SET || edit->superseded)
+			continue;
+		if (fdt_batch_is_new(batch, node) || edit->fresh ||
+		    !fdt_get_property(batch->fdt, node, edit->name, NULL))
+			edit->emitted = true;
+	}
+
+	do {
+		best = NULL;
+		for (i = first; i < last; i++) {
+			edit = &batch->edit[i];
+			if (edit->emitted && !edit->written &&
+			    (!best || edit->first > best->first))
+				best = edit;
+		}
+		if (best) {
+			err = fdt_batch_put_prop(out, best);
+			if (err)
+				return err;
+			best->written = true;
+		}
+	} while (best);
+
+	return 0;
+}
+
+/*
+ * Write out the nodes added under a node. libfdt puts each new node before
+ * the existing ones, so the last one added comes first.
+ */
+static int fdt_batch_put_new_nodes(struct fdt_batch *batch,
+				   struct fdt_batch_out *out, int first,
+				   int last)
+{
+	struct fdt_batch_edit *edit;
+	int sub_first, sub_last;
+	int i, err;
+
+	for (i = last - 1; i >= first; i--) {
+		edit = &batch->edit[i];
+		if (edit->op != FDT_BATCH_NODE)
+			continue;
+		err = fdt_batch_put_tag(out, FDT_BEGIN_NODE);
+		if (!err)
+			err = fdt_batch_put(out, edit->name,
+					    strlen(edit->name) + 1);
+		if (err)
+			return err;
+
+		sub_first = fdt_batch_range(batch, edit->handle, &sub_last);
+		err = fdt_batch_put_new_props(batch, out, edit->handle,
+					      sub_first, sub_last);
+		if (!err)
+			err = fdt_batch_put_new_nodes(batch, out, sub_first,
+						      sub_last);
+		if (!err)
+			err = fdt_batch_put_tag(out, FDT_END_NODE);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+/* Copy an existing property, unless the batch changes or deletes it */
+static int fdt_batch_put_old_prop(struct fdt_batch *batch,
+				  struct fdt_batch_out *out, int offset,
+				  int size, int first, int last)
+{
+	const void *fdt = batch->fdt;
+	const struct fdt_property *prop;
+	struct fdt_batch_edit *edit;
+	const char *name;
+	int i;
+
+	prop = fdt_offset_ptr(fdt, offset, size);
+	if (!prop)
+		return -FDT_ERR_TRUNCATED;
+	name = fdt_string(fdt, fdt32_to_cpu(prop->nameoff));
+	for (i = first; i < last; i++) {
+		edit = &batch->edit[i];
+		if (edit->op == FDT_BATCH_NODE || edit->superseded ||
+		    strcmp(edit->name, name))
+			continue;
+		if (edit->op == FDT_BATCH_DEL || edit->emitted)
+			return 0;
+		return fdt_batch_put_prop(out, edit);
+	}
+
+	return fdt_batch_put(out, prop, size);
+}
+
+/* Write the new structure block, in one pass over the old one */
+static int fdt_batch_rebuild(struct fdt_batch *batch,
+			     struct fdt_batch_out *out)
+{
+	struct {
+		int first, last;	/* range of changes to the node */
+		bool nodes_done;	/* new subnodes written out */
+	} stack[FDT_BATCH_MAX_DEPTH], *top = NULL;
+	const void *fdt = batch->fdt;
+	const char *base = (const char *)fdt + fdt_off_dt_struct(fdt);
+	int offset, next, depth = -1;
+	uint32_t tag;
+	int err;
+
+	for (offset = 0; ; offset = next) {
+		tag = fdt_next_tag(fdt, offset, &next);
+		if (next < 0)
+			return next;
+
+		switch (tag) {
+		case FDT_BEGIN_NODE:
+			if (top && !top->nodes_done) {
+				err = fdt_batch_put_new_nodes(batch, out,
+						top->first, top->last);
+				if (err)
+					return err;
+				top->nodes_done = true;
+			}
+			if (++depth == FDT_BATCH_MAX_DEPTH)
+				return -FDT_ERR_BADSTRUCTURE;
+			top = &stack[depth];
+			top->first = fdt_batch_range(batch, offset, &top->last);
+			top->nodes_done = false;
+			err = fdt_batch_put(out, base + offset, next - offset);
+			if (!err)
+				err = fdt_batch_put_new_props(batch, out,
+						offset, top->first, top->last);
+			break;
+		case FDT_PROP:
+			if (!top)
+				return -FDT_ERR_BADSTRUCTURE;
+			err = fdt_batch_put_old_prop(batch, out, offset,
+					next - offset, top->first, top->last);
+			break;
+		case FDT_END_NODE:
+			if (!top)
+				return -FDT_ERR_BADSTRUCTURE;
+			err = 0;
+			if (!top->nodes_done)
+				err = fdt_batch_put_new_nodes(batch, out,
+						top->first, top->last);
+			if (!err)
+				err = fdt_batch_put_tag(out, FDT_END_NODE);
+			top = --depth >= 0 ? &stack[depth] : NULL;
+			break;
+		case FDT_NOP:
+			err = 0;
+			break;
+		case FDT_END:
+			return fdt_batch_put_tag(out, FDT_END);
+		default:
+			return -FDT_ERR_BADSTRUCTURE;
+		}
+		if (err)
+			return err;
+	}
+}
+
+int fdt_batch_commit(struct fdt_batch *batch)
+{
+	void *fdt = batch->fdt;
+	struct fdt_batch_out out;
+	int struct_off, strings_size, extra_size;
+	int i, err;
+	char *buf = NULL, *extra = NULL;
+
+	if (!batch->count)
+		return 0;
+	if (fdt_version(fdt) < 17) {
+		err = -FDT_ERR_BADVERSION;
+		goto out;
+	}
+	if (fdt_off_dt_strings(fdt) < fdt_off_dt_struct(fdt) +
+	    fdt_size_dt_struct(fdt)) {
+		err = -FDT_ERR_BADLAYOUT;
+		goto out;
+	}
+
+	err = -FDT_ERR_NOSPACE;
+	for (i = extra_size = 0; i < batch->count; i++)
+		extra_size += strlen(batch->edit[i].name) + 1;
+	extra = malloc(extra_size);
+	struct_off = fdt_off_dt_struct(fdt);
+	buf = malloc(fdt_totalsize(fdt) - struct_off);
+	if (!extra || !buf)
+		goto out;
+
+	extra_size = fdt_batch_strings(batch, extra);
+	qsort(batch->edit, batch->count, sizeof(*batch->edit), fdt_batch_cmp);
+	fdt_batch_resolve(batch);
+
+	/* The strings go straight after the structure block */
+	strings_size = fdt_size_dt_strings(fdt) + extra_size;
+	out.ptr = buf;
+	out.end = buf + fdt_totalsize(fdt) - struct_off - strings_size;
+	if (out.end < out.ptr)
+		goto out;
+	err = fdt_batch_rebuild(batch, &out);
+	if (err)
+		goto out;
+	memcpy(out.ptr, (char *)fdt + fdt_off_dt_strings(fdt),
+	       fdt_size_dt_strings(fdt));
+	memcpy(out.ptr + fdt_size_dt_strings(fdt), extra, extra_size);
+
+	fdt_blob_written(fdt);
+	memcpy((char *)fdt + struct_off, buf, out.ptr - buf + strings_size);
+	fdt_set_size_dt_struct(fdt, out.ptr - buf);
+	fdt_set_off_dt_strings(fdt, struct_off + out.ptr - buf);
+	fdt_set_size_dt_strings(fdt, strings_size);
+	debug("%s: %d changes, structure %d bytes, strings %d bytes\n",
+	      __func__, batch->count, fdt_size_dt_struct(fdt), strings_size);
+out:
+	free(buf);
+	free(extra);
+	fdt_batch_discard(batch);
+	batch->end = fdt_size_dt_struct(fdt);
+
+	return err;
+}
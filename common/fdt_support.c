@@ -301,6 +301,17 @@ int fdt_chosen(void *fdt)
 	return fdt_fixup_stdout(fdt, nodeoffset);
 }
 
+/* Write out a batch of fixups, saying so if that fails */
+static void fdt_batch_commit_report(struct fdt_batch *batch, const char *prop)
+{
+	int err;
+
+	err = fdt_batch_commit(batch);
+	if (err)
+		printf("Unable to update property %s, err=%s\n", prop,
+		       fdt_strerror(err));
+}
+
 void do_fixup_by_path(void *fdt, const char *path, const char *prop,
 		      const void *val, int len, int create)
 {
@@ -329,6 +340,7 @@ void do_fixup_by_prop(void *fdt,
 		      const char *prop, const void *val, int len,
 		      int create)
 {
+	struct fdt_batch batch;
 	int off;
 #if defined(DEBUG)
 	int i;
@@ -337,12 +349,15 @@ void do_fixup_by_prop(void *fdt,
 		debug(" %.2x", *(u8*)(val+i));
 	debug("\n");
 #endif
+	if (fdt_batch_init(&batch, fdt))
+		return;
 	off = fdt_node_offset_by_prop_value(fdt, -1, pname, pval, plen);
 	while (off != -FDT_ERR_NOTFOUND) {
 		if (create || (fdt_get_property(fdt, off, prop, NULL) != NULL))
-			fdt_setprop(fdt, off, prop, val, len);
+			fdt_batch_setprop(&batch, off, prop, val, len);
 		off = fdt_node_offset_by_prop_value(fdt, off, pname, pval, plen);
 	}
+	fdt_batch_commit_report(&batch, prop);
 }
 
 void do_fixup_by_prop_u32(void *fdt,
@@ -356,6 +371,7 @@ void do_fixup_by_prop_u32(void *fdt,
 void do_fixup_by_compat(void *fdt, const char *compat,
 			const char *prop, const void *val, int len, int create)
 {
+	struct fdt_batch batch;
 	int off = -1;
 #if defined(DEBUG)
 	int i;
@@ -364,12 +380,15 @@ void do_fixup_by_compat(void *fdt, const char *compat,
 		debug(" %.2x", *(u8*)(val+i));
 	debug("\n");
 #endif
+	if (fdt_batch_init(&batch, fdt))
+		return;
 	off = fdt_node_offset_by_compatible(fdt, -1, compat);
 	while (off != -FDT_ERR_NOTFOUND) {
 		if (create || (fdt_get_property(fdt, off, prop, NULL) != NULL))
-			fdt_setprop(fdt, off, prop, val, len);
+			fdt_batch_setprop(&batch, off, prop, val, len);
 		off = fdt_node_offset_by_compatible(fdt, off, compat);
 	}
+	fdt_batch_commit_report(&batch, prop);
 }
 
 void do_fixup_by_compat_u32(void *fdt, const char *compat,
@@ -462,7 +481,8 @@ int fdt_fixup_memory(void *blob, u64 start, u64 size)
 
 void fdt_fixup_ethernet(void *fdt)
 {
-	int node, i, j;
+	struct fdt_batch batch;
+	int node, nodeoff, i, j;
 	char enet[16], *tmp, *end;
 	char mac[16];
 	const char *path;
@@ -483,6 +503,8 @@ void fdt_fixup_ethernet(void *fdt)
 		strcpy(mac, "ethaddr");
 	}
 
+	if (fdt_batch_init(&batch, fdt))
+		return;
 	i = 0;
 	while ((tmp = getenv(mac)) != NULL) {
 		sprintf(enet, "ethernet%d", i);
@@ -499,12 +521,27 @@ void fdt_fixup_ethernet(void *fdt)
 				tmp = (*end) ? end+1 : end;
 		}
 
-		do_fixup_by_path(fdt, path, "mac-address", &mac_addr, 6, 0);
-		do_fixup_by_path(fdt, path, "local-mac-address",
-				&mac_addr, 6, 1);
+		/*
+		 * The changes are batched, so the alias paths and offsets
+		 * found in the tree stay put while we go
+		 */
+		nodeoff = fdt_path_offset(fdt, path);
+		if (nodeoff < 0) {
+			printf("Unable to update property %s:%s, err=%s\n",
+			       path, "local-mac-address",
+			       fdt_strerror(nodeoff));
+		} else {
+			if (fdt_get_property(fdt, nodeoff, "mac-address",
+					     NULL))
+				fdt_batch_setprop(&batch, nodeoff,
+						  "mac-address", mac_addr, 6);
+			fdt_batch_setprop(&batch, nodeoff,
+					  "local-mac-address", mac_addr, 6);
+		}
 
 		sprintf(mac, "eth%daddr", ++i);
 	}
+	fdt_batch_commit_report(&batch, "local-mac-address");
 }
 
 /* Resize the fdt to its actual size + a bit of padding */
@@ -28,6 +28,7 @@
  */
 #include <common.h>
 #include <command.h>
+#include <errno.h>
 #include <asm/processor.h>
 #include <linux/compiler.h>
 #include <linux/ctype.h>
@@ -865,6 +866,41 @@ __weak int usb_alloc_device(struct usb_device *udev)
 {
 	return 0;
 }
+
+/*
+ * Host controller drivers override this to tell class drivers how much
+ * they may ask for at once; the callers fall back to a safe default.
+ */
+__weak int usb_get_max_xfer_size(struct usb_device *udev, size_t *size)
+{
+	return -ENOSYS;
+}
+
+/*
+ * Controllers which cannot queue transfers run a batch one transfer at a
+ * time, stopping at the first failure.
+ */
+__weak int submit_bulk_batch(struct usb_device *udev,
+			     struct usb_bulk_xfer *xfers, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		xfers[i].status = USB_ST_NOT_PROC;
+	for (i = 0; i < count; i++) {
+		udev->status = USB_ST_NOT_PROC;
+		if (submit_bulk_msg(udev, xfers[i].pipe, xfers[i].buffer,
+				    xfers[i].length) < 0)
+			return -1;
+		xfers[i].act_len = udev->act_len;
+		xfers[i].status = udev->status;
+		if (udev->status)
+			return -1;
+	}
+
+	return 0;
+}
+
 /*
  * By the time we get here, the device has gotten a new device ID
  * and is in the default state. We need to identify the thing and
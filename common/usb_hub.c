@@ -37,6 +37,20 @@
 
 #define USB_BUFSIZ	512
 
+/*
+ * Port timings. Debounce and reset recovery are the USB 2.0 minimums
+ * (TATTDB and TRSTRCY); a device gets HUB_CONNECT_TIMEOUT_MS after power
+ * good to show up, and a port HUB_RESET_TIMEOUT_MS to finish a reset.
+ */
+#define HUB_POLL_MS		10
+#define HUB_DEBOUNCE_MS		100
+#define HUB_CONNECT_TIMEOUT_MS	1000
+#define HUB_RESET_TIMEOUT_MS	200
+#define HUB_RESET_RECOVERY_MS	10
+
+/* Times the ports of a hub are powered again after an over-current */
+#define HUB_OVERCURRENT_TRIES	3
+
 static struct usb_hub_device hub_dev[USB_MAX_HUB];
 static int usb_hub_index;
 
@@ -135,10 +149,10 @@ static void usb_hub_power_on(struct usb_hub_device *hub)
 	}
 
 	/*
-	 * Wait for power to become stable,
-	 * plus spec-defined max time for device to connect
+	 * Waiting for power to become stable and for devices to connect
+	 * is left to usb_hub_scan(), along with that of all other ports
 	 */
-	mdelay(pgood_delay + 1000);
+	hub->power_on = get_timer(0);
 }
 
 void usb_hub_reset(void)
@@ -148,8 +162,13 @@ void usb_hub_reset(void)
 
 static struct usb_hub_device *usb_hub_allocate(void)
 {
-	if (usb_hub_index < USB_MAX_HUB)
-		return &hub_dev[usb_hub_index++];
+	struct usb_hub_device *hub;
+
+	if (usb_hub_index < USB_MAX_HUB) {
+		hub = &hub_dev[usb_hub_index++];
+		memset(hub, '\0', sizeof(*hub));
+		return hub;
+	}
 
 	printf("ERROR: USB_MAX_HUB (%d) reached\n", USB_MAX_HUB);
 	return NULL;
@@ -185,20 +204,26 @@ int hub_port_reset(struct usb_device *dev, int port,
 	int tries;
 	ALLOC_CACHE_ALIGN_BUFFER(struct usb_port_status, portsts, 1);
 	unsigned short portstatus, portchange;
+	ulong start;
 
 	debug("hub_port_reset: resetting port %d...\n", port);
 	for (tries = 0; tries < MAX_TRIES; tries++) {
 
 		usb_set_port_feature(dev, port + 1, USB_PORT_FEAT_RESET);
-		mdelay(200);
 
-		if (usb_get_port_status(dev, port + 1, portsts) < 0) {
-			debug("get_port_status failed status %lX\n",
-			      dev->status);
-			return -1;
-		}
-		portstatus = le16_to_cpu(portsts->wPortStatus);
-		portchange = le16_to_cpu(portsts->wPortChange);
+		/* A reset takes 10-20ms; the hub says when it is over */
+		start = get_timer(0);
+		do {
+			mdelay(HUB_POLL_MS);
+			if (usb_get_port_status(dev, port + 1, portsts) < 0) {
+				debug("get_port_status failed status %lX\n",
+				      dev->status);
+				return -1;
+			}
+			portstatus = le16_to_cpu(portsts->wPortStatus);
+			portchange = le16_to_cpu(portsts->wPortChange);
+		} while (!(portchange & USB_PORT_STAT_C_RESET) &&
+			 get_timer(start) < HUB_RESET_TIMEOUT_MS);
 
 		debug("portstatus %x, change %x, %s\n", portstatus, portchange,
 							portspeed(portstatus));
@@ -228,49 +253,26 @@ int hub_port_reset(struct usb_device *dev, int port,
 
 	usb_clear_port_feature(dev, port + 1, USB_PORT_FEAT_C_RESET);
 	*portstat = portstatus;
+
+	/* Give the device time to recover before talking to it */
+	mdelay(HUB_RESET_RECOVERY_MS);
+
 	return 0;
 }
 
 
-void usb_hub_port_connect_change(struct usb_device *dev, int port)
+/* Reset the port and enumerate the device connected to it */
+static void usb_hub_port_enumerate(struct usb_device *dev, int port)
 {
 	struct usb_device *usb;
-	ALLOC_CACHE_ALIGN_BUFFER(struct usb_port_status, portsts, 1);
 	unsigned short portstatus;
 
-	/* Check status */
-	if (usb_get_port_status(dev, port + 1, portsts) < 0) {
-		debug("get_port_status failed\n");
-		return;
-	}
-
-	portstatus = le16_to_cpu(portsts->wPortStatus);
-	debug("portstatus %x, change %x, %s\n",
-	      portstatus,
-	      le16_to_cpu(portsts->wPortChange),
-	      portspeed(portstatus));
-
-	/* Clear the connection change status */
-	usb_clear_port_feature(dev, port + 1, USB_PORT_FEAT_C_CONNECTION);
-
-	/* Disconnect any existing devices under this port */
-	if (((!(portstatus & USB_PORT_STAT_CONNECTION)) &&
-	     (!(portstatus & USB_PORT_STAT_ENABLE))) || (dev->children[port])) {
-		debug("usb_disconnect(&hub->children[port]);\n");
-		/* Return now if nothing is connected */
-		if (!(portstatus & USB_PORT_STAT_CONNECTION))
-			return;
-	}
-	mdelay(200);
-
 	/* Reset the port */
 	if (hub_port_reset(dev, port, &portstatus) < 0) {
 		printf("cannot reset port %i!?\n", port + 1);
 		return;
 	}
 
-	mdelay(200);
-
 	/* Allocate a new device struct for it */
 	usb = usb_alloc_new_device(dev->controller);
 
@@ -302,6 +304,195 @@ void usb_hub_port_connect_change(struct usb_device *dev, int port)
 	}
 }
 
+void usb_hub_port_connect_change(struct usb_device *dev, int port)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(struct usb_port_status, portsts, 1);
+	unsigned short portstatus;
+
+	/* Check status */
+	if (usb_get_port_status(dev, port + 1, portsts) < 0) {
+		debug("get_port_status failed\n");
+		return;
+	}
+
+	portstatus = le16_to_cpu(portsts->wPortStatus);
+	debug("portstatus %x, change %x, %s\n",
+	      portstatus,
+	      le16_to_cpu(portsts->wPortChange),
+	      portspeed(portstatus));
+
+	/* Clear the connection change status */
+	usb_clear_port_feature(dev, port + 1, USB_PORT_FEAT_C_CONNECTION);
+
+	/* Disconnect any existing devices under this port */
+	if (((!(portstatus & USB_PORT_STAT_CONNECTION)) &&
+	     (!(portstatus & USB_PORT_STAT_ENABLE))) || (dev->children[port])) {
+		debug("usb_disconnect(&hub->children[port]);\n");
+		/* Return now if nothing is connected */
+		if (!(portstatus & USB_PORT_STAT_CONNECTION))
+			return;
+	}
+	mdelay(200);
+
+	usb_hub_port_enumerate(dev, port);
+}
+
+/* Act on what a port reports once it has settled */
+static void usb_hub_port_status(struct usb_hub_device *hub, int i,
+				unsigned short portstatus,
+				unsigned short portchange)
+{
+	struct usb_device *dev = hub->pusb_dev;
+	int j;
+
+	debug("Port %d Status %X Change %X\n", i + 1, portstatus, portchange);
+
+	if (portchange & USB_PORT_STAT_C_CONNECTION) {
+		debug("port %d connection change\n", i + 1);
+		usb_clear_port_feature(dev, i + 1, USB_PORT_FEAT_C_CONNECTION);
+	}
+	if (portstatus & USB_PORT_STAT_CONNECTION)
+		usb_hub_port_enumerate(dev, i);
+	if (portchange & USB_PORT_STAT_C_ENABLE) {
+		debug("port %d enable change, status %x\n", i + 1, portstatus);
+		usb_clear_port_feature(dev, i + 1, USB_PORT_FEAT_C_ENABLE);
+		/*
+		 * The following hack causes a ghost device problem
+		 * to Faraday EHCI
+		 */
+#ifndef CONFIG_USB_EHCI_FARADAY
+		/* EM interference sometimes causes bad shielded USB
+		 * devices to be shutdown by the hub, this hack enables
+		 * them again. Works at least with mouse driver */
+		if (!(portstatus & USB_PORT_STAT_ENABLE) &&
+		     (portstatus & USB_PORT_STAT_CONNECTION) &&
+		     ((dev->children[i]))) {
+			debug("already running port %i "  \
+			      "disabled by hub (EMI?), " \
+			      "re-enabling...\n", i + 1);
+			      usb_hub_port_connect_change(dev, i);
+		}
+#endif
+	}
+	if (portstatus & USB_PORT_STAT_SUSPEND) {
+		debug("port %d suspend change\n", i + 1);
+		usb_clear_port_feature(dev, i + 1, USB_PORT_FEAT_SUSPEND);
+	}
+
+	if (portchange & USB_PORT_STAT_C_OVERCURRENT) {
+		debug("port %d over-current change\n", i + 1);
+		usb_clear_port_feature(dev, i + 1,
+				       USB_PORT_FEAT_C_OVER_CURRENT);
+		if (hub->port[i].overcurrent++ < HUB_OVERCURRENT_TRIES) {
+			/* Other ports may have tripped too: all start again */
+			for (j = 0; j < dev->maxchild; j++) {
+				if (j != i)
+					usb_clear_port_feature(dev, j + 1,
+						USB_PORT_FEAT_C_OVER_CURRENT);
+			}
+			usb_hub_power_on(hub);
+			/*
+			 * Wait for power to become stable, plus the time a
+			 * device has to connect, then look at the ports
+			 * which have nothing on them again
+			 */
+			mdelay(hub->desc.bPwrOn2PwrGood * 2 +
+			       HUB_CONNECT_TIMEOUT_MS);
+			for (j = 0; j < dev->maxchild; j++) {
+				if (!dev->children[j])
+					hub->port[j].state = USB_HUB_PORT_POWER;
+			}
+		} else {
+			printf("Port %d: over-current, not powered again\n",
+			       i + 1);
+		}
+	}
+
+	if (portchange & USB_PORT_STAT_C_RESET) {
+		debug("port %d reset change\n", i + 1);
+		usb_clear_port_feature(dev, i + 1, USB_PORT_FEAT_C_RESET);
+	}
+}
+
+/* Move a port along: power good, then connect, then debounce */
+static void usb_hub_scan_port(struct usb_hub_device *hub, int i)
+{
+	struct usb_device *dev = hub->pusb_dev;
+	struct usb_hub_port *port = &hub->port[i];
+	unsigned pgood_delay = hub->desc.bPwrOn2PwrGood * 2;
+	ALLOC_CACHE_ALIGN_BUFFER(struct usb_port_status, portsts, 1);
+	unsigned short portstatus, portchange;
+	ulong elapsed = get_timer(hub->power_on);
+
+	if (port->state == USB_HUB_PORT_POWER) {
+		if (elapsed < pgood_delay)
+			return;
+		port->state = USB_HUB_PORT_CONNECT;
+	}
+
+	if (usb_get_port_status(dev, i + 1, portsts) < 0) {
+		debug("get_port_status failed\n");
+		port->state = USB_HUB_PORT_IDLE;
+		return;
+	}
+	portstatus = le16_to_cpu(portsts->wPortStatus);
+	portchange = le16_to_cpu(portsts->wPortChange);
+
+	if (!(portstatus & USB_PORT_STAT_CONNECTION)) {
+		/* Nothing there yet, or the connection bounced */
+		port->state = USB_HUB_PORT_CONNECT;
+		if (elapsed < pgood_delay + HUB_CONNECT_TIMEOUT_MS)
+			return;
+	} else if (port->state == USB_HUB_PORT_CONNECT) {
+		port->state = USB_HUB_PORT_DEBOUNCE;
+		port->debounce = get_timer(0);
+		return;
+	} else if (get_timer(port->debounce) < HUB_DEBOUNCE_MS) {
+		return;
+	}
+
+	port->state = USB_HUB_PORT_IDLE;
+	usb_hub_port_status(hub, i, portstatus, portchange);
+}
+
+/*
+ * Bring up the ports of all hubs, including hubs found on the way. Each
+ * port waits for power, connection and debounce on its own timer so the
+ * waits of all ports overlap, and the time taken is that of the slowest
+ * port rather than the sum of all of them. Enumeration needs the bus to
+ * itself, as a device answers at address 0 until it is given its own, so
+ * ports are enumerated one at a time as they become ready.
+ */
+static void usb_hub_scan(void)
+{
+	static int running;
+	struct usb_hub_device *hub;
+	int pending, i, j;
+
+	/* Hubs configured while scanning are picked up by the loop below */
+	if (running)
+		return;
+	running = 1;
+
+	do {
+		pending = 0;
+		for (i = 0; i < usb_hub_index; i++) {
+			hub = &hub_dev[i];
+			for (j = 0; j < hub->pusb_dev->maxchild; j++) {
+				if (hub->port[j].state == USB_HUB_PORT_IDLE)
+					continue;
+				usb_hub_scan_port(hub, j);
+				if (hub->port[j].state != USB_HUB_PORT_IDLE)
+					pending = 1;
+			}
+		}
+		if (pending)
+			mdelay(HUB_POLL_MS);
+	} while (pending);
+
+	running = 0;
+}
+
 
 static int usb_hub_configure(struct usb_device *dev)
 {
@@ -431,88 +622,9 @@ static int usb_hub_configure(struct usb_device *dev)
 	for (i = 0; i < dev->maxchild; i++)
 		usb_hub_reset_devices(i + 1);
 
-	for (i = 0; i < dev->maxchild; i++) {
-		ALLOC_CACHE_ALIGN_BUFFER(struct usb_port_status, portsts, 1);
-		unsigned short portstatus, portchange;
-		int ret;
-		ulong start = get_timer(0);
-
-		/*
-		 * Wait for (whichever finishes first)
-		 *  - A maximum of 10 seconds
-		 *    This is a purely observational value driven by connecting
-		 *    a few broken pen drives and taking the max * 1.5 approach
-		 *  - connection_change and connection state to report same
-		 *    state
-		 */
-		do {
-			ret = usb_get_port_status(dev, i + 1, portsts);
-			if (ret < 0) {
-				debug("get_port_status failed\n");
-				break;
-			}
-
-			portstatus = le16_to_cpu(portsts->wPortStatus);
-			portchange = le16_to_cpu(portsts->wPortChange);
-
-			if ((portchange & USB_PORT_STAT_C_CONNECTION) ==
-				(portstatus & USB_PORT_STAT_CONNECTION))
-				break;
-
-		} while (get_timer(start) < CONFIG_SYS_HZ * 10);
-
-		if (ret < 0)
-			continue;
-
-		debug("Port %d Status %X Change %X\n",
-		      i + 1, portstatus, portchange);
-
-		if (portchange & USB_PORT_STAT_C_CONNECTION) {
-			debug("port %d connection change\n", i + 1);
-			usb_hub_port_connect_change(dev, i);
-		}
-		if (portchange & USB_PORT_STAT_C_ENABLE) {
-			debug("port %d enable change, status %x\n",
-			      i + 1, portstatus);
-			usb_clear_port_feature(dev, i + 1,
-						USB_PORT_FEAT_C_ENABLE);
-			/*
-			 * The following hack causes a ghost device problem
-			 * to Faraday EHCI
-			 */
-#ifndef CONFIG_USB_EHCI_FARADAY
-			/* EM interference sometimes causes bad shielded USB
-			 * devices to be shutdown by the hub, this hack enables
-			 * them again. Works at least with mouse driver */
-			if (!(portstatus & USB_PORT_STAT_ENABLE) &&
-			     (portstatus & USB_PORT_STAT_CONNECTION) &&
-			     ((dev->children[i]))) {
-				debug("already running port %i "  \
-				      "disabled by hub (EMI?), " \
-				      "re-enabling...\n", i + 1);
-				      usb_hub_port_connect_change(dev, i);
-			}
-#endif
-		}
-		if (portstatus & USB_PORT_STAT_SUSPEND) {
-			debug("port %d suspend change\n", i + 1);
-			usb_clear_port_feature(dev, i + 1,
-						USB_PORT_FEAT_SUSPEND);
-		}
-
-		if (portchange & USB_PORT_STAT_C_OVERCURRENT) {
-			debug("port %d over-current change\n", i + 1);
-			usb_clear_port_feature(dev, i + 1,
-						USB_PORT_FEAT_C_OVER_CURRENT);
-			usb_hub_power_on(hub);
-		}
-
-		if (portchange & USB_PORT_STAT_C_RESET) {
-			debug("port %d reset change\n", i + 1);
-			usb_clear_port_feature(dev, i + 1,
-						USB_PORT_FEAT_C_RESET);
-		}
-	} /* end for i all ports */
+	for (i = 0; i < dev->maxchild; i++)
+		hub->port[i].state = USB_HUB_PORT_POWER;
+	usb_hub_scan();
 
 	return 0;
 }
@@ -97,6 +97,9 @@ static const unsigned char usb_kbd_arrow[] = {
  */
 #define USB_KBD_BOOT_REPORT_SIZE 8
 
+/* Reports the controller keeps polling for ahead of the keyboard driver */
+#define USB_KBD_INT_QUEUE_LEN	4
+
 struct usb_kbd_pdata {
 	uint32_t	repeat_delay;
 
@@ -108,6 +111,11 @@ struct usb_kbd_pdata {
 	uint8_t		old[USB_KBD_BOOT_REPORT_SIZE];
 
 	uint8_t		flags;
+
+#ifdef CONFIG_SYS_USB_EVENT_POLL_VIA_INT_QUEUE
+	struct int_queue *intq;
+	uint8_t		*reports;	/* buffer of intq */
+#endif
 };
 
 extern int __maybe_unused net_busy_flag;
@@ -356,6 +364,15 @@ static inline void usb_kbd_poll_for_event(struct usb_device *dev)
 		       1, 0, data->new, USB_KBD_BOOT_REPORT_SIZE);
 	if (memcmp(data->old, data->new, USB_KBD_BOOT_REPORT_SIZE))
 		usb_kbd_irq_worker(dev);
+#elif	defined(CONFIG_SYS_USB_EVENT_POLL_VIA_INT_QUEUE)
+	struct usb_kbd_pdata *data = dev->privptr;
+	uint8_t *report;
+
+	/* Whatever the controller received since the last poll, no waiting */
+	while ((report = poll_int_queue(dev, data->intq)) != NULL) {
+		memcpy(data->new, report, dev->act_len);
+		usb_kbd_irq_worker(dev);
+	}
 #endif
 }
 
@@ -471,6 +488,22 @@ static int usb_kbd_probe(struct usb_device *dev, unsigned int ifnum)
 	debug("USB KBD: found set idle...\n");
 	usb_set_idle(dev, iface->desc.bInterfaceNumber, REPEAT_RATE, 0);
 
+#ifdef CONFIG_SYS_USB_EVENT_POLL_VIA_INT_QUEUE
+	debug("USB KBD: enable interrupt queue...\n");
+	data->reports = memalign(USB_DMA_MINALIGN,
+		roundup(USB_KBD_INT_QUEUE_LEN * USB_KBD_BOOT_REPORT_SIZE,
+			USB_DMA_MINALIGN));
+	if (data->reports)
+		data->intq = create_int_queue(dev, pipe, USB_KBD_INT_QUEUE_LEN,
+					min(maxp, USB_KBD_BOOT_REPORT_SIZE),
+					data->reports);
+	if (!data->intq) {
+		printf("Failed to queue keyboard reports from device %04x:%04x\n",
+		       dev->descriptor.idVendor, dev->descriptor.idProduct);
+		free(data->reports);
+		return 0;
+	}
+#else
 	debug("USB KBD: enable interrupt pipe...\n");
 	if (usb_submit_int_msg(dev, pipe, data->new,
 			       min(maxp, USB_KBD_BOOT_REPORT_SIZE),
@@ -480,6 +513,7 @@ static int usb_kbd_probe(struct usb_device *dev, unsigned int ifnum)
 		/* Abort, we don't want to use that non-functional keyboard. */
 		return 0;
 	}
+#endif
 
 	/* Success. */
 	return 1;
@@ -558,7 +592,28 @@ int drv_usb_kbd_init(void)
 int usb_kbd_deregister(void)
 {
 #ifdef CONFIG_SYS_STDIO_DEREGISTER
+#ifdef CONFIG_SYS_USB_EVENT_POLL_VIA_INT_QUEUE
+	struct stdio_dev *dev = stdio_get_by_name(DEVNAME);
+	struct usb_device *usb_kbd_dev = dev ? dev->priv : NULL;
+	struct usb_kbd_pdata *data;
+	int ret;
+
+	ret = stdio_deregister(DEVNAME);
+	if (ret || !usb_kbd_dev)
+		return ret;
+
+	/* Take the keyboard off the periodic schedule */
+	data = usb_kbd_dev->privptr;
+	destroy_int_queue(usb_kbd_dev, data->intq);
+	free(data->reports);
+	free(data->new);
+	free(data);
+	usb_kbd_dev->privptr = NULL;
+
+	return 0;
+#else
 	return stdio_deregister(DEVNAME);
+#endif
 #else
 	return 1;
 #endif
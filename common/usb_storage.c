@@ -129,18 +129,17 @@ struct us_data {
 	ccb		*srb;			/* current srb */
 	trans_reset	transport_reset;	/* reset routine */
 	trans_cmnd	transport;		/* transport routine */
+	size_t		max_xfer_size;		/* host limit, 0 if unknown */
 };
 
-#ifdef CONFIG_USB_EHCI
 /*
- * The U-Boot EHCI driver can handle any transfer length as long as there is
- * enough free heap space left, but the SCSI READ(10) and WRITE(10) commands are
- * limited to 65535 blocks.
+ * The SCSI READ(10) and WRITE(10) commands are limited to 65535 blocks.
+ * Within that, each command is as large as the host controller driver
+ * says it can take (the EHCI driver handles any length); controllers
+ * which don't tell get the 20 blocks that every one of them copes with.
  */
 #define USB_MAX_XFER_BLK	65535
-#else
-#define USB_MAX_XFER_BLK	20
-#endif
+#define USB_DEFAULT_XFER_BLK	20
 
 static struct us_data usb_stor[USB_MAX_STOR_DEV];
 
@@ -155,6 +154,8 @@ int usb_storage_probe(struct usb_device *dev, unsigned int ifnum,
 		      struct us_data *ss);
 unsigned long usb_stor_read(int device, lbaint_t blknr,
 			    lbaint_t blkcnt, void *buffer);
+unsigned long usb_stor_read_sg(int device, lbaint_t blknr,
+			       const struct blk_sg *sg, int nsg);
 unsigned long usb_stor_write(int device, lbaint_t blknr,
 			     lbaint_t blkcnt, const void *buffer);
 struct usb_device * usb_get_dev_index(int index);
@@ -231,6 +232,7 @@ int usb_stor_scan(int mode)
 		usb_dev_desc[i].type = DEV_TYPE_UNKNOWN;
 		usb_dev_desc[i].block_read = usb_stor_read;
 		usb_dev_desc[i].block_write = usb_stor_write;
+		usb_dev_desc[i].block_read_sg = usb_stor_read_sg;
 	}
 
 	usb_max_devs = 0;
@@ -335,8 +337,8 @@ static int us_one_transfer(struct us_data *us, int pipe, char *buf, int length)
 		/* set up the transfer loop */
 		do {
 			/* transfer the data */
-			debug("Bulk xfer 0x%x(%d) try #%d\n",
-			      (unsigned int)buf, this_xfer, 11 - maxtry);
+			debug("Bulk xfer %p(%d) try #%d\n",
+			      buf, this_xfer, 11 - maxtry);
 			result = usb_bulk_msg(us->pusb_dev, pipe, buf,
 					      this_xfer, &partial,
 					      USB_CNTL_TIMEOUT * 5);
@@ -602,7 +604,7 @@ static int usb_stor_CBI_get_status(ccb *srb, struct us_data *us)
 			(void *) &us->ip_data, us->irqmaxp, us->irqinterval);
 	timeout = 1000;
 	while (timeout--) {
-		if ((volatile int *) us->ip_wanted == NULL)
+		if (!*(volatile int *)&us->ip_wanted)
 			break;
 		mdelay(10);
 	}
@@ -1013,6 +1015,137 @@ static int usb_write_10(ccb *srb, struct us_data *ss, unsigned long start,
 	return ss->transport(srb, ss);
 }
 
+/*
+ * Commands of the Bulk-Only Transport, each put in a batch of bulk
+ * transfers for host controllers which can queue several of them: its
+ * CBW, its data and its CSW. The data phase of a command may be split
+ * over several transfers, one per fragment of a scatter-gather list it
+ * covers. The commands themselves still go one at a time, as a device
+ * need not take a CBW before it has sent the CSW of the command before.
+ */
+#define USB_STOR_BATCH		8
+#define USB_STOR_BATCH_XFERS	(4 * USB_STOR_BATCH)
+
+struct usb_stor_bbb_wrap {
+	umass_bbb_cbw_t cbw;
+	umass_bbb_csw_t csw __aligned(ARCH_DMA_MINALIGN);
+} __aligned(ARCH_DMA_MINALIGN);
+
+static struct usb_stor_bbb_wrap usb_stor_bbb_wraps[USB_STOR_BATCH];
+
+/*
+ * Read (write == 0) or write the blocks of a scatter-gather list, from
+ * skip blocks into its first fragment, to or from the device from
+ * start, with a batch of up to USB_STOR_BATCH READ(10) or WRITE(10)
+ * commands of max_blks blocks. Returns the number of blocks the leading
+ * commands which completed cleanly moved. When a command did not, the
+ * device is reset and no longer marked ready, and the caller then goes
+ * on one command at a time.
+ */
+static lbaint_t usb_stor_BBB_batch(ccb *srb, struct us_data *us, int write,
+				   lbaint_t start, const struct blk_sg *sg,
+				   int nsg, lbaint_t skip, unsigned long blksz,
+				   unsigned short max_blks)
+{
+	struct usb_device *udev = us->pusb_dev;
+	struct usb_bulk_xfer xfers[USB_STOR_BATCH_XFERS], *x;
+	unsigned int pipein = usb_rcvbulkpipe(udev, us->ep_in);
+	unsigned int pipeout = usb_sndbulkpipe(udev, us->ep_out);
+	unsigned short blks[USB_STOR_BATCH];
+	int first[USB_STOR_BATCH + 1];
+	umass_bbb_cbw_t *cbw;
+	umass_bbb_csw_t *csw;
+	lbaint_t done = 0, n;
+	int cmds, nx = 0, i;
+
+	for (cmds = 0; cmds < USB_STOR_BATCH; cmds++) {
+		while (nsg && skip == sg->blkcnt) {
+			sg++;
+			nsg--;
+			skip = 0;
+		}
+		/* Room for the CBW, some data and the CSW */
+		if (!nsg || nx + 3 > USB_STOR_BATCH_XFERS)
+			break;
+		cbw = &usb_stor_bbb_wraps[cmds].cbw;
+		csw = &usb_stor_bbb_wraps[cmds].csw;
+		first[cmds] = nx;
+		x = &xfers[nx++];
+		x->pipe = pipeout;
+		x->buffer = cbw;
+		x->length = UMASS_BBB_CBW_SIZE;
+
+		blks[cmds] = 0;
+		while (nsg && blks[cmds] < max_blks &&
+		       nx + 1 < USB_STOR_BATCH_XFERS) {
+			n = min(sg->blkcnt - skip,
+				(lbaint_t)(max_blks - blks[cmds]));
+			x = &xfers[nx++];
+			x->pipe = write ? pipeout : pipein;
+			x->buffer = sg->buf + skip * blksz;
+			x->length = n * blksz;
+			blks[cmds] += n;
+			skip += n;
+			while (nsg && skip == sg->blkcnt) {
+				sg++;
+				nsg--;
+				skip = 0;
+			}
+		}
+
+		x = &xfers[nx++];
+		x->pipe = pipein;
+		x->buffer = csw;
+		x->length = UMASS_BBB_CSW_SIZE;
+
+		memset(cbw, 0, sizeof(*cbw));
+		cbw->dCBWSignature = cpu_to_le32(CBWSIGNATURE);
+		cbw->dCBWTag = cpu_to_le32(CBWTag++);
+		cbw->dCBWDataTransferLength = cpu_to_le32(blks[cmds] * blksz);
+		cbw->bCBWFlags = write ? CBWFLAGS_OUT : CBWFLAGS_IN;
+		cbw->bCBWLUN = srb->lun;
+		cbw->bCDBLength = 12;
+		cbw->CBWCDB[0] = write ? SCSI_WRITE10 : SCSI_READ10;
+		cbw->CBWCDB[1] = srb->lun << 5;
+		cbw->CBWCDB[2] = (start >> 24) & 0xff;
+		cbw->CBWCDB[3] = (start >> 16) & 0xff;
+		cbw->CBWCDB[4] = (start >> 8) & 0xff;
+		cbw->CBWCDB[5] = start & 0xff;
+		cbw->CBWCDB[7] = (blks[cmds] >> 8) & 0xff;
+		cbw->CBWCDB[8] = blks[cmds] & 0xff;
+
+		start += blks[cmds];
+	}
+	first[cmds] = nx;
+	debug("BBB batch: %d commands, %d transfers\n", cmds, nx);
+
+	for (i = 0; i < cmds; i++) {
+		cbw = &usb_stor_bbb_wraps[i].cbw;
+		csw = &usb_stor_bbb_wraps[i].csw;
+		/* Whatever failed shows in the transfers */
+		submit_bulk_batch(udev, &xfers[first[i]],
+				  first[i + 1] - first[i]);
+		for (x = &xfers[first[i]]; x < &xfers[first[i + 1]]; x++) {
+			if (x->status || x->act_len != x->length)
+				break;
+		}
+		if (x < &xfers[first[i + 1]] ||
+		    le32_to_cpu(csw->dCSWSignature) != CSWSIGNATURE ||
+		    csw->dCSWTag != cbw->dCBWTag ||
+		    csw->bCSWStatus != CSWSTATUS_GOOD ||
+		    csw->dCSWDataResidue)
+			break;
+		usb_show_progress();
+		done += blks[i];
+	}
+	if (i < cmds) {
+		debug("BBB batch: command %d of %d failed\n", i, cmds);
+		usb_stor_BBB_reset(us);
+		us->flags &= ~USB_READY;
+	}
+
+	return done;
+}
 
 #ifdef CONFIG_USB_BIN_FIXUP
 /*
@@ -1037,14 +1170,26 @@ static void usb_bin_fixup(struct usb_device_descriptor descriptor,
 }
 #endif /* CONFIG_USB_BIN_FIXUP */
 
+/* Number of blocks to move with each READ(10)/WRITE(10) command */
+static unsigned short usb_stor_max_blks(struct us_data *ss,
+					block_dev_desc_t *dev_desc)
+{
+	if (!dev_desc->blksz || ss->max_xfer_size < dev_desc->blksz)
+		return USB_DEFAULT_XFER_BLK;
+
+	return min(ss->max_xfer_size / dev_desc->blksz,
+		   (ulong)USB_MAX_XFER_BLK);
+}
+
 unsigned long usb_stor_read(int device, lbaint_t blknr,
 			    lbaint_t blkcnt, void *buffer)
 {
-	lbaint_t start, blks;
+	lbaint_t start, blks, done;
 	uintptr_t buf_addr;
-	unsigned short smallblks;
+	unsigned short smallblks = 0, max_blks;
 	struct usb_device *dev;
 	struct us_data *ss;
+	struct blk_sg sg;
 	int retry, i;
 	ccb *srb = &usb_ccb;
 
@@ -1063,6 +1208,7 @@ unsigned long usb_stor_read(int device, lbaint_t blknr,
 			break;
 	}
 	ss = (struct us_data *)dev->privptr;
+	max_blks = usb_stor_max_blks(ss, &usb_dev_desc[device]);
 
 	usb_disable_asynch(1); /* asynch transfer not allowed */
 	srb->lun = usb_dev_desc[device].lun;
@@ -1074,15 +1220,26 @@ unsigned long usb_stor_read(int device, lbaint_t blknr,
 	      " buffer %lx\n", device, start, blks, buf_addr);
 
 	do {
+		if (ss->protocol == US_PR_BULK && (ss->flags & USB_READY)) {
+			sg.buf = (void *)buf_addr;
+			sg.blkcnt = blks;
+			done = usb_stor_BBB_batch(srb, ss, 0, start, &sg, 1, 0,
+						  usb_dev_desc[device].blksz,
+						  max_blks);
+			start += done;
+			blks -= done;
+			buf_addr += done * usb_dev_desc[device].blksz;
+			continue;
+		}
 		/* XXX need some comment here */
 		retry = 2;
 		srb->pdata = (unsigned char *)buf_addr;
-		if (blks > USB_MAX_XFER_BLK)
-			smallblks = USB_MAX_XFER_BLK;
+		if (blks > max_blks)
+			smallblks = max_blks;
 		else
 			smallblks = (unsigned short) blks;
 retry_it:
-		if (smallblks == USB_MAX_XFER_BLK)
+		if (smallblks == max_blks)
 			usb_show_progress();
 		srb->datalen = usb_dev_desc[device].blksz * smallblks;
 		srb->pdata = (unsigned char *)buf_addr;
@@ -1098,26 +1255,92 @@ retry_it:
 		blks -= smallblks;
 		buf_addr += srb->datalen;
 	} while (blks != 0);
-	ss->flags &= ~USB_READY;
+	/*
+	 * A device which just moved data is ready, don't make the next
+	 * command wait for it. Only ask again after a failure.
+	 */
+	if (blks)
+		ss->flags &= ~USB_READY;
+	else
+		ss->flags |= USB_READY;
 
 	debug("usb_read: end startblk " LBAF
 	      ", blccnt %x buffer %lx\n",
 	      start, smallblks, buf_addr);
 
 	usb_disable_asynch(0); /* asynch transfer allowed */
-	if (blkcnt >= USB_MAX_XFER_BLK)
+	if (blkcnt >= max_blks)
 		debug("\n");
 	return blkcnt;
 }
 
+/*
+ * Read into the fragments of a scatter-gather list with as few commands
+ * as possible: the data phase of each command goes to as many of them as
+ * it covers.
+ */
+unsigned long usb_stor_read_sg(int device, lbaint_t blknr,
+			       const struct blk_sg *sg, int nsg)
+{
+	lbaint_t done = 0, skip = 0, n;
+	unsigned short max_blks;
+	unsigned long blksz;
+	struct usb_device *dev;
+	struct us_data *ss;
+	ccb *srb = &usb_ccb;
+	int i;
+
+	device &= 0xff;
+	debug("\nusb_read_sg: dev %d startblk " LBAF ", %d fragments\n",
+	      device, blknr, nsg);
+	dev = NULL;
+	for (i = 0; i < USB_MAX_DEVICE; i++) {
+		dev = usb_get_dev_index(i);
+		if (dev == NULL)
+			return 0;
+		if (dev->devnum == usb_dev_desc[device].target)
+			break;
+	}
+	ss = (struct us_data *)dev->privptr;
+	max_blks = usb_stor_max_blks(ss, &usb_dev_desc[device]);
+	blksz = usb_dev_desc[device].blksz;
+
+	usb_disable_asynch(1); /* asynch transfer not allowed */
+	srb->lun = usb_dev_desc[device].lun;
+	while (nsg && ss->protocol == US_PR_BULK && (ss->flags & USB_READY)) {
+		n = usb_stor_BBB_batch(srb, ss, 0, blknr + done, sg, nsg, skip,
+				       blksz, max_blks);
+		done += n;
+		skip += n;
+		while (nsg && skip >= sg->blkcnt) {
+			skip -= sg->blkcnt;
+			sg++;
+			nsg--;
+		}
+	}
+	usb_disable_asynch(0); /* asynch transfer allowed */
+
+	/* Whatever the batches did not read, one fragment at a time */
+	for (; nsg; sg++, nsg--, skip = 0) {
+		n = usb_stor_read(device, blknr + done, sg->blkcnt - skip,
+				  sg->buf + skip * blksz);
+		done += n;
+		if (n != sg->blkcnt - skip)
+			break;
+	}
+
+	return done;
+}
+
 unsigned long usb_stor_write(int device, lbaint_t blknr,
 				lbaint_t blkcnt, const void *buffer)
 {
-	lbaint_t start, blks;
+	lbaint_t start, blks, done;
 	uintptr_t buf_addr;
-	unsigned short smallblks;
+	unsigned short smallblks = 0, max_blks;
 	struct usb_device *dev;
 	struct us_data *ss;
+	struct blk_sg sg;
 	int retry, i;
 	ccb *srb = &usb_ccb;
 
@@ -1136,6 +1359,7 @@ unsigned long usb_stor_write(int device, lbaint_t blknr,
 			break;
 	}
 	ss = (struct us_data *)dev->privptr;
+	max_blks = usb_stor_max_blks(ss, &usb_dev_desc[device]);
 
 	usb_disable_asynch(1); /* asynch transfer not allowed */
 
@@ -1148,17 +1372,28 @@ unsigned long usb_stor_write(int device, lbaint_t blknr,
 	      " buffer %lx\n", device, start, blks, buf_addr);
 
 	do {
+		if (ss->protocol == US_PR_BULK && (ss->flags & USB_READY)) {
+			sg.buf = (void *)buf_addr;
+			sg.blkcnt = blks;
+			done = usb_stor_BBB_batch(srb, ss, 1, start, &sg, 1, 0,
+						  usb_dev_desc[device].blksz,
+						  max_blks);
+			start += done;
+			blks -= done;
+			buf_addr += done * usb_dev_desc[device].blksz;
+			continue;
+		}
 		/* If write fails retry for max retry count else
 		 * return with number of blocks written successfully.
 		 */
 		retry = 2;
 		srb->pdata = (unsigned char *)buf_addr;
-		if (blks > USB_MAX_XFER_BLK)
-			smallblks = USB_MAX_XFER_BLK;
+		if (blks > max_blks)
+			smallblks = max_blks;
 		else
 			smallblks = (unsigned short) blks;
 retry_it:
-		if (smallblks == USB_MAX_XFER_BLK)
+		if (smallblks == max_blks)
 			usb_show_progress();
 		srb->datalen = usb_dev_desc[device].blksz * smallblks;
 		srb->pdata = (unsigned char *)buf_addr;
@@ -1174,13 +1409,20 @@ retry_it:
 		blks -= smallblks;
 		buf_addr += srb->datalen;
 	} while (blks != 0);
-	ss->flags &= ~USB_READY;
+	/*
+	 * A device which just moved data is ready, don't make the next
+	 * command wait for it. Only ask again after a failure.
+	 */
+	if (blks)
+		ss->flags &= ~USB_READY;
+	else
+		ss->flags |= USB_READY;
 
 	debug("usb_write: end startblk " LBAF ", blccnt %x buffer %lx\n",
 	      start, smallblks, buf_addr);
 
 	usb_disable_asynch(0); /* asynch transfer allowed */
-	if (blkcnt >= USB_MAX_XFER_BLK)
+	if (blkcnt >= max_blks)
 		debug("\n");
 	return blkcnt;
 
@@ -1325,6 +1567,8 @@ int usb_storage_probe(struct usb_device *dev, unsigned int ifnum,
 		ss->irqmaxp = usb_maxpacket(dev, ss->irqpipe);
 		dev->irq_handle = usb_stor_irq;
 	}
+	if (usb_get_max_xfer_size(dev, &ss->max_xfer_size))
+		ss->max_xfer_size = 0;
 	dev->privptr = (void *)ss;
 	return 1;
 }
@@ -1333,9 +1577,9 @@ int usb_stor_get_info(struct usb_device *dev, struct us_data *ss,
 		      block_dev_desc_t *dev_desc)
 {
 	unsigned char perq, modi;
-	ALLOC_CACHE_ALIGN_BUFFER(unsigned long, cap, 2);
+	ALLOC_CACHE_ALIGN_BUFFER(u32, cap, 2);
 	ALLOC_CACHE_ALIGN_BUFFER(unsigned char, usb_stor_buf, 36);
-	unsigned long *capacity, *blksz;
+	u32 *capacity, *blksz;
 	ccb *pccb = &usb_ccb;
 
 	pccb->pdata = usb_stor_buf;
@@ -1389,7 +1633,7 @@ int usb_stor_get_info(struct usb_device *dev, struct us_data *ss,
 		cap[1] = 0x200;
 	}
 	ss->flags &= ~USB_READY;
-	debug("Read Capacity returns: 0x%lx, 0x%lx\n", cap[0], cap[1]);
+	debug("Read Capacity returns: 0x%x, 0x%x\n", cap[0], cap[1]);
 #if 0
 	if (cap[0] > (0x200000 * 10)) /* greater than 10 GByte */
 		cap[0] >>= 16;
@@ -1401,7 +1645,7 @@ int usb_stor_get_info(struct usb_device *dev, struct us_data *ss,
 	cap[0] += 1;
 	capacity = &cap[0];
 	blksz = &cap[1];
-	debug("Capacity = 0x%lx, blocksz = 0x%lx\n", *capacity, *blksz);
+	debug("Capacity = 0x%x, blocksz = 0x%x\n", *capacity, *blksz);
 	dev_desc->lba = *capacity;
 	dev_desc->blksz = *blksz;
 	dev_desc->log2blksz = LOG2(dev_desc->blksz);
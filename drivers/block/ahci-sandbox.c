@@ -0,0 +1,479 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Sandbox AHCI controller
+ *
+ * A model of an AHCI controller with a SATA disk on each port, backed by
+ * a file on the host. Its registers react to the accesses the AHCI driver
+ * makes through ahci_readl()/ahci_writel(), and the commands it puts in
+ * the command lists are run as their bits in PxCI are set: IDENTIFY,
+ * READ/WRITE DMA EXT, FLUSH CACHE EXT and SET FEATURES, and with Native
+ * Command Queueing READ/WRITE FPDMA QUEUED.
+ *
+ * The disks are described by the environment, read at each controller
+ * reset (so at 'scsi reset'):
+ *
+ *   sandbox_ahci		the files of the disks on ports 0, 1, ...,
+ *			'-' for an empty port
+ *   sandbox_ahci_ncq	0 for a controller and disks without NCQ
+ *   sandbox_ahci_latency	time each command takes, in us (default 0)
+ *   sandbox_ahci_linkup	time from spin-up until a disk's link is up,
+ *			in ms (default 0)
+ *
+ * An empty port is implemented, but its link never comes up.
+ *
+ * The data moves as a command is issued, but the command only completes
+ * once its time is up: checked at each register access. Queued commands
+ * take their time side by side, as a drive working through its queue
+ * does, while the others take it one after the other.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <ahci.h>
+#include <libata.h>
+#include <os.h>
+#include <linux/compat.h>
+
+#define SANDBOX_AHCI_PORTS	CONFIG_SYS_SCSI_MAX_SCSI_ID
+#define SANDBOX_AHCI_SLOTS	AHCI_MAX_CMD_SLOT
+#define SANDBOX_AHCI_MMIO_SZ	(0x100 + SANDBOX_AHCI_PORTS * 0x80)
+
+/* PORT_CMD bits the driver sets */
+#define PORT_CMD_WRITABLE	(PORT_CMD_FIS_RX | PORT_CMD_POWER_ON | \
+				 PORT_CMD_SPIN_UP | PORT_CMD_START)
+/* PORT_SCR_STAT: device present and link up at 3Gbps, interface active */
+#define SANDBOX_AHCI_SSTS	0x123
+#define SANDBOX_AHCI_SIG_ATA	0x00000101
+
+#define FIS_TYPE_REG_H2D	0x27
+#define FIS_TYPE_REG_D2H	0x34
+
+struct sandbox_ahci_disk {
+	int fd;			/* file of the disk, -1 for none */
+	u64 sectors;
+	u32 running;		/* commands issued but not completed */
+	ulong done_us[SANDBOX_AHCI_SLOTS];	/* when each one completes */
+	ulong busy_us;		/* when the non-queued ones are done */
+	bool linking;		/* spun up, waiting for the link */
+	ulong link_us;		/* when the link comes up */
+};
+
+static struct sandbox_ahci {
+	u32 mmio[SANDBOX_AHCI_MMIO_SZ / 4];
+	struct sandbox_ahci_disk disks[SANDBOX_AHCI_PORTS];
+	bool ncq;
+	ulong latency;
+	ulong linkup;
+} sa;
+
+static u32 *sandbox_ahci_port_reg(int port, int reg)
+{
+	return &sa.mmio[(0x100 + port * 0x80 + reg) / 4];
+}
+
+static void *sandbox_ahci_ptr(u32 lo, u32 hi)
+{
+	return (void *)(uintptr_t)((u64)hi << 32 | lo);
+}
+
+/* Copy between the disk and the memory of the PRDs; bytes done, or -1 */
+static int sandbox_ahci_xfer(struct sandbox_ahci_disk *disk,
+			     struct ahci_sg *prd, int prds, u64 lba, u32 count,
+			     bool write)
+{
+	int bytes = count * ATA_SECT_SIZE;
+	int done = 0, len;
+	void *buf;
+	ssize_t ret;
+
+	if (lba + count > disk->sectors)
+		return -1;
+	if (os_lseek(disk->fd, lba * ATA_SECT_SIZE, OS_SEEK_SET) == -1)
+		return -1;
+	for (; prds && done < bytes; prd++, prds--) {
+		buf = sandbox_ahci_ptr(le32_to_cpu(prd->addr),
+				       le32_to_cpu(prd->addr_hi));
+		len = (le32_to_cpu(prd->flags_size) & 0x3fffff) + 1;
+		len = min(len, bytes - done);
+		if (write)
+			ret = os_write(disk->fd, buf, len);
+		else
+			ret = os_read(disk->fd, buf, len);
+		if (ret != len)
+			return -1;
+		done += len;
+	}
+
+	/* The PRDs have to take all the data */
+	return done == bytes ? done : -1;
+}
+
+/* An IDENTIFY string: two characters a word, the first in the high byte */
+static void sandbox_ahci_id_string(u16 *id, const char *s, int words)
+{
+	int len = strlen(s);
+	int i;
+
+	for (i = 0; i < words * 2; i++)
+		id[i / 2] |= cpu_to_le16((i < len ? s[i] : ' ') <<
+					 (i & 1 ? 0 : 8));
+}
+
+static int sandbox_ahci_identify(int port, struct ahci_sg *prd, int prds)
+{
+	struct sandbox_ahci_disk *disk = &sa.disks[port];
+	u16 id[ATA_ID_WORDS];
+	char serial[20];
+	void *buf;
+	int i;
+
+	if (!prds ||
+	    (le32_to_cpu(prd->flags_size) & 0x3fffff) + 1 < sizeof(id))
+		return -1;
+
+	memset(id, '\0', sizeof(id));
+	snprintf(serial, sizeof(serial), "SANDBOX%d", port);
+	sandbox_ahci_id_string(&id[ATA_ID_SERNO], serial, 10);
+	sandbox_ahci_id_string(&id[ATA_ID_FW_REV], "1.0", 4);
+	sandbox_ahci_id_string(&id[ATA_ID_PROD], "Sandbox disk", 20);
+	id[49] = cpu_to_le16(1 << 9 | 1 << 8);		/* LBA, DMA */
+	id[60] = cpu_to_le16(min(disk->sectors, 0xfffffffULL) & 0xffff);
+	id[61] = cpu_to_le16(min(disk->sectors, 0xfffffffULL) >> 16);
+	id[75] = cpu_to_le16(SANDBOX_AHCI_SLOTS - 1);	/* queue depth */
+	if (sa.ncq)
+		id[76] = cpu_to_le16(1 << 8 | 1 << 2 | 1 << 1);
+	id[80] = cpu_to_le16(1 << 8);			/* ATA8-ACS */
+	id[83] = cpu_to_le16(1 << 14 | 1 << 10);	/* LBA48 */
+	id[86] = cpu_to_le16(1 << 10);
+	id[88] = cpu_to_le16(0x7f);			/* UDMA 0-6 */
+	for (i = 0; i < 4; i++)
+		id[100 + i] = cpu_to_le16(disk->sectors >> (16 * i));
+
+	buf = sandbox_ahci_ptr(le32_to_cpu(prd->addr),
+			       le32_to_cpu(prd->addr_hi));
+	memcpy(buf, id, sizeof(id));
+
+	return sizeof(id);
+}
+
+/* The drive reports an error: the command stays in PxCI, as it would */
+static void sandbox_ahci_error(int port)
+{
+	*sandbox_ahci_port_reg(port, PORT_TFDATA) = ATA_ABORTED << 8 |
+						    ATA_DRDY | ATA_ERR;
+	*sandbox_ahci_port_reg(port, PORT_IRQ_STAT) |= PORT_IRQ_TF_ERR;
+	sa.mmio[HOST_IRQ_STAT / 4] |= 1 << port;
+}
+
+/* Run the command in @slot of @port's command list */
+static void sandbox_ahci_exec(int port, int slot)
+{
+	struct sandbox_ahci_disk *disk = &sa.disks[port];
+	struct ahci_cmd_hdr *hdr;
+	struct ahci_sg *prd;
+	u64 lba = 0;
+	u32 count = 0;
+	bool queued = false;
+	int bytes = 0, prds, i;
+	ulong now;
+	u8 *fis;
+
+	hdr = sandbox_ahci_ptr(*sandbox_ahci_port_reg(port, PORT_LST_ADDR),
+			       *sandbox_ahci_port_reg(port, PORT_LST_ADDR_HI));
+	hdr += slot;
+	fis = sandbox_ahci_ptr(le32_to_cpu(hdr->tbl_addr),
+			       le32_to_cpu(hdr->tbl_addr_hi));
+	prd = (struct ahci_sg *)(fis + AHCI_CMD_TBL_HDR);
+	prds = le32_to_cpu(hdr->opts) >> 16;
+
+	if (fis[0] != FIS_TYPE_REG_H2D || !(fis[1] & 0x80))
+		goto err;
+	for (i = 0; i < 6; i++)
+		lba |= (u64)fis[i < 3 ? 4 + i : 5 + i] << (8 * i);
+
+	switch (fis[2]) {
+	case ATA_CMD_ID_ATA:
+		bytes = sandbox_ahci_identify(port, prd, prds);
+		break;
+	case ATA_CMD_READ_EXT:
+	case ATA_CMD_WRITE_EXT:
+		count = fis[12] | fis[13] << 8;
+		bytes = sandbox_ahci_xfer(disk, prd, prds, lba,
+					  count ? count : 0x10000,
+					  fis[2] == ATA_CMD_WRITE_EXT);
+		break;
+	case ATA_CMD_FPDMA_READ:
+	case ATA_CMD_FPDMA_WRITE:
+		/* The tag has to be the slot, and in PxSACT */
+		if (!sa.ncq || fis[12] >> 3 != slot ||
+		    !(*sandbox_ahci_port_reg(port, PORT_SCR_ACT) & 1 << slot))
+			goto err;
+		count = fis[3] | fis[11] << 8;
+		bytes = sandbox_ahci_xfer(disk, prd, prds, lba,
+					  count ? count : 0x10000,
+					  fis[2] == ATA_CMD_FPDMA_WRITE);
+		queued = true;
+		break;
+	case ATA_CMD_FLUSH_EXT:
+	case ATA_CMD_SET_FEATURES:
+		break;
+	default:
+		goto err;
+	}
+	if (bytes < 0)
+		goto err;
+	hdr->status = cpu_to_le32(bytes);
+
+	now = timer_get_us();
+	if (queued) {
+		/* Accepted at once, done when its own time is up */
+		*sandbox_ahci_port_reg(port, PORT_CMD_ISSUE) &= ~(1 << slot);
+		disk->done_us[slot] = now + sa.latency;
+	} else {
+		if ((long)(disk->busy_us - now) > 0)
+			now = disk->busy_us;
+		disk->done_us[slot] = now + sa.latency;
+		disk->busy_us = disk->done_us[slot];
+	}
+	disk->running |= 1 << slot;
+	return;
+
+err:
+	sandbox_ahci_error(port);
+}
+
+/* The link is up, and the drive sends its signature */
+static void sandbox_ahci_link_up(int port)
+{
+	sa.disks[port].linking = false;
+	*sandbox_ahci_port_reg(port, PORT_SCR_STAT) = SANDBOX_AHCI_SSTS;
+	*sandbox_ahci_port_reg(port, PORT_SIG) = SANDBOX_AHCI_SIG_ATA;
+	*sandbox_ahci_port_reg(port, PORT_TFDATA) = ATA_DRDY;
+	*sandbox_ahci_port_reg(port, PORT_IRQ_STAT) |=
+		PORT_IRQ_D2H_REG_FIS | PORT_IRQ_PHYRDY;
+}
+
+/* Bring up the links and complete the commands whose time is up */
+static void sandbox_ahci_update(void)
+{
+	struct sandbox_ahci_disk *disk;
+	ulong now = timer_get_us();
+	u32 *ci, *sact, *rx_fis;
+	int port, slot;
+
+	for (port = 0; port < SANDBOX_AHCI_PORTS; port++) {
+		disk = &sa.disks[port];
+		if (disk->linking && (long)(now - disk->link_us) >= 0)
+			sandbox_ahci_link_up(port);
+		ci = sandbox_ahci_port_reg(port, PORT_CMD_ISSUE);
+		sact = sandbox_ahci_port_reg(port, PORT_SCR_ACT);
+		for (slot = 0; disk->running && slot < SANDBOX_AHCI_SLOTS;
+		     slot++) {
+			if (!(disk->running & 1 << slot) ||
+			    (long)(now - disk->done_us[slot]) < 0)
+				continue;
+			disk->running &= ~(1 << slot);
+			if (*sact & 1 << slot) {
+				/* Set Device Bits FIS */
+				*sact &= ~(1 << slot);
+				*sandbox_ahci_port_reg(port, PORT_IRQ_STAT) |=
+					PORT_IRQ_SDB_FIS;
+			} else {
+				*ci &= ~(1 << slot);
+				rx_fis = sandbox_ahci_ptr(
+					*sandbox_ahci_port_reg(port,
+							       PORT_FIS_ADDR),
+					*sandbox_ahci_port_reg(port,
+							PORT_FIS_ADDR_HI));
+				rx_fis[RX_FIS_D2H_REG / 4] =
+					cpu_to_le32(ATA_DRDY << 16 |
+						    FIS_TYPE_REG_D2H);
+				*sandbox_ahci_port_reg(port, PORT_IRQ_STAT) |=
+					PORT_IRQ_D2H_REG_FIS;
+			}
+			*sandbox_ahci_port_reg(port, PORT_TFDATA) = ATA_DRDY;
+			sa.mmio[HOST_IRQ_STAT / 4] |= 1 << port;
+		}
+	}
+}
+
+/* Attach the disks the environment names, and reset everything */
+static void sandbox_ahci_reset(void)
+{
+	struct sandbox_ahci_disk *disk;
+	const char *env = getenv("sandbox_ahci");
+	const char *end;
+	char name[256];
+	int port, len;
+	off_t size;
+
+	memset(sa.mmio, '\0', sizeof(sa.mmio));
+	sa.ncq = getenv_ulong("sandbox_ahci_ncq", 10, 1);
+	sa.latency = getenv_ulong("sandbox_ahci_latency", 10, 0);
+	sa.linkup = getenv_ulong("sandbox_ahci_linkup", 10, 0);
+	sa.mmio[HOST_CAP / 4] = HOST_CAP_64 | (sa.ncq ? HOST_CAP_NCQ : 0) |
+		1 << 27 | 3 << 20 | (SANDBOX_AHCI_SLOTS - 1) << 8 |
+		(SANDBOX_AHCI_PORTS - 1);
+	sa.mmio[HOST_VERSION / 4] = 0x00010300;
+
+	for (port = 0; port < SANDBOX_AHCI_PORTS; port++) {
+		disk = &sa.disks[port];
+		if (disk->fd != -1)
+			os_close(disk->fd);
+		memset(disk, '\0', sizeof(*disk));
+		disk->fd = -1;
+		*sandbox_ahci_port_reg(port, PORT_SIG) = 0xffffffff;
+		*sandbox_ahci_port_reg(port, PORT_TFDATA) = 0x7f;
+
+		while (env && *env == ' ')
+			env++;
+		if (!env || !*env)
+			continue;
+		end = strchr(env, ' ');
+		len = end ? end - env : strlen(env);
+		snprintf(name, sizeof(name), "%.*s", len, env);
+		env += len;
+		sa.mmio[HOST_PORTS_IMPL / 4] |= 1 << port;
+		if (!strcmp(name, "-"))
+			continue;
+		disk->fd = os_open(name, OS_O_RDWR);
+		if (disk->fd == -1) {
+			printf("sandbox_ahci: cannot open '%s'\n", name);
+			continue;
+		}
+		size = os_lseek(disk->fd, 0, OS_SEEK_END);
+		disk->sectors = size > 0 ? size / ATA_SECT_SIZE : 0;
+	}
+}
+
+static void sandbox_ahci_port_cmd(int port, u32 val)
+{
+	u32 *cmd = sandbox_ahci_port_reg(port, PORT_CMD);
+	u32 *ssts = sandbox_ahci_port_reg(port, PORT_SCR_STAT);
+
+	/* Stopping the command list drops what was in it */
+	if ((*cmd & PORT_CMD_START) && !(val & PORT_CMD_START)) {
+		*sandbox_ahci_port_reg(port, PORT_CMD_ISSUE) = 0;
+		*sandbox_ahci_port_reg(port, PORT_SCR_ACT) = 0;
+		sa.disks[port].running = 0;
+		*sandbox_ahci_port_reg(port, PORT_TFDATA) = ATA_DRDY;
+	}
+
+	*cmd = val & PORT_CMD_WRITABLE;
+	if (val & PORT_CMD_START)
+		*cmd |= PORT_CMD_LIST_ON;
+	if (val & PORT_CMD_FIS_RX)
+		*cmd |= PORT_CMD_FIS_ON;
+
+	/* Spinning up a disk starts training its link */
+	if ((val & PORT_CMD_SPIN_UP) && sa.disks[port].fd != -1 &&
+	    *ssts != SANDBOX_AHCI_SSTS && !sa.disks[port].linking) {
+		sa.disks[port].linking = true;
+		sa.disks[port].link_us = timer_get_us() + sa.linkup * 1000;
+		if (!sa.linkup)
+			sandbox_ahci_link_up(port);
+	}
+}
+
+static void sandbox_ahci_port_writel(int port, int reg, u32 val)
+{
+	u32 *p = sandbox_ahci_port_reg(port, reg);
+	u32 issued;
+	int slot;
+
+	switch (reg) {
+	case PORT_LST_ADDR:
+	case PORT_LST_ADDR_HI:
+	case PORT_FIS_ADDR:
+	case PORT_FIS_ADDR_HI:
+	case PORT_IRQ_MASK:
+	case PORT_SCR_CTL:
+		*p = val;
+		break;
+	case PORT_IRQ_STAT:
+	case PORT_SCR_ERR:
+		*p &= ~val;
+		break;
+	case PORT_CMD:
+		sandbox_ahci_port_cmd(port, val);
+		break;
+	case PORT_SCR_ACT:
+		if (*sandbox_ahci_port_reg(port, PORT_CMD) & PORT_CMD_START)
+			*p |= val;
+		break;
+	case PORT_CMD_ISSUE:
+		if (!(*sandbox_ahci_port_reg(port, PORT_CMD) & PORT_CMD_START))
+			break;
+		issued = val & ~*p;
+		*p |= val;
+		for (slot = 0; slot < SANDBOX_AHCI_SLOTS; slot++) {
+			if (issued & 1 << slot)
+				sandbox_ahci_exec(port, slot);
+		}
+		break;
+	}
+}
+
+static int sandbox_ahci_offset(const volatile void *addr)
+{
+	long offset = (const volatile u8 *)addr - (u8 *)sa.mmio;
+
+	if (offset < 0 || offset >= SANDBOX_AHCI_MMIO_SZ || (offset & 3)) {
+		printf("sandbox_ahci: bad register access at %p\n", addr);
+		return -1;
+	}
+
+	return offset;
+}
+
+u32 sandbox_ahci_readl(const volatile void *addr)
+{
+	int offset = sandbox_ahci_offset(addr);
+
+	if (offset < 0)
+		return 0;
+	sandbox_ahci_update();
+
+	return sa.mmio[offset / 4];
+}
+
+void sandbox_ahci_writel(u32 val, volatile void *addr)
+{
+	int offset = sandbox_ahci_offset(addr);
+
+	if (offset < 0)
+		return;
+	sandbox_ahci_update();
+
+	if (offset >= 0x100) {
+		sandbox_ahci_port_writel((offset - 0x100) / 0x80,
+					 (offset - 0x100) % 0x80, val);
+		return;
+	}
+
+	switch (offset) {
+	case HOST_CTL:
+		if (val & HOST_RESET)
+			sandbox_ahci_reset();
+		else
+			sa.mmio[HOST_CTL / 4] = val & (HOST_AHCI_EN |
+						       HOST_IRQ_EN);
+		break;
+	case HOST_IRQ_STAT:
+		sa.mmio[HOST_IRQ_STAT / 4] &= ~val;
+		break;
+	}
+}
+
+/* The disks come and go with the controller resets, so that is all */
+void scsi_init(void)
+{
+	int port;
+
+	for (port = 0; port < SANDBOX_AHCI_PORTS; port++)
+		sa.disks[port].fd = -1;
+	sandbox_ahci_reset();
+	ahci_init((ulong)sa.mmio);
+}
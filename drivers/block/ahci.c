@@ -15,17 +15,27 @@
 #include <asm/errno.h>
 #include <asm/io.h>
 #include <malloc.h>
+#include <part.h>
 #include <scsi.h>
 #include <libata.h>
 #include <linux/ctype.h>
 #include <ahci.h>
+#include <linux/compat.h>
 
 static int ata_io_flush(u8 port);
 
 struct ahci_probe_ent *probe_ent = NULL;
 u16 *ataid[AHCI_MAX_PORTS];
 
-#define writel_with_flush(a,b)	do { writel(a,b); readl(b); } while (0)
+#ifdef CONFIG_AHCI_SANDBOX
+#define ahci_readl(a)		sandbox_ahci_readl(a)
+#define ahci_writel(v, a)	sandbox_ahci_writel(v, a)
+#else
+#define ahci_readl(a)		readl(a)
+#define ahci_writel(v, a)	writel(v, a)
+#endif
+
+#define writel_with_flush(a,b)	do { ahci_writel(a,b); ahci_readl(b); } while (0)
 
 /*
  * Some controllers limit number of blocks they can read/write at once.
@@ -37,13 +47,22 @@ u16 *ataid[AHCI_MAX_PORTS];
 #define MAX_SATA_BLOCKS_READ_WRITE	0x80
 #endif
 
+/*
+ * Commands queued with NCQ are not waited for one at a time, so they can
+ * be larger: up to this many blocks, or as many as their PRD table takes.
+ * The controller's MAX_SATA_BLOCKS_READ_WRITE limit still applies.
+ */
+#ifndef AHCI_NCQ_MAX_BLOCKS
+#define AHCI_NCQ_MAX_BLOCKS		0x800
+#endif
+
 /* Maximum timeouts for each event */
 #define WAIT_MS_SPINUP	20000
 #define WAIT_MS_DATAIO	5000
 #define WAIT_MS_FLUSH	5000
 #define WAIT_MS_LINKUP	200
 
-static inline u32 ahci_port_base(u32 base, u32 port)
+static inline ulong ahci_port_base(ulong base, u32 port)
 {
 	return base + 0x100 + (port * 0x80);
 }
@@ -61,7 +80,7 @@ static void ahci_setup_port(struct ahci_ioports *port, unsigned long base,
 
 #define msleep(a) udelay(a * 1000)
 
-static void ahci_dcache_flush_range(unsigned begin, unsigned len)
+static void ahci_dcache_flush_range(ulong begin, unsigned len)
 {
 	const unsigned long start = begin;
 	const unsigned long end = start + len;
@@ -75,7 +94,7 @@ static void ahci_dcache_flush_range(unsigned begin, unsigned len)
  * controller is invalidated from dcache; next access comes from
  * physical RAM.
  */
-static void ahci_dcache_invalidate_range(unsigned begin, unsigned len)
+static void ahci_dcache_invalidate_range(ulong begin, unsigned len)
 {
 	const unsigned long start = begin;
 	const unsigned long end = start + len;
@@ -101,32 +120,35 @@ static int waiting_for_cmd_completed(volatile u8 *offset,
 	int i;
 	u32 status;
 
-	for (i = 0; ((status = readl(offset)) & sign) && i < timeout_msec; i++)
+	for (i = 0; ((status = ahci_readl(offset)) & sign) && i < timeout_msec; i++)
 		msleep(1);
 
 	return (i < timeout_msec) ? 0 : -1;
 }
 
-int __weak ahci_link_up(struct ahci_probe_ent *probe_ent, u8 port)
+/*
+ * Wait up to @timeout_msec for register @reg of each of the ports in the
+ * bitmap @ports to read @val under @mask, polling them all together.
+ * Returns the ports which timed out.
+ */
+static u32 ahci_wait_ports(struct ahci_probe_ent *probe_ent, u32 ports,
+			   int reg, u32 mask, u32 val, int timeout_msec)
 {
-	u32 tmp;
-	int j = 0;
-	u8 *port_mmio = (u8 *)probe_ent->port[port].port_mmio;
+	volatile u8 *port_mmio;
+	int i, j;
 
-	/*
-	 * Bring up SATA link.
-	 * SATA link bringup time is usually less than 1 ms; only very
-	 * rarely has it taken between 1-2 ms. Never seen it above 2 ms.
-	 */
-	while (j < WAIT_MS_LINKUP) {
-		tmp = readl(port_mmio + PORT_SCR_STAT);
-		tmp &= PORT_SCR_STAT_DET_MASK;
-		if (tmp == PORT_SCR_STAT_DET_PHYRDY)
-			return 0;
+	for (j = 0; ; j++) {
+		for (i = 0; i < probe_ent->n_ports; i++) {
+			if (!(ports & (1 << i)))
+				continue;
+			port_mmio = (volatile u8 *)probe_ent->port[i].port_mmio;
+			if ((ahci_readl(port_mmio + reg) & mask) == val)
+				ports &= ~(1 << i);
+		}
+		if (!ports || j >= timeout_msec)
+			return ports;
 		udelay(1000);
-		j++;
 	}
-	return 1;
 }
 
 #ifdef CONFIG_SUNXI_AHCI
@@ -146,18 +168,21 @@ static int ahci_host_init(struct ahci_probe_ent *probe_ent)
 #endif
 	volatile u8 *mmio = (volatile u8 *)probe_ent->mmio_base;
 	u32 tmp, cap_save, cmd;
-	int i, j, ret;
+	int i, j;
 	volatile u8 *port_mmio;
 	u32 port_map;
+	/* Bitmaps of ports */
+	u32 ports = 0, active = 0, down, spinning;
+	int spinup_ms[AHCI_MAX_PORTS];
 
 	debug("ahci_host_init: start\n");
 
-	cap_save = readl(mmio + HOST_CAP);
+	cap_save = ahci_readl(mmio + HOST_CAP);
 	cap_save &= ((1 << 28) | (1 << 17));
 	cap_save |= (1 << 27);  /* Staggered Spin-up. Not needed. */
 
 	/* global controller reset */
-	tmp = readl(mmio + HOST_CTL);
+	tmp = ahci_readl(mmio + HOST_CTL);
 	if ((tmp & HOST_RESET) == 0)
 		writel_with_flush(tmp | HOST_RESET, mmio + HOST_CTL);
 
@@ -167,7 +192,7 @@ static int ahci_host_init(struct ahci_probe_ent *probe_ent)
 	i = 1000;
 	do {
 		udelay(1000);
-		tmp = readl(mmio + HOST_CTL);
+		tmp = ahci_readl(mmio + HOST_CTL);
 		if (!i--) {
 			debug("controller reset failed (0x%x)\n", tmp);
 			return -1;
@@ -175,7 +200,7 @@ static int ahci_host_init(struct ahci_probe_ent *probe_ent)
 	} while (tmp & HOST_RESET);
 
 	writel_with_flush(HOST_AHCI_EN, mmio + HOST_CTL);
-	writel(cap_save, mmio + HOST_CAP);
+	ahci_writel(cap_save, mmio + HOST_CAP);
 	writel_with_flush(0xf, mmio + HOST_PORTS_IMPL);
 
 #ifndef CONFIG_SCSI_AHCI_PLAT
@@ -188,8 +213,8 @@ static int ahci_host_init(struct ahci_probe_ent *probe_ent)
 		pci_write_config_word(pdev, 0x92, tmp16);
 	}
 #endif
-	probe_ent->cap = readl(mmio + HOST_CAP);
-	probe_ent->port_map = readl(mmio + HOST_PORTS_IMPL);
+	probe_ent->cap = ahci_readl(mmio + HOST_CAP);
+	probe_ent->port_map = ahci_readl(mmio + HOST_PORTS_IMPL);
 	port_map = probe_ent->port_map;
 	probe_ent->n_ports = (probe_ent->cap & 0x1f) + 1;
 
@@ -202,24 +227,40 @@ static int ahci_host_init(struct ahci_probe_ent *probe_ent)
 	for (i = 0; i < probe_ent->n_ports; i++) {
 		if (!(port_map & (1 << i)))
 			continue;
-		probe_ent->port[i].port_mmio = ahci_port_base((u32) mmio, i);
+		probe_ent->port[i].port_mmio = ahci_port_base((ulong)mmio, i);
 		port_mmio = (u8 *) probe_ent->port[i].port_mmio;
 		ahci_setup_port(&probe_ent->port[i], (unsigned long)mmio, i);
+		ports |= 1 << i;
 
 		/* make sure port is not active */
-		tmp = readl(port_mmio + PORT_CMD);
+		tmp = ahci_readl(port_mmio + PORT_CMD);
 		if (tmp & (PORT_CMD_LIST_ON | PORT_CMD_FIS_ON |
 			   PORT_CMD_FIS_RX | PORT_CMD_START)) {
 			debug("Port %d is active. Deactivating.\n", i);
 			tmp &= ~(PORT_CMD_LIST_ON | PORT_CMD_FIS_ON |
 				 PORT_CMD_FIS_RX | PORT_CMD_START);
 			writel_with_flush(tmp, port_mmio + PORT_CMD);
-
-			/* spec says 500 msecs for each bit, so
-			 * this is slightly incorrect.
-			 */
-			msleep(500);
+			active |= 1 << i;
 		}
+	}
+
+	/*
+	 * From here on, each step is started on all the ports, then waited
+	 * for on all of them together, so that the time a link or a device
+	 * takes to come up, or an empty port takes to time out, is spent
+	 * once rather than for each port.
+	 *
+	 * spec says 500 msecs for each bit
+	 */
+	active = ahci_wait_ports(probe_ent, active, PORT_CMD,
+				 PORT_CMD_LIST_ON | PORT_CMD_FIS_ON, 0, 500);
+	if (active)
+		debug("Ports 0x%x did not stop\n", active);
+
+	for (i = 0; i < probe_ent->n_ports; i++) {
+		if (!(ports & (1 << i)))
+			continue;
+		port_mmio = (u8 *) probe_ent->port[i].port_mmio;
 
 #ifdef CONFIG_SUNXI_AHCI
 		sunxi_dma_init(port_mmio);
@@ -228,79 +269,124 @@ static int ahci_host_init(struct ahci_probe_ent *probe_ent)
 		/* Add the spinup command to whatever mode bits may
 		 * already be on in the command register.
 		 */
-		cmd = readl(port_mmio + PORT_CMD);
+		cmd = ahci_readl(port_mmio + PORT_CMD);
 		cmd |= PORT_CMD_FIS_RX;
 		cmd |= PORT_CMD_SPIN_UP;
 		writel_with_flush(cmd, port_mmio + PORT_CMD);
+	}
 
-		/* Bring up SATA link. */
-		ret = ahci_link_up(probe_ent, i);
-		if (ret) {
+	while (ports) {
+		/*
+		 * Bring up SATA links.
+		 * SATA link bringup time is usually less than 1 ms; only very
+		 * rarely has it taken between 1-2 ms. Never seen it above 2 ms.
+		 */
+		down = ahci_wait_ports(probe_ent, ports, PORT_SCR_STAT,
+				       PORT_SCR_STAT_DET_MASK,
+				       PORT_SCR_STAT_DET_PHYRDY, WAIT_MS_LINKUP);
+		for (i = 0; i < probe_ent->n_ports; i++) {
+			if (!(down & (1 << i)))
+				continue;
 			printf("SATA link %d timeout.\n", i);
-			continue;
-		} else {
-			debug("SATA link ok.\n");
 		}
+		ports &= ~down;
 
-		/* Clear error status */
-		tmp = readl(port_mmio + PORT_SCR_ERR);
-		if (tmp)
-			writel(tmp, port_mmio + PORT_SCR_ERR);
+		for (i = 0; i < probe_ent->n_ports; i++) {
+			if (!(ports & (1 << i)))
+				continue;
+			port_mmio = (u8 *) probe_ent->port[i].port_mmio;
+			debug("SATA link %d ok.\n", i);
 
-		debug("Spinning up device on SATA port %d... ", i);
+			/* Clear error status */
+			tmp = ahci_readl(port_mmio + PORT_SCR_ERR);
+			if (tmp)
+				ahci_writel(tmp, port_mmio + PORT_SCR_ERR);
 
-		j = 0;
-		while (j < WAIT_MS_SPINUP) {
-			tmp = readl(port_mmio + PORT_TFDATA);
-			if (!(tmp & (ATA_BUSY | ATA_DRQ)))
-				break;
-			udelay(1000);
-			tmp = readl(port_mmio + PORT_SCR_STAT);
-			tmp &= PORT_SCR_STAT_DET_MASK;
-			if (tmp == PORT_SCR_STAT_DET_PHYRDY)
-				break;
-			j++;
+			debug("Spinning up device on SATA port %d...\n", i);
 		}
 
-		tmp = readl(port_mmio + PORT_SCR_STAT) & PORT_SCR_STAT_DET_MASK;
-		if (tmp == PORT_SCR_STAT_DET_COMINIT) {
-			debug("SATA link %d down (COMINIT received), retrying...\n", i);
-			i--;
-			continue;
+		/*
+		 * A device has spun up once it is no longer busy, or has
+		 * its link up a millisecond on
+		 */
+		spinning = ports;
+		for (j = 0; spinning && j < WAIT_MS_SPINUP; j++) {
+			for (i = 0; i < probe_ent->n_ports; i++) {
+				if (!(spinning & (1 << i)))
+					continue;
+				port_mmio = (u8 *) probe_ent->port[i].port_mmio;
+				tmp = ahci_readl(port_mmio + PORT_TFDATA);
+				if (!(tmp & (ATA_BUSY | ATA_DRQ))) {
+					spinup_ms[i] = j;
+					spinning &= ~(1 << i);
+				}
+			}
+			udelay(1000);
+			for (i = 0; i < probe_ent->n_ports; i++) {
+				if (!(spinning & (1 << i)))
+					continue;
+				port_mmio = (u8 *) probe_ent->port[i].port_mmio;
+				tmp = ahci_readl(port_mmio + PORT_SCR_STAT);
+				tmp &= PORT_SCR_STAT_DET_MASK;
+				if (tmp == PORT_SCR_STAT_DET_PHYRDY) {
+					spinup_ms[i] = j;
+					spinning &= ~(1 << i);
+				}
+			}
 		}
 
-		printf("Target spinup took %d ms.\n", j);
-		if (j == WAIT_MS_SPINUP)
-			debug("timeout.\n");
-		else
-			debug("ok.\n");
+		for (i = 0; i < probe_ent->n_ports; i++) {
+			if (!(ports & (1 << i)))
+				continue;
+			port_mmio = (u8 *) probe_ent->port[i].port_mmio;
+
+			/* Try the ones which lost their links again */
+			tmp = ahci_readl(port_mmio + PORT_SCR_STAT) &
+			      PORT_SCR_STAT_DET_MASK;
+			if (tmp == PORT_SCR_STAT_DET_COMINIT) {
+				debug("SATA link %d down (COMINIT received), retrying...\n", i);
+				continue;
+			}
+			ports &= ~(1 << i);
+
+			if (spinning & (1 << i)) {
+				printf("Target spinup took %d ms.\n",
+				       WAIT_MS_SPINUP);
+				debug("timeout.\n");
+			} else {
+				printf("Target spinup took %d ms.\n",
+				       spinup_ms[i]);
+				debug("ok.\n");
+			}
 
-		tmp = readl(port_mmio + PORT_SCR_ERR);
-		debug("PORT_SCR_ERR 0x%x\n", tmp);
-		writel(tmp, port_mmio + PORT_SCR_ERR);
+			tmp = ahci_readl(port_mmio + PORT_SCR_ERR);
+			debug("PORT_SCR_ERR 0x%x\n", tmp);
+			ahci_writel(tmp, port_mmio + PORT_SCR_ERR);
 
-		/* ack any pending irq events for this port */
-		tmp = readl(port_mmio + PORT_IRQ_STAT);
-		debug("PORT_IRQ_STAT 0x%x\n", tmp);
-		if (tmp)
-			writel(tmp, port_mmio + PORT_IRQ_STAT);
+			/* ack any pending irq events for this port */
+			tmp = ahci_readl(port_mmio + PORT_IRQ_STAT);
+			debug("PORT_IRQ_STAT 0x%x\n", tmp);
+			if (tmp)
+				ahci_writel(tmp, port_mmio + PORT_IRQ_STAT);
 
-		writel(1 << i, mmio + HOST_IRQ_STAT);
+			ahci_writel(1 << i, mmio + HOST_IRQ_STAT);
 
-		/* set irq mask (enables interrupts) */
-		writel(DEF_PORT_IRQ, port_mmio + PORT_IRQ_MASK);
+			/* set irq mask (enables interrupts) */
+			ahci_writel(DEF_PORT_IRQ, port_mmio + PORT_IRQ_MASK);
 
-		/* register linkup ports */
-		tmp = readl(port_mmio + PORT_SCR_STAT);
-		debug("SATA port %d status: 0x%x\n", i, tmp);
-		if ((tmp & PORT_SCR_STAT_DET_MASK) == PORT_SCR_STAT_DET_PHYRDY)
-			probe_ent->link_port_map |= (0x01 << i);
+			/* register linkup ports */
+			tmp = ahci_readl(port_mmio + PORT_SCR_STAT);
+			debug("SATA port %d status: 0x%x\n", i, tmp);
+			if ((tmp & PORT_SCR_STAT_DET_MASK) ==
+			    PORT_SCR_STAT_DET_PHYRDY)
+				probe_ent->link_port_map |= (0x01 << i);
+		}
 	}
 
-	tmp = readl(mmio + HOST_CTL);
+	tmp = ahci_readl(mmio + HOST_CTL);
 	debug("HOST_CTL 0x%x\n", tmp);
-	writel(tmp | HOST_IRQ_EN, mmio + HOST_CTL);
-	tmp = readl(mmio + HOST_CTL);
+	ahci_writel(tmp | HOST_IRQ_EN, mmio + HOST_CTL);
+	tmp = ahci_readl(mmio + HOST_CTL);
 	debug("HOST_CTL 0x%x\n", tmp);
 #ifndef CONFIG_SCSI_AHCI_PLAT
 	pci_read_config_word(pdev, PCI_COMMAND, &tmp16);
@@ -322,9 +408,9 @@ static void ahci_print_info(struct ahci_probe_ent *probe_ent)
 	const char *speed_s;
 	const char *scc_s;
 
-	vers = readl(mmio + HOST_VERSION);
+	vers = ahci_readl(mmio + HOST_VERSION);
 	cap = probe_ent->cap;
-	cap2 = readl(mmio + HOST_CAP2);
+	cap2 = ahci_readl(mmio + HOST_CAP2);
 	impl = probe_ent->port_map;
 
 	speed = (cap >> 20) & 0xf;
@@ -388,6 +474,7 @@ static void ahci_print_info(struct ahci_probe_ent *probe_ent)
 static int ahci_init_one(pci_dev_t pdev)
 {
 	u16 vendor;
+	u32 bar;
 	int rc;
 
 	probe_ent = malloc(sizeof(struct ahci_probe_ent));
@@ -407,8 +494,9 @@ static int ahci_init_one(pci_dev_t pdev)
 	probe_ent->pio_mask = 0x1f;
 	probe_ent->udma_mask = 0x7f;	/*Fixme,assume to support UDMA6 */
 
-	pci_read_config_dword(pdev, PCI_BASE_ADDRESS_5, &probe_ent->mmio_base);
-	debug("ahci mmio_base=0x%08x\n", probe_ent->mmio_base);
+	pci_read_config_dword(pdev, PCI_BASE_ADDRESS_5, &bar);
+	probe_ent->mmio_base = bar;
+	debug("ahci mmio_base=0x%08lx\n", probe_ent->mmio_base);
 
 	/* Take from kernel:
 	 * JMicron-specific fixup:
@@ -434,6 +522,35 @@ static int ahci_init_one(pci_dev_t pdev)
 
 #define MAX_DATA_BYTE_COUNT  (4*1024*1024)
 
+/* The address at which the controller sees the memory at @ptr */
+static ulong ahci_dma_addr(void *ptr)
+{
+#ifdef CONFIG_AHCI_SANDBOX
+	/* Sandbox's controller model works on the pointers themselves */
+	return (ulong)ptr;
+#else
+	return virt_to_phys(ptr);
+#endif
+}
+
+/* The command table of command slot @tag, and its PRD table */
+static ulong ahci_cmd_tbl(struct ahci_ioports *pp, int tag)
+{
+	return pp->cmd_tbl + tag * AHCI_CMD_TBL_SZ;
+}
+
+static struct ahci_sg *ahci_cmd_tbl_sg(struct ahci_ioports *pp, int tag)
+{
+	return (struct ahci_sg *)(ahci_cmd_tbl(pp, tag) + AHCI_CMD_TBL_HDR);
+}
+
+static void ahci_set_sg(struct ahci_sg *ahci_sg, unsigned char *buf, int len)
+{
+	ahci_sg->addr = cpu_to_le32(lower_32_bits((ulong)buf));
+	ahci_sg->addr_hi = cpu_to_le32(upper_32_bits((ulong)buf));
+	ahci_sg->flags_size = cpu_to_le32(0x3fffff & (len - 1));
+}
+
 static int ahci_fill_sg(u8 port, unsigned char *buf, int buf_len)
 {
 	struct ahci_ioports *pp = &(probe_ent->port[port]);
@@ -448,13 +565,8 @@ static int ahci_fill_sg(u8 port, unsigned char *buf, int buf_len)
 	}
 
 	for (i = 0; i < sg_count; i++) {
-		ahci_sg->addr =
-		    cpu_to_le32((u32) buf + i * MAX_DATA_BYTE_COUNT);
-		ahci_sg->addr_hi = 0;
-		ahci_sg->flags_size = cpu_to_le32(0x3fffff &
-					  (buf_len < MAX_DATA_BYTE_COUNT
-					   ? (buf_len - 1)
-					   : (MAX_DATA_BYTE_COUNT - 1)));
+		ahci_set_sg(ahci_sg, buf + i * MAX_DATA_BYTE_COUNT,
+			    min(buf_len, MAX_DATA_BYTE_COUNT));
 		ahci_sg++;
 		buf_len -= MAX_DATA_BYTE_COUNT;
 	}
@@ -462,13 +574,64 @@ static int ahci_fill_sg(u8 port, unsigned char *buf, int buf_len)
 	return sg_count;
 }
 
+/*
+ * Fill the PRD table of command slot @tag from the fragments of a
+ * scatter-gather list, skip sectors into the first one, for up to *blocks
+ * sectors. *blocks is cut down to the sectors which fit in the table.
+ */
+static int ahci_fill_sg_list(u8 port, int tag, const struct blk_sg *sg,
+			     int nsg, lbaint_t skip, u16 *blocks)
+{
+	struct ahci_ioports *pp = &(probe_ent->port[port]);
+	struct ahci_sg *ahci_sg = ahci_cmd_tbl_sg(pp, tag);
+	int sg_count = 0;
+	u16 filled = 0;
+	unsigned char *buf;
+	lbaint_t n;
+	int len;
+
+	for (; nsg && filled < *blocks; sg++, nsg--, skip = 0) {
+		n = min(sg->blkcnt - skip, (lbaint_t)(*blocks - filled));
+		buf = sg->buf + skip * ATA_SECT_SIZE;
+		while (n && sg_count < AHCI_MAX_SG) {
+			len = min(n * ATA_SECT_SIZE, (lbaint_t)MAX_DATA_BYTE_COUNT);
+			ahci_set_sg(ahci_sg, buf, len);
+			ahci_sg++;
+			sg_count++;
+			buf += len;
+			n -= len / ATA_SECT_SIZE;
+			filled += len / ATA_SECT_SIZE;
+		}
+		if (n)
+			break;
+	}
+	*blocks = filled;
+
+	return sg_count;
+}
+
+/* Move a position in a scatter-gather list on by @blocks sectors */
+static void ahci_sg_advance(const struct blk_sg **sg, int *nsg,
+			    lbaint_t *skip, lbaint_t blocks)
+{
+	*skip += blocks;
+	while (*nsg && *skip >= (*sg)->blkcnt) {
+		*skip -= (*sg)->blkcnt;
+		(*sg)++;
+		(*nsg)--;
+	}
+}
 
-static void ahci_fill_cmd_slot(struct ahci_ioports *pp, u32 opts)
+static void ahci_fill_cmd_slot(struct ahci_ioports *pp, int tag, u32 opts)
 {
-	pp->cmd_slot->opts = cpu_to_le32(opts);
-	pp->cmd_slot->status = 0;
-	pp->cmd_slot->tbl_addr = cpu_to_le32(pp->cmd_tbl & 0xffffffff);
-	pp->cmd_slot->tbl_addr_hi = 0;
+	struct ahci_cmd_hdr *cmd_hdr = pp->cmd_slot + tag;
+	ulong tbl = ahci_cmd_tbl(pp, tag);
+
+	cmd_hdr->opts = cpu_to_le32(opts);
+	cmd_hdr->status = 0;
+	tbl = ahci_dma_addr((void *)tbl);
+	cmd_hdr->tbl_addr = cpu_to_le32(lower_32_bits(tbl));
+	cmd_hdr->tbl_addr_hi = cpu_to_le32(upper_32_bits(tbl));
 }
 
 
@@ -489,10 +652,10 @@ static void ahci_set_feature(u8 port)
 	fis[12] = __ilog2(probe_ent->udma_mask + 1) + 0x40 - 0x01;
 
 	memcpy((unsigned char *)pp->cmd_tbl, fis, sizeof(fis));
-	ahci_fill_cmd_slot(pp, cmd_fis_len);
+	ahci_fill_cmd_slot(pp, 0, cmd_fis_len);
 	ahci_dcache_flush_sata_cmd(pp);
-	writel(1, port_mmio + PORT_CMD_ISSUE);
-	readl(port_mmio + PORT_CMD_ISSUE);
+	ahci_writel(1, port_mmio + PORT_CMD_ISSUE);
+	ahci_readl(port_mmio + PORT_CMD_ISSUE);
 
 	if (waiting_for_cmd_completed(port_mmio + PORT_CMD_ISSUE,
 				WAIT_MS_DATAIO, 0x1)) {
@@ -507,55 +670,60 @@ static int ahci_port_start(u8 port)
 	struct ahci_ioports *pp = &(probe_ent->port[port]);
 	volatile u8 *port_mmio = (volatile u8 *)pp->port_mmio;
 	u32 port_status;
-	u32 mem;
+	ulong mem;
 
 	debug("Enter start port: %d\n", port);
-	port_status = readl(port_mmio + PORT_SCR_STAT);
+	port_status = ahci_readl(port_mmio + PORT_SCR_STAT);
 	debug("Port %d status: %x\n", port, port_status);
 	if ((port_status & 0xf) != 0x03) {
 		printf("No Link on this port!\n");
 		return -1;
 	}
 
-	mem = (u32) malloc(AHCI_PORT_PRIV_DMA_SZ + 2048);
+	/* A port started again keeps the memory it had */
+	mem = (ulong)pp->cmd_slot;
 	if (!mem) {
-		free(pp);
-		printf("%s: No mem for table!\n", __func__);
-		return -ENOMEM;
+		mem = (ulong)malloc(AHCI_PORT_PRIV_DMA_SZ + 2048);
+		if (!mem) {
+			printf("%s: No mem for table!\n", __func__);
+			return -ENOMEM;
+		}
+		mem = (mem + 0x800) & (~0x7ff);	/* Aligned to 2048-bytes */
 	}
-
-	mem = (mem + 0x800) & (~0x7ff);	/* Aligned to 2048-bytes */
 	memset((u8 *) mem, 0, AHCI_PORT_PRIV_DMA_SZ);
+	pp->ncq_depth = 0;
 
 	/*
 	 * First item in chunk of DMA memory: 32-slot command table,
 	 * 32 bytes each in size
 	 */
-	pp->cmd_slot =
-		(struct ahci_cmd_hdr *)(uintptr_t)virt_to_phys((void *)mem);
-	debug("cmd_slot = 0x%x\n", (unsigned)pp->cmd_slot);
-	mem += (AHCI_CMD_SLOT_SZ + 224);
+	pp->cmd_slot = (struct ahci_cmd_hdr *)mem;
+	debug("cmd_slot = %p\n", pp->cmd_slot);
+	mem += AHCI_CMD_SLOT_SZ * AHCI_MAX_CMD_SLOT;
 
 	/*
 	 * Second item: Received-FIS area
 	 */
-	pp->rx_fis = virt_to_phys((void *)mem);
+	pp->rx_fis = mem;
 	mem += AHCI_RX_FIS_SZ;
 
 	/*
-	 * Third item: data area for storing a single command
-	 * and its scatter-gather table
+	 * Third item: data area for storing the commands of the slots
+	 * used, AHCI_CMD_TBLS of them, and their scatter-gather tables
 	 */
-	pp->cmd_tbl = virt_to_phys((void *)mem);
-	debug("cmd_tbl_dma = 0x%x\n", pp->cmd_tbl);
+	pp->cmd_tbl = mem;
+	debug("cmd_tbl_dma = 0x%lx\n", pp->cmd_tbl);
 
 	mem += AHCI_CMD_TBL_HDR;
-	pp->cmd_tbl_sg =
-			(struct ahci_sg *)(uintptr_t)virt_to_phys((void *)mem);
+	pp->cmd_tbl_sg = (struct ahci_sg *)mem;
 
-	writel_with_flush((u32) pp->cmd_slot, port_mmio + PORT_LST_ADDR);
+	mem = ahci_dma_addr(pp->cmd_slot);
+	ahci_writel(upper_32_bits(mem), port_mmio + PORT_LST_ADDR_HI);
+	writel_with_flush(lower_32_bits(mem), port_mmio + PORT_LST_ADDR);
 
-	writel_with_flush(pp->rx_fis, port_mmio + PORT_FIS_ADDR);
+	mem = ahci_dma_addr((void *)pp->rx_fis);
+	ahci_writel(upper_32_bits(mem), port_mmio + PORT_FIS_ADDR_HI);
+	writel_with_flush(lower_32_bits(mem), port_mmio + PORT_FIS_ADDR);
 
 #ifdef CONFIG_SUNXI_AHCI
 	sunxi_dma_init(port_mmio);
@@ -571,37 +739,67 @@ static int ahci_port_start(u8 port)
 }
 
 
-static int ahci_device_data_io(u8 port, u8 *fis, int fis_len, u8 *buf,
-				int buf_len, u8 is_write)
+static int ahci_port_ready(u8 port)
 {
-
-	struct ahci_ioports *pp = &(probe_ent->port[port]);
-	volatile u8 *port_mmio = (volatile u8 *)pp->port_mmio;
-	u32 opts;
+	volatile u8 *port_mmio;
 	u32 port_status;
-	int sg_count;
-
-	debug("Enter %s: for port %d\n", __func__, port);
 
 	if (port > probe_ent->n_ports) {
 		printf("Invalid port number %d\n", port);
-		return -1;
+		return 0;
 	}
 
-	port_status = readl(port_mmio + PORT_SCR_STAT);
+	port_mmio = (volatile u8 *)probe_ent->port[port].port_mmio;
+	port_status = ahci_readl(port_mmio + PORT_SCR_STAT);
 	if ((port_status & 0xf) != 0x03) {
 		debug("No Link on port %d!\n", port);
-		return -1;
+		return 0;
 	}
 
+	return 1;
+}
+
+/*
+ * Flush (before a command) or invalidate (after it) the data of the PRDs
+ * of command slot @tag
+ */
+static void ahci_dcache_sg(struct ahci_ioports *pp, int tag, int sg_count,
+			   int flush)
+{
+	struct ahci_sg *ahci_sg = ahci_cmd_tbl_sg(pp, tag);
+	unsigned len;
+	ulong addr;
+	int i;
+
+	for (i = 0; i < sg_count; i++, ahci_sg++) {
+		addr = le32_to_cpu(ahci_sg->addr) |
+		       (u64)le32_to_cpu(ahci_sg->addr_hi) << 32;
+		len = (le32_to_cpu(ahci_sg->flags_size) & 0x3fffff) + 1;
+		if (flush)
+			ahci_dcache_flush_range(addr, len);
+		else
+			ahci_dcache_invalidate_range(addr, len);
+	}
+}
+
+/* Run a command whose PRD table is filled in, and wait for it */
+static int ahci_issue_data_io(u8 port, u8 *fis, int fis_len, int sg_count,
+			      u8 is_write)
+{
+	struct ahci_ioports *pp = &(probe_ent->port[port]);
+	volatile u8 *port_mmio = (volatile u8 *)pp->port_mmio;
+	u32 opts;
+
+	if (sg_count < 0)
+		return -1;
+
 	memcpy((unsigned char *)pp->cmd_tbl, fis, fis_len);
 
-	sg_count = ahci_fill_sg(port, buf, buf_len);
 	opts = (fis_len >> 2) | (sg_count << 16) | (is_write << 6);
-	ahci_fill_cmd_slot(pp, opts);
+	ahci_fill_cmd_slot(pp, 0, opts);
 
 	ahci_dcache_flush_sata_cmd(pp);
-	ahci_dcache_flush_range((unsigned)buf, (unsigned)buf_len);
+	ahci_dcache_sg(pp, 0, sg_count, 1);
 
 	writel_with_flush(1, port_mmio + PORT_CMD_ISSUE);
 
@@ -611,12 +809,169 @@ static int ahci_device_data_io(u8 port, u8 *fis, int fis_len, u8 *buf,
 		return -1;
 	}
 
-	ahci_dcache_invalidate_range((unsigned)buf, (unsigned)buf_len);
+	ahci_dcache_sg(pp, 0, sg_count, 0);
 	debug("%s: %d byte transferred.\n", __func__, pp->cmd_slot->status);
 
 	return 0;
 }
 
+static int ahci_device_data_io(u8 port, u8 *fis, int fis_len, u8 *buf,
+				int buf_len, u8 is_write)
+{
+	debug("Enter %s: for port %d\n", __func__, port);
+
+	if (!ahci_port_ready(port))
+		return -1;
+
+	return ahci_issue_data_io(port, fis, fis_len,
+				  ahci_fill_sg(port, buf, buf_len), is_write);
+}
+
+/*
+ * As ahci_device_data_io(), for the data of up to *blocks sectors in a
+ * scatter-gather list, skip sectors into its first fragment. *blocks is
+ * cut down to the sectors the command could take.
+ */
+static int ahci_device_sg_io(u8 port, u8 *fis, int fis_len,
+			     const struct blk_sg *sg, int nsg, lbaint_t skip,
+			     u16 *blocks, u8 is_write)
+{
+	int sg_count;
+
+	debug("Enter %s: for port %d\n", __func__, port);
+
+	if (!ahci_port_ready(port))
+		return -1;
+
+	sg_count = ahci_fill_sg_list(port, 0, sg, nsg, skip, blocks);
+	if (!*blocks)
+		return -1;
+	/* The sector count of the FIS follows */
+	fis[12] = *blocks & 0xff;
+	fis[13] = *blocks >> 8;
+
+	return ahci_issue_data_io(port, fis, fis_len, sg_count, is_write);
+}
+
+#ifdef CONFIG_AHCI_NCQ
+/* Stop and restart the command list, dropping the commands in it */
+static void ahci_port_restart(u8 port)
+{
+	volatile u8 *port_mmio = (volatile u8 *)probe_ent->port[port].port_mmio;
+	u32 cmd;
+
+	cmd = ahci_readl(port_mmio + PORT_CMD);
+	ahci_writel(cmd & ~PORT_CMD_START, port_mmio + PORT_CMD);
+	if (waiting_for_cmd_completed(port_mmio + PORT_CMD, 500,
+				      PORT_CMD_LIST_ON))
+		debug("%s: port %d does not stop\n", __func__, port);
+
+	ahci_writel(ahci_readl(port_mmio + PORT_SCR_ERR),
+		    port_mmio + PORT_SCR_ERR);
+	ahci_writel(ahci_readl(port_mmio + PORT_IRQ_STAT),
+		    port_mmio + PORT_IRQ_STAT);
+	writel_with_flush(cmd | PORT_CMD_START, port_mmio + PORT_CMD);
+}
+
+/*
+ * Read @blocks sectors from @lba into a scatter-gather list, skip sectors
+ * into its first fragment, with READ FPDMA QUEUED. The command slots are
+ * kept busy: each gets the next command, of up to AHCI_NCQ_MAX_BLOCKS
+ * sectors, as soon as the drive reports the one before done.
+ */
+static int ahci_ncq_read(u8 port, u32 lba, u32 blocks,
+			 const struct blk_sg *sg, int nsg, lbaint_t skip)
+{
+	struct ahci_ioports *pp = &(probe_ent->port[port]);
+	volatile u8 *port_mmio = (volatile u8 *)pp->port_mmio;
+	int sg_count[AHCI_CMD_TBLS];
+	u32 queued = 0, done, irq;
+	ulong start;
+	u8 fis[20];
+	u16 n;
+	int tag;
+
+	debug("Enter %s: %u blocks from lba 0x%x on port %d\n", __func__,
+	      blocks, lba, port);
+
+	ahci_writel(ahci_readl(port_mmio + PORT_IRQ_STAT),
+		    port_mmio + PORT_IRQ_STAT);
+
+	while (blocks || queued) {
+		for (tag = 0; blocks && tag < pp->ncq_depth; tag++) {
+			if (queued & (1 << tag))
+				continue;
+
+			n = min(blocks, (u32)min(AHCI_NCQ_MAX_BLOCKS,
+						 MAX_SATA_BLOCKS_READ_WRITE));
+			sg_count[tag] = ahci_fill_sg_list(port, tag, sg, nsg,
+							  skip, &n);
+			if (!n)
+				goto err;
+
+			memset(fis, 0, sizeof(fis));
+			fis[0] = 0x27;		/* Host to device FIS. */
+			fis[1] = 1 << 7;	/* Command FIS. */
+			fis[2] = ATA_CMD_FPDMA_READ;
+			fis[3] = n & 0xff;	/* Block count, in the features */
+			fis[4] = (lba >> 0) & 0xff;
+			fis[5] = (lba >> 8) & 0xff;
+			fis[6] = (lba >> 16) & 0xff;
+			fis[7] = 1 << 6;	/* device reg: set LBA mode */
+			fis[8] = (lba >> 24) & 0xff;
+			fis[11] = n >> 8;
+			fis[12] = tag << 3;	/* The tag, in the count */
+
+			memcpy((unsigned char *)ahci_cmd_tbl(pp, tag), fis,
+			       sizeof(fis));
+			ahci_fill_cmd_slot(pp, tag, (sizeof(fis) >> 2) |
+					   (sg_count[tag] << 16));
+			ahci_dcache_flush_range((ulong)pp->cmd_slot,
+					AHCI_CMD_SLOT_SZ * AHCI_MAX_CMD_SLOT);
+			ahci_dcache_flush_range(ahci_cmd_tbl(pp, tag),
+						AHCI_CMD_TBL_SZ);
+			ahci_dcache_sg(pp, tag, sg_count[tag], 1);
+
+			ahci_writel(1 << tag, port_mmio + PORT_SCR_ACT);
+			writel_with_flush(1 << tag, port_mmio + PORT_CMD_ISSUE);
+			queued |= 1 << tag;
+
+			lba += n;
+			blocks -= n;
+			ahci_sg_advance(&sg, &nsg, &skip, n);
+		}
+
+		/* Wait for the drive to finish any of them */
+		start = get_timer(0);
+		do {
+			irq = ahci_readl(port_mmio + PORT_IRQ_STAT);
+			if (irq & (PORT_IRQ_FATAL)) {
+				printf("NCQ error on port %d: 0x%x\n", port,
+				       irq);
+				goto err;
+			}
+			if (get_timer(start) > WAIT_MS_DATAIO) {
+				printf("timeout exit!\n");
+				goto err;
+			}
+			done = queued & ~ahci_readl(port_mmio + PORT_SCR_ACT);
+		} while (!done);
+
+		for (tag = 0; tag < pp->ncq_depth; tag++) {
+			if (done & (1 << tag))
+				ahci_dcache_sg(pp, tag, sg_count[tag], 0);
+		}
+		queued &= ~done;
+	}
+
+	return 0;
+
+err:
+	ahci_port_restart(port);
+	return -EIO;
+}
+#endif
+
 
 static char *ata_id_strcpy(u16 *target, u16 *src, int len)
 {
@@ -683,6 +1038,18 @@ static int ata_scsiop_inquiry(ccb *pccb)
 	ata_id_strcpy((u16 *)&pccb->pdata[16], &idbuf[ATA_ID_PROD], 16);
 	ata_id_strcpy((u16 *)&pccb->pdata[32], &idbuf[ATA_ID_FW_REV], 4);
 
+#ifdef CONFIG_AHCI_NCQ
+	/* Reads are queued if both the controller and the drive can */
+	probe_ent->port[port].ncq_depth = 0;
+	if ((probe_ent->cap & HOST_CAP_NCQ) && ata_id_has_ncq(idbuf))
+		probe_ent->port[port].ncq_depth =
+			min3(ata_id_queue_depth(idbuf),
+			     (int)((probe_ent->cap >> 8) & 0x1f) + 1,
+			     AHCI_CMD_TBLS);
+	debug("scsi_ahci: port %d queues %d commands\n", port,
+	      probe_ent->port[port].ncq_depth);
+#endif
+
 #ifdef DEBUG
 	ata_dump_id(idbuf);
 #endif
@@ -700,6 +1067,9 @@ static int ata_scsiop_read_write(ccb *pccb, u8 is_write)
 	u8 fis[20];
 	u8 *user_buffer = pccb->pdata;
 	u32 user_buffer_size = pccb->datalen;
+	const struct blk_sg *sg = pccb->sg;
+	int nsg = pccb->sg_count;
+	lbaint_t skip = pccb->sg_skip;
 
 	/* Retrieve the base LBA number from the ccb structure. */
 	memcpy(&lba, pccb->cmd + 2, sizeof(lba));
@@ -727,6 +1097,31 @@ static int ata_scsiop_read_write(ccb *pccb, u8 is_write)
 	/* Command byte (read/write). */
 	fis[2] = is_write ? ATA_CMD_WRITE_EXT : ATA_CMD_READ_EXT;
 
+#ifdef CONFIG_AHCI_NCQ
+	if (!is_write && blocks && probe_ent->port[pccb->target].ncq_depth) {
+		struct blk_sg one = { user_buffer, blocks };
+
+		if (!sg) {
+			if (ATA_SECT_SIZE * blocks > user_buffer_size) {
+				printf("scsi_ahci: Error: buffer too small.\n");
+				return -EIO;
+			}
+			sg = &one;
+			nsg = 1;
+		}
+		if (!ahci_port_ready(pccb->target))
+			return -EIO;
+		if (!ahci_ncq_read(pccb->target, lba, blocks, sg, nsg, skip))
+			return 0;
+
+		/* Try again one command at a time */
+		printf("scsi_ahci: NCQ read failed, queueing turned off\n");
+		probe_ent->port[pccb->target].ncq_depth = 0;
+		if (sg == &one)
+			sg = NULL;
+	}
+#endif
+
 	while (blocks) {
 		u16 now_blocks; /* number of blocks per iteration */
 		u32 transfer_size; /* number of bytes per iteration */
@@ -754,9 +1149,20 @@ static int ata_scsiop_read_write(ccb *pccb, u8 is_write)
 		fis[13] = (now_blocks >> 8) & 0xff;
 
 		/* Read/Write from ahci */
-		if (ahci_device_data_io(pccb->target, (u8 *) &fis, sizeof(fis),
-					user_buffer, user_buffer_size,
-					is_write)) {
+		if (sg) {
+			/* The PRD table may take fewer blocks than asked */
+			if (ahci_device_sg_io(pccb->target, fis, sizeof(fis),
+					      sg, nsg, skip, &now_blocks,
+					      is_write)) {
+				debug("scsi_ahci: SCSI %s10 command failure.\n",
+				      is_write ? "WRITE" : "READ");
+				return -EIO;
+			}
+			transfer_size = ATA_SECT_SIZE * now_blocks;
+			ahci_sg_advance(&sg, &nsg, &skip, now_blocks);
+		} else if (ahci_device_data_io(pccb->target, (u8 *) &fis,
+					       sizeof(fis), user_buffer,
+					       user_buffer_size, is_write)) {
 			debug("scsi_ahci: SCSI %s10 command failure.\n",
 			      is_write ? "WRITE" : "READ");
 			return -EIO;
@@ -884,15 +1290,12 @@ int scsi_exec(ccb *pccb)
 }
 
 
-void scsi_low_level_init(int busdevfunc)
+/* Start the ports whose links are up */
+static void ahci_start_ports(void)
 {
 	int i;
 	u32 linkmap;
 
-#ifndef CONFIG_SCSI_AHCI_PLAT
-	ahci_init_one(busdevfunc);
-#endif
-
 	linkmap = probe_ent->link_port_map;
 
 	for (i = 0; i < CONFIG_SYS_SCSI_MAX_SCSI_ID; i++) {
@@ -908,11 +1311,19 @@ void scsi_low_level_init(int busdevfunc)
 	}
 }
 
+void scsi_low_level_init(int busdevfunc)
+{
+#ifndef CONFIG_SCSI_AHCI_PLAT
+	ahci_init_one(busdevfunc);
+#endif
+
+	ahci_start_ports();
+}
+
 #ifdef CONFIG_SCSI_AHCI_PLAT
-int ahci_init(u32 base)
+int ahci_init(ulong base)
 {
-	int i, rc = 0;
-	u32 linkmap;
+	int rc = 0;
 
 	probe_ent = malloc(sizeof(struct ahci_probe_ent));
 	if (!probe_ent) {
@@ -939,19 +1350,7 @@ int ahci_init(u32 base)
 
 	ahci_print_info(probe_ent);
 
-	linkmap = probe_ent->link_port_map;
-
-	for (i = 0; i < CONFIG_SYS_SCSI_MAX_SCSI_ID; i++) {
-		if (((linkmap >> i) & 0x01)) {
-			if (ahci_port_start((u8) i)) {
-				printf("Can not start port %d\n", i);
-				continue;
-			}
-#ifdef CONFIG_AHCI_SETFEATURES_XFER
-			ahci_set_feature((u8) i);
-#endif
-		}
-	}
+	ahci_start_ports();
 err_out:
 	return rc;
 }
@@ -985,7 +1384,7 @@ static int ata_io_flush(u8 port)
 	fis[2] = ATA_CMD_FLUSH_EXT;
 
 	memcpy((unsigned char *)pp->cmd_tbl, fis, 20);
-	ahci_fill_cmd_slot(pp, cmd_fis_len);
+	ahci_fill_cmd_slot(pp, 0, cmd_fis_len);
 	writel_with_flush(1, port_mmio + PORT_CMD_ISSUE);
 
 	if (waiting_for_cmd_completed(port_mmio + PORT_CMD_ISSUE,
@@ -1000,7 +1399,13 @@ static int ata_io_flush(u8 port)
 
 void scsi_bus_reset(void)
 {
-	/*Not implement*/
+	if (!probe_ent)
+		return;
+
+	/* Reset the controller, and bring the links up again */
+	probe_ent->link_port_map = 0;
+	if (!ahci_host_init(probe_ent))
+		ahci_start_ports();
 }
 
 
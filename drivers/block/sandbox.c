@@ -22,6 +22,16 @@ static struct host_block_dev *find_host_device(int dev)
 	return NULL;
 }
 
+/* Take as long as media at sandbox_host_speed KiB/s would */
+static void host_block_delay(struct host_block_dev *host_dev, lbaint_t blkcnt)
+{
+	ulong speed = getenv_ulong("sandbox_host_speed", 10, 0);
+
+	if (speed)
+		os_usleep((u64)blkcnt * host_dev->blk_dev.blksz * 1000000 /
+			  (speed * 1024));
+}
+
 static unsigned long host_block_read(int dev, unsigned long start,
 				     lbaint_t blkcnt, void *buffer)
 {
@@ -29,6 +39,7 @@ static unsigned long host_block_read(int dev, unsigned long start,
 
 	if (!host_dev)
 		return -1;
+	host_block_delay(host_dev, blkcnt);
 	if (os_lseek(host_dev->fd,
 		     start * host_dev->blk_dev.blksz,
 		     OS_SEEK_SET) == -1) {
@@ -46,6 +57,9 @@ static unsigned long host_block_write(int dev, unsigned long start,
 				      lbaint_t blkcnt, const void *buffer)
 {
 	struct host_block_dev *host_dev = find_host_device(dev);
+
+	host_block_delay(host_dev, blkcnt);
+
 	if (os_lseek(host_dev->fd,
 		     start * host_dev->blk_dev.blksz,
 		     OS_SEEK_SET) == -1) {
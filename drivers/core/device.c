@@ -170,7 +170,7 @@ int device_unbind(struct udevice *dev)
 	if (!dev)
 		return -EINVAL;
 
-	if (dev->flags & DM_FLAG_ACTIVATED)
+	if (dev->flags & (DM_FLAG_ACTIVATED | DM_FLAG_PROBING))
 		return -EINVAL;
 
 	drv = dev->driver;
@@ -227,7 +227,108 @@ static void device_free(struct udevice *dev)
 	}
 }
 
-int device_probe(struct udevice *dev)
+static int device_do_probe(struct udevice *dev, bool wait);
+
+/* Find the device bound to a device tree node, at or below @parent */
+static struct udevice *device_find_by_of_offset(struct udevice *parent,
+						int of_offset)
+{
+	struct udevice *dev, *found;
+
+	if (parent->of_offset == of_offset)
+		return parent;
+	list_for_each_entry(dev, &parent->child_head, sibling_node) {
+		found = device_find_by_of_offset(dev, of_offset);
+		if (found)
+			return found;
+	}
+
+	return NULL;
+}
+
+/**
+ * device_dep_cells() - Find how a property refers to other devices
+ *
+ * Properties such as 'clocks', 'xxx-gpios' and 'xxx-supply' hold phandles
+ * of the devices that this one needs, each followed by the number of
+ * argument cells that the node it refers to gives in its '#xxx-cells'.
+ *
+ * @name:	Property name
+ * @return name of the '#xxx-cells' property, "" if each phandle has no
+ * arguments, or NULL if the property does not refer to devices
+ */
+static const char *device_dep_cells(const char *name)
+{
+	int len = strlen(name);
+
+	if (!strcmp(name, "clocks"))
+		return "#clock-cells";
+	if (!strcmp(name, "gpios") ||
+	    (len > 6 && !strcmp(name + len - 6, "-gpios")))
+		return "#gpio-cells";
+	if (len > 7 && !strcmp(name + len - 7, "-supply"))
+		return "";
+
+	return NULL;
+}
+
+/**
+ * device_probe_deps() - Probe the devices that a device needs
+ *
+ * These are its parent, and the devices its device tree node refers to.
+ *
+ * @dev:	Device whose dependencies are to be probed
+ * @wait:	true to wait for devices which are still getting ready
+ * @return 0 if OK, -EAGAIN if @wait is false and a device is not ready
+ * yet, -ELOOP if one of them needs @dev, other -ve on error
+ */
+static int device_probe_deps(struct udevice *dev, bool wait)
+{
+	const void *blob = gd->fdt_blob;
+	const struct fdt_property *prop;
+	const char *name, *cells;
+	struct udevice *dep;
+	const fdt32_t *cell;
+	int offset, node, len, ret;
+
+	if (dev->parent) {
+		ret = device_do_probe(dev->parent, wait);
+		if (ret)
+			return ret;
+	}
+	if (!blob || dev->of_offset < 0)
+		return 0;
+
+	for (offset = fdt_first_property_offset(blob, dev->of_offset);
+	     offset > 0;
+	     offset = fdt_next_property_offset(blob, offset)) {
+		prop = fdt_get_property_by_offset(blob, offset, &len);
+		name = fdt_string(blob, fdt32_to_cpu(prop->nameoff));
+		cells = device_dep_cells(name);
+		if (!cells)
+			continue;
+		for (cell = (const fdt32_t *)prop->data;
+		     len >= sizeof(*cell);
+		     cell += 1 + ret, len -= (1 + ret) * sizeof(*cell)) {
+			node = fdtdec_node_offset_by_phandle(blob,
+							fdt32_to_cpu(*cell));
+			if (node < 0)
+				break;
+			ret = *cells ? fdtdec_get_int(blob, node, cells, 2) : 0;
+			dep = device_find_by_of_offset(gd->dm_root, node);
+			if (!dep || dep == dev)
+				continue;
+			dm_dbg("Device '%s' needs '%s'\n", dev->name, dep->name);
+			node = device_do_probe(dep, wait);
+			if (node)
+				return node;
+		}
+	}
+
+	return 0;
+}
+
+static int device_do_probe(struct udevice *dev, bool wait)
 {
 	struct driver *drv;
 	int size = 0;
@@ -243,6 +344,25 @@ int device_probe(struct udevice *dev)
 	drv = dev->driver;
 	assert(drv);
 
+	/* Set up the device, unless its probe method is still going */
+	if (dev->flags & DM_FLAG_PROBING)
+		goto probe;
+
+	/*
+	 * Ensure all parents, and other devices it needs, are probed. If
+	 * one of those needs this device in turn, there is no order that
+	 * works.
+	 */
+	if (dev->flags & DM_FLAG_PROBING_DEPS) {
+		dm_warn("Device '%s' depends on itself\n", dev->name);
+		return -ELOOP;
+	}
+	dev->flags |= DM_FLAG_PROBING_DEPS;
+	ret = device_probe_deps(dev, wait);
+	dev->flags &= ~DM_FLAG_PROBING_DEPS;
+	if (ret)
+		return ret;
+
 	/* Allocate private data and platdata if requested */
 	if (drv->priv_auto_alloc_size) {
 		dev->priv = calloc(1, drv->priv_auto_alloc_size);
@@ -268,7 +388,6 @@ int device_probe(struct udevice *dev)
 		}
 	}
 
-	/* Ensure all parents are probed */
 	if (dev->parent) {
 		size = dev->parent->driver->per_child_auto_alloc_size;
 		if (size) {
@@ -278,10 +397,6 @@ int device_probe(struct udevice *dev)
 				goto fail;
 			}
 		}
-
-		ret = device_probe(dev->parent);
-		if (ret)
-			goto fail;
 	}
 
 	seq = uclass_resolve_seq(dev);
@@ -289,7 +404,9 @@ int device_probe(struct udevice *dev)
 		ret = seq;
 		goto fail;
 	}
-	dev->seq = seq;
+	ret = uclass_set_seq(dev, seq);
+	if (ret)
+		goto fail;
 
 	if (dev->parent && dev->parent->driver->child_pre_probe) {
 		ret = dev->parent->driver->child_pre_probe(dev);
@@ -303,8 +420,17 @@ int device_probe(struct udevice *dev)
 			goto fail;
 	}
 
+probe:
 	if (drv->probe) {
-		ret = drv->probe(dev);
+		/* -EAGAIN means the hardware is not ready yet: try again */
+		do {
+			ret = drv->probe(dev);
+		} while (ret == -EAGAIN && wait);
+		if (ret == -EAGAIN) {
+			dev->flags |= DM_FLAG_PROBING;
+			return ret;
+		}
+		dev->flags &= ~DM_FLAG_PROBING;
 		if (ret)
 			goto fail;
 	}
@@ -324,12 +450,22 @@ fail_uclass:
 			__func__, dev->name);
 	}
 fail:
-	dev->seq = -1;
+	uclass_set_seq(dev, -1);
 	device_free(dev);
 
 	return ret;
 }
 
+int device_probe(struct udevice *dev)
+{
+	return device_do_probe(dev, true);
+}
+
+int device_try_probe(struct udevice *dev)
+{
+	return device_do_probe(dev, false);
+}
+
 int device_remove(struct udevice *dev)
 {
 	struct driver *drv;
@@ -338,6 +474,14 @@ int device_remove(struct udevice *dev)
 	if (!dev)
 		return -EINVAL;
 
+	/* A device which was getting ready only needs its memory back */
+	if (dev->flags & DM_FLAG_PROBING) {
+		dev->flags &= ~DM_FLAG_PROBING;
+		uclass_set_seq(dev, -1);
+		device_free(dev);
+		return 0;
+	}
+
 	if (!(dev->flags & DM_FLAG_ACTIVATED))
 		return 0;
 
@@ -368,7 +512,7 @@ int device_remove(struct udevice *dev)
 
 	device_free(dev);
 
-	dev->seq = -1;
+	uclass_set_seq(dev, -1);
 	dev->flags &= ~DM_FLAG_ACTIVATED;
 
 	return ret;
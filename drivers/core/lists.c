@@ -9,6 +9,7 @@
 
 #include <common.h>
 #include <errno.h>
+#include <malloc.h>
 #include <dm/device.h>
 #include <dm/device-internal.h>
 #include <dm/lists.h>
@@ -18,6 +19,8 @@
 #include <fdtdec.h>
 #include <linux/compiler.h>
 
+DECLARE_GLOBAL_DATA_PTR;
+
 struct driver *lists_driver_lookup_name(const char *name)
 {
 	struct driver *drv =
@@ -118,10 +121,149 @@ static int driver_check_compatible(const void *blob, int offset,
 	return -ENOENT;
 }
 
-int lists_bind_fdt(struct udevice *parent, const void *blob, int offset)
+/*
+ * The compatible strings of all the drivers, hashed, so that a node's
+ * driver is found without checking each driver in turn. It is built on
+ * first use after relocation, as it holds relocated pointers; before
+ * that the drivers are searched one by one.
+ */
+struct compat_entry {
+	const char *compatible;
+	struct driver *driver;
+};
+
+static struct compat_entry *compat_table;
+static int compat_table_mask;
+static bool compat_table_failed;
+
+static unsigned int compat_hash(const char *str)
+{
+	unsigned int hval = 0;
+
+	while (*str)
+		hval = hval * 31 + *str++;
+
+	return hval;
+}
+
+static int compat_table_build(void)
+{
+	struct driver *driver = ll_entry_start(struct driver, driver);
+	const int n_ents = ll_entry_count(struct driver, driver);
+	const struct udevice_id *of_match;
+	struct driver *entry;
+	int count = 0;
+	int size;
+	int i;
+
+	for (entry = driver; entry != driver + n_ents; entry++) {
+		for (of_match = entry->of_match; of_match &&
+		     of_match->compatible; of_match++)
+			count++;
+	}
+
+	/* At most half full, so that the probe chains stay short */
+	for (size = 16; size < count * 2; size <<= 1)
+		;
+	compat_table = calloc(size, sizeof(*compat_table));
+	if (!compat_table)
+		return -ENOMEM;
+	compat_table_mask = size - 1;
+
+	for (entry = driver; entry != driver + n_ents; entry++) {
+		for (of_match = entry->of_match; of_match &&
+		     of_match->compatible; of_match++) {
+			i = compat_hash(of_match->compatible) &
+				compat_table_mask;
+			while (compat_table[i].compatible)
+				i = (i + 1) & compat_table_mask;
+			compat_table[i].compatible = of_match->compatible;
+			compat_table[i].driver = entry;
+		}
+	}
+
+	return 0;
+}
+
+/* Find the first driver, in linker list order, with this compatible */
+static struct driver *compat_table_lookup(const char *compatible)
+{
+	struct driver *found = NULL;
+	int i;
+
+	i = compat_hash(compatible) & compat_table_mask;
+	for (; compat_table[i].compatible; i = (i + 1) & compat_table_mask) {
+		if (strcmp(compat_table[i].compatible, compatible))
+			continue;
+		if (!found || compat_table[i].driver < found)
+			found = compat_table[i].driver;
+	}
+
+	return found;
+}
+
+/**
+ * driver_lookup_compatible() - Find the driver for a node
+ *
+ * This gives the same driver as checking each driver in turn with
+ * driver_check_compatible() would: the first one, in linker list order,
+ * which is compatible with any of the node's compatible strings.
+ *
+ * @param blob:		Device tree pointer
+ * @param offset:	Offset of node in device tree
+ * @param drvp:		Returns the driver found
+ * @return 0 if found, -ENOENT if no match, -ENODEV if the node does not
+ * have a compatible string, other error <0 if there is a device tree error
+ */
+static int driver_lookup_compatible(const void *blob, int offset,
+				    struct driver **drvp)
 {
 	struct driver *driver = ll_entry_start(struct driver, driver);
 	const int n_ents = ll_entry_count(struct driver, driver);
+	struct driver *entry, *found = NULL;
+	const char *compat;
+	int len, ret;
+
+	if ((gd->flags & GD_FLG_RELOC) && !compat_table &&
+	    !compat_table_failed) {
+		if (compat_table_build())
+			compat_table_failed = true;
+	}
+
+	if (!(gd->flags & GD_FLG_RELOC) || !compat_table) {
+		for (entry = driver; entry != driver + n_ents; entry++) {
+			ret = driver_check_compatible(blob, offset,
+						      entry->of_match);
+			if (ret == -ENOENT)
+				continue;
+			if (!ret)
+				*drvp = entry;
+			return ret;
+		}
+
+		return -ENOENT;
+	}
+
+	compat = fdt_getprop(blob, offset, "compatible", &len);
+	if (!compat)
+		return len == -FDT_ERR_NOTFOUND ? -ENODEV : -EINVAL;
+	while (len > 0) {
+		entry = compat_table_lookup(compat);
+		if (entry && (!found || entry < found))
+			found = entry;
+		ret = strnlen(compat, len) + 1;
+		compat += ret;
+		len -= ret;
+	}
+	if (!found)
+		return -ENOENT;
+	*drvp = found;
+
+	return 0;
+}
+
+int lists_bind_fdt(struct udevice *parent, const void *blob, int offset)
+{
 	struct driver *entry;
 	struct udevice *dev;
 	bool found = false;
@@ -130,31 +272,22 @@ int lists_bind_fdt(struct udevice *parent, const void *blob, int offset)
 	int ret = 0;
 
 	dm_dbg("bind node %s\n", fdt_get_name(blob, offset, NULL));
-	for (entry = driver; entry != driver + n_ents; entry++) {
-		ret = driver_check_compatible(blob, offset, entry->of_match);
-		name = fdt_get_name(blob, offset, NULL);
-		if (ret == -ENOENT) {
-			continue;
-		} else if (ret == -ENODEV) {
-			dm_dbg("Device '%s' has no compatible string\n", name);
-			break;
-		} else if (ret) {
-			dm_warn("Device tree error at offset %d\n", offset);
-			if (!result || ret != -ENOENT)
-				result = ret;
-			break;
-		}
-
+	ret = driver_lookup_compatible(blob, offset, &entry);
+	name = fdt_get_name(blob, offset, NULL);
+	if (ret == -ENODEV) {
+		dm_dbg("Device '%s' has no compatible string\n", name);
+	} else if (ret && ret != -ENOENT) {
+		dm_warn("Device tree error at offset %d\n", offset);
+		result = ret;
+	} else if (!ret) {
 		dm_dbg("   - found match at '%s'\n", entry->name);
 		ret = device_bind(parent, entry, name, NULL, offset, &dev);
 		if (ret) {
 			dm_warn("Error binding driver '%s'\n", entry->name);
-			if (!result || ret != -ENOENT)
-				result = ret;
+			result = ret;
 		} else {
 			found = true;
 		}
-		break;
 	}
 
 	if (!found && !result && ret != -ENODEV) {
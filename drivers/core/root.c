@@ -45,6 +45,8 @@ int dm_init(void)
 		return -EINVAL;
 	}
 	INIT_LIST_HEAD(&DM_UCLASS_ROOT_NON_CONST);
+	memset(DM_UCLASS_TABLE_NON_CONST, '\0',
+	       sizeof(DM_UCLASS_TABLE_NON_CONST));
 
 	ret = device_bind_by_name(NULL, false, &root_info, &DM_ROOT_NON_CONST);
 	if (ret)
@@ -113,6 +115,79 @@ __weak int dm_scan_other(bool pre_reloc_only)
 	return 0;
 }
 
+/* Devices still getting ready, for dm_probe_all() */
+struct dm_probe_list {
+	struct udevice **dev;
+	int count;
+	int size;
+};
+
+static int dm_probe_add(struct dm_probe_list *list, struct udevice *dev)
+{
+	struct udevice **new;
+
+	if (list->count == list->size) {
+		new = realloc(list->dev, (list->size + 16) * sizeof(*new));
+		if (!new)
+			return -ENOMEM;
+		list->dev = new;
+		list->size += 16;
+	}
+	list->dev[list->count++] = dev;
+
+	return 0;
+}
+
+/* Start probing a device and those below it */
+static int dm_probe_tree(struct dm_probe_list *list, struct udevice *dev)
+{
+	struct udevice *child;
+	int ret, err;
+
+	err = device_try_probe(dev);
+	if (err == -EAGAIN) {
+		err = dm_probe_add(list, dev);
+		/* Without space to note it, wait for it now */
+		if (err)
+			err = device_probe(dev);
+	}
+
+	list_for_each_entry(child, &dev->child_head, sibling_node) {
+		ret = dm_probe_tree(list, child);
+		if (ret && !err)
+			err = ret;
+	}
+
+	return err;
+}
+
+int dm_probe_all(void)
+{
+	struct dm_probe_list list = { NULL };
+	int ret, err;
+	int i, n;
+
+	err = dm_probe_tree(&list, dm_root());
+
+	/* Go round the devices which are getting ready, until all are */
+	while (list.count) {
+		for (i = 0, n = 0; i < list.count; i++) {
+			ret = device_try_probe(list.dev[i]);
+			if (ret == -EAGAIN)
+				list.dev[n++] = list.dev[i];
+			else if (ret && !err)
+				err = ret;
+		}
+		list.count = n;
+	}
+	free(list.dev);
+
+	if (err)
+		dm_warn("Some devices failed to probe\n");
+
+	return err;
+}
+
 int dm_init_and_scan(bool pre_reloc_only)
 {
 	int ret;
@@ -21,21 +21,12 @@ DECLARE_GLOBAL_DATA_PTR;
 
 struct uclass *uclass_find(enum uclass_id key)
 {
-	struct uclass *uc;
-
 	if (!gd->dm_root)
 		return NULL;
-	/*
-	 * TODO(sjg@chromium.org): Optimise this, perhaps moving the found
-	 * node to the start of the list, or creating a linear array mapping
-	 * id to node.
-	 */
-	list_for_each_entry(uc, &gd->uclass_root, sibling_node) {
-		if (uc->uc_drv->id == key)
-			return uc;
-	}
+	if (key < 0 || key >= UCLASS_COUNT)
+		return NULL;
 
-	return NULL;
+	return gd->uclass_table[key];
 }
 
 /**
@@ -78,6 +69,7 @@ static int uclass_add(enum uclass_id id, struct uclass **ucp)
 	INIT_LIST_HEAD(&uc->sibling_node);
 	INIT_LIST_HEAD(&uc->dev_head);
 	list_add(&uc->sibling_node, &DM_UCLASS_ROOT_NON_CONST);
+	DM_UCLASS_TABLE_NON_CONST[id] = uc;
 
 	if (uc_drv->init) {
 		ret = uc_drv->init(uc);
@@ -94,6 +86,7 @@ fail:
 		uc->priv = NULL;
 	}
 	list_del(&uc->sibling_node);
+	DM_UCLASS_TABLE_NON_CONST[id] = NULL;
 fail_mem:
 	free(uc);
 
@@ -119,8 +112,10 @@ int uclass_destroy(struct uclass *uc)
 	if (uc_drv->destroy)
 		uc_drv->destroy(uc);
 	list_del(&uc->sibling_node);
+	DM_UCLASS_TABLE_NON_CONST[uc_drv->id] = NULL;
 	if (uc_drv->priv_auto_alloc_size)
 		free(uc->priv);
+	free(uc->seq_dev);
 	free(uc);
 
 	return 0;
@@ -175,6 +170,15 @@ int uclass_find_device_by_seq(enum uclass_id id, int seq_or_req_seq,
 	if (ret)
 		return ret;
 
+	/* Sequence numbers in use are indexed, so there is no need to look */
+	if (!find_req_seq && seq_or_req_seq >= 0 &&
+	    seq_or_req_seq < DM_MAX_SEQ) {
+		if (seq_or_req_seq < uc->seq_count)
+			*devp = uc->seq_dev[seq_or_req_seq];
+		debug("   - %s\n", *devp ? "found" : "not found");
+		return *devp ? 0 : -ENODEV;
+	}
+
 	list_for_each_entry(dev, &uc->dev_head, uclass_node) {
 		debug("   - %d %d\n", dev->req_seq, dev->seq);
 		if ((find_req_seq ? dev->req_seq : dev->seq) ==
@@ -384,6 +388,34 @@ int uclass_resolve_seq(struct udevice *dev)
 	return seq;
 }
 
+int uclass_set_seq(struct udevice *dev, int seq)
+{
+	struct uclass *uc = dev->uclass;
+	struct udevice **seq_dev;
+	int count;
+
+	if (seq >= 0 && seq < DM_MAX_SEQ && seq >= uc->seq_count) {
+		count = max(seq + 1, uc->seq_count * 2);
+		count = min(max(count, 8), DM_MAX_SEQ);
+		seq_dev = realloc(uc->seq_dev, count * sizeof(*seq_dev));
+		if (!seq_dev)
+			return -ENOMEM;
+		memset(seq_dev + uc->seq_count, '\0',
+		       (count - uc->seq_count) * sizeof(*seq_dev));
+		uc->seq_dev = seq_dev;
+		uc->seq_count = count;
+	}
+
+	if (dev->seq >= 0 && dev->seq < uc->seq_count &&
+	    uc->seq_dev[dev->seq] == dev)
+		uc->seq_dev[dev->seq] = NULL;
+	dev->seq = seq;
+	if (seq >= 0 && seq < uc->seq_count)
+		uc->seq_dev[seq] = dev;
+
+	return 0;
+}
+
 int uclass_post_probe_device(struct udevice *dev)
 {
 	struct uclass_driver *uc_drv = dev->uclass->uc_drv;
@@ -411,7 +443,7 @@ int uclass_pre_remove_device(struct udevice *dev)
 		free(dev->uclass_priv);
 		dev->uclass_priv = NULL;
 	}
-	dev->seq = -1;
+	uclass_set_seq(dev, -1);
 
 	return 0;
 }
@@ -70,6 +70,15 @@ int dfu_init_env_entities(char *interface, int dev)
 static unsigned char *dfu_buf;
 static unsigned long dfu_buf_size = CONFIG_SYS_DFU_DATA_BUF_SIZE;
 
+/*
+ * With overlapped writes the buffer is used as two halves: while one is
+ * filled from USB, dfu_write_poll() writes the other to the medium a
+ * slice at a time, from the loop that waits for the host.
+ */
+static bool dfu_overlap;
+static unsigned long dfu_slice_size = CONFIG_SYS_DFU_WRITE_SLICE_SIZE;
+static struct dfu_entity *dfu_draining;
+
 unsigned char *dfu_free_buf(void)
 {
 	free(dfu_buf);
@@ -101,6 +110,16 @@ unsigned char *dfu_get_buf(void)
 	return dfu_buf;
 }
 
+void dfu_set_write_overlap(bool enable)
+{
+	char *s;
+
+	dfu_overlap = enable;
+	s = getenv("dfu_slicesiz");
+	dfu_slice_size = s ? (unsigned long)simple_strtol(s, NULL, 16) :
+			CONFIG_SYS_DFU_WRITE_SLICE_SIZE;
+}
+
 static char *dfu_get_hash_algo(void)
 {
 	char *s;
@@ -128,10 +147,6 @@ static int dfu_write_buffer_drain(struct dfu_entity *dfu)
 	if (w_size == 0)
 		return 0;
 
-	if (dfu_hash_algo)
-		dfu_hash_algo->hash_update(dfu_hash_algo, &dfu->crc,
-					   dfu->i_buf_start, w_size, 0);
-
 	ret = dfu->write_medium(dfu, dfu->offset, dfu->i_buf_start, &w_size);
 	if (ret)
 		debug("%s: Write error!\n", __func__);
@@ -147,11 +162,93 @@ static int dfu_write_buffer_drain(struct dfu_entity *dfu)
 	return ret;
 }
 
+/* Write the next slice of the half buffer handed over by dfu_write() */
+static int dfu_write_slice(struct dfu_entity *dfu)
+{
+	long w_size = dfu->d_left;
+	int ret;
+
+	if (dfu->write_slices && dfu_slice_size && w_size > dfu_slice_size)
+		w_size = dfu_slice_size;
+
+	ret = dfu->write_medium(dfu, dfu->offset, dfu->d_buf, &w_size);
+	if (ret) {
+		debug("%s: Write error!\n", __func__);
+		dfu->d_left = 0;
+		return ret;
+	}
+
+	/* the medium may round the last slice up to its block size */
+	dfu->offset += w_size;
+	dfu->d_buf += w_size;
+	dfu->d_left = max(dfu->d_left - w_size, 0L);
+	if (!dfu->d_left)
+		puts("#");
+
+	return 0;
+}
+
+/* Finish writing the half buffer, returning what went wrong with it */
+static int dfu_write_finish(struct dfu_entity *dfu)
+{
+	int ret = dfu->d_ret;
+
+	while (!ret && dfu->d_left)
+		ret = dfu_write_slice(dfu);
+
+	dfu->d_buf = NULL;
+	dfu->d_left = 0;
+	dfu->d_ret = 0;
+	dfu_draining = NULL;
+
+	return ret;
+}
+
+/* Hand the filled half over to dfu_write_poll() and fill the other one */
+static int dfu_write_buffer_switch(struct dfu_entity *dfu)
+{
+	long half = dfu->i_buf_end - dfu->i_buf_start;
+	int ret;
+
+	/* A medium slower than USB holds the host back here */
+	ret = dfu_write_finish(dfu);
+	if (ret)
+		return ret;
+
+	if (dfu->i_buf == dfu->i_buf_start)
+		return 0;
+
+	dfu->d_buf = dfu->i_buf_start;
+	dfu->d_left = dfu->i_buf - dfu->i_buf_start;
+	dfu_draining = dfu;
+
+	dfu->i_buf_start = dfu->i_buf_start == dfu_buf ? dfu_buf + half :
+			dfu_buf;
+	dfu->i_buf_end = dfu->i_buf_start + half;
+	dfu->i_buf = dfu->i_buf_start;
+
+	return 0;
+}
+
+int dfu_write_poll(void)
+{
+	struct dfu_entity *dfu = dfu_draining;
+
+	if (!dfu || !dfu->d_left || dfu->d_ret)
+		return 0;
+
+	dfu->d_ret = dfu_write_slice(dfu);
+
+	return 1;
+}
+
 int dfu_flush(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 {
 	int ret = 0;
 
-	ret = dfu_write_buffer_drain(dfu);
+	ret = dfu_write_finish(dfu);
+	if (!ret)
+		ret = dfu_write_buffer_drain(dfu);
 	if (ret)
 		return ret;
 
@@ -175,6 +272,45 @@ int dfu_flush(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 	return ret;
 }
 
+static int dfu_write_init(struct dfu_entity *dfu)
+{
+	/* initial state */
+	dfu->crc = 0;
+	dfu->offset = 0;
+	dfu->bad_skip = 0;
+	dfu->i_blk_seq_num = 0;
+	dfu->i_buf_start = dfu_get_buf();
+	if (dfu->i_buf_start == NULL)
+		return -ENOMEM;
+	dfu->i_buf_end = dfu_get_buf() + dfu_buf_size;
+	if (dfu_overlap)
+		dfu->i_buf_end = dfu->i_buf_start + dfu_buf_size / 2;
+	dfu->i_buf = dfu->i_buf_start;
+	dfu->d_buf = NULL;
+	dfu->d_left = 0;
+	dfu->d_ret = 0;
+	dfu_draining = NULL;
+
+	dfu->inited = 1;
+
+	return 0;
+}
+
+/*
+ * Where dfu_write() would copy its next data to, and how much fits there
+ * before the buffer gets written: data received straight into it is not
+ * copied again.
+ */
+void *dfu_get_write_buf(struct dfu_entity *dfu, long *room)
+{
+	if (!dfu->inited && dfu_write_init(dfu))
+		return NULL;
+
+	*room = dfu->i_buf_end - dfu->i_buf;
+
+	return dfu->i_buf;
+}
+
 int dfu_write(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 {
 	int ret = 0;
@@ -182,21 +318,12 @@ int dfu_write(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 
 	debug("%s: name: %s buf: 0x%p size: 0x%x p_num: 0x%x offset: 0x%llx bufoffset: 0x%x\n",
 	      __func__, dfu->name, buf, size, blk_seq_num, dfu->offset,
-	      dfu->i_buf - dfu->i_buf_start);
+	      (unsigned int)(dfu->i_buf - dfu->i_buf_start));
 
 	if (!dfu->inited) {
-		/* initial state */
-		dfu->crc = 0;
-		dfu->offset = 0;
-		dfu->bad_skip = 0;
-		dfu->i_blk_seq_num = 0;
-		dfu->i_buf_start = dfu_get_buf();
-		if (dfu->i_buf_start == NULL)
-			return -ENOMEM;
-		dfu->i_buf_end = dfu_get_buf() + dfu_buf_size;
-		dfu->i_buf = dfu->i_buf_start;
-
-		dfu->inited = 1;
+		ret = dfu_write_init(dfu);
+		if (ret)
+			return ret;
 	}
 
 	if (dfu->i_blk_seq_num != blk_seq_num) {
@@ -223,7 +350,8 @@ int dfu_write(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 
 	/* flush buffer if overflow */
 	if ((dfu->i_buf + size) > dfu->i_buf_end) {
-		tret = dfu_write_buffer_drain(dfu);
+		tret = dfu_overlap ? dfu_write_buffer_switch(dfu) :
+			dfu_write_buffer_drain(dfu);
 		if (ret == 0)
 			ret = tret;
 	}
@@ -235,12 +363,20 @@ int dfu_write(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 		return -1;
 	}
 
-	memcpy(dfu->i_buf, buf, size);
+	/* data received in place, see dfu_get_write_buf(), needs no copy */
+	if (buf != dfu->i_buf)
+		memcpy(dfu->i_buf, buf, size);
 	dfu->i_buf += size;
 
+	/* the hash goes along with the data, not with the writes */
+	if (dfu_hash_algo)
+		dfu_hash_algo->hash_update(dfu_hash_algo, &dfu->crc,
+					   buf, size, 0);
+
 	/* if end or if buffer full flush */
 	if (size == 0 || (dfu->i_buf + size) > dfu->i_buf_end) {
-		tret = dfu_write_buffer_drain(dfu);
+		tret = dfu_overlap ? dfu_write_buffer_switch(dfu) :
+			dfu_write_buffer_drain(dfu);
 		if (ret == 0)
 			ret = tret;
 	}
@@ -392,6 +528,9 @@ static int dfu_fill_entity(struct dfu_entity *dfu, char *s, int alt,
 	} else if (strcmp(interface, "ram") == 0) {
 		if (dfu_fill_entity_ram(dfu, s))
 			return -1;
+	} else if (strcmp(interface, "host") == 0) {
+		if (dfu_fill_entity_host(dfu, s))
+			return -1;
 	} else {
 		printf("%s: Device %s not (yet) supported!\n",
 		       __func__,  interface);
@@ -414,6 +553,8 @@ void dfu_free_entities(void)
 	INIT_LIST_HEAD(&dfu_list);
 
 	alt_num_cnt = 0;
+	dfu_draining = NULL;
+	dfu_overlap = false;
 }
 
 int dfu_config_entities(char *env, char *interface, int num)
@@ -452,7 +593,8 @@ int dfu_config_entities(char *env, char *interface, int num)
 
 const char *dfu_get_dev_type(enum dfu_device_type t)
 {
-	const char *dev_t[] = {NULL, "eMMC", "OneNAND", "NAND", "RAM" };
+	const char *dev_t[] = {NULL, "eMMC", "OneNAND", "NAND", "RAM",
+				 "Host" };
 	return dev_t[t];
 }
 
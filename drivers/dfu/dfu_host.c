@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * DFU to the block devices sandbox backs with host files
+ *
+ * Reference: dfu_mmc.c
+ * Copyright (C) 2012 Samsung Electronics
+ * author: Lukasz Majewski <l.majewski@samsung.com>
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <errno.h>
+#include <div64.h>
+#include <dfu.h>
+#include <part.h>
+
+static int host_block_op(enum dfu_op op, struct dfu_entity *dfu,
+			 u64 offset, void *buf, long *len)
+{
+	block_dev_desc_t *dev_desc = get_dev("host", dfu->dev_num);
+	u32 blk_start, blk_count, n;
+
+	if (!dev_desc || dev_desc->type == DEV_TYPE_UNKNOWN) {
+		error("host device %d not bound\n", dfu->dev_num);
+		return -ENODEV;
+	}
+
+	*len = ALIGN(*len, dev_desc->blksz);
+	blk_start = dfu->data.host.lba_start +
+			(u32)lldiv(offset, dev_desc->blksz);
+	blk_count = *len / dev_desc->blksz;
+	if (blk_start + blk_count >
+			dfu->data.host.lba_start + dfu->data.host.lba_size) {
+		puts("Request would exceed designated area!\n");
+		return -EINVAL;
+	}
+
+	if (op == DFU_OP_READ)
+		n = dev_desc->block_read(dfu->dev_num, blk_start, blk_count,
+					 buf);
+	else
+		n = dev_desc->block_write(dfu->dev_num, blk_start, blk_count,
+					  buf);
+	if (n != blk_count) {
+		error("host operation failed");
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static int dfu_write_medium_host(struct dfu_entity *dfu, u64 offset,
+				 void *buf, long *len)
+{
+	return host_block_op(DFU_OP_WRITE, dfu, offset, buf, len);
+}
+
+static int dfu_read_medium_host(struct dfu_entity *dfu, u64 offset,
+				void *buf, long *len)
+{
+	block_dev_desc_t *dev_desc;
+
+	if (!*len) {
+		dev_desc = get_dev("host", dfu->dev_num);
+		if (!dev_desc)
+			return -ENODEV;
+		*len = dfu->data.host.lba_size * dev_desc->blksz;
+		return 0;
+	}
+
+	return host_block_op(DFU_OP_READ, dfu, offset, buf, len);
+}
+
+/*
+ * @param s Parameter string containing space-separated arguments:
+ *	1st:
+ *		raw	(raw read/write)
+ *	2nd and 3rd:
+ *		lba_start and lba_size
+ */
+int dfu_fill_entity_host(struct dfu_entity *dfu, char *s)
+{
+	char *st;
+
+	st = strsep(&s, " ");
+	if (!st || strcmp(st, "raw") || !s) {
+		error("Memory layout (%s) not supported!\n", st);
+		return -ENODEV;
+	}
+
+	dfu->layout = DFU_RAW_ADDR;
+	dfu->data.host.lba_start = simple_strtoul(s, &s, 0);
+	s++;
+	dfu->data.host.lba_size = simple_strtoul(s, &s, 0);
+
+	dfu->dev_type = DFU_DEV_HOST;
+	dfu->read_medium = dfu_read_medium_host;
+	dfu->write_medium = dfu_write_medium_host;
+	dfu->write_slices = 1;
+	dfu->inited = 0;
+
+	return 0;
+}
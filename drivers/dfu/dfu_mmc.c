@@ -319,6 +319,7 @@ int dfu_fill_entity_mmc(struct dfu_entity *dfu, char *s)
 	dfu->read_medium = dfu_read_medium_mmc;
 	dfu->write_medium = dfu_write_medium_mmc;
 	dfu->flush_medium = dfu_flush_medium_mmc;
+	dfu->write_slices = dfu->layout == DFU_RAW_ADDR;
 	dfu->inited = 0;
 
 	return 0;
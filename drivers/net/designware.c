@@ -87,6 +87,56 @@ static int dw_mdio_init(char *name, struct eth_mac_regs *mac_regs_p)
 	return mdio_register(bus);
 }
 
+static u32 dw_descr_num(const char *var, u32 def)
+{
+	ulong num = getenv_ulong(var, 10, def);
+
+	if (num < 2 || num > CONFIG_DESCR_NUM_MAX) {
+		printf("%s: %lu out of range, using %u\n", var, num, def);
+		num = def;
+	}
+
+	return num;
+}
+
+/*
+ * (Re)allocate the descriptor rings and their buffers if the requested
+ * ring sizes differ from the ones currently in use.
+ */
+static int dw_alloc_rings(struct dw_eth_dev *priv)
+{
+	u32 tx_num = dw_descr_num("dw_tx_descs", CONFIG_TX_DESCR_NUM);
+	u32 rx_num = dw_descr_num("dw_rx_descs", CONFIG_RX_DESCR_NUM);
+
+	if (tx_num != priv->tx_descr_num) {
+		free(priv->tx_mac_descrtable);
+		free(priv->txbuffs);
+		priv->tx_descr_num = 0;
+		priv->tx_mac_descrtable = memalign(ARCH_DMA_MINALIGN,
+				tx_num * sizeof(struct dmamacdescr));
+		priv->txbuffs = memalign(ARCH_DMA_MINALIGN,
+					 tx_num * CONFIG_ETH_BUFSIZE);
+		if (!priv->tx_mac_descrtable || !priv->txbuffs)
+			return -ENOMEM;
+		priv->tx_descr_num = tx_num;
+	}
+
+	if (rx_num != priv->rx_descr_num) {
+		free(priv->rx_mac_descrtable);
+		free(priv->rxbuffs);
+		priv->rx_descr_num = 0;
+		priv->rx_mac_descrtable = memalign(ARCH_DMA_MINALIGN,
+				rx_num * sizeof(struct dmamacdescr));
+		priv->rxbuffs = memalign(ARCH_DMA_MINALIGN,
+					 rx_num * CONFIG_ETH_BUFSIZE);
+		if (!priv->rx_mac_descrtable || !priv->rxbuffs)
+			return -ENOMEM;
+		priv->rx_descr_num = rx_num;
+	}
+
+	return 0;
+}
+
 static void tx_descs_init(struct eth_device *dev)
 {
 	struct dw_eth_dev *priv = dev->priv;
@@ -96,7 +146,7 @@ static void tx_descs_init(struct eth_device *dev)
 	struct dmamacdescr *desc_p;
 	u32 idx;
 
-	for (idx = 0; idx < CONFIG_TX_DESCR_NUM; idx++) {
+	for (idx = 0; idx < priv->tx_descr_num; idx++) {
 		desc_p = &desc_table_p[idx];
 		desc_p->dmamac_addr = &txbuffs[idx * CONFIG_ETH_BUFSIZE];
 		desc_p->dmamac_next = &desc_table_p[idx + 1];
@@ -117,12 +167,12 @@ static void tx_descs_init(struct eth_device *dev)
 	}
 
 	/* Correcting the last pointer of the chain */
-	desc_p->dmamac_next = &desc_table_p[0];
+	desc_table_p[priv->tx_descr_num - 1].dmamac_next = &desc_table_p[0];
 
 	/* Flush all Tx buffer descriptors at once */
 	flush_dcache_range((unsigned int)priv->tx_mac_descrtable,
 			   (unsigned int)priv->tx_mac_descrtable +
-			   sizeof(priv->tx_mac_descrtable));
+			   priv->tx_descr_num * sizeof(struct dmamacdescr));
 
 	writel((ulong)&desc_table_p[0], &dma_p->txdesclistaddr);
 	priv->tx_currdescnum = 0;
@@ -137,16 +187,16 @@ static void rx_descs_init(struct eth_device *dev)
 	struct dmamacdescr *desc_p;
 	u32 idx;
 
-	/* Before passing buffers to GMAC we need to make sure zeros
-	 * written there right after "priv" structure allocation were
-	 * flushed into RAM.
+	/* Before passing buffers to GMAC we need to make sure anything
+	 * written there since the buffers were allocated was flushed
+	 * into RAM.
 	 * Otherwise there's a chance to get some of them flushed in RAM when
 	 * GMAC is already pushing data to RAM via DMA. This way incoming from
 	 * GMAC data will be corrupted. */
 	flush_dcache_range((unsigned int)rxbuffs, (unsigned int)rxbuffs +
-			   RX_TOTAL_BUFSIZE);
+			   priv->rx_descr_num * CONFIG_ETH_BUFSIZE);
 
-	for (idx = 0; idx < CONFIG_RX_DESCR_NUM; idx++) {
+	for (idx = 0; idx < priv->rx_descr_num; idx++) {
 		desc_p = &desc_table_p[idx];
 		desc_p->dmamac_addr = &rxbuffs[idx * CONFIG_ETH_BUFSIZE];
 		desc_p->dmamac_next = &desc_table_p[idx + 1];
@@ -159,12 +209,12 @@ static void rx_descs_init(struct eth_device *dev)
 	}
 
 	/* Correcting the last pointer of the chain */
-	desc_p->dmamac_next = &desc_table_p[0];
+	desc_table_p[priv->rx_descr_num - 1].dmamac_next = &desc_table_p[0];
 
 	/* Flush all Rx buffer descriptors at once */
 	flush_dcache_range((unsigned int)priv->rx_mac_descrtable,
 			   (unsigned int)priv->rx_mac_descrtable +
-			   sizeof(priv->rx_mac_descrtable));
+			   priv->rx_descr_num * sizeof(struct dmamacdescr));
 
 	writel((ulong)&desc_table_p[0], &dma_p->rxdesclistaddr);
 	priv->rx_currdescnum = 0;
@@ -192,6 +242,10 @@ static void dw_adjust_link(struct eth_mac_regs *mac_p,
 {
 	u32 conf = readl(&mac_p->conf) | FRAMEBURSTENABLE | DISABLERXOWN;
 
+#ifdef CONFIG_DW_CHECKSUM_OFFLOAD
+	conf |= CHECKSUMOFFLOAD;
+#endif
+
 	if (!phydev->link) {
 		printf("%s: No link.\n", phydev->dev->name);
 		return;
@@ -246,6 +300,11 @@ static int dw_eth_init(struct eth_device *dev, bd_t *bis)
 	 * So we have to set it here once again */
 	dw_write_hwaddr(dev);
 
+	if (dw_alloc_rings(priv)) {
+		printf("%s: Failed to allocate descriptor rings\n", dev->name);
+		return -1;
+	}
+
 	rx_descs_init(dev);
 	tx_descs_init(dev);
 
@@ -299,20 +358,24 @@ static int dw_eth_send(struct eth_device *dev, void *packet, int length)
 		return -1;
 	}
 
+	desc_p->dmamac_addr = &priv->txbuffs[desc_num * CONFIG_ETH_BUFSIZE];
 	memcpy((void *)desc_p->dmamac_addr, packet, length);
 
 	/* Flush data to be sent */
 	flush_dcache_range((unsigned long)desc_p->dmamac_addr,
-			   (unsigned long)desc_p->dmamac_addr + length);
+			   (unsigned long)desc_p->dmamac_addr +
+			   roundup(length, ARCH_DMA_MINALIGN));
 
 #if defined(CONFIG_DW_ALTDESCRIPTOR)
 	desc_p->txrx_status |= DESC_TXSTS_TXFIRST | DESC_TXSTS_TXLAST;
+	desc_p->dmamac_cntl &= ~DESC_TXCTRL_SIZE1MASK;
 	desc_p->dmamac_cntl |= (length << DESC_TXCTRL_SIZE1SHFT) & \
 			       DESC_TXCTRL_SIZE1MASK;
 
 	desc_p->txrx_status &= ~(DESC_TXSTS_MSK);
 	desc_p->txrx_status |= DESC_TXSTS_OWNBYDMA;
 #else
+	desc_p->dmamac_cntl &= ~DESC_TXCTRL_SIZE1MASK;
 	desc_p->dmamac_cntl |= ((length << DESC_TXCTRL_SIZE1SHFT) & \
 			       DESC_TXCTRL_SIZE1MASK) | DESC_TXCTRL_TXLAST | \
 			       DESC_TXCTRL_TXFIRST;
@@ -325,7 +388,7 @@ static int dw_eth_send(struct eth_device *dev, void *packet, int length)
 			   (unsigned long)desc_p + sizeof(struct dmamacdescr));
 
 	/* Test the wrap-around condition. */
-	if (++desc_num >= CONFIG_TX_DESCR_NUM)
+	if (++desc_num >= priv->tx_descr_num)
 		desc_num = 0;
 
 	priv->tx_currdescnum = desc_num;
@@ -361,7 +424,22 @@ static int dw_eth_recv(struct eth_device *dev)
 					(unsigned long)desc_p->dmamac_addr +
 					roundup(length, ARCH_DMA_MINALIGN));
 
-		NetReceive(desc_p->dmamac_addr, length);
+		/* The frame is handed to the stack in place, without a copy */
+#ifdef CONFIG_DW_CHECKSUM_OFFLOAD
+		if ((status & DESC_RXSTS_CSUM_MASK) == DESC_RXSTS_CSUM_OK)
+			NetReceiveCsumOk(desc_p->dmamac_addr, length);
+		else
+#endif
+			NetReceive(desc_p->dmamac_addr, length);
+
+		/*
+		 * The stack may have modified the frame in place; discard
+		 * those lines so that they cannot be evicted on top of the
+		 * next frame the DMA engine writes into this buffer.
+		 */
+		invalidate_dcache_range((unsigned long)desc_p->dmamac_addr,
+					(unsigned long)desc_p->dmamac_addr +
+					roundup(length, ARCH_DMA_MINALIGN));
 
 		/*
 		 * Make the current descriptor valid again and go to
@@ -375,7 +453,7 @@ static int dw_eth_recv(struct eth_device *dev)
 				   sizeof(desc_p->txrx_status));
 
 		/* Test the wrap-around condition. */
-		if (++desc_num >= CONFIG_RX_DESCR_NUM)
+		if (++desc_num >= priv->rx_descr_num)
 			desc_num = 0;
 	}
 
@@ -8,11 +8,19 @@
 #ifndef _DW_ETH_H
 #define _DW_ETH_H
 
+/*
+ * Default descriptor ring sizes. They can be overridden at run time
+ * through the "dw_tx_descs" and "dw_rx_descs" environment variables,
+ * which are evaluated each time the interface is brought up.
+ */
+#ifndef CONFIG_TX_DESCR_NUM
 #define CONFIG_TX_DESCR_NUM	16
+#endif
+#ifndef CONFIG_RX_DESCR_NUM
 #define CONFIG_RX_DESCR_NUM	16
+#endif
+#define CONFIG_DESCR_NUM_MAX	256
 #define CONFIG_ETH_BUFSIZE	2048
-#define TX_TOTAL_BUFSIZE	(CONFIG_ETH_BUFSIZE * CONFIG_TX_DESCR_NUM)
-#define RX_TOTAL_BUFSIZE	(CONFIG_ETH_BUFSIZE * CONFIG_RX_DESCR_NUM)
 
 #define CONFIG_MACRESET_TIMEOUT	(3 * CONFIG_SYS_HZ)
 #define CONFIG_MDIO_TIMEOUT	(3 * CONFIG_SYS_HZ)
@@ -40,6 +48,7 @@ struct eth_mac_regs {
 #define FES_100			(1 << 14)
 #define DISABLERXOWN		(1 << 13)
 #define FULLDPLXMODE		(1 << 11)
+#define CHECKSUMOFFLOAD		(1 << 10)
 #define RXENABLE		(1 << 2)
 #define TXENABLE		(1 << 3)
 
@@ -159,6 +168,13 @@ struct dmamacdescr {
 #define DESC_RXSTS_RXMIIERROR		(1 << 3)
 #define DESC_RXSTS_RXDRIBBLING		(1 << 2)
 #define DESC_RXSTS_RXCRC		(1 << 1)
+#define DESC_RXSTS_RXPAYLOADCSUM	(1 << 0)
+
+/* Checksum offload engine status: IPv4/6 frame, no checksum errors */
+#define DESC_RXSTS_CSUM_MASK		(DESC_RXSTS_RXIPC_GIANT | \
+					 DESC_RXSTS_RXFRAMEETHER | \
+					 DESC_RXSTS_RXPAYLOADCSUM)
+#define DESC_RXSTS_CSUM_OK		DESC_RXSTS_RXFRAMEETHER
 
 /*
  * dmamac_cntl definitions
@@ -215,12 +231,14 @@ struct dmamacdescr {
 #endif
 
 struct dw_eth_dev {
-	struct dmamacdescr tx_mac_descrtable[CONFIG_TX_DESCR_NUM];
-	struct dmamacdescr rx_mac_descrtable[CONFIG_RX_DESCR_NUM];
-	char txbuffs[TX_TOTAL_BUFSIZE] __aligned(ARCH_DMA_MINALIGN);
-	char rxbuffs[RX_TOTAL_BUFSIZE] __aligned(ARCH_DMA_MINALIGN);
+	struct dmamacdescr *tx_mac_descrtable;
+	struct dmamacdescr *rx_mac_descrtable;
+	char *txbuffs;
+	char *rxbuffs;
 
 	u32 interface;
+	u32 tx_descr_num;
+	u32 rx_descr_num;
 	u32 tx_currdescnum;
 	u32 rx_currdescnum;
 
@@ -0,0 +1,698 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Sandbox ethernet devices
+ *
+ * Ethernet devices, each on a link of its own to a model of a boot
+ * server. The server runs in-process: a frame sent on a link is answered
+ * there and then, and the answers are queued for the device to receive.
+ * It knows just enough to serve files to U-Boot:
+ *
+ *   - ARP: every address but the sender's is the server's
+ *   - TFTP read requests, with the blksize, tsize and timeout options
+ *   - portmap GETPORT, mount MNT and UMNTALL, NFSv2 LOOKUP and READ
+ *
+ * Replies come from the address the request was sent to, so each link
+ * can be given a subnet of its own. Datagrams larger than a frame are
+ * sent as IP fragments.
+ *
+ * The server is set up from the environment, read each time a device is
+ * brought up:
+ *
+ *   sandbox_eth_root	host directory of the files served (default ".")
+ *   sandbox_eth_latency	time each reply takes to arrive, in us
+ *			(default 0)
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <malloc.h>
+#include <net.h>
+#include <netdev.h>
+#include <os.h>
+
+#define SANDBOX_ETH_DEVS	2
+#define SANDBOX_ETH_RXQ		64	/* frames in flight to a device */
+#define SANDBOX_ETH_MTU		1500
+#define SANDBOX_ETH_HANDLES	16	/* NFS file handles */
+#define SANDBOX_ETH_MAXPATH	256
+
+/* What the server needs of TFTP, Sun RPC, the mount protocol and NFSv2 */
+#define TFTP_PORT		69
+#define TFTP_XFER_PORT		1069
+#define TFTP_RRQ		1
+#define TFTP_DATA		3
+#define TFTP_ACK		4
+#define TFTP_ERROR		5
+#define TFTP_OACK		6
+#define TFTP_MAX_BLKSIZE	65464
+
+#define RPC_PORTMAP_PORT	111
+#define RPC_MOUNT_PORT		635
+#define RPC_NFS_PORT		2049
+#define RPC_PROG_PORTMAP	100000
+#define RPC_PROG_NFS		100003
+#define RPC_PROG_MOUNT		100005
+#define RPC_MSG_REPLY		1
+#define RPC_PROG_UNAVAIL	1
+#define RPC_PROC_UNAVAIL	3
+#define RPC_GARBAGE_ARGS	4
+#define PMAP_GETPORT		3
+#define MOUNT_MNT		1
+#define MOUNT_UMNTALL		4
+#define NFS_LOOKUP		4
+#define NFS_READ		6
+#define NFS_FHSIZE		32
+#define NFS_MAXDATA		8192
+#define NFS_FATTR_WORDS		17
+#define NFSERR_NOENT		2
+#define NFSERR_IO		5
+#define NFSERR_NAMETOOLONG	63
+#define NFSERR_STALE		70
+
+struct sandbox_eth_frame {
+	ulong ready_us;		/* when the device can receive it */
+	int len;
+	uchar data[PKTSIZE_ALIGN];
+};
+
+/* A TFTP transfer, one at a time on each link */
+struct sandbox_eth_tftp {
+	int fd;			/* file being sent, -1 when idle */
+	int client_port;
+	uint blksize;
+	uint block;		/* last block sent, 0 before the first */
+	int last_len;		/* and its length */
+};
+
+static struct sandbox_eth {
+	struct eth_device dev;
+	uchar server_mac[6];
+	struct sandbox_eth_frame rxq[SANDBOX_ETH_RXQ];
+	int rx_head;
+	int rx_count;
+	ushort ip_id;
+	struct sandbox_eth_tftp tftp;
+} sandbox_eth[SANDBOX_ETH_DEVS];
+
+/* Set-up of the server, and the NFS file handles given out on any link */
+static struct {
+	char root[SANDBOX_ETH_MAXPATH];
+	ulong latency;
+	char *handles[SANDBOX_ETH_HANDLES];	/* their paths, under root */
+} sbe;
+
+/* A UDP datagram being put together, with room for the largest block */
+static uchar sandbox_eth_dgram[UDP_HDR_SIZE + 4 + TFTP_MAX_BLKSIZE];
+
+/* Room for a frame of @len bytes at the end of the device's queue */
+static uchar *sandbox_eth_queue(struct sandbox_eth *priv, int len)
+{
+	struct sandbox_eth_frame *frame;
+
+	if (priv->rx_count == SANDBOX_ETH_RXQ) {
+		debug("%s: %s: queue full, frame dropped\n", __func__,
+		      priv->dev.name);
+		return NULL;
+	}
+	frame = &priv->rxq[(priv->rx_head + priv->rx_count++) %
+			   SANDBOX_ETH_RXQ];
+	frame->ready_us = timer_get_us() + sbe.latency;
+	frame->len = len;
+
+	return frame->data;
+}
+
+static void sandbox_eth_set_ether(struct sandbox_eth *priv,
+				  struct ethernet_hdr *et, const uchar *dest,
+				  uint prot)
+{
+	memcpy(et->et_dest, dest, 6);
+	memcpy(et->et_src, priv->server_mac, 6);
+	et->et_protlen = htons(prot);
+}
+
+/*
+ * Send the UDP payload at the end of sandbox_eth_dgram back to where @req
+ * came from, in as many fragments as it takes
+ */
+static void sandbox_eth_reply(struct sandbox_eth *priv,
+			      struct ethernet_hdr *req_et,
+			      struct ip_udp_hdr *req, int len)
+{
+	int total = UDP_HDR_SIZE + len;
+	int max = (SANDBOX_ETH_MTU - IP_HDR_SIZE) & ~7;
+	__be16 *udp = (__be16 *)sandbox_eth_dgram;
+	ushort id = priv->ip_id++;
+	struct ip_udp_hdr *ip;
+	int offset, part;
+	uchar *pkt;
+
+	/* Source and destination port, length, no checksum */
+	udp[0] = req->udp_dst;
+	udp[1] = req->udp_src;
+	udp[2] = htons(total);
+	udp[3] = 0;
+
+	for (offset = 0; offset < total; offset += part) {
+		part = min(total - offset, max);
+		pkt = sandbox_eth_queue(priv, ETHER_HDR_SIZE + IP_HDR_SIZE +
+					part);
+		if (!pkt)
+			return;
+		sandbox_eth_set_ether(priv, (struct ethernet_hdr *)pkt,
+				      req_et->et_src, PROT_IP);
+		ip = (struct ip_udp_hdr *)(pkt + ETHER_HDR_SIZE);
+		ip->ip_hl_v = 0x45;
+		ip->ip_tos = 0;
+		ip->ip_len = htons(IP_HDR_SIZE + part);
+		ip->ip_id = htons(id);
+		ip->ip_off = htons(offset / 8);
+		if (offset + part < total)
+			ip->ip_off |= htons(IP_FLAGS_MFRAG);
+		ip->ip_ttl = 255;
+		ip->ip_p = IPPROTO_UDP;
+		ip->ip_sum = 0;
+		NetCopyIP(&ip->ip_src, &req->ip_dst);
+		NetCopyIP(&ip->ip_dst, &req->ip_src);
+		ip->ip_sum = ~NetCksum((uchar *)ip, IP_HDR_SIZE >> 1);
+		memcpy(pkt + ETHER_HDR_SIZE + IP_HDR_SIZE,
+		       sandbox_eth_dgram + offset, part);
+	}
+}
+
+static void sandbox_eth_arp(struct sandbox_eth *priv, struct ethernet_hdr *et,
+			    struct arp_hdr *arp, int len)
+{
+	struct arp_hdr *reply;
+	uchar *pkt;
+
+	if (len < ARP_HDR_SIZE || ntohs(arp->ar_op) != ARPOP_REQUEST ||
+	    !memcmp(&arp->ar_spa, &arp->ar_tpa, ARP_PLEN))
+		return;
+
+	pkt = sandbox_eth_queue(priv, ETHER_HDR_SIZE + ARP_HDR_SIZE);
+	if (!pkt)
+		return;
+	sandbox_eth_set_ether(priv, (struct ethernet_hdr *)pkt, et->et_src,
+			      PROT_ARP);
+	reply = (struct arp_hdr *)(pkt + ETHER_HDR_SIZE);
+	reply->ar_hrd = htons(ARP_ETHER);
+	reply->ar_pro = htons(PROT_IP);
+	reply->ar_hln = ARP_HLEN;
+	reply->ar_pln = ARP_PLEN;
+	reply->ar_op = htons(ARPOP_REPLY);
+	memcpy(&reply->ar_sha, priv->server_mac, ARP_HLEN);
+	memcpy(&reply->ar_spa, &arp->ar_tpa, ARP_PLEN);
+	memcpy(&reply->ar_tha, &arp->ar_sha, ARP_HLEN);
+	memcpy(&reply->ar_tpa, &arp->ar_spa, ARP_PLEN);
+}
+
+/* The host path of @name under the root, or -1 if it must not be served */
+static int sandbox_eth_path(char *path, const char *name)
+{
+	while (*name == '/')
+		name++;
+	if (strstr(name, "..") ||
+	    snprintf(path, SANDBOX_ETH_MAXPATH, "%s/%s", sbe.root, name) >=
+	    SANDBOX_ETH_MAXPATH)
+		return -1;
+
+	return 0;
+}
+
+static int sandbox_eth_tftp_error(int code, const char *msg)
+{
+	__be16 *s = (__be16 *)(sandbox_eth_dgram + UDP_HDR_SIZE);
+
+	s[0] = htons(TFTP_ERROR);
+	s[1] = htons(code);
+	strcpy((char *)&s[2], msg);
+
+	return 4 + strlen(msg) + 1;
+}
+
+static int sandbox_eth_tftp_block(struct sandbox_eth_tftp *tftp, uint block)
+{
+	__be16 *s = (__be16 *)(sandbox_eth_dgram + UDP_HDR_SIZE);
+	ssize_t len = -1;
+
+	if (os_lseek(tftp->fd, (off_t)(block - 1) * tftp->blksize,
+		     OS_SEEK_SET) != -1)
+		len = os_read(tftp->fd, &s[2], tftp->blksize);
+	if (len < 0)
+		return sandbox_eth_tftp_error(0, "Read error");
+	s[0] = htons(TFTP_DATA);
+	s[1] = htons(block);
+	tftp->block = block;
+	tftp->last_len = len;
+
+	return 4 + len;
+}
+
+static void sandbox_eth_tftp_close(struct sandbox_eth_tftp *tftp)
+{
+	if (tftp->fd != -1)
+		os_close(tftp->fd);
+	tftp->fd = -1;
+}
+
+static int sandbox_eth_tftp_rrq(struct sandbox_eth *priv, char *req, int len,
+				int client_port)
+{
+	struct sandbox_eth_tftp *tftp = &priv->tftp;
+	char *end = req + len, *opt, *val;
+	char path[SANDBOX_ETH_MAXPATH];
+	char *oack = (char *)sandbox_eth_dgram + UDP_HDR_SIZE + 2;
+	ssize_t size;
+
+	/* Filename and mode, then pairs of option and value */
+	if (len < 2 || end[-1])
+		return sandbox_eth_tftp_error(4, "Bad request");
+	sandbox_eth_tftp_close(tftp);
+	if (sandbox_eth_path(path, req))
+		return sandbox_eth_tftp_error(2, "Access violation");
+	size = os_get_filesize(path);
+	tftp->fd = os_open(path, OS_O_RDONLY);
+	if (size < 0 || tftp->fd < 0) {
+		tftp->fd = -1;
+		return sandbox_eth_tftp_error(1, "File not found");
+	}
+	tftp->client_port = client_port;
+	tftp->blksize = 512;
+	tftp->block = 0;
+
+	opt = req + strlen(req) + 1;
+	opt += strlen(opt) + 1;
+	for (; opt < end; opt = val + strlen(val) + 1) {
+		val = opt + strlen(opt) + 1;
+		if (val >= end)
+			break;
+		if (!strcmp(opt, "blksize")) {
+			tftp->blksize = simple_strtoul(val, NULL, 10);
+			tftp->blksize = max(8U, min(tftp->blksize,
+						    (uint)TFTP_MAX_BLKSIZE));
+			oack += sprintf(oack, "blksize%c%u", 0, tftp->blksize);
+		} else if (!strcmp(opt, "tsize")) {
+			oack += sprintf(oack, "tsize%c%zd", 0, size);
+		} else if (!strcmp(opt, "timeout")) {
+			oack += sprintf(oack, "timeout%c%s", 0, val);
+		} else {
+			continue;
+		}
+		oack++;
+	}
+
+	tftp->last_len = tftp->blksize;
+	if (oack == (char *)sandbox_eth_dgram + UDP_HDR_SIZE + 2)
+		return sandbox_eth_tftp_block(tftp, 1);
+	*(__be16 *)(sandbox_eth_dgram + UDP_HDR_SIZE) = htons(TFTP_OACK);
+
+	return oack - (char *)sandbox_eth_dgram - UDP_HDR_SIZE;
+}
+
+static int sandbox_eth_tftp_ack(struct sandbox_eth *priv, ushort block)
+{
+	struct sandbox_eth_tftp *tftp = &priv->tftp;
+
+	/* A repeated ACK asks for the last block again */
+	if (block == (ushort)(tftp->block - 1))
+		return sandbox_eth_tftp_block(tftp, tftp->block);
+	if (block != (ushort)tftp->block)
+		return 0;
+	if (tftp->last_len < tftp->blksize) {
+		sandbox_eth_tftp_close(tftp);
+		return 0;
+	}
+
+	return sandbox_eth_tftp_block(tftp, tftp->block + 1);
+}
+
+static int sandbox_eth_tftp(struct sandbox_eth *priv, struct ip_udp_hdr *ip,
+			    uchar *req, int len)
+{
+	int port = ntohs(ip->udp_src);
+	int op;
+
+	if (len < 4)
+		return 0;
+	op = ntohs(*(__be16 *)req);
+	if (ntohs(ip->udp_dst) == TFTP_PORT)
+		return op == TFTP_RRQ ?
+			sandbox_eth_tftp_rrq(priv, (char *)req + 2, len - 2,
+					     port) : 0;
+	if (priv->tftp.fd == -1 || port != priv->tftp.client_port)
+		return sandbox_eth_tftp_error(5, "Unknown transfer ID");
+	if (op == TFTP_ACK)
+		return sandbox_eth_tftp_ack(priv, ntohs(((__be16 *)req)[1]));
+	if (op == TFTP_ERROR)
+		sandbox_eth_tftp_close(&priv->tftp);
+
+	return 0;
+}
+
+/* The path of an NFS file handle, NULL if it is not one of ours */
+static const char *sandbox_eth_nfs_path(const __be32 *fh)
+{
+	uint handle = ntohl(fh[0]);
+
+	if (!handle || handle > SANDBOX_ETH_HANDLES)
+		return NULL;
+
+	return sbe.handles[handle - 1];
+}
+
+/* Give out a file handle for @path, NULL if we ran out of them */
+static __be32 *sandbox_eth_nfs_handle(__be32 *p, const char *path)
+{
+	int i;
+
+	for (i = 0; i < SANDBOX_ETH_HANDLES && sbe.handles[i]; i++) {
+		if (!strcmp(sbe.handles[i], path))
+			break;
+	}
+	if (i == SANDBOX_ETH_HANDLES)
+		return NULL;
+	if (!sbe.handles[i]) {
+		sbe.handles[i] = strdup(path);
+		if (!sbe.handles[i])
+			return NULL;
+	}
+	memset(p, '\0', NFS_FHSIZE);
+	p[0] = htonl(i + 1);
+
+	return p + NFS_FHSIZE / 4;
+}
+
+/* The attributes of a regular file of @size bytes */
+static __be32 *sandbox_eth_nfs_fattr(__be32 *p, const __be32 *fh,
+				     ssize_t size)
+{
+	memset(p, '\0', NFS_FATTR_WORDS * 4);
+	p[0] = htonl(1);		/* NFREG */
+	p[1] = htonl(0100644);		/* mode */
+	p[2] = htonl(1);		/* nlink */
+	p[5] = htonl(size);
+	p[6] = htonl(4096);		/* blocksize */
+	p[8] = htonl(DIV_ROUND_UP(size, 4096));
+	p[10] = fh[0];			/* fileid */
+
+	return p + NFS_FATTR_WORDS;
+}
+
+/* An XDR string, copied to @str; the words after it, NULL if bad */
+static const __be32 *sandbox_eth_xdr_string(const __be32 *p,
+					    const __be32 *end, char *str,
+					    int size)
+{
+	uint len;
+
+	if (p >= end)
+		return NULL;
+	len = ntohl(*p++);
+	if (len >= size || (const char *)p + len > (const char *)end)
+		return NULL;
+	memcpy(str, p, len);
+	str[len] = '\0';
+
+	return p + DIV_ROUND_UP(len, 4);
+}
+
+/* The results of an NFS procedure: words after them, NULL if bad args */
+static __be32 *sandbox_eth_nfs(uint proc, const __be32 *args,
+			       const __be32 *end, __be32 *res)
+{
+	char name[SANDBOX_ETH_MAXPATH], path[SANDBOX_ETH_MAXPATH];
+	char host[SANDBOX_ETH_MAXPATH];
+	const char *fpath;
+	ssize_t size;
+	uint offset, count;
+	int fd, len;
+
+	if (end - args < NFS_FHSIZE / 4)
+		return NULL;
+	fpath = sandbox_eth_nfs_path(args);
+	switch (proc) {
+	case NFS_LOOKUP:
+		if (!sandbox_eth_xdr_string(args + NFS_FHSIZE / 4, end, name,
+					    sizeof(name)))
+			return NULL;
+		if (!fpath) {
+			*res++ = htonl(NFSERR_STALE);
+			break;
+		}
+		if (snprintf(path, sizeof(path), "%s/%s", fpath, name) >=
+		    sizeof(path)) {
+			*res++ = htonl(NFSERR_NAMETOOLONG);
+			break;
+		}
+		size = -1;
+		if (!sandbox_eth_path(host, path))
+			size = os_get_filesize(host);
+		if (size < 0) {
+			*res++ = htonl(NFSERR_NOENT);
+			break;
+		}
+		if (!sandbox_eth_nfs_handle(res + 1, path)) {
+			*res++ = htonl(NFSERR_IO);
+			break;
+		}
+		*res++ = 0;
+		res = sandbox_eth_nfs_fattr(res + NFS_FHSIZE / 4, res, size);
+		break;
+	case NFS_READ:
+		if (end - args < NFS_FHSIZE / 4 + 3)
+			return NULL;
+		offset = ntohl(args[NFS_FHSIZE / 4]);
+		count = min((uint)ntohl(args[NFS_FHSIZE / 4 + 1]),
+			    (uint)NFS_MAXDATA);
+		if (!fpath) {
+			*res++ = htonl(NFSERR_STALE);
+			break;
+		}
+		fd = -1;
+		size = -1;
+		if (!sandbox_eth_path(host, fpath)) {
+			fd = os_open(host, OS_O_RDONLY);
+			size = os_get_filesize(host);
+		}
+		if (fd < 0 || size < 0) {
+			if (fd >= 0)
+				os_close(fd);
+			*res++ = htonl(NFSERR_NOENT);
+			break;
+		}
+		len = -1;
+		if (os_lseek(fd, offset, OS_SEEK_SET) != -1)
+			len = os_read(fd, res + 1 + NFS_FATTR_WORDS + 1,
+				      count);
+		os_close(fd);
+		if (len < 0) {
+			*res++ = htonl(NFSERR_IO);
+			break;
+		}
+		*res++ = 0;
+		res = sandbox_eth_nfs_fattr(res, args, size);
+		*res++ = htonl(len);
+		if (len & 3)
+			memset((char *)res + len, '\0', 4 - (len & 3));
+		res += DIV_ROUND_UP(len, 4);
+		break;
+	default:
+		return NULL;
+	}
+
+	return res;
+}
+
+/* Answer an RPC call; the length of the reply, 0 for none */
+static int sandbox_eth_rpc(struct sandbox_eth *priv, int port,
+			   const __be32 *call, int len)
+{
+	const __be32 *end = call + len / 4;
+	const __be32 *args;
+	__be32 *reply = (__be32 *)(sandbox_eth_dgram + UDP_HDR_SIZE);
+	__be32 *res = reply + 6;
+	char path[SANDBOX_ETH_MAXPATH], dir[SANDBOX_ETH_MAXPATH];
+	uint prog, proc;
+
+	/* xid, call, RPC version, program, version, procedure, cred, verf */
+	if (len < 10 * 4 || ntohl(call[1]) != 0)
+		return 0;
+	args = call + 8 + DIV_ROUND_UP(ntohl(call[7]), 4);
+	if (args + 2 > end)
+		return 0;
+	args += 2 + DIV_ROUND_UP(ntohl(args[1]), 4);
+	if (args > end)
+		return 0;
+	prog = ntohl(call[3]);
+	proc = ntohl(call[5]);
+
+	reply[0] = call[0];
+	reply[1] = htonl(RPC_MSG_REPLY);
+	reply[2] = 0;			/* accepted */
+	reply[3] = 0;			/* verifier: AUTH_NULL */
+	reply[4] = 0;
+	reply[5] = 0;			/* success */
+
+	if (prog == RPC_PROG_PORTMAP && port == RPC_PORTMAP_PORT) {
+		if (proc != PMAP_GETPORT || end - args < 4) {
+			reply[5] = htonl(RPC_PROC_UNAVAIL);
+		} else {
+			prog = ntohl(args[0]);
+			*res++ = htonl(prog == RPC_PROG_MOUNT ? RPC_MOUNT_PORT :
+				       prog == RPC_PROG_NFS ? RPC_NFS_PORT : 0);
+		}
+	} else if (prog == RPC_PROG_MOUNT && port == RPC_MOUNT_PORT) {
+		if (proc == MOUNT_MNT) {
+			if (!sandbox_eth_xdr_string(args, end, dir,
+						    sizeof(dir))) {
+				reply[5] = htonl(RPC_GARBAGE_ARGS);
+			} else if (sandbox_eth_path(path, dir) ||
+				   os_get_filesize(path) < 0) {
+				*res++ = htonl(NFSERR_NOENT);
+			} else if (!sandbox_eth_nfs_handle(res + 1, dir)) {
+				*res++ = htonl(NFSERR_IO);
+			} else {
+				*res++ = 0;
+				res += NFS_FHSIZE / 4;
+			}
+		} else if (proc != MOUNT_UMNTALL) {
+			reply[5] = htonl(RPC_PROC_UNAVAIL);
+		}
+	} else if (prog == RPC_PROG_NFS && port == RPC_NFS_PORT) {
+		if (proc != NFS_LOOKUP && proc != NFS_READ) {
+			reply[5] = htonl(RPC_PROC_UNAVAIL);
+		} else {
+			res = sandbox_eth_nfs(proc, args, end, res);
+			if (!res) {
+				res = reply + 6;
+				reply[5] = htonl(RPC_GARBAGE_ARGS);
+			}
+		}
+	} else {
+		reply[5] = htonl(RPC_PROG_UNAVAIL);
+	}
+
+	return (uchar *)res - (uchar *)reply;
+}
+
+static void sandbox_eth_udp(struct sandbox_eth *priv, struct ethernet_hdr *et,
+			    struct ip_udp_hdr *ip, int len)
+{
+	int port = ntohs(ip->udp_dst);
+	uchar *req = (uchar *)ip + IP_UDP_HDR_SIZE;
+	int reply_len = 0;
+
+	if (len < IP_UDP_HDR_SIZE || ip->ip_hl_v != 0x45 ||
+	    ip->ip_p != IPPROTO_UDP ||
+	    (ntohs(ip->ip_off) & (IP_OFFS | IP_FLAGS_MFRAG)) ||
+	    ntohs(ip->udp_len) < UDP_HDR_SIZE ||
+	    ntohs(ip->udp_len) > len - IP_HDR_SIZE)
+		return;
+	len = ntohs(ip->udp_len) - UDP_HDR_SIZE;
+
+	if (port == TFTP_PORT || port == TFTP_XFER_PORT)
+		reply_len = sandbox_eth_tftp(priv, ip, req, len);
+	else if (port == RPC_PORTMAP_PORT || port == RPC_MOUNT_PORT ||
+		 port == RPC_NFS_PORT)
+		reply_len = sandbox_eth_rpc(priv, port, (__be32 *)req, len);
+	if (!reply_len)
+		return;
+
+	/* Transfers go on from a port of their own */
+	if (port == TFTP_PORT)
+		ip->udp_dst = htons(TFTP_XFER_PORT);
+	sandbox_eth_reply(priv, et, ip, reply_len);
+}
+
+static int sandbox_eth_send(struct eth_device *dev, void *packet, int length)
+{
+	struct sandbox_eth *priv = dev->priv;
+	struct ethernet_hdr *et = packet;
+
+	if (length < ETHER_HDR_SIZE)
+		return -EINVAL;
+	length -= ETHER_HDR_SIZE;
+	switch (ntohs(et->et_protlen)) {
+	case PROT_ARP:
+		sandbox_eth_arp(priv, et, packet + ETHER_HDR_SIZE, length);
+		break;
+	case PROT_IP:
+		sandbox_eth_udp(priv, et, packet + ETHER_HDR_SIZE, length);
+		break;
+	}
+
+	return 0;
+}
+
+static int sandbox_eth_recv(struct eth_device *dev)
+{
+	struct sandbox_eth *priv = dev->priv;
+	struct sandbox_eth_frame *frame;
+	ulong now = timer_get_us();
+	int len;
+
+	while (priv->rx_count) {
+		frame = &priv->rxq[priv->rx_head];
+		if ((long)(now - frame->ready_us) < 0)
+			break;
+		/* The stack may answer at once, queueing more frames */
+		len = frame->len;
+		memcpy(NetRxPackets[0], frame->data, len);
+		priv->rx_head = (priv->rx_head + 1) % SANDBOX_ETH_RXQ;
+		priv->rx_count--;
+		NetReceive(NetRxPackets[0], len);
+	}
+
+	return 0;
+}
+
+static int sandbox_eth_init(struct eth_device *dev, bd_t *bis)
+{
+	struct sandbox_eth *priv = dev->priv;
+	const char *root = getenv("sandbox_eth_root");
+
+	snprintf(sbe.root, sizeof(sbe.root), "%s", root ? root : ".");
+	sbe.latency = getenv_ulong("sandbox_eth_latency", 10, 0);
+
+	priv->rx_count = 0;
+	sandbox_eth_tftp_close(&priv->tftp);
+
+	return 0;
+}
+
+static void sandbox_eth_halt(struct eth_device *dev)
+{
+	struct sandbox_eth *priv = dev->priv;
+
+	priv->rx_count = 0;
+	sandbox_eth_tftp_close(&priv->tftp);
+}
+
+int sandbox_eth_initialize(bd_t *bis)
+{
+	struct sandbox_eth *priv;
+	struct eth_device *dev;
+	int i;
+
+	for (i = 0; i < SANDBOX_ETH_DEVS; i++) {
+		priv = &sandbox_eth[i];
+		dev = &priv->dev;
+		sprintf(dev->name, "sb_eth%d", i);
+		memcpy(dev->enetaddr, "\x02\x00\x11\x22\x33\x00", 6);
+		dev->enetaddr[5] = i;
+		memcpy(priv->server_mac, "\x02\x00\x11\x22\x33\x80", 6);
+		priv->server_mac[5] |= i;
+		priv->tftp.fd = -1;
+		dev->init = sandbox_eth_init;
+		dev->send = sandbox_eth_send;
+		dev->recv = sandbox_eth_recv;
+		dev->halt = sandbox_eth_halt;
+		dev->priv = priv;
+		eth_register(dev);
+	}
+
+	return 0;
+}
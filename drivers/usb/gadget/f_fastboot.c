@@ -19,6 +19,10 @@
 #include <linux/compiler.h>
 #include <version.h>
 #include <g_dnl.h>
+#include <asm/io.h>
+#ifdef CONFIG_FASTBOOT_FLASH
+#include <fb_mmc.h>
+#endif
 
 #define FASTBOOT_VERSION		"0.4"
 
@@ -41,6 +45,8 @@ struct f_fastboot {
 	/* IN/OUT EP's and correspoinding requests */
 	struct usb_ep *in_ep, *out_ep;
 	struct usb_request *in_req, *out_req;
+	/* buffer of out_req, which points into the download buffer at times */
+	void *out_buf;
 };
 
 static inline struct f_fastboot *func_to_fastboot(struct usb_function *f)
@@ -173,7 +179,7 @@ static void fastboot_disable(struct usb_function *f)
 	usb_ep_disable(f_fb->in_ep);
 
 	if (f_fb->out_req) {
-		free(f_fb->out_req->buf);
+		free(f_fb->out_buf);
 		usb_ep_free_request(f_fb->out_ep, f_fb->out_req);
 		f_fb->out_req = NULL;
 	}
@@ -231,6 +237,7 @@ static int fastboot_set_alt(struct usb_function *f,
 		goto err;
 	}
 	f_fb->out_req->complete = rx_handler_command;
+	f_fb->out_buf = f_fb->out_req->buf;
 
 	ret = usb_ep_enable(f_fb->in_ep, &fs_ep_in);
 	if (ret) {
@@ -346,10 +353,12 @@ static void cb_getvar(struct usb_ep *ep, struct usb_request *req)
 		strncat(response, FASTBOOT_VERSION, chars_left);
 	} else if (!strcmp_l1("bootloader-version", cmd)) {
 		strncat(response, U_BOOT_VERSION, chars_left);
-	} else if (!strcmp_l1("downloadsize", cmd)) {
+	} else if (!strcmp_l1("downloadsize", cmd) ||
+		   !strcmp_l1("max-download-size", cmd)) {
 		char str_num[12];
 
-		sprintf(str_num, "%08x", CONFIG_USB_FASTBOOT_BUF_SIZE);
+		/* The host tool splits sparse images bigger than this */
+		sprintf(str_num, "0x%08x", CONFIG_USB_FASTBOOT_BUF_SIZE);
 		strncat(response, str_num, chars_left);
 	} else if (!strcmp_l1("serialno", cmd)) {
 		s = getenv("serial#");
@@ -363,6 +372,12 @@ static void cb_getvar(struct usb_ep *ep, struct usb_request *req)
 	fastboot_tx_write_str(response);
 }
 
+static void *fastboot_buf_addr(void)
+{
+	return map_sysmem(CONFIG_USB_FASTBOOT_BUF_ADDR,
+			  CONFIG_USB_FASTBOOT_BUF_SIZE);
+}
+
 static unsigned int rx_bytes_expected(void)
 {
 	int rx_remain = download_size - download_bytes;
@@ -373,6 +388,23 @@ static unsigned int rx_bytes_expected(void)
 	return rx_remain;
 }
 
+/*
+ * Have the controller put the next part of the download straight where
+ * it belongs. Only a tail shorter than a packet, for which the request
+ * must be a packet long and could run past the buffer, goes through the
+ * request's own buffer.
+ */
+static void rx_prepare_dl_req(struct usb_ep *ep, struct usb_request *req)
+{
+	req->length = rx_bytes_expected();
+	if (req->length >= ep->maxpacket) {
+		req->buf = fastboot_buf_addr() + download_bytes;
+	} else {
+		req->buf = fastboot_func->out_buf;
+		req->length = ep->maxpacket;
+	}
+}
+
 #define BYTES_PER_DOT	0x20000
 static void rx_handler_dl_image(struct usb_ep *ep, struct usb_request *req)
 {
@@ -389,8 +421,9 @@ static void rx_handler_dl_image(struct usb_ep *ep, struct usb_request *req)
 	if (buffer_size < transfer_size)
 		transfer_size = buffer_size;
 
-	memcpy((void *)CONFIG_USB_FASTBOOT_BUF_ADDR + download_bytes,
-	       buffer, transfer_size);
+	if (req->buf == fastboot_func->out_buf)
+		memcpy(fastboot_buf_addr() + download_bytes, buffer,
+		       transfer_size);
 
 	download_bytes += transfer_size;
 
@@ -402,6 +435,7 @@ static void rx_handler_dl_image(struct usb_ep *ep, struct usb_request *req)
 		 */
 		download_size = 0;
 		req->complete = rx_handler_command;
+		req->buf = fastboot_func->out_buf;
 		req->length = EP_BUFFER_SIZE;
 
 		sprintf(response, "OKAY");
@@ -409,9 +443,7 @@ static void rx_handler_dl_image(struct usb_ep *ep, struct usb_request *req)
 
 		printf("\ndownloading of %d bytes finished\n", download_bytes);
 	} else {
-		req->length = rx_bytes_expected();
-		if (req->length < ep->maxpacket)
-			req->length = ep->maxpacket;
+		rx_prepare_dl_req(ep, req);
 	}
 
 	if (download_bytes && !(download_bytes % BYTES_PER_DOT)) {
@@ -442,9 +474,7 @@ static void cb_download(struct usb_ep *ep, struct usb_request *req)
 	} else {
 		sprintf(response, "DATA%08x", download_size);
 		req->complete = rx_handler_dl_image;
-		req->length = rx_bytes_expected();
-		if (req->length < ep->maxpacket)
-			req->length = ep->maxpacket;
+		rx_prepare_dl_req(ep, req);
 	}
 	fastboot_tx_write_str(response);
 }
@@ -469,6 +499,24 @@ static void cb_boot(struct usb_ep *ep, struct usb_request *req)
 	fastboot_tx_write_str("OKAY");
 }
 
+#ifdef CONFIG_FASTBOOT_FLASH
+static void cb_flash(struct usb_ep *ep, struct usb_request *req)
+{
+	char *cmd = req->buf;
+	char response[RESPONSE_LEN];
+
+	strsep(&cmd, ":");
+	if (!cmd) {
+		fastboot_tx_write_str("FAILmissing partition name");
+		return;
+	}
+
+	strcpy(response, "FAILno flash device defined");
+	fb_mmc_flash_write(cmd, fastboot_buf_addr(), download_bytes, response);
+	fastboot_tx_write_str(response);
+}
+#endif
+
 struct cmd_dispatch_info {
 	char *cmd;
 	void (*cb)(struct usb_ep *ep, struct usb_request *req);
@@ -488,6 +536,12 @@ static const struct cmd_dispatch_info cmd_dispatch_info[] = {
 		.cmd = "boot",
 		.cb = cb_boot,
 	},
+#ifdef CONFIG_FASTBOOT_FLASH
+	{
+		.cmd = "flash:",
+		.cb = cb_flash,
+	},
+#endif
 };
 
 static void rx_handler_command(struct usb_ep *ep, struct usb_request *req)
@@ -496,6 +550,10 @@ static void rx_handler_command(struct usb_ep *ep, struct usb_request *req)
 	void (*func_cb)(struct usb_ep *ep, struct usb_request *req) = NULL;
 	int i;
 
+	/* Arguments such as partition names are used as strings */
+	if (req->actual < req->length)
+		cmdbuf[req->actual] = '\0';
+
 	for (i = 0; i < ARRAY_SIZE(cmd_dispatch_info); i++) {
 		if (!strcmp_l1(cmd_dispatch_info[i].cmd, cmdbuf)) {
 			func_cb = cmd_dispatch_info[i].cb;
@@ -305,6 +305,35 @@ inline void clear_bit(int nr, volatile void *addr)
 struct fsg_dev;
 struct fsg_common;
 
+/* Read-ahead and write-back of the backing device, see fsg_cache_poll() */
+#ifndef CONFIG_USB_GADGET_STORAGE_CACHE_SIZE
+#define CONFIG_USB_GADGET_STORAGE_CACHE_SIZE	0
+#endif
+/* How much the cache reads or writes back at a time */
+#ifndef CONFIG_USB_GADGET_STORAGE_CACHE_CHUNK
+#define CONFIG_USB_GADGET_STORAGE_CACHE_CHUNK	(64 << 10)
+#endif
+/* Write back the rest once the host has been quiet this long, in ms */
+#define FSG_CACHE_IDLE_MS	100
+
+enum fsg_cache_state {
+	CACHE_EMPTY = 0,
+	CACHE_READ,
+	CACHE_WRITE
+};
+
+struct fsg_cache {
+	u8			*buf;
+	u32			size;		/* In sectors */
+	u32			chunk;		/* In sectors */
+	enum fsg_cache_state	state;
+	u32			lba;		/* First sector held */
+	u32			count;		/* Sectors held or to read */
+	u32			done;		/* Sectors read or written */
+	ulong			last;		/* get_timer() of last write */
+	int			error;		/* Lost write-back, sticky */
+};
+
 /* Data shared by all the FSG instances. */
 struct fsg_common {
 	struct usb_gadget	*gadget;
@@ -318,6 +347,8 @@ struct fsg_common {
 	struct fsg_buffhd	*next_buffhd_to_drain;
 	struct fsg_buffhd	buffhds[FSG_NUM_BUFFERS];
 
+	struct fsg_cache	cache;
+
 	int			cmnd_size;
 	u8			cmnd[MAX_COMMAND_SIZE];
 
@@ -661,6 +692,181 @@ static void busy_indicator(void)
 		state = 0;
 }
 
+/*-------------------------------------------------------------------------*/
+
+/*
+ * The backing device is accessed through a cache of its own, which is
+ * worked on in sleep_thread(), while the host or the bus keeps us waiting:
+ * after a READ the sectors that follow are read ahead, so that the next
+ * sequential READ finds its data already there, and WRITE data is gathered
+ * and written back a chunk at a time.  What is left is written back when
+ * the host goes quiet, sends any other command, asks for it with
+ * SYNCHRONIZE CACHE or FUA, or goes away.
+ */
+static void fsg_cache_init(struct fsg_common *common)
+{
+	struct fsg_cache *cache = &common->cache;
+	u32 size;
+
+	size = getenv_ulong("ums_cachesiz", 16,
+			    CONFIG_USB_GADGET_STORAGE_CACHE_SIZE);
+	memset(cache, 0, sizeof(*cache));
+	/* Anything smaller than what a buffer brings is no use */
+	if (size < FSG_BUFLEN)
+		return;
+
+	cache->buf = memalign(CONFIG_SYS_CACHELINE_SIZE, size);
+	if (!cache->buf) {
+		printf("UMS: no memory for a %#x byte cache\n", size);
+		return;
+	}
+	cache->size = size / SECTOR_SIZE;
+	cache->chunk = max(CONFIG_USB_GADGET_STORAGE_CACHE_CHUNK /
+			   SECTOR_SIZE, 1);
+}
+
+/* Read or write back the next chunk */
+static int fsg_cache_step(struct fsg_cache *cache)
+{
+	u32 n = min(cache->count - cache->done, cache->chunk);
+	u8 *buf = cache->buf + cache->done * SECTOR_SIZE;
+	int rc;
+
+	if (cache->state == CACHE_READ)
+		rc = ums->read_sector(ums, cache->lba + cache->done, n, buf);
+	else
+		rc = ums->write_sector(ums, cache->lba + cache->done, n, buf);
+	if (rc != n) {
+		if (cache->state == CACHE_WRITE) {
+			printf("UMS: write-back of %u sectors at %#x failed\n",
+			       cache->count - cache->done,
+			       cache->lba + cache->done);
+			cache->error = -EIO;
+		}
+		cache->state = CACHE_EMPTY;
+		return -EIO;
+	}
+	cache->done += n;
+
+	return 0;
+}
+
+/* Write back all that is left, returning -EIO if any of it was lost */
+static int fsg_cache_flush(struct fsg_cache *cache)
+{
+	if (cache->state == CACHE_WRITE) {
+		while (cache->done < cache->count)
+			if (fsg_cache_step(cache))
+				break;
+		cache->state = CACHE_EMPTY;
+	}
+
+	return cache->error;
+}
+
+/* Called while waiting for the host */
+static void fsg_cache_poll(struct fsg_cache *cache)
+{
+	if (cache->done == cache->count)
+		return;
+
+	switch (cache->state) {
+	case CACHE_READ:
+		fsg_cache_step(cache);
+		break;
+	case CACHE_WRITE:
+		/* Chunks as they fill up, the rest when the host is quiet */
+		if (cache->count - cache->done >= cache->chunk ||
+		    get_timer(cache->last) > FSG_CACHE_IDLE_MS)
+			fsg_cache_step(cache);
+		break;
+	default:
+		break;
+	}
+}
+
+/* After a READ ending before lba, read ahead of the host from there */
+static void fsg_cache_read_ahead(struct fsg_common *common, u32 lba)
+{
+	struct fsg_cache *cache = &common->cache;
+	u32 num_sectors = common->luns[common->lun].num_sectors;
+	u32 off, keep;
+
+	if (!cache->buf || cache->state == CACHE_WRITE)
+		return;
+	if (lba >= num_sectors) {
+		cache->state = CACHE_EMPTY;
+		return;
+	}
+
+	if (cache->state == CACHE_READ && lba >= cache->lba &&
+	    lba <= cache->lba + cache->count) {
+		/* Sequential: the window only moves once half of it is used */
+		off = lba - cache->lba;
+		if (cache->count - off >= cache->size / 2)
+			return;
+		keep = cache->done > off ? cache->done - off : 0;
+		memmove(cache->buf, cache->buf + off * SECTOR_SIZE,
+			keep * SECTOR_SIZE);
+	} else {
+		keep = 0;
+	}
+	cache->state = CACHE_READ;
+	cache->lba = lba;
+	cache->count = min(cache->size, num_sectors - lba);
+	cache->done = keep;
+}
+
+/* Read sectors, from what was read ahead when it has them */
+static int fsg_cache_read(struct fsg_cache *cache, u32 lba, u32 n, void *buf)
+{
+	u32 off, m;
+	int rc;
+
+	if (cache->state != CACHE_READ || lba < cache->lba ||
+	    lba >= cache->lba + cache->count)
+		return ums->read_sector(ums, lba, n, buf);
+
+	/* The host may have caught up with us */
+	off = lba - cache->lba;
+	m = min(n, cache->count - off);
+	while (cache->state == CACHE_READ && cache->done < off + m)
+		fsg_cache_step(cache);
+	if (cache->state != CACHE_READ)
+		return ums->read_sector(ums, lba, n, buf);
+	memcpy(buf, cache->buf + off * SECTOR_SIZE, m * SECTOR_SIZE);
+	if (m == n)
+		return n;
+
+	rc = ums->read_sector(ums, lba + m, n - m,
+			      (u8 *)buf + m * SECTOR_SIZE);
+	return rc == n - m ? n : m;
+}
+
+/* Take WRITE data, to be written back later */
+static int fsg_cache_write(struct fsg_cache *cache, u32 lba, u32 n,
+			   const void *buf)
+{
+	if (cache->state == CACHE_WRITE &&
+	    (lba != cache->lba + cache->count ||
+	     cache->count + n > cache->size))
+		fsg_cache_flush(cache);
+	if (cache->error)
+		return 0;
+
+	if (cache->state != CACHE_WRITE) {
+		cache->state = CACHE_WRITE;
+		cache->lba = lba;
+		cache->count = 0;
+		cache->done = 0;
+	}
+	memcpy(cache->buf + cache->count * SECTOR_SIZE, buf, n * SECTOR_SIZE);
+	cache->count += n;
+	cache->last = get_timer(0);
+
+	return n;
+}
+
 static int sleep_thread(struct fsg_common *common)
 {
 	int	rc = 0;
@@ -679,17 +885,22 @@ static int sleep_thread(struct fsg_common *common)
 
 		if (k == 10) {
 			/* Handle CTRL+C */
-			if (ctrlc())
+			if (ctrlc()) {
+				fsg_cache_flush(&common->cache);
 				return -EPIPE;
+			}
 
 			/* Check cable connection */
-			if (!g_dnl_board_usb_cable_connected())
+			if (!g_dnl_board_usb_cable_connected()) {
+				fsg_cache_flush(&common->cache);
 				return -EIO;
+			}
 
 			k = 0;
 		}
 
 		usb_gadget_handle_interrupts();
+		fsg_cache_poll(&common->cache);
 	}
 	common->thread_wakeup_needed = 0;
 	return rc;
@@ -771,10 +982,10 @@ static int do_read(struct fsg_common *common)
 		}
 
 		/* Perform the read */
-		rc = ums->read_sector(ums,
-				      file_offset / SECTOR_SIZE,
-				      amount / SECTOR_SIZE,
-				      (char __user *)bh->buf);
+		rc = fsg_cache_read(&common->cache,
+				    file_offset / SECTOR_SIZE,
+				    amount / SECTOR_SIZE,
+				    (char __user *)bh->buf);
 		if (!rc)
 			return -EIO;
 
@@ -806,8 +1017,11 @@ static int do_read(struct fsg_common *common)
 			break;
 		}
 
-		if (amount_left == 0)
+		if (amount_left == 0) {
+			/* The host will likely want what follows next */
+			fsg_cache_read_ahead(common, file_offset / SECTOR_SIZE);
 			break;		/* No more left to read */
+		}
 
 		/* Send this buffer and go read some more */
 		bh->inreq->zero = 0;
@@ -836,12 +1050,20 @@ static int do_write(struct fsg_common *common)
 	unsigned int		partial_page;
 	ssize_t			nwritten;
 	int			rc;
+	int			fua = 0;
 
 	if (curlun->ro) {
 		curlun->sense_data = SS_WRITE_PROTECTED;
 		return -EINVAL;
 	}
 
+	/* Earlier data that could not be written back fails this WRITE */
+	if (common->cache.error) {
+		common->cache.error = 0;
+		curlun->sense_data = SS_WRITE_ERROR;
+		return -EINVAL;
+	}
+
 	/* Get the starting Logical Block Address and check that it's
 	 * not too big */
 	if (common->cmnd[0] == SC_WRITE_6)
@@ -857,12 +1079,17 @@ static int do_write(struct fsg_common *common)
 			curlun->sense_data = SS_INVALID_FIELD_IN_CDB;
 			return -EINVAL;
 		}
+		fua = common->cmnd[1] & 0x08;
 	}
 	if (lba >= curlun->num_sectors) {
 		curlun->sense_data = SS_LOGICAL_BLOCK_ADDRESS_OUT_OF_RANGE;
 		return -EINVAL;
 	}
 
+	/* What was read ahead may be about to change */
+	if (common->cache.state == CACHE_READ)
+		common->cache.state = CACHE_EMPTY;
+
 	/* Carry out the file writes */
 	get_some_more = 1;
 	file_offset = usb_offset = ((loff_t) lba) << 9;
@@ -945,10 +1172,16 @@ static int do_write(struct fsg_common *common)
 			amount = bh->outreq->actual;
 
 			/* Perform the write */
-			rc = ums->write_sector(ums,
-					       file_offset / SECTOR_SIZE,
-					       amount / SECTOR_SIZE,
-					       (char __user *)bh->buf);
+			if (common->cache.buf)
+				rc = fsg_cache_write(&common->cache,
+						     file_offset / SECTOR_SIZE,
+						     amount / SECTOR_SIZE,
+						     bh->buf);
+			else
+				rc = ums->write_sector(ums,
+						       file_offset / SECTOR_SIZE,
+						       amount / SECTOR_SIZE,
+						       (char __user *)bh->buf);
 			if (!rc)
 				return -EIO;
 			nwritten = rc * SECTOR_SIZE;
@@ -973,7 +1206,7 @@ static int do_write(struct fsg_common *common)
 
 			/* If an error occurred, report it and its position */
 			if (nwritten < amount) {
-				printf("nwritten:%d amount:%d\n", nwritten,
+				printf("nwritten:%zd amount:%d\n", nwritten,
 				       amount);
 				curlun->sense_data = SS_WRITE_ERROR;
 				curlun->info_valid = 1;
@@ -994,6 +1227,12 @@ static int do_write(struct fsg_common *common)
 			return rc;
 	}
 
+	/* FUA wants the data on the medium before the status goes out */
+	if (fua && fsg_cache_flush(&common->cache)) {
+		common->cache.error = 0;
+		curlun->sense_data = SS_WRITE_ERROR;
+	}
+
 	return -EIO;		/* No default reply */
 }
 
@@ -1001,6 +1240,14 @@ static int do_write(struct fsg_common *common)
 
 static int do_synchronize_cache(struct fsg_common *common)
 {
+	struct fsg_lun	*curlun = &common->luns[common->lun];
+
+	if (fsg_cache_flush(&common->cache)) {
+		common->cache.error = 0;
+		curlun->sense_data = SS_WRITE_ERROR;
+		return -EINVAL;
+	}
+
 	return 0;
 }
 
@@ -1806,6 +2053,12 @@ static int do_scsi_command(struct fsg_common *common)
 	common->phase_error = 0;
 	common->short_packet_received = 0;
 
+	/* Other commands see the medium only once WRITE data is on it */
+	if (common->cmnd[0] != SC_WRITE_6 && common->cmnd[0] != SC_WRITE_10 &&
+	    common->cmnd[0] != SC_WRITE_12 &&
+	    common->cmnd[0] != SC_SYNCHRONIZE_CACHE)
+		fsg_cache_flush(&common->cache);
+
 	down_read(&common->filesem);	/* We're using the backing file */
 	switch (common->cmnd[0]) {
 
@@ -2524,6 +2777,8 @@ buffhds_first_it:
 	} while (--i);
 	bh->next = common->buffhds;
 
+	fsg_cache_init(common);
+
 	snprintf(common->inquiry_string, sizeof common->inquiry_string,
 		 "%-8s%-16s%04x",
 		 "Linux   ",
@@ -2589,6 +2844,7 @@ static void fsg_common_release(struct kref *ref)
 			kfree(bh->buf);
 		} while (++bh, --i);
 	}
+	kfree(common->cache.buf);
 
 	if (common->free_storage_on_release)
 		kfree(common);
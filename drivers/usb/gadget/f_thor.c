@@ -25,6 +25,7 @@
 #include <linux/usb/cdc.h>
 #include <g_dnl.h>
 #include <dfu.h>
+#include <div64.h>
 
 #include "f_thor.h"
 
@@ -141,18 +142,28 @@ static long long int download_head(unsigned long long total,
 				   long long int *left,
 				   int *cnt)
 {
+	struct dfu_entity *dfu_entity = dfu_get_entity(alt_setting_num);
 	long long int rcv_cnt = 0, left_to_rcv, ret_rcv;
-	void *transfer_buffer = dfu_get_buf();
-	void *buf = transfer_buffer;
+	void *transfer_buffer, *buf;
+	long room;
 	int usb_pkt_cnt = 0, ret;
 
 	/*
-	 * Files smaller than THOR_STORE_UNIT_SIZE (now 32 MiB) are stored on
-	 * the medium.
-	 * The packet response is sent on the purpose after successful data
-	 * chunk write. There is a room for improvement when asynchronous write
-	 * is performed.
+	 * Packets are received straight into the DFU buffer, and handed to
+	 * the DFU backend in one chunk once no further packet fits there.
+	 * While the next packets come in, thor_rx_data() has the backend
+	 * write the chunk out.
 	 */
+	transfer_buffer = dfu_get_write_buf(dfu_entity, &room);
+	if (!transfer_buffer)
+		return -ENOMEM;
+	if (room < packet_size) {
+		error("DFU buffer smaller than a packet (%u bytes)",
+		      packet_size);
+		return -ENOMEM;
+	}
+	buf = transfer_buffer;
+
 	while (total - rcv_cnt >= packet_size) {
 		thor_set_dma(buf, packet_size);
 		buf += packet_size;
@@ -163,15 +174,15 @@ static long long int download_head(unsigned long long total,
 		debug("%d: RCV data count: %llu cnt: %d\n", usb_pkt_cnt,
 		      rcv_cnt, *cnt);
 
-		if ((rcv_cnt % THOR_STORE_UNIT_SIZE) == 0) {
-			ret = dfu_write(dfu_get_entity(alt_setting_num),
-					transfer_buffer, THOR_STORE_UNIT_SIZE,
-					(*cnt)++);
+		if (buf - transfer_buffer + packet_size > room) {
+			ret = dfu_write(dfu_entity, transfer_buffer,
+					buf - transfer_buffer, (*cnt)++);
 			if (ret) {
 				error("DFU write failed [%d] cnt: %d",
 				      ret, *cnt);
 				return ret;
 			}
+			transfer_buffer = dfu_get_write_buf(dfu_entity, &room);
 			buf = transfer_buffer;
 		}
 		send_data_rsp(0, ++usb_pkt_cnt);
@@ -182,7 +193,7 @@ static long long int download_head(unsigned long long total,
 
 	/*
 	 * Calculate number of data already received. but not yet stored
-	 * on the medium (they are smaller than THOR_STORE_UNIT_SIZE)
+	 * on the medium (they are smaller than a chunk)
 	 */
 	*left = left_to_rcv + buf - transfer_buffer;
 	debug("%s: left: %llu left_to_rcv: %llu buf: 0x%p\n", __func__,
@@ -205,11 +216,17 @@ static long long int download_head(unsigned long long total,
 static int download_tail(long long int left, int cnt)
 {
 	struct dfu_entity *dfu_entity = dfu_get_entity(alt_setting_num);
-	void *transfer_buffer = dfu_get_buf();
+	void *transfer_buffer;
+	long room;
 	int ret;
 
 	debug("%s: left: %llu cnt: %d\n", __func__, left, cnt);
 
+	/* The rest is where download_head() received it */
+	transfer_buffer = dfu_get_write_buf(dfu_entity, &room);
+	if (!transfer_buffer)
+		return -ENOMEM;
+
 	if (left) {
 		ret = dfu_write(dfu_entity, transfer_buffer, left, cnt++);
 		if (ret) {
@@ -238,6 +255,8 @@ static long long int process_rqt_download(const struct rqt_box *rqt)
 	static long long int left, ret_head;
 	int file_type, ret = 0;
 	static int cnt;
+	static ulong start;
+	ulong ms;
 
 	memset(rsp, 0, sizeof(struct rsp_box));
 	rsp->rsp = rqt->rqt;
@@ -275,6 +294,7 @@ static long long int process_rqt_download(const struct rqt_box *rqt)
 		break;
 	case RQT_DL_FILE_START:
 		send_rsp(rsp);
+		start = get_timer(0);
 		ret_head = download_head(thor_file_size, THOR_PACKET_SIZE,
 					 &left, &cnt);
 		if (ret_head < 0) {
@@ -288,6 +308,12 @@ static long long int process_rqt_download(const struct rqt_box *rqt)
 		ret = rsp->ack;
 		left = 0;
 		cnt = 0;
+		if (!ret) {
+			ms = max(get_timer(start), 1UL);
+			printf("\n%s: %llu bytes in %lu ms (%llu KiB/s)\n",
+			       f_name, thor_file_size, ms,
+			       lldiv(thor_file_size * 1000, ms) / 1024);
+		}
 		break;
 	case RQT_DL_EXIT:
 		debug("DL EXIT\n");
@@ -541,6 +567,8 @@ static int thor_rx_data(void)
 
 		while (!dev->rxdata) {
 			usb_gadget_handle_interrupts();
+			/* Meanwhile, the medium takes the last chunk */
+			dfu_write_poll();
 			if (ctrlc())
 				return -1;
 		}
@@ -562,7 +590,7 @@ static void thor_tx_data(unsigned char *data, int len)
 
 	dev->in_req->length = len;
 
-	debug("%s: dev->in_req->length:%d to_cpy:%d\n", __func__,
+	debug("%s: dev->in_req->length:%d to_cpy:%zu\n", __func__,
 	      dev->in_req->length, sizeof(data));
 
 	status = usb_ep_queue(dev->in_ep, dev->in_req, 0);
@@ -803,6 +831,7 @@ static int thor_func_bind(struct usb_configuration *c, struct usb_function *f)
 	}
 
 	dev->in_ep = ep; /* Store IN EP for enabling @ setup */
+	ep->driver_data = c->cdev; /* claim */
 
 	ep = usb_ep_autoconfig(gadget, &fs_out_desc);
 	if (!ep) {
@@ -815,6 +844,7 @@ static int thor_func_bind(struct usb_configuration *c, struct usb_function *f)
 				fs_out_desc.bEndpointAddress;
 
 	dev->out_ep = ep; /* Store OUT EP for enabling @ setup */
+	ep->driver_data = c->cdev; /* claim */
 
 	ep = usb_ep_autoconfig(gadget, &fs_int_desc);
 	if (!ep) {
@@ -823,6 +853,7 @@ static int thor_func_bind(struct usb_configuration *c, struct usb_function *f)
 	}
 
 	dev->int_ep = ep;
+	ep->driver_data = c->cdev; /* claim */
 
 	if (gadget_is_dualspeed(gadget)) {
 		hs_int_desc.bEndpointAddress =
@@ -868,24 +899,21 @@ static void thor_func_disable(struct usb_function *f)
 
 	debug("%s:\n", __func__);
 
-	/* Avoid freeing memory when ep is still claimed */
-	if (dev->in_ep->driver_data) {
+	/* The endpoints stay claimed from bind, only their requests go */
+	if (dev->in_req) {
 		free_ep_req(dev->in_ep, dev->in_req);
 		usb_ep_disable(dev->in_ep);
-		dev->in_ep->driver_data = NULL;
+		dev->in_req = NULL;
 	}
 
-	if (dev->out_ep->driver_data) {
+	if (dev->out_req) {
 		dev->out_req->buf = NULL;
 		usb_ep_free_request(dev->out_ep, dev->out_req);
 		usb_ep_disable(dev->out_ep);
-		dev->out_ep->driver_data = NULL;
+		dev->out_req = NULL;
 	}
 
-	if (dev->int_ep->driver_data) {
-		usb_ep_disable(dev->int_ep);
-		dev->int_ep->driver_data = NULL;
-	}
+	usb_ep_disable(dev->int_ep);
 }
 
 static int thor_eps_setup(struct usb_function *f)
@@ -906,7 +934,6 @@ static int thor_eps_setup(struct usb_function *f)
 	if (result)
 		goto exit;
 
-	ep->driver_data = cdev; /* claim */
 	req = thor_start_ep(ep);
 	if (!req) {
 		usb_ep_disable(ep);
@@ -923,7 +950,6 @@ static int thor_eps_setup(struct usb_function *f)
 	if (result)
 		goto exit;
 
-	ep->driver_data = cdev; /* claim */
 	req = thor_start_ep(ep);
 	if (!req) {
 		usb_ep_disable(ep);
@@ -932,9 +958,6 @@ static int thor_eps_setup(struct usb_function *f)
 	}
 
 	dev->out_req = req;
-	/* ACM control EP */
-	ep = dev->int_ep;
-	ep->driver_data = cdev;	/* claim */
 
  exit:
 	return result;
@@ -120,5 +120,4 @@ struct f_thor {
 
 #define F_NAME_BUF_SIZE 32
 #define THOR_PACKET_SIZE SZ_1M      /* 1 MiB */
-#define THOR_STORE_UNIT_SIZE SZ_32M /* 32 MiB */
 #endif /* _USB_THOR_H_ */
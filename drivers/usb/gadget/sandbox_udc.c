@@ -0,0 +1,639 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Sandbox USB device controller
+ *
+ * The gadget is cabled to a program on the host which plays the part of
+ * the USB host, through a pair of named pipes. When a gadget driver
+ * registers, the sandbox_udc environment variable gives their common
+ * prefix: U-Boot reads from <prefix>.h2d and writes to <prefix>.d2h.
+ *
+ * Each message starts with a type byte. Lengths are 32-bit little endian.
+ *
+ * host to device:
+ *   'S' setup[8] [data]	control transfer, with the data stage
+ *				appended if it is an OUT one
+ *   'O' ep len data		OUT transfer to endpoint address ep
+ *
+ * device to host:
+ *   'C' len data		data stage of an IN control transfer, or
+ *				an empty one for the status stage of others
+ *   'I' ep len data		IN transfer from endpoint address ep
+ *   'X' ep			endpoint stalled, 0 for a control transfer
+ *
+ * The end of a message is the end of the transfer, so a request is
+ * completed short when the host sends less than it asked for. An OUT
+ * transfer to an endpoint which is not enabled yet is NAKed: it stays in
+ * the pipe, holding up what follows, until the gadget driver enables the
+ * endpoint. The host closing its end of the pipes is a disconnect.
+ *
+ * The sandbox_udc_speed environment variable, in KiB/s, makes the bus
+ * that slow: after moving data the controller leaves U-Boot alone for as
+ * long as the transfer would have taken, and only then completes an OUT
+ * request with it.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <errno.h>
+#include <malloc.h>
+#include <os.h>
+#include <asm/unaligned.h>
+#include <linux/list.h>
+#include <linux/usb/ch9.h>
+#include <linux/usb/gadget.h>
+
+#define UDC_NUM_EPS		8
+#define UDC_EP0_MAXPACKET	64
+#define UDC_EP_MAXPACKET	512
+#define UDC_EP0_BUFSIZE		4096
+/* Time to give the host program when it has nothing for us */
+#define UDC_IDLE_US		100
+
+struct sandbox_udc_ep {
+	struct usb_ep ep;
+	const struct usb_endpoint_descriptor *desc;
+	struct list_head queue;
+};
+
+struct sandbox_udc_req {
+	struct usb_request req;
+	struct list_head queue;
+};
+
+static struct sandbox_udc {
+	struct usb_gadget gadget;
+	struct usb_gadget_driver *driver;
+	struct sandbox_udc_ep ep[UDC_NUM_EPS];
+	int rfd;
+	int wfd;
+	bool connected;
+	/* control transfer waiting for the gadget driver to queue a request */
+	bool setup_pending;
+	struct usb_ctrlrequest setup;
+	uchar setup_data[UDC_EP0_BUFSIZE];
+	/* OUT transfer being received, its endpoint and what is left of it */
+	int out_addr;
+	struct sandbox_udc_ep *out_ep;
+	u32 out_left;
+	/* endpoint whose first request is full, once the bus is free */
+	struct sandbox_udc_ep *out_done;
+	/* emulated bus speed in KiB/s, and when it is free again */
+	unsigned long wire_speed;
+	unsigned long wire_ready;
+} controller;
+
+static struct usb_endpoint_descriptor ep0_desc = {
+	.bLength = sizeof(struct usb_endpoint_descriptor),
+	.bDescriptorType = USB_DT_ENDPOINT,
+	.bEndpointAddress = 0,
+	.bmAttributes =	USB_ENDPOINT_XFER_CONTROL,
+};
+
+/* Account for @len bytes on the emulated bus */
+static void udc_wire(u32 len)
+{
+	unsigned long now;
+
+	if (!controller.wire_speed)
+		return;
+	now = timer_get_us();
+	if ((long)(now - controller.wire_ready) > 0)
+		controller.wire_ready = now;
+	controller.wire_ready += (u64)len * 1000000 /
+			(controller.wire_speed * 1024);
+}
+
+static bool udc_wire_busy(void)
+{
+	return (long)(timer_get_us() - controller.wire_ready) < 0;
+}
+
+/* Read exactly @len bytes from the host */
+static int udc_read(void *buf, int len)
+{
+	char *p = buf;
+	ssize_t ret;
+
+	/* The pipe is non-blocking, but the rest of a message follows */
+	while (len) {
+		ret = os_read(controller.rfd, p, len);
+		if (!ret)
+			return -ENOTCONN;
+		if (ret < 0)
+			continue;
+		p += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+static int udc_write(const void *buf, int len)
+{
+	const char *p = buf;
+	ssize_t ret;
+
+	while (len) {
+		ret = os_write(controller.wfd, p, len);
+		if (ret <= 0)
+			return -ENOTCONN;
+		p += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+/* Send a message to the host, @ep being ignored for control transfers */
+static int udc_send(char type, int ep, const void *data, u32 len)
+{
+	uchar hdr[6];
+	int hlen = 0;
+
+	hdr[hlen++] = type;
+	if (type != 'C')
+		hdr[hlen++] = ep;
+	if (type != 'X') {
+		put_unaligned_le32(len, hdr + hlen);
+		hlen += 4;
+	}
+	if (udc_write(hdr, hlen))
+		return -ENOTCONN;
+	udc_wire(len);
+
+	return udc_write(data, len);
+}
+
+static struct sandbox_udc_req *udc_first_req(struct sandbox_udc_ep *ep)
+{
+	if (list_empty(&ep->queue))
+		return NULL;
+
+	return list_first_entry(&ep->queue, struct sandbox_udc_req, queue);
+}
+
+static void udc_complete(struct sandbox_udc_ep *ep,
+			 struct sandbox_udc_req *req, int status)
+{
+	list_del_init(&req->queue);
+	req->req.status = status;
+	if (req->req.complete)
+		req->req.complete(&ep->ep, &req->req);
+}
+
+static void udc_disconnect(void)
+{
+	if (!controller.connected)
+		return;
+
+	debug("sandbox_udc: disconnect\n");
+	controller.connected = false;
+	controller.setup_pending = false;
+	controller.out_addr = 0;
+	controller.out_ep = NULL;
+	controller.out_done = NULL;
+	controller.gadget.speed = USB_SPEED_UNKNOWN;
+	controller.driver->disconnect(&controller.gadget);
+}
+
+/* Run the data and status stages of the pending control transfer */
+static bool udc_ep0_work(void)
+{
+	struct sandbox_udc_ep *ep = &controller.ep[0];
+	struct sandbox_udc_req *req = udc_first_req(ep);
+	struct usb_ctrlrequest *ctrl = &controller.setup;
+	int len;
+
+	if (!req)
+		return false;
+	if (!controller.setup_pending) {
+		/* a status stage queued on its own, nothing to move */
+		req->req.actual = 0;
+		udc_complete(ep, req, 0);
+		return true;
+	}
+
+	controller.setup_pending = false;
+	len = min((int)le16_to_cpu(ctrl->wLength), (int)req->req.length);
+	req->req.actual = len;
+	if (ctrl->bRequestType & USB_DIR_IN) {
+		udc_send('C', 0, req->req.buf, len);
+		udc_complete(ep, req, 0);
+	} else {
+		memcpy(req->req.buf, controller.setup_data, len);
+		udc_complete(ep, req, 0);
+		udc_send('C', 0, NULL, 0);
+	}
+
+	return true;
+}
+
+static bool udc_in_work(struct sandbox_udc_ep *ep)
+{
+	struct sandbox_udc_req *req = udc_first_req(ep);
+
+	if (!req)
+		return false;
+
+	udc_send('I', ep->desc->bEndpointAddress, req->req.buf,
+		 req->req.length);
+	req->req.actual = req->req.length;
+	udc_complete(ep, req, 0);
+
+	return true;
+}
+
+static struct sandbox_udc_ep *udc_find_ep(int addr)
+{
+	int i;
+
+	for (i = 1; i < UDC_NUM_EPS; i++) {
+		struct sandbox_udc_ep *ep = &controller.ep[i];
+
+		if (ep->desc && ep->desc->bEndpointAddress == addr)
+			return ep;
+	}
+
+	return NULL;
+}
+
+/* Move what we can of the current OUT transfer into the queued request */
+static bool udc_out_work(void)
+{
+	struct sandbox_udc_ep *ep = controller.out_done;
+	struct sandbox_udc_req *req;
+	u32 len;
+
+	if (ep) {
+		if (udc_wire_busy())
+			return false;
+		controller.out_done = NULL;
+		udc_complete(ep, udc_first_req(ep), 0);
+		return true;
+	}
+
+	if (!controller.out_addr)
+		return false;
+	/* NAK until the gadget driver has enabled the endpoint */
+	if (!controller.out_ep)
+		controller.out_ep = udc_find_ep(controller.out_addr);
+	ep = controller.out_ep;
+	if (!ep)
+		return false;
+	req = udc_first_req(ep);
+	if (!req)
+		return false;
+
+	len = min(controller.out_left, req->req.length - req->req.actual);
+	if (udc_read(req->req.buf + req->req.actual, len)) {
+		udc_disconnect();
+		return false;
+	}
+	udc_wire(len);
+	req->req.actual += len;
+	controller.out_left -= len;
+	if (!controller.out_left) {
+		controller.out_addr = 0;
+		controller.out_ep = NULL;
+	}
+	if (!controller.out_addr || req->req.actual == req->req.length)
+		controller.out_done = ep;
+
+	return true;
+}
+
+static int udc_setup(void)
+{
+	struct usb_ctrlrequest *ctrl = &controller.setup;
+	int len = le16_to_cpu(ctrl->wLength);
+	int ret;
+
+	if (!(ctrl->bRequestType & USB_DIR_IN) && len) {
+		if (len > sizeof(controller.setup_data))
+			return -EPROTO;
+		ret = udc_read(controller.setup_data, len);
+		if (ret)
+			return ret;
+		udc_wire(len);
+	}
+	debug("sandbox_udc: setup %02x %02x value %04x index %04x length %d\n",
+	      ctrl->bRequestType, ctrl->bRequest, le16_to_cpu(ctrl->wValue),
+	      le16_to_cpu(ctrl->wIndex), len);
+
+	/* What the controller takes care of itself */
+	if (ctrl->bRequestType == USB_RECIP_DEVICE &&
+	    ctrl->bRequest == USB_REQ_SET_ADDRESS)
+		return udc_send('C', 0, NULL, 0);
+	if (ctrl->bRequestType == USB_RECIP_ENDPOINT &&
+	    ctrl->bRequest == USB_REQ_CLEAR_FEATURE &&
+	    le16_to_cpu(ctrl->wValue) == USB_ENDPOINT_HALT)
+		return udc_send('C', 0, NULL, 0);
+
+	controller.setup_pending = true;
+	ret = controller.driver->setup(&controller.gadget, ctrl);
+	if (ret < 0 && controller.setup_pending) {
+		controller.setup_pending = false;
+		return udc_send('X', 0, NULL, 0);
+	}
+
+	return 0;
+}
+
+/* Take the next message from the host */
+static int udc_receive(void)
+{
+	uchar type, hdr[5];
+	ssize_t ret;
+
+	ret = os_read_no_block(controller.rfd, &type, 1);
+	if (ret < 0)
+		return -EAGAIN;
+	if (!ret)
+		return -ENOTCONN;
+
+	switch (type) {
+	case 'S':
+		ret = udc_read(&controller.setup, sizeof(controller.setup));
+		if (ret)
+			return ret;
+		return udc_setup();
+	case 'O':
+		ret = udc_read(hdr, sizeof(hdr));
+		if (ret)
+			return ret;
+		if (!(hdr[0] & USB_ENDPOINT_NUMBER_MASK) ||
+		    (hdr[0] & USB_DIR_IN)) {
+			printf("sandbox_udc: OUT transfer to bad endpoint %02x\n",
+			       hdr[0]);
+			return -EPROTO;
+		}
+		controller.out_addr = hdr[0];
+		controller.out_left = get_unaligned_le32(hdr + 1);
+		return 0;
+	}
+
+	printf("sandbox_udc: bad message type %02x\n", type);
+
+	return -EPROTO;
+}
+
+/* Run whatever the gadget driver has queued, and what that queues */
+static void udc_work(void)
+{
+	bool busy;
+	int i;
+
+	do {
+		busy = udc_ep0_work();
+		for (i = 1; i < UDC_NUM_EPS; i++) {
+			struct sandbox_udc_ep *ep = &controller.ep[i];
+
+			if (ep->desc && (ep->desc->bEndpointAddress & USB_DIR_IN))
+				busy |= udc_in_work(ep);
+		}
+		busy |= udc_out_work();
+	} while (busy && controller.connected);
+}
+
+int usb_gadget_handle_interrupts(void)
+{
+	int ret;
+
+	/* The bus is busy with the last transfer, nothing to see yet */
+	if (!controller.connected || udc_wire_busy())
+		return 0;
+
+	udc_work();
+
+	/*
+	 * Wait for the driver to enable the endpoint of the current OUT
+	 * transfer, and to make room for it
+	 */
+	if (!controller.connected || controller.out_addr)
+		return 0;
+
+	ret = udc_receive();
+	if (ret == -EAGAIN)
+		os_usleep(UDC_IDLE_US);
+	else if (ret)
+		udc_disconnect();
+	else if (!udc_wire_busy())
+		/* Answer what came without data straight away, as hardware does */
+		udc_work();
+
+	return 0;
+}
+
+static int sandbox_ep_enable(struct usb_ep *ep,
+			     const struct usb_endpoint_descriptor *desc)
+{
+	struct sandbox_udc_ep *sep = container_of(ep, struct sandbox_udc_ep, ep);
+
+	sep->desc = desc;
+	ep->maxpacket = get_unaligned_le16(&desc->wMaxPacketSize);
+
+	return 0;
+}
+
+static int sandbox_ep_disable(struct usb_ep *ep)
+{
+	struct sandbox_udc_ep *sep = container_of(ep, struct sandbox_udc_ep, ep);
+	struct sandbox_udc_req *req, *next;
+
+	/* Drop what is queued, as the hardware would */
+	list_for_each_entry_safe(req, next, &sep->queue, queue)
+		list_del_init(&req->queue);
+	/* The rest of an OUT transfer waits for the endpoint to come back */
+	if (controller.out_ep == sep)
+		controller.out_ep = NULL;
+	if (controller.out_done == sep)
+		controller.out_done = NULL;
+	sep->desc = NULL;
+
+	return 0;
+}
+
+static struct usb_request *sandbox_ep_alloc_request(struct usb_ep *ep,
+						     gfp_t gfp_flags)
+{
+	struct sandbox_udc_req *req;
+
+	req = calloc(1, sizeof(*req));
+	if (!req)
+		return NULL;
+	INIT_LIST_HEAD(&req->queue);
+
+	return &req->req;
+}
+
+static void sandbox_ep_free_request(struct usb_ep *ep,
+				    struct usb_request *_req)
+{
+	struct sandbox_udc_req *req;
+
+	req = container_of(_req, struct sandbox_udc_req, req);
+	list_del(&req->queue);
+	free(req);
+}
+
+static int sandbox_ep_queue(struct usb_ep *ep, struct usb_request *_req,
+			    gfp_t gfp_flags)
+{
+	struct sandbox_udc_ep *sep = container_of(ep, struct sandbox_udc_ep, ep);
+	struct sandbox_udc_req *req;
+
+	if (!controller.connected)
+		return -ESHUTDOWN;
+
+	/* Completed from usb_gadget_handle_interrupts(), like hardware */
+	req = container_of(_req, struct sandbox_udc_req, req);
+	req->req.actual = 0;
+	req->req.status = -EINPROGRESS;
+	list_add_tail(&req->queue, &sep->queue);
+
+	return 0;
+}
+
+static int sandbox_ep_dequeue(struct usb_ep *ep, struct usb_request *_req)
+{
+	struct sandbox_udc_ep *sep = container_of(ep, struct sandbox_udc_ep, ep);
+	struct sandbox_udc_req *req;
+
+	req = container_of(_req, struct sandbox_udc_req, req);
+	if (list_empty(&req->queue))
+		return -EINVAL;
+	if (controller.out_done == sep && req == udc_first_req(sep))
+		controller.out_done = NULL;
+	udc_complete(sep, req, -ECONNRESET);
+
+	return 0;
+}
+
+static int sandbox_ep_set_halt(struct usb_ep *ep, int value)
+{
+	struct sandbox_udc_ep *sep = container_of(ep, struct sandbox_udc_ep, ep);
+
+	if (!value)
+		return 0;
+	if (sep == &controller.ep[0]) {
+		if (!controller.setup_pending)
+			return 0;
+		controller.setup_pending = false;
+	}
+
+	return udc_send('X', sep->desc->bEndpointAddress, NULL, 0);
+}
+
+static struct usb_ep_ops sandbox_ep_ops = {
+	.enable		= sandbox_ep_enable,
+	.disable	= sandbox_ep_disable,
+	.alloc_request	= sandbox_ep_alloc_request,
+	.free_request	= sandbox_ep_free_request,
+	.queue		= sandbox_ep_queue,
+	.dequeue	= sandbox_ep_dequeue,
+	.set_halt	= sandbox_ep_set_halt,
+};
+
+static int sandbox_pullup(struct usb_gadget *gadget, int is_on)
+{
+	return 0;
+}
+
+static struct usb_gadget_ops sandbox_udc_ops = {
+	.pullup = sandbox_pullup,
+};
+
+static void udc_probe(void)
+{
+	struct sandbox_udc_ep *ep;
+	int i;
+
+	memset(controller.ep, '\0', sizeof(controller.ep));
+	controller.gadget.name = "sandbox_udc";
+	controller.gadget.ops = &sandbox_udc_ops;
+	controller.gadget.is_dualspeed = 1;
+	INIT_LIST_HEAD(&controller.gadget.ep_list);
+
+	for (i = 0; i < UDC_NUM_EPS; i++) {
+		ep = &controller.ep[i];
+		ep->ep.ops = &sandbox_ep_ops;
+		INIT_LIST_HEAD(&ep->queue);
+		INIT_LIST_HEAD(&ep->ep.ep_list);
+		if (!i) {
+			ep->ep.name = "ep0";
+			ep->ep.maxpacket = UDC_EP0_MAXPACKET;
+			ep->desc = &ep0_desc;
+		} else {
+			ep->ep.name = "ep-";
+			ep->ep.maxpacket = UDC_EP_MAXPACKET;
+			list_add_tail(&ep->ep.ep_list,
+				      &controller.gadget.ep_list);
+		}
+	}
+	controller.gadget.ep0 = &controller.ep[0].ep;
+}
+
+static int udc_open(const char *prefix, const char *suffix, int flags)
+{
+	char fname[256];
+	int fd;
+
+	snprintf(fname, sizeof(fname), "%s.%s", prefix, suffix);
+	fd = os_open(fname, flags);
+	if (fd < 0)
+		printf("sandbox_udc: cannot open '%s'\n", fname);
+
+	return fd;
+}
+
+int usb_gadget_register_driver(struct usb_gadget_driver *driver)
+{
+	const char *prefix = getenv("sandbox_udc");
+	int ret;
+
+	if (!driver || !driver->bind || !driver->setup || !driver->disconnect)
+		return -EINVAL;
+	if (!prefix) {
+		printf("sandbox_udc: no host program, set sandbox_udc\n");
+		return -ENODEV;
+	}
+
+	/* Both open calls wait for the host program */
+	controller.rfd = udc_open(prefix, "h2d", OS_O_RDONLY);
+	if (controller.rfd < 0)
+		return -ENODEV;
+	controller.wfd = udc_open(prefix, "d2h", OS_O_WRONLY);
+	if (controller.wfd < 0) {
+		os_close(controller.rfd);
+		return -ENODEV;
+	}
+
+	udc_probe();
+	controller.wire_speed = getenv_ulong("sandbox_udc_speed", 10, 0);
+	controller.wire_ready = 0;
+	controller.gadget.speed = USB_SPEED_HIGH;
+	ret = driver->bind(&controller.gadget);
+	if (ret) {
+		debug("driver->bind() returned %d\n", ret);
+		os_close(controller.wfd);
+		os_close(controller.rfd);
+		return ret;
+	}
+	controller.driver = driver;
+	controller.connected = true;
+
+	return 0;
+}
+
+int usb_gadget_unregister_driver(struct usb_gadget_driver *driver)
+{
+	udc_disconnect();
+	driver->unbind(&controller.gadget);
+	controller.driver = NULL;
+	os_close(controller.wfd);
+	os_close(controller.rfd);
+
+	return 0;
+}
@@ -29,6 +29,7 @@
 #include <malloc.h>
 #include <watchdog.h>
 #include <linux/compiler.h>
+#include <linux/compat.h>
 
 #include "ehci.h"
 
@@ -45,7 +46,7 @@
 static struct ehci_ctrl ehcic[CONFIG_USB_MAX_CONTROLLER_COUNT];
 
 #define ALIGN_END_ADDR(type, ptr, size)			\
-	((uint32_t)(ptr) + roundup((size) * sizeof(type), USB_DMA_MINALIGN))
+	((uintptr_t)(ptr) + roundup((size) * sizeof(type), USB_DMA_MINALIGN))
 
 static struct descriptor {
 	struct usb_hub_descriptor hub;
@@ -229,10 +230,41 @@ static int ehci_shutdown(struct ehci_ctrl *ctrl)
 	return ret;
 }
 
+/* Address of a data structure, as the controller links to it */
+static uint32_t ehci_link(void *ptr)
+{
+	return lower_32_bits((uintptr_t)ptr);
+}
+
+/* Data structure a link of the controller points to */
+static void *ehci_link_ptr(struct ehci_ctrl *ctrl, uint32_t link)
+{
+	return (void *)(uintptr_t)((u64)ctrl->dsseg << 32 | (link & ~0x1f));
+}
+
+/*
+ * Memory for the data structures the controller links together, which
+ * all have to be in the segment of CTRLDSSEGMENT. The size is rounded up
+ * so that cache maintenance of one never touches another.
+ */
+static void *ehci_alloc_desc(struct ehci_ctrl *ctrl, size_t align,
+			     size_t size)
+{
+	void *ptr = memalign(align, roundup(size, USB_DMA_MINALIGN));
+
+	if (ptr && upper_32_bits((uintptr_t)ptr) != ctrl->dsseg) {
+		printf("EHCI: %p is outside segment %#x\n", ptr, ctrl->dsseg);
+		free(ptr);
+		return NULL;
+	}
+
+	return ptr;
+}
+
 static int ehci_td_buffer(struct qTD *td, void *buf, size_t sz)
 {
-	uint32_t delta, next;
-	uint32_t addr = (uint32_t)buf;
+	uintptr_t delta, next;
+	uintptr_t addr = (uintptr_t)buf;
 	int idx;
 
 	if (addr != ALIGN(addr, ARCH_DMA_MINALIGN))
@@ -242,8 +274,8 @@ static int ehci_td_buffer(struct qTD *td, void *buf, size_t sz)
 
 	idx = 0;
 	while (idx < QT_BUFFER_CNT) {
-		td->qt_buffer[idx] = cpu_to_hc32(addr);
-		td->qt_buffer_hi[idx] = 0;
+		td->qt_buffer[idx] = cpu_to_hc32(lower_32_bits(addr));
+		td->qt_buffer_hi[idx] = cpu_to_hc32(upper_32_bits(addr));
 		next = (addr + EHCI_PAGE_SIZE) & ~(EHCI_PAGE_SIZE - 1);
 		delta = next - addr;
 		if (delta >= sz)
@@ -254,7 +286,7 @@ static int ehci_td_buffer(struct qTD *td, void *buf, size_t sz)
 	}
 
 	if (idx == QT_BUFFER_CNT) {
-		printf("out of buffer pointers (%u bytes left)\n", sz);
+		printf("out of buffer pointers (%zu bytes left)\n", sz);
 		return -1;
 	}
 
@@ -273,11 +305,40 @@ static inline u8 ehci_encode_speed(enum usb_device_speed speed)
 	return QH_FULL_SPEED;
 }
 
+/*
+ * The qTDs of asynchronous transfers come from a per-controller pool,
+ * which is only ever grown, so that a stream of bulk transfers does not
+ * go through the allocator each time.
+ */
+#define TD_POOL_GRANULE	32
+
+static struct qTD *ehci_get_qtds(struct ehci_ctrl *ctrl, int count)
+{
+	if (count <= ctrl->td_pool_count)
+		return ctrl->td_pool;
+
+	count = roundup(count, TD_POOL_GRANULE);
+	free(ctrl->td_pool);
+	ctrl->td_pool = ehci_alloc_desc(ctrl, USB_DMA_MINALIGN,
+					count * sizeof(struct qTD));
+	ctrl->td_pool_count = ctrl->td_pool ? count : 0;
+
+	return ctrl->td_pool;
+}
+
+static void ehci_free_qtds(struct ehci_ctrl *ctrl)
+{
+	free(ctrl->td_pool);
+	ctrl->td_pool = NULL;
+	ctrl->td_pool_count = 0;
+}
+
 static int
 ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
 		   int length, struct devrequest *req)
 {
-	ALLOC_ALIGN_BUFFER(struct QH, qh, 1, USB_DMA_MINALIGN);
+	struct ehci_ctrl *ctrl = dev->controller;
+	struct QH *qh = ctrl->async_qh;
 	struct qTD *qtd;
 	int qtd_count = 0;
 	int qtd_counter = 0;
@@ -289,7 +350,6 @@ ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
 	uint32_t cmd;
 	int timeout;
 	int ret = 0;
-	struct ehci_ctrl *ctrl = dev->controller;
 
 	debug("dev=%p, pipe=%lx, buffer=%p, length=%d, req=%p\n", dev, pipe,
 	      buffer, length, req);
@@ -340,7 +400,7 @@ ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
 		 * qTD transfer size will be one page shorter, and the first qTD
 		 * data buffer of each transfer will be page-unaligned.
 		 */
-		if ((uint32_t)buffer & (PKT_ALIGN - 1))
+		if ((uintptr_t)buffer & (PKT_ALIGN - 1))
 			xfr_sz--;
 		/* Convert the qTD transfer size to bytes. */
 		xfr_sz *= EHCI_PAGE_SIZE;
@@ -359,7 +419,7 @@ ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
 #if CONFIG_SYS_MALLOC_LEN <= 64 + 128 * 1024
 #warning CONFIG_SYS_MALLOC_LEN may be too small for EHCI
 #endif
-	qtd = memalign(USB_DMA_MINALIGN, qtd_count * sizeof(struct qTD));
+	qtd = ehci_get_qtds(ctrl, qtd_count);
 	if (qtd == NULL) {
 		printf("unable to allocate TDs\n");
 		return -1;
@@ -380,7 +440,7 @@ ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
 	 *   qh_overlay.qt_next ...... 13-10 H
 	 * - qh_overlay.qt_altnext
 	 */
-	qh->qh_link = cpu_to_hc32((uint32_t)&ctrl->qh_list | QH_LINK_TYPE_QH);
+	qh->qh_link = cpu_to_hc32(ehci_link(ctrl->qh_list) | QH_LINK_TYPE_QH);
 	c = (dev->speed != USB_SPEED_HIGH) && !usb_pipeendpoint(pipe);
 	maxpacket = usb_maxpacket(dev, pipe);
 	endpt = QH_ENDPT1_RL(8) | QH_ENDPT1_C(c) |
@@ -421,7 +481,7 @@ ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
 			goto fail;
 		}
 		/* Update previous qTD! */
-		*tdp = cpu_to_hc32((uint32_t)&qtd[qtd_counter]);
+		*tdp = cpu_to_hc32(ehci_link(&qtd[qtd_counter]));
 		tdp = &qtd[qtd_counter++].qt_next;
 		toggle = 1;
 	}
@@ -441,7 +501,7 @@ ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
 			 * portion of the first page before the buffer start
 			 * offset within that page is unusable.
 			 */
-			xfr_bytes -= (uint32_t)buf_ptr & (EHCI_PAGE_SIZE - 1);
+			xfr_bytes -= (uintptr_t)buf_ptr & (EHCI_PAGE_SIZE - 1);
 			/*
 			 * In order to keep each packet within a qTD transfer,
 			 * align the qTD transfer size to PKT_ALIGN.
@@ -480,7 +540,7 @@ ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
 				goto fail;
 			}
 			/* Update previous qTD! */
-			*tdp = cpu_to_hc32((uint32_t)&qtd[qtd_counter]);
+			*tdp = cpu_to_hc32(ehci_link(&qtd[qtd_counter]));
 			tdp = &qtd[qtd_counter++].qt_next;
 			/*
 			 * Data toggle has to be adjusted since the qTD transfer
@@ -511,21 +571,21 @@ ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
 			QT_TOKEN_STATUS(QT_TOKEN_STATUS_ACTIVE);
 		qtd[qtd_counter].qt_token = cpu_to_hc32(token);
 		/* Update previous qTD! */
-		*tdp = cpu_to_hc32((uint32_t)&qtd[qtd_counter]);
+		*tdp = cpu_to_hc32(ehci_link(&qtd[qtd_counter]));
 		tdp = &qtd[qtd_counter++].qt_next;
 	}
 
-	ctrl->qh_list.qh_link = cpu_to_hc32((uint32_t)qh | QH_LINK_TYPE_QH);
+	ctrl->qh_list->qh_link = cpu_to_hc32(ehci_link(qh) | QH_LINK_TYPE_QH);
 
 	/* Flush dcache */
-	flush_dcache_range((uint32_t)&ctrl->qh_list,
-		ALIGN_END_ADDR(struct QH, &ctrl->qh_list, 1));
-	flush_dcache_range((uint32_t)qh, ALIGN_END_ADDR(struct QH, qh, 1));
-	flush_dcache_range((uint32_t)qtd,
+	flush_dcache_range((uintptr_t)ctrl->qh_list,
+		ALIGN_END_ADDR(struct QH, ctrl->qh_list, 1));
+	flush_dcache_range((uintptr_t)qh, ALIGN_END_ADDR(struct QH, qh, 1));
+	flush_dcache_range((uintptr_t)qtd,
 			   ALIGN_END_ADDR(struct qTD, qtd, qtd_count));
 
 	/* Set async. queue head pointer. */
-	ehci_writel(&ctrl->hcor->or_asynclistaddr, (uint32_t)&ctrl->qh_list);
+	ehci_writel(&ctrl->hcor->or_asynclistaddr, ehci_link(ctrl->qh_list));
 
 	usbsts = ehci_readl(&ctrl->hcor->or_usbsts);
 	ehci_writel(&ctrl->hcor->or_usbsts, (usbsts & 0x3f));
@@ -548,11 +608,11 @@ ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
 	timeout = USB_TIMEOUT_MS(pipe);
 	do {
 		/* Invalidate dcache */
-		invalidate_dcache_range((uint32_t)&ctrl->qh_list,
-			ALIGN_END_ADDR(struct QH, &ctrl->qh_list, 1));
-		invalidate_dcache_range((uint32_t)qh,
+		invalidate_dcache_range((uintptr_t)ctrl->qh_list,
+			ALIGN_END_ADDR(struct QH, ctrl->qh_list, 1));
+		invalidate_dcache_range((uintptr_t)qh,
 			ALIGN_END_ADDR(struct QH, qh, 1));
-		invalidate_dcache_range((uint32_t)qtd,
+		invalidate_dcache_range((uintptr_t)qtd,
 			ALIGN_END_ADDR(struct qTD, qtd, qtd_count));
 
 		token = hc32_to_cpu(vtd->qt_token);
@@ -570,8 +630,8 @@ ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
 	 * dangerous operation, it's responsibility of the calling
 	 * code to make sure enough space is reserved.
 	 */
-	invalidate_dcache_range((uint32_t)buffer,
-		ALIGN((uint32_t)buffer + length, ARCH_DMA_MINALIGN));
+	invalidate_dcache_range((uintptr_t)buffer,
+		ALIGN((uintptr_t)buffer + length, ARCH_DMA_MINALIGN));
 
 	/* Check that the TD processing happened */
 	if (QT_TOKEN_GET_STATUS(token) & QT_TOKEN_STATUS_ACTIVE)
@@ -628,11 +688,9 @@ ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
 #endif
 	}
 
-	free(qtd);
 	return (dev->status != USB_ST_NOT_PROC) ? 0 : -1;
 
 fail:
-	free(qtd);
 	return -1;
 }
 
@@ -917,9 +975,44 @@ unknown:
 	return -1;
 }
 
+/*
+ * Allocate the QHs and the frame list the schedules start from. They
+ * are kept across 'usb reset', and fix the segment the qTDs must share.
+ */
+static int ehci_alloc_schedule(struct ehci_ctrl *ctrl)
+{
+	if (ctrl->qh_list)
+		return 0;
+
+	ctrl->qh_list = memalign(USB_DMA_MINALIGN,
+				 roundup(sizeof(struct QH), USB_DMA_MINALIGN));
+	if (!ctrl->qh_list)
+		return -ENOMEM;
+	ctrl->dsseg = upper_32_bits((uintptr_t)ctrl->qh_list);
+	ctrl->periodic_queue = ehci_alloc_desc(ctrl, USB_DMA_MINALIGN,
+					       sizeof(struct QH));
+	ctrl->async_qh = ehci_alloc_desc(ctrl, USB_DMA_MINALIGN,
+					 sizeof(struct QH));
+	ctrl->periodic_list = ehci_alloc_desc(ctrl, 4096, 1024 * 4);
+	if (ctrl->periodic_queue && ctrl->async_qh && ctrl->periodic_list)
+		return 0;
+
+	free(ctrl->periodic_list);
+	free(ctrl->async_qh);
+	free(ctrl->periodic_queue);
+	free(ctrl->qh_list);
+	ctrl->periodic_list = NULL;
+	ctrl->async_qh = NULL;
+	ctrl->periodic_queue = NULL;
+	ctrl->qh_list = NULL;
+
+	return -ENOMEM;
+}
+
 int usb_lowlevel_stop(int index)
 {
 	ehci_shutdown(&ehcic[index]);
+	ehci_free_qtds(&ehcic[index]);
 	return ehci_hcd_stop(index);
 }
 
@@ -947,15 +1040,23 @@ int usb_lowlevel_init(int index, enum usb_init_type init, void **controller)
 	if (rc)
 		return rc;
 #endif
+	if (ehci_alloc_schedule(&ehcic[index]))
+		return -ENOMEM;
+
 	/* Set the high address word (aka segment) for 64-bit controller */
-	if (ehci_readl(&ehcic[index].hccr->cr_hccparams) & 1)
-		ehci_writel(&ehcic[index].hcor->or_ctrldssegment, 0);
+	if (ehci_readl(&ehcic[index].hccr->cr_hccparams) & 1) {
+		ehci_writel(&ehcic[index].hcor->or_ctrldssegment,
+			    ehcic[index].dsseg);
+	} else if (ehcic[index].dsseg) {
+		printf("EHCI: 32-bit controller, memory above 4GiB\n");
+		return -1;
+	}
 
-	qh_list = &ehcic[index].qh_list;
+	qh_list = ehcic[index].qh_list;
 
 	/* Set head of reclaim list */
 	memset(qh_list, 0, sizeof(*qh_list));
-	qh_list->qh_link = cpu_to_hc32((uint32_t)qh_list | QH_LINK_TYPE_QH);
+	qh_list->qh_link = cpu_to_hc32(ehci_link(qh_list) | QH_LINK_TYPE_QH);
 	qh_list->qh_endpt1 = cpu_to_hc32(QH_ENDPT1_H(1) |
 						QH_ENDPT1_EPS(USB_SPEED_HIGH));
 	qh_list->qh_curtd = cpu_to_hc32(QT_NEXT_TERMINATE);
@@ -964,23 +1065,23 @@ int usb_lowlevel_init(int index, enum usb_init_type init, void **controller)
 	qh_list->qh_overlay.qt_token =
 			cpu_to_hc32(QT_TOKEN_STATUS(QT_TOKEN_STATUS_HALTED));
 
-	flush_dcache_range((uint32_t)qh_list,
+	flush_dcache_range((uintptr_t)qh_list,
 			   ALIGN_END_ADDR(struct QH, qh_list, 1));
 
 	/* Set async. queue head pointer. */
-	ehci_writel(&ehcic[index].hcor->or_asynclistaddr, (uint32_t)qh_list);
+	ehci_writel(&ehcic[index].hcor->or_asynclistaddr, ehci_link(qh_list));
 
 	/*
 	 * Set up periodic list
 	 * Step 1: Parent QH for all periodic transfers.
 	 */
-	periodic = &ehcic[index].periodic_queue;
+	periodic = ehcic[index].periodic_queue;
 	memset(periodic, 0, sizeof(*periodic));
 	periodic->qh_link = cpu_to_hc32(QH_LINK_TERMINATE);
 	periodic->qh_overlay.qt_next = cpu_to_hc32(QT_NEXT_TERMINATE);
 	periodic->qh_overlay.qt_altnext = cpu_to_hc32(QT_NEXT_TERMINATE);
 
-	flush_dcache_range((uint32_t)periodic,
+	flush_dcache_range((uintptr_t)periodic,
 			   ALIGN_END_ADDR(struct QH, periodic, 1));
 
 	/*
@@ -992,23 +1093,18 @@ int usb_lowlevel_init(int index, enum usb_init_type init, void **controller)
 	 *         Split Transactions will be spread across microframes using
 	 *         S-mask and C-mask.
 	 */
-	if (ehcic[index].periodic_list == NULL)
-		ehcic[index].periodic_list = memalign(4096, 1024 * 4);
-
-	if (!ehcic[index].periodic_list)
-		return -ENOMEM;
 	for (i = 0; i < 1024; i++) {
-		ehcic[index].periodic_list[i] = cpu_to_hc32((uint32_t)periodic
+		ehcic[index].periodic_list[i] = cpu_to_hc32(ehci_link(periodic)
 						| QH_LINK_TYPE_QH);
 	}
 
-	flush_dcache_range((uint32_t)ehcic[index].periodic_list,
+	flush_dcache_range((uintptr_t)ehcic[index].periodic_list,
 			   ALIGN_END_ADDR(uint32_t, ehcic[index].periodic_list,
 					  1024));
 
 	/* Set periodic list base address */
 	ehci_writel(&ehcic[index].hcor->or_periodiclistbase,
-		(uint32_t)ehcic[index].periodic_list);
+		ehci_link(ehcic[index].periodic_list));
 
 	reg = ehci_readl(&ehcic[index].hccr->cr_hcsparams);
 	descriptor.hub.bNbrPorts = HCS_N_PORTS(reg);
@@ -1063,6 +1159,16 @@ submit_bulk_msg(struct usb_device *dev, unsigned long pipe, void *buffer,
 	return ehci_submit_async(dev, pipe, buffer, length, NULL);
 }
 
+int usb_get_max_xfer_size(struct usb_device *dev, size_t *size)
+{
+	/*
+	 * Any length that fits the int of submit_bulk_msg() goes, as long
+	 * as the qTD pool can grow to cover it
+	 */
+	*size = 0x7fffffff;
+	return 0;
+}
+
 int
 submit_control_msg(struct usb_device *dev, unsigned long pipe, void *buffer,
 		   int length, struct devrequest *setup)
@@ -1082,15 +1188,25 @@ submit_control_msg(struct usb_device *dev, unsigned long pipe, void *buffer,
 	return ehci_submit_async(dev, pipe, buffer, length, setup);
 }
 
+/*
+ * An interrupt queue is one QH with a ring of qTDs, one per element of
+ * the buffer. An element handed out by poll_int_queue() is given back to
+ * the controller at the next poll, so the endpoint is polled every frame
+ * without the schedule ever being touched again.
+ */
 struct int_queue {
-	struct QH *first;
-	struct QH *current;
-	struct QH *last;
+	struct QH *qh;
 	struct qTD *tds;
+	void *buffer;
+	int queuesize;
+	int elementsize;
+	int current;		/* element to complete next */
+	int rearm;		/* element handed out last, -1 if none */
+	unsigned long pipe;
+	bool active_seen;	/* current was still active in frame */
+	uint32_t frame;
 };
 
-#define NEXT_QH(qh) (struct QH *)(hc32_to_cpu((qh)->qh_link) & ~0x1f)
-
 static int
 enable_periodic(struct ehci_ctrl *ctrl)
 {
@@ -1134,12 +1250,34 @@ disable_periodic(struct ehci_ctrl *ctrl)
 
 static int periodic_schedules;
 
+/* Hand an element of an interrupt queue (back) to the controller */
+static void ehci_int_queue_arm(struct int_queue *queue, int i)
+{
+	struct qTD *td = &queue->tds[i];
+	int next = (i + 1) % queue->queuesize;
+
+	td->qt_next = cpu_to_hc32(ehci_link(&queue->tds[next]));
+	td->qt_altnext = cpu_to_hc32(QT_NEXT_TERMINATE);
+	ehci_td_buffer(td, queue->buffer + i * queue->elementsize,
+		       queue->elementsize);
+	/* The token goes last, the controller may pick the qTD up at once */
+	td->qt_token = cpu_to_hc32(QT_TOKEN_TOTALBYTES(queue->elementsize) |
+				   QT_TOKEN_IOC(1) | QT_TOKEN_CERR(3) |
+				   QT_TOKEN_PID(usb_pipein(queue->pipe) ?
+						QT_TOKEN_PID_IN :
+						QT_TOKEN_PID_OUT) |
+				   QT_TOKEN_STATUS(QT_TOKEN_STATUS_ACTIVE));
+	flush_dcache_range((uintptr_t)td, ALIGN_END_ADDR(struct qTD, td, 1));
+}
+
 struct int_queue *
 create_int_queue(struct usb_device *dev, unsigned long pipe, int queuesize,
 		 int elementsize, void *buffer)
 {
 	struct ehci_ctrl *ctrl = dev->controller;
 	struct int_queue *result = NULL;
+	struct QH *list = ctrl->periodic_queue;
+	struct QH *qh;
 	int i;
 
 	debug("Enter create_int_queue\n");
@@ -1157,157 +1295,162 @@ create_int_queue(struct usb_device *dev, unsigned long pipe, int queuesize,
 		return NULL;
 	}
 
-	result = malloc(sizeof(*result));
+	result = calloc(1, sizeof(*result));
 	if (!result) {
 		debug("ehci intr queue: out of memory\n");
 		goto fail1;
 	}
-	result->first = memalign(USB_DMA_MINALIGN,
-				 sizeof(struct QH) * queuesize);
-	if (!result->first) {
+	result->qh = ehci_alloc_desc(ctrl, USB_DMA_MINALIGN, sizeof(struct QH));
+	if (!result->qh) {
 		debug("ehci intr queue: out of memory\n");
 		goto fail2;
 	}
-	result->current = result->first;
-	result->last = result->first + queuesize - 1;
-	result->tds = memalign(USB_DMA_MINALIGN,
-			       sizeof(struct qTD) * queuesize);
+	result->tds = ehci_alloc_desc(ctrl, USB_DMA_MINALIGN,
+				      sizeof(struct qTD) * queuesize);
 	if (!result->tds) {
 		debug("ehci intr queue: out of memory\n");
 		goto fail3;
 	}
-	memset(result->first, 0, sizeof(struct QH) * queuesize);
-	memset(result->tds, 0, sizeof(struct qTD) * queuesize);
+	result->buffer = buffer;
+	result->queuesize = queuesize;
+	result->elementsize = elementsize;
+	result->rearm = -1;
+	result->pipe = pipe;
+	debug("communication direction is '%s'\n",
+	      usb_pipein(pipe) ? "in" : "out");
 
-	for (i = 0; i < queuesize; i++) {
-		struct QH *qh = result->first + i;
-		struct qTD *td = result->tds + i;
-		void **buf = &qh->buffer;
-
-		qh->qh_link = cpu_to_hc32((uint32_t)(qh+1) | QH_LINK_TYPE_QH);
-		if (i == queuesize - 1)
-			qh->qh_link = cpu_to_hc32(QH_LINK_TERMINATE);
-
-		qh->qh_overlay.qt_next = cpu_to_hc32((uint32_t)td);
-		qh->qh_overlay.qt_altnext = cpu_to_hc32(QT_NEXT_TERMINATE);
-		qh->qh_endpt1 =
-			cpu_to_hc32((0 << 28) | /* No NAK reload (ehci 4.9) */
-			(usb_maxpacket(dev, pipe) << 16) | /* MPS */
-			(1 << 14) |
-			QH_ENDPT1_EPS(ehci_encode_speed(dev->speed)) |
-			(usb_pipeendpoint(pipe) << 8) | /* Endpoint Number */
-			(usb_pipedevice(pipe) << 0));
-		qh->qh_endpt2 = cpu_to_hc32((1 << 30) | /* 1 Tx per mframe */
-			(1 << 0)); /* S-mask: microframe 0 */
-		if (dev->speed == USB_SPEED_LOW ||
-				dev->speed == USB_SPEED_FULL) {
-			debug("TT: port: %d, hub address: %d\n",
-				dev->portnr, dev->parent->devnum);
-			qh->qh_endpt2 |= cpu_to_hc32((dev->portnr << 23) |
-				(dev->parent->devnum << 16) |
-				(0x1c << 8)); /* C-mask: microframes 2-4 */
-		}
+	memset(result->tds, 0, sizeof(struct qTD) * queuesize);
+	for (i = 0; i < queuesize; i++)
+		ehci_int_queue_arm(result, i);
 
-		td->qt_next = cpu_to_hc32(QT_NEXT_TERMINATE);
-		td->qt_altnext = cpu_to_hc32(QT_NEXT_TERMINATE);
-		debug("communication direction is '%s'\n",
-		      usb_pipein(pipe) ? "in" : "out");
-		td->qt_token = cpu_to_hc32((elementsize << 16) |
-			((usb_pipein(pipe) ? 1 : 0) << 8) | /* IN/OUT token */
-			0x80); /* active */
-		td->qt_buffer[0] =
-		    cpu_to_hc32((uint32_t)buffer + i * elementsize);
-		td->qt_buffer[1] =
-		    cpu_to_hc32((td->qt_buffer[0] + 0x1000) & ~0xfff);
-		td->qt_buffer[2] =
-		    cpu_to_hc32((td->qt_buffer[0] + 0x2000) & ~0xfff);
-		td->qt_buffer[3] =
-		    cpu_to_hc32((td->qt_buffer[0] + 0x3000) & ~0xfff);
-		td->qt_buffer[4] =
-		    cpu_to_hc32((td->qt_buffer[0] + 0x4000) & ~0xfff);
-
-		*buf = buffer + i * elementsize;
+	/*
+	 * The data toggle is kept in the QH, so that it carries on from one
+	 * qTD to the next
+	 */
+	qh = result->qh;
+	memset(qh, 0, sizeof(*qh));
+	qh->qh_endpt1 =
+		cpu_to_hc32(QH_ENDPT1_RL(0) | /* No NAK reload (ehci 4.9) */
+		QH_ENDPT1_MAXPKTLEN(usb_maxpacket(dev, pipe)) |
+		QH_ENDPT1_DTC(QH_ENDPT1_DTC_IGNORE_QTD_TD) |
+		QH_ENDPT1_EPS(ehci_encode_speed(dev->speed)) |
+		QH_ENDPT1_ENDPT(usb_pipeendpoint(pipe)) |
+		QH_ENDPT1_DEVADDR(usb_pipedevice(pipe)));
+	qh->qh_endpt2 = cpu_to_hc32(QH_ENDPT2_MULT(1) | /* 1 Tx per mframe */
+		QH_ENDPT2_UFSMASK(1)); /* S-mask: microframe 0 */
+	if (dev->speed == USB_SPEED_LOW ||
+			dev->speed == USB_SPEED_FULL) {
+		debug("TT: port: %d, hub address: %d\n",
+			dev->portnr, dev->parent->devnum);
+		qh->qh_endpt2 |= cpu_to_hc32(QH_ENDPT2_PORTNUM(dev->portnr) |
+			QH_ENDPT2_HUBADDR(dev->parent->devnum) |
+			QH_ENDPT2_UFCMASK(0x1c)); /* C-mask: microframes 2-4 */
 	}
+	qh->qh_curtd = cpu_to_hc32(QT_NEXT_TERMINATE);
+	qh->qh_overlay.qt_next = cpu_to_hc32(ehci_link(result->tds));
+	qh->qh_overlay.qt_altnext = cpu_to_hc32(QT_NEXT_TERMINATE);
+	qh->qh_overlay.qt_token = cpu_to_hc32(QT_TOKEN_DT(usb_gettoggle(dev,
+				usb_pipeendpoint(pipe), usb_pipeout(pipe))));
 
-	flush_dcache_range((uint32_t)buffer,
+	flush_dcache_range((uintptr_t)buffer,
 			   ALIGN_END_ADDR(char, buffer,
 					  queuesize * elementsize));
-	flush_dcache_range((uint32_t)result->first,
-			   ALIGN_END_ADDR(struct QH, result->first,
-					  queuesize));
-	flush_dcache_range((uint32_t)result->tds,
-			   ALIGN_END_ADDR(struct qTD, result->tds,
-					  queuesize));
 
 	if (disable_periodic(ctrl) < 0) {
 		debug("FATAL: periodic should never fail, but did");
-		goto fail3;
+		goto fail4;
 	}
 
 	/* hook up to periodic list */
-	struct QH *list = &ctrl->periodic_queue;
-	result->last->qh_link = list->qh_link;
-	list->qh_link = cpu_to_hc32((uint32_t)result->first | QH_LINK_TYPE_QH);
+	qh->qh_link = list->qh_link;
+	list->qh_link = cpu_to_hc32(ehci_link(qh) | QH_LINK_TYPE_QH);
 
-	flush_dcache_range((uint32_t)result->last,
-			   ALIGN_END_ADDR(struct QH, result->last, 1));
-	flush_dcache_range((uint32_t)list,
+	flush_dcache_range((uintptr_t)qh, ALIGN_END_ADDR(struct QH, qh, 1));
+	flush_dcache_range((uintptr_t)list,
 			   ALIGN_END_ADDR(struct QH, list, 1));
 
 	if (enable_periodic(ctrl) < 0) {
 		debug("FATAL: periodic should never fail, but did");
-		goto fail3;
+		goto fail4;
 	}
 	periodic_schedules++;
 
 	debug("Exit create_int_queue\n");
 	return result;
+fail4:
+	free(result->tds);
 fail3:
-	if (result->tds)
-		free(result->tds);
+	free(result->qh);
 fail2:
-	if (result->first)
-		free(result->first);
-	if (result)
-		free(result);
+	free(result);
 fail1:
 	return NULL;
 }
 
+/*
+ * Return the next element the controller has completed, or NULL. The
+ * element stays the caller's until the next call, which gives it back
+ * to the controller.
+ */
 void *poll_int_queue(struct usb_device *dev, struct int_queue *queue)
 {
-	struct QH *cur = queue->current;
+	struct ehci_ctrl *ctrl = dev->controller;
+	struct qTD *td = &queue->tds[queue->current];
+	uint32_t token, frame;
+	void *buf;
+
+	if (queue->rearm >= 0) {
+		ehci_int_queue_arm(queue, queue->rearm);
+		queue->rearm = -1;
+	}
 
-	/* depleted queue */
-	if (cur == NULL) {
-		debug("Exit poll_int_queue with completed queue\n");
+	/*
+	 * The QH only runs at the start of each frame, so once its qTD has
+	 * been seen active there is nothing new to look for until the next
+	 */
+	frame = ehci_readl(&ctrl->hcor->or_frindex) >> 3;
+	if (queue->active_seen && frame == queue->frame)
+		return NULL;
+
+	invalidate_dcache_range((uintptr_t)td,
+				ALIGN_END_ADDR(struct qTD, td, 1));
+	token = hc32_to_cpu(td->qt_token);
+	if (QT_TOKEN_GET_STATUS(token) & QT_TOKEN_STATUS_ACTIVE) {
+		queue->active_seen = true;
+		queue->frame = frame;
 		return NULL;
 	}
-	/* still active */
-	invalidate_dcache_range((uint32_t)cur,
-				ALIGN_END_ADDR(struct QH, cur, 1));
-	if (cur->qh_overlay.qt_token & cpu_to_hc32(0x80)) {
-		debug("Exit poll_int_queue with no completed intr transfer. "
-		      "token is %x\n", cur->qh_overlay.qt_token);
+	queue->active_seen = false;
+	if (QT_TOKEN_GET_STATUS(token) & QT_TOKEN_STATUS_HALTED) {
+		debug("Interrupt queue halted, token is %x\n", token);
+		dev->act_len = 0;
+		dev->status = USB_ST_STALLED;
 		return NULL;
 	}
-	if (!(cur->qh_link & QH_LINK_TERMINATE))
-		queue->current++;
-	else
-		queue->current = NULL;
+
+	buf = queue->buffer + queue->current * queue->elementsize;
+	dev->act_len = queue->elementsize - QT_TOKEN_GET_TOTALBYTES(token);
+	dev->status = 0;
+	invalidate_dcache_range((uintptr_t)buf,
+				ALIGN_END_ADDR(char, buf, queue->elementsize));
 	debug("Exit poll_int_queue with completed intr transfer. "
-	      "token is %x at %p (first at %p)\n", cur->qh_overlay.qt_token,
-	      &cur->qh_overlay.qt_token, queue->first);
-	return cur->buffer;
+	      "token is %x at %p\n", token, td);
+
+	queue->rearm = queue->current;
+	queue->current = (queue->current + 1) % queue->queuesize;
+
+	return buf;
 }
 
-/* Do not free buffers associated with QHs, they're owned by someone else */
+/* Do not free the buffer of the queue, it's owned by someone else */
 int
 destroy_int_queue(struct usb_device *dev, struct int_queue *queue)
 {
 	struct ehci_ctrl *ctrl = dev->controller;
+	struct QH *cur = ctrl->periodic_queue;
+	uint32_t link = ehci_link(queue->qh) | QH_LINK_TYPE_QH;
+	uint32_t token;
 	int result = -1;
-	unsigned long timeout;
 
 	if (disable_periodic(ctrl) < 0) {
 		debug("FATAL: periodic should never fail, but did");
@@ -1315,24 +1458,26 @@ destroy_int_queue(struct usb_device *dev, struct int_queue *queue)
 	}
 	periodic_schedules--;
 
-	struct QH *cur = &ctrl->periodic_queue;
-	timeout = get_timer(0) + 500; /* abort after 500ms */
 	while (!(cur->qh_link & cpu_to_hc32(QH_LINK_TERMINATE))) {
 		debug("considering %p, with qh_link %x\n", cur, cur->qh_link);
-		if (NEXT_QH(cur) == queue->first) {
+		if (cur->qh_link == cpu_to_hc32(link)) {
 			debug("found candidate. removing from chain\n");
-			cur->qh_link = queue->last->qh_link;
+			cur->qh_link = queue->qh->qh_link;
+			flush_dcache_range((uintptr_t)cur,
+					   ALIGN_END_ADDR(struct QH, cur, 1));
 			result = 0;
 			break;
 		}
-		cur = NEXT_QH(cur);
-		if (get_timer(0) > timeout) {
-			printf("Timeout destroying interrupt endpoint queue\n");
-			result = -1;
-			goto out;
-		}
+		cur = ehci_link_ptr(ctrl, hc32_to_cpu(cur->qh_link));
 	}
 
+	/* The next transfer on the endpoint carries on with the toggle */
+	invalidate_dcache_range((uintptr_t)queue->qh,
+				ALIGN_END_ADDR(struct QH, queue->qh, 1));
+	token = hc32_to_cpu(queue->qh->qh_overlay.qt_token);
+	usb_settoggle(dev, usb_pipeendpoint(queue->pipe),
+		      usb_pipeout(queue->pipe), QT_TOKEN_GET_DT(token));
+
 	if (periodic_schedules > 0) {
 		result = enable_periodic(ctrl);
 		if (result < 0)
@@ -1341,7 +1486,7 @@ destroy_int_queue(struct usb_device *dev, struct int_queue *queue)
 
 out:
 	free(queue->tds);
-	free(queue->first);
+	free(queue->qh);
 	free(queue);
 
 	return result;
@@ -1377,6 +1522,8 @@ submit_int_msg(struct usb_device *dev, unsigned long pipe, void *buffer,
 	}
 
 	queue = create_int_queue(dev, pipe, 1, length, buffer);
+	if (!queue)
+		return -1;
 
 	timeout = get_timer(0) + USB_TIMEOUT_MS(pipe);
 	while ((backbuffer = poll_int_queue(dev, queue)) == NULL)
@@ -1386,15 +1533,12 @@ submit_int_msg(struct usb_device *dev, unsigned long pipe, void *buffer,
 			break;
 		}
 
-	if (backbuffer != buffer) {
-		debug("got wrong buffer back (%x instead of %x)\n",
-		      (uint32_t)backbuffer, (uint32_t)buffer);
-		return -EINVAL;
+	if (backbuffer && backbuffer != buffer) {
+		debug("got wrong buffer back (%p instead of %p)\n",
+		      backbuffer, buffer);
+		result = -EINVAL;
 	}
 
-	invalidate_dcache_range((uint32_t)buffer,
-				ALIGN_END_ADDR(char, buffer, length));
-
 	ret = destroy_int_queue(dev, queue);
 	if (ret < 0)
 		return ret;
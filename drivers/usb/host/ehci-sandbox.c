@@ -0,0 +1,532 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Sandbox EHCI host controller
+ *
+ * A model of an EHCI controller, enough for the EHCI driver: its
+ * registers react to the accesses the driver makes through
+ * ehci_readl()/ehci_writel(), and the asynchronous and periodic
+ * schedules it builds in memory are run against the emulated devices of
+ * the sandbox host controller.
+ *
+ * The bus is described by the environment when 'usb start' runs:
+ *
+ *   sandbox_usb		devices on the root ports, as for the sandbox
+ *			host controller: file names for storage devices,
+ *			'kbd' for keyboards, '-' for empty ports and
+ *			'hub(...)' for hubs
+ *   sandbox_usb_kbd	what the keyboards type, an Enter following it
+ *   sandbox_usb_pgood	power-on to power-good time of the emulated
+ *			hubs, in ms (default 100)
+ *
+ * The asynchronous schedule runs within the register write which
+ * enables it, and again at each register access while it is enabled.
+ * The periodic schedule runs as time passes, also caught up at each
+ * register access: each 1ms frame, every QH of the frame's list with an
+ * S-mask gets one transaction. Intervals are not modelled (the driver
+ * links every QH into every frame), nor are split transactions: all
+ * devices are high speed. The data buffer of a qTD has to be
+ * contiguous, which it always is here.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <errno.h>
+#include <usb.h>
+#include <linux/compat.h>
+#include "ehci.h"
+#include "usb-sandbox.h"
+
+#define SANDBOX_EHCI_PORTS	CONFIG_SYS_USB_EHCI_MAX_ROOT_PORTS
+#define SANDBOX_HUB_PGOOD_MS	100
+/* Frames the periodic schedule catches up on at most */
+#define SANDBOX_EHCI_MAX_FRAMES	1024
+/* Guard against loops in the lists the driver builds */
+#define SANDBOX_EHCI_MAX_QHS	64
+
+#define STS_USBINT		(1 << 0)
+#define STS_W1C			0x3f
+#define QH_LINK_TYPE(link)	((link) & 6)
+#define QH_ENDPT1_GET_MAXPKTLEN(x)	(((x) >> 16) & 0x7ff)
+#define QH_ENDPT1_GET_ENDPT(x)	(((x) >> 8) & 0xf)
+#define QH_ENDPT1_GET_DEVADDR(x)	((x) & 0x7f)
+
+struct sandbox_ehci_regs {
+	struct ehci_hccr cap;
+	struct ehci_hcor op __aligned(32);
+};
+
+static struct sandbox_ehci {
+	struct sandbox_ehci_regs regs;
+	struct sandbox_usb_emul *ports[SANDBOX_EHCI_PORTS];
+	ulong frame_us;		/* timer_get_us() when the frame started */
+	u32 frame;
+	bool busy;
+} se;
+
+/* Turn a link of the driver's data structures into a pointer */
+static void *sandbox_ehci_ptr(u32 link)
+{
+	return (void *)(uintptr_t)((u64)se.regs.op.or_ctrldssegment << 32 |
+				   (link & ~0x1f));
+}
+
+/* Address of byte @offset of the data of a qTD, from its page list */
+static u64 sandbox_ehci_page(struct qTD *td, int page)
+{
+	return (u64)le32_to_cpu(td->qt_buffer_hi[page]) << 32 |
+		(le32_to_cpu(td->qt_buffer[page]) & ~0xfff);
+}
+
+/* Data of a qTD about to move @len bytes; NULL if not contiguous */
+static void *sandbox_ehci_data(struct qTD *td, int len)
+{
+	u64 start = sandbox_ehci_page(td, 0) |
+		(le32_to_cpu(td->qt_buffer[0]) & 0xfff);
+	int pages = ((start & 0xfff) + len + 0xfff) >> 12;
+	int i;
+
+	if (pages > QT_BUFFER_CNT)
+		return NULL;
+	for (i = 1; i < pages; i++) {
+		if (sandbox_ehci_page(td, i) !=
+				(start & ~(u64)0xfff) + i * EHCI_PAGE_SIZE)
+			return NULL;
+	}
+
+	return (void *)(uintptr_t)start;
+}
+
+/* Step the data of a qTD on by @len bytes */
+static void sandbox_ehci_data_done(struct qTD *td, int len)
+{
+	u64 addr = sandbox_ehci_page(td, 0) +
+		(le32_to_cpu(td->qt_buffer[0]) & 0xfff) + len;
+	int i;
+
+	/* The pages are contiguous: move the list along with the data */
+	for (i = 0; i < QT_BUFFER_CNT; i++) {
+		td->qt_buffer[i] = cpu_to_le32(lower_32_bits(addr));
+		td->qt_buffer_hi[i] = cpu_to_le32(upper_32_bits(addr));
+		addr = (addr & ~(u64)0xfff) + EHCI_PAGE_SIZE;
+	}
+}
+
+static struct sandbox_usb_emul *sandbox_ehci_find(int addr)
+{
+	struct sandbox_usb_emul *emul, *found;
+	int port;
+
+	for (port = 0; port < SANDBOX_EHCI_PORTS; port++) {
+		emul = se.ports[port];
+		if (!emul || !(se.regs.op.or_portsc[port] & EHCI_PS_PE))
+			continue;
+		if (emul->addr == addr)
+			return emul;
+		if (emul->ops->find) {
+			found = emul->ops->find(emul, addr);
+			if (found)
+				return found;
+		}
+	}
+
+	return NULL;
+}
+
+/* Finish the qTD in the overlay, writing its token back */
+static void sandbox_ehci_retire(struct QH *qh, u32 status)
+{
+	struct qTD *td = sandbox_ehci_ptr(le32_to_cpu(qh->qh_curtd));
+	u32 token = le32_to_cpu(qh->qh_overlay.qt_token);
+
+	token = (token & ~QT_TOKEN_STATUS(0xff)) | QT_TOKEN_STATUS(status);
+	qh->qh_overlay.qt_token = cpu_to_le32(token);
+	td->qt_token = qh->qh_overlay.qt_token;
+	if (token & QT_TOKEN_IOC(1))
+		se.regs.op.or_usbsts |= STS_USBINT;
+}
+
+/*
+ * Load the next qTD into the overlay of a QH if the one there is done;
+ * false if there is no active qTD to run
+ */
+static bool sandbox_ehci_fetch(struct QH *qh)
+{
+	u32 token = le32_to_cpu(qh->qh_overlay.qt_token);
+	u32 endpt1 = le32_to_cpu(qh->qh_endpt1);
+	u32 next, dt;
+	struct qTD *td;
+
+	if (QT_TOKEN_GET_STATUS(token) & QT_TOKEN_STATUS_HALTED)
+		return false;
+	if (QT_TOKEN_GET_STATUS(token) & QT_TOKEN_STATUS_ACTIVE)
+		return true;
+
+	/* After a short packet, the alternate pointer if there is one */
+	next = le32_to_cpu(qh->qh_overlay.qt_altnext);
+	if (!QT_TOKEN_GET_TOTALBYTES(token) || (next & QT_NEXT_TERMINATE))
+		next = le32_to_cpu(qh->qh_overlay.qt_next);
+	if (next & QT_NEXT_TERMINATE)
+		return false;
+	td = sandbox_ehci_ptr(next);
+	if (!(QT_TOKEN_GET_STATUS(le32_to_cpu(td->qt_token)) &
+	      QT_TOKEN_STATUS_ACTIVE))
+		return false;
+
+	/* Unless the toggle comes from the qTD, the QH keeps its own */
+	dt = token & QT_TOKEN_DT(1);
+	memcpy(&qh->qh_overlay, td, sizeof(*td));
+	qh->qh_curtd = cpu_to_le32(next & ~0x1f);
+	if (!(endpt1 & QH_ENDPT1_DTC(1))) {
+		token = le32_to_cpu(qh->qh_overlay.qt_token);
+		token = (token & ~QT_TOKEN_DT(1)) | dt;
+		qh->qh_overlay.qt_token = cpu_to_le32(token);
+	}
+
+	return true;
+}
+
+/* Run a whole control transfer, from the SETUP qTD in the overlay */
+static void sandbox_ehci_control(struct QH *qh,
+				 struct sandbox_usb_emul *emul)
+{
+	struct qTD *setup = sandbox_ehci_ptr(le32_to_cpu(qh->qh_curtd));
+	struct qTD *data = NULL, *status, *td;
+	struct devrequest req;
+	void *buf = NULL, *p;
+	int len = 0, ret;
+	u32 token;
+
+	p = sandbox_ehci_data(&qh->qh_overlay, sizeof(req));
+	if (!p) {
+		sandbox_ehci_retire(qh, QT_TOKEN_STATUS_HALTED |
+				    QT_TOKEN_STATUS_DATBUFERR);
+		return;
+	}
+	memcpy(&req, p, sizeof(req));
+	sandbox_ehci_retire(qh, 0);
+
+	td = sandbox_ehci_ptr(le32_to_cpu(setup->qt_next));
+	token = le32_to_cpu(td->qt_token);
+	if (QT_TOKEN_GET_TOTALBYTES(token) || !(le32_to_cpu(td->qt_next) &
+						QT_NEXT_TERMINATE)) {
+		data = td;
+		len = QT_TOKEN_GET_TOTALBYTES(token);
+		buf = len ? sandbox_ehci_data(data, len) : NULL;
+		status = sandbox_ehci_ptr(le32_to_cpu(data->qt_next));
+	} else {
+		status = td;
+	}
+
+	ret = sandbox_usb_emul_control(emul, &req, buf, len);
+	debug("sandbox_ehci: %s: request %02x type %02x value %04x: %d\n",
+	      emul->name, req.request, req.requesttype,
+	      le16_to_cpu(req.value), ret);
+
+	/* A STALL halts the queue on the stage which got it */
+	td = ret < 0 ? (data ? data : status) : status;
+	if (data && ret >= 0) {
+		token = le32_to_cpu(data->qt_token);
+		token &= ~(QT_TOKEN_TOTALBYTES(0x7fff) |
+			   QT_TOKEN_STATUS(QT_TOKEN_STATUS_ACTIVE));
+		data->qt_token = cpu_to_le32(token |
+					     QT_TOKEN_TOTALBYTES(len - ret));
+	}
+	memcpy(&qh->qh_overlay, td, sizeof(*td));
+	qh->qh_curtd = cpu_to_le32((uintptr_t)td & ~0x1f);
+	sandbox_ehci_retire(qh, ret < 0 ? QT_TOKEN_STATUS_HALTED : 0);
+}
+
+/*
+ * Run the transfers of a QH: one transaction in the periodic schedule,
+ * else until it runs out of qTDs or the device NAKs. Returns true if
+ * anything moved.
+ */
+static bool sandbox_ehci_run_qh(struct QH *qh, bool periodic)
+{
+	u32 endpt1 = le32_to_cpu(qh->qh_endpt1);
+	int maxp = QH_ENDPT1_GET_MAXPKTLEN(endpt1);
+	struct sandbox_usb_emul *emul;
+	bool progress = false;
+	int len, ret, pid, packets;
+	u32 token;
+	void *buf;
+
+	while (sandbox_ehci_fetch(qh)) {
+		emul = sandbox_ehci_find(QH_ENDPT1_GET_DEVADDR(endpt1));
+		if (!emul) {
+			sandbox_ehci_retire(qh, QT_TOKEN_STATUS_HALTED |
+					    QT_TOKEN_STATUS_XACTERR);
+			return true;
+		}
+		token = le32_to_cpu(qh->qh_overlay.qt_token);
+		pid = (token >> 8) & 3;
+		if (pid == QT_TOKEN_PID_SETUP) {
+			sandbox_ehci_control(qh, emul);
+			progress = true;
+			continue;
+		}
+
+		len = QT_TOKEN_GET_TOTALBYTES(token);
+		if (periodic)
+			len = min(len, maxp);
+		buf = sandbox_ehci_data(&qh->qh_overlay, len);
+		if (!buf) {
+			sandbox_ehci_retire(qh, QT_TOKEN_STATUS_HALTED |
+					    QT_TOKEN_STATUS_DATBUFERR);
+			return true;
+		}
+		ret = emul->ops->bulk ?
+			emul->ops->bulk(emul, QH_ENDPT1_GET_ENDPT(endpt1),
+					pid == QT_TOKEN_PID_IN, buf, len) :
+			-EPIPE;
+		if (ret == -EAGAIN)
+			return progress;
+		progress = true;
+		if (ret < 0) {
+			sandbox_ehci_retire(qh, QT_TOKEN_STATUS_HALTED |
+					    (ret == -EPIPE ? 0 :
+					     QT_TOKEN_STATUS_XACTERR));
+			return true;
+		}
+
+		/* Each packet flips the toggle */
+		packets = ret ? DIV_ROUND_UP(ret, maxp) : 1;
+		if (packets & 1)
+			token ^= QT_TOKEN_DT(1);
+		token -= QT_TOKEN_TOTALBYTES(ret);
+		qh->qh_overlay.qt_token = cpu_to_le32(token);
+		sandbox_ehci_data_done(&qh->qh_overlay, ret);
+		if (!QT_TOKEN_GET_TOTALBYTES(token) || ret < len)
+			sandbox_ehci_retire(qh, 0);
+		if (periodic)
+			break;
+	}
+
+	return progress;
+}
+
+static void sandbox_ehci_run_async(void)
+{
+	u32 head = se.regs.op.or_asynclistaddr;
+	u32 link = head;
+	bool progress;
+	struct QH *qh;
+	int i;
+
+	if (se.busy)
+		return;
+	se.busy = true;
+	do {
+		progress = false;
+		for (i = 0; i < SANDBOX_EHCI_MAX_QHS; i++) {
+			qh = sandbox_ehci_ptr(link);
+			if (sandbox_ehci_run_qh(qh, false))
+				progress = true;
+			link = le32_to_cpu(qh->qh_link);
+			if ((link & QH_LINK_TERMINATE) ||
+			    (link & ~0x1f) == (head & ~0x1f))
+				break;
+		}
+	} while (progress);
+	se.busy = false;
+}
+
+static void sandbox_ehci_run_frame(u32 frame)
+{
+	u32 *list = sandbox_ehci_ptr(se.regs.op.or_periodiclistbase);
+	u32 link = le32_to_cpu(list[frame % 1024]);
+	struct QH *qh;
+	int i;
+
+	for (i = 0; i < SANDBOX_EHCI_MAX_QHS; i++) {
+		if ((link & QH_LINK_TERMINATE) ||
+		    QH_LINK_TYPE(link) != QH_LINK_TYPE_QH)
+			break;
+		qh = sandbox_ehci_ptr(link);
+		if (QH_ENDPT2_UFSMASK(0xff) & le32_to_cpu(qh->qh_endpt2))
+			sandbox_ehci_run_qh(qh, true);
+		link = le32_to_cpu(qh->qh_link);
+	}
+}
+
+/* Catch up with the frames which went by since the last access */
+static void sandbox_ehci_update(void)
+{
+	struct ehci_hcor *op = &se.regs.op;
+	ulong now = timer_get_us();
+	ulong frames;
+
+	if (op->or_usbsts & STS_HALT) {
+		se.frame_us = now;
+		return;
+	}
+	frames = (now - se.frame_us) / 1000;
+	se.frame_us += frames * 1000;
+	if (frames > SANDBOX_EHCI_MAX_FRAMES)
+		frames = SANDBOX_EHCI_MAX_FRAMES;
+
+	if (!se.busy) {
+		se.busy = true;
+		while (frames--) {
+			se.frame++;
+			op->or_frindex = (se.frame << 3) & 0x3fff;
+			if (op->or_usbsts & STS_PSS)
+				sandbox_ehci_run_frame(se.frame);
+		}
+		se.busy = false;
+	}
+	if (op->or_usbsts & STS_ASS)
+		sandbox_ehci_run_async();
+}
+
+u32 sandbox_ehci_readl(volatile u32 *reg)
+{
+	sandbox_ehci_update();
+
+	return *reg;
+}
+
+static void sandbox_ehci_reset(void)
+{
+	int port;
+
+	memset(&se.regs.op, '\0', sizeof(se.regs.op));
+	se.regs.op.or_usbsts = STS_HALT;
+	se.frame = 0;
+	for (port = 0; port < SANDBOX_EHCI_PORTS; port++) {
+		se.regs.op.or_portsc[port] = EHCI_PS_PP;
+		if (se.ports[port])
+			se.regs.op.or_portsc[port] |= EHCI_PS_CS | EHCI_PS_CSC;
+	}
+}
+
+static void sandbox_ehci_write_portsc(int port, u32 val)
+{
+	struct sandbox_usb_emul *emul = se.ports[port];
+	volatile u32 *portsc = &se.regs.op.or_portsc[port];
+	u32 old = *portsc;
+
+	/* Change bits are write 1 to clear, the enable bit only clears */
+	*portsc = (old & (EHCI_PS_PP | EHCI_PS_OCA | EHCI_PS_CS)) |
+		(old & EHCI_PS_CLEAR & ~val) |
+		(old & val & EHCI_PS_PE) |
+		(val & (EHCI_PS_PR | EHCI_PS_SUSP | EHCI_PS_PO |
+			EHCI_PS_WKOC_E | EHCI_PS_WKDSCNNT_E |
+			EHCI_PS_WKCNNT_E | 0xf << 16));
+
+	/* The end of a reset enables the port, all devices are high speed */
+	if ((old & EHCI_PS_PR) && !(val & EHCI_PS_PR) && emul &&
+	    !(*portsc & EHCI_PS_PO)) {
+		if (emul->ops->reset)
+			emul->ops->reset(emul);
+		emul->addr = 0;
+		emul->configuration = 0;
+		*portsc |= EHCI_PS_PE;
+	}
+	if (*portsc & EHCI_PS_PO)
+		*portsc &= ~(EHCI_PS_CS | EHCI_PS_PE);
+}
+
+void sandbox_ehci_writel(volatile u32 *reg, u32 val)
+{
+	struct sandbox_ehci_regs *regs = &se.regs;
+	struct ehci_hcor *op = &regs->op;
+	uintptr_t offset = (uintptr_t)reg - (uintptr_t)regs;
+
+	/* Only the registers are modelled, anything else is plain memory */
+	if (offset >= sizeof(*regs)) {
+		*reg = val;
+		return;
+	}
+
+	sandbox_ehci_update();
+	if (reg == &op->or_usbcmd) {
+		if (val & CMD_RESET) {
+			sandbox_ehci_reset();
+			return;
+		}
+		*reg = val;
+		if (val & CMD_RUN) {
+			if (op->or_usbsts & STS_HALT)
+				se.frame_us = timer_get_us();
+			op->or_usbsts &= ~STS_HALT;
+		} else {
+			op->or_usbsts |= STS_HALT;
+		}
+		if (val & CMD_PSE)
+			op->or_usbsts |= STS_PSS;
+		else
+			op->or_usbsts &= ~STS_PSS;
+		if (val & CMD_ASE) {
+			op->or_usbsts |= STS_ASS;
+			sandbox_ehci_run_async();
+		} else {
+			op->or_usbsts &= ~STS_ASS;
+		}
+	} else if (reg == &op->or_usbsts) {
+		*reg &= ~(val & STS_W1C);
+	} else if (reg >= &op->or_portsc[0] &&
+		   reg < &op->or_portsc[SANDBOX_EHCI_PORTS]) {
+		sandbox_ehci_write_portsc(reg - &op->or_portsc[0], val);
+	} else if (reg == &op->or_frindex) {
+		/* Only while halted, the frame counter starts from there */
+		if (op->or_usbsts & STS_HALT) {
+			*reg = val & 0x3fff;
+			se.frame = *reg >> 3;
+		}
+	} else {
+		*reg = val;
+	}
+}
+
+int ehci_hcd_init(int index, enum usb_init_type init,
+		  struct ehci_hccr **hccr, struct ehci_hcor **hcor)
+{
+	const char *spec = getenv("sandbox_usb");
+	int pgood_ms;
+	int nports;
+
+	if (init != USB_INIT_HOST)
+		return -ENODEV;
+
+	pgood_ms = getenv_ulong("sandbox_usb_pgood", 10, SANDBOX_HUB_PGOOD_MS);
+	if (!spec)
+		spec = "";
+	memset(se.ports, '\0', sizeof(se.ports));
+	nports = sandbox_usb_emul_parse(&spec, se.ports, SANDBOX_EHCI_PORTS,
+					pgood_ms);
+	if (nports < 0)
+		return -EINVAL;
+	if (*spec) {
+		printf("sandbox_ehci: unexpected '%s'\n", spec);
+		ehci_hcd_stop(index);
+		return -EINVAL;
+	}
+
+	memset(&se.regs.cap, '\0', sizeof(se.regs.cap));
+	se.regs.cap.cr_capbase = 0x100 << 16 |
+		offsetof(struct sandbox_ehci_regs, op);
+	/* Ports always powered, no companion controllers */
+	se.regs.cap.cr_hcsparams = SANDBOX_EHCI_PORTS;
+	se.regs.cap.cr_hccparams = 1;	/* 64-bit addressing */
+	sandbox_ehci_reset();
+
+	*hccr = &se.regs.cap;
+	*hcor = &se.regs.op;
+
+	return 0;
+}
+
+int ehci_hcd_stop(int index)
+{
+	int port;
+
+	for (port = 0; port < SANDBOX_EHCI_PORTS; port++) {
+		sandbox_usb_emul_remove(se.ports[port]);
+		se.ports[port] = NULL;
+	}
+
+	return 0;
+}
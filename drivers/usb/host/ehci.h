@@ -114,7 +114,13 @@ struct usb_linux_config_descriptor {
 	unsigned char	MaxPower;
 } __attribute__ ((packed));
 
-#if defined CONFIG_EHCI_DESC_BIG_ENDIAN
+#if defined CONFIG_USB_EHCI_SANDBOX
+/* Register accesses drive sandbox's model of the controller */
+u32 sandbox_ehci_readl(volatile u32 *reg);
+void sandbox_ehci_writel(volatile u32 *reg, u32 val);
+#define ehci_readl(x)		sandbox_ehci_readl((volatile u32 *)(x))
+#define ehci_writel(a, b)	sandbox_ehci_writel((volatile u32 *)(a), (b))
+#elif defined CONFIG_EHCI_DESC_BIG_ENDIAN
 #define	ehci_readl(x)		(*((volatile u32 *)(x)))
 #define ehci_writel(a, b)	(*((volatile u32 *)(a)) = ((volatile u32)b))
 #else
@@ -243,10 +249,18 @@ struct ehci_ctrl {
 	struct ehci_hcor *hcor;
 	int rootdev;
 	uint16_t portreset;
-	struct QH qh_list __aligned(USB_DMA_MINALIGN);
-	struct QH periodic_queue __aligned(USB_DMA_MINALIGN);
+	/*
+	 * The controller follows 32-bit links between its data structures,
+	 * so they are all allocated within the segment of CTRLDSSEGMENT
+	 */
+	uint32_t dsseg;
+	struct QH *qh_list;
+	struct QH *periodic_queue;
+	struct QH *async_qh;	/* QH of asynchronous transfers */
 	uint32_t *periodic_list;
 	int ntds;
+	struct qTD *td_pool;	/* qTDs for asynchronous transfers */
+	int td_pool_count;
 };
 
 /* Low level init functions */
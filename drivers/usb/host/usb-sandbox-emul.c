@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Requests common to the emulated USB devices of sandbox's host
+ * controllers
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <errno.h>
+#include <usb.h>
+#include "usb-sandbox.h"
+
+static int sandbox_usb_get_descriptor(struct sandbox_usb_emul *emul,
+				      struct devrequest *req, void *buf,
+				      int len)
+{
+	int type = le16_to_cpu(req->value) >> 8;
+	int index = le16_to_cpu(req->value) & 0xff;
+	const uchar *config = emul->config;
+	uchar *p = buf;
+	const char *str;
+	int i, size;
+
+	switch (type) {
+	case USB_DT_DEVICE:
+		size = min(len, USB_DT_DEVICE_SIZE);
+		memcpy(buf, emul->dev_desc, size);
+		return size;
+	case USB_DT_CONFIG:
+		size = min(len, config[2] | config[3] << 8);
+		memcpy(buf, config, size);
+		return size;
+	case USB_DT_STRING:
+		if (index > emul->nstrings)
+			return -EPIPE;
+		if (!index) {
+			/* the only language, US English */
+			static const uchar langids[] = { 4, USB_DT_STRING,
+							 0x09, 0x04 };
+
+			size = min(len, (int)sizeof(langids));
+			memcpy(buf, langids, size);
+			return size;
+		}
+		str = emul->strings[index - 1];
+		size = min(len, 2 + 2 * (int)strlen(str));
+		for (i = 0; i < size; i++) {
+			if (i == 0)
+				p[i] = 2 + 2 * strlen(str);
+			else if (i == 1)
+				p[i] = USB_DT_STRING;
+			else
+				p[i] = i & 1 ? 0 : str[i / 2 - 1];
+		}
+		return size;
+	}
+
+	return -EPIPE;
+}
+
+/* Standard requests, common to all emulated devices */
+static int sandbox_usb_std_request(struct sandbox_usb_emul *emul,
+				   struct devrequest *req, void *buf, int len)
+{
+	switch (req->request) {
+	case USB_REQ_GET_DESCRIPTOR:
+		return sandbox_usb_get_descriptor(emul, req, buf, len);
+	case USB_REQ_SET_ADDRESS:
+		emul->addr = le16_to_cpu(req->value);
+		return 0;
+	case USB_REQ_SET_CONFIGURATION:
+		emul->configuration = le16_to_cpu(req->value);
+		return 0;
+	case USB_REQ_GET_STATUS:
+		memset(buf, '\0', min(len, 2));
+		return min(len, 2);
+	case USB_REQ_SET_INTERFACE:
+	case USB_REQ_CLEAR_FEATURE:
+	case USB_REQ_SET_FEATURE:
+		return 0;
+	}
+
+	return -EPIPE;
+}
+
+int sandbox_usb_emul_control(struct sandbox_usb_emul *emul,
+			     struct devrequest *req, void *buf, int len)
+{
+	if ((req->requesttype & USB_TYPE_MASK) == USB_TYPE_STANDARD)
+		return sandbox_usb_std_request(emul, req, buf, len);
+	if (emul->ops->control)
+		return emul->ops->control(emul, req, buf, len);
+
+	return -EPIPE;
+}
+
+void sandbox_usb_emul_remove(struct sandbox_usb_emul *emul)
+{
+	if (emul && emul->ops->remove)
+		emul->ops->remove(emul);
+}
+
+/* Parse one device of the bus description */
+static int sandbox_usb_parse_item(const char **specp,
+				  struct sandbox_usb_emul **emulp,
+				  int hub_pgood_ms)
+{
+	struct sandbox_usb_emul *children[USB_MAXCHILDREN];
+	const char *p = *specp;
+	char fname[256];
+	int len, nports, i;
+
+	*emulp = NULL;
+	if (!strncmp(p, "hub(", 4)) {
+		p += 4;
+		nports = sandbox_usb_emul_parse(&p, children, USB_MAXCHILDREN,
+						hub_pgood_ms);
+		if (nports < 0)
+			return nports;
+		if (*p != ')') {
+			printf("sandbox_usb: missing ')'\n");
+			goto err;
+		}
+		/* A hub has at least one port, if only an empty one */
+		if (!nports)
+			children[nports++] = NULL;
+		*emulp = sandbox_usb_hub_create(nports, children, hub_pgood_ms);
+		if (!*emulp)
+			goto err;
+		*specp = p + 1;
+		return 0;
+err:
+		for (i = 0; i < nports; i++)
+			sandbox_usb_emul_remove(children[i]);
+		return -EINVAL;
+	}
+
+	for (len = 0; p[len] && p[len] != ' ' && p[len] != ')'; len++)
+		;
+	*specp = p + len;
+	if (len == 1 && *p == '-')
+		return 0;
+	if (len == 3 && !strncmp(p, "kbd", 3)) {
+		*emulp = sandbox_usb_kbd_create(getenv("sandbox_usb_kbd"));
+		return *emulp ? 0 : -EINVAL;
+	}
+	if (len >= sizeof(fname)) {
+		printf("sandbox_usb: file name too long\n");
+		return -EINVAL;
+	}
+	memcpy(fname, p, len);
+	fname[len] = '\0';
+	*emulp = sandbox_usb_flash_create(fname);
+
+	return *emulp ? 0 : -EINVAL;
+}
+
+int sandbox_usb_emul_parse(const char **specp,
+			   struct sandbox_usb_emul **children, int max,
+			   int hub_pgood_ms)
+{
+	const char *p = *specp;
+	int nports = 0;
+	int i;
+
+	for (;;) {
+		while (*p == ' ')
+			p++;
+		if (!*p || *p == ')')
+			break;
+		if (nports == max) {
+			printf("sandbox_usb: more than %d ports on a hub\n",
+			       max);
+			goto err;
+		}
+		if (sandbox_usb_parse_item(&p, &children[nports],
+					   hub_pgood_ms))
+			goto err;
+		nports++;
+	}
+	*specp = p;
+
+	return nports;
+
+err:
+	for (i = 0; i < nports; i++)
+		sandbox_usb_emul_remove(children[i]);
+
+	return -EINVAL;
+}
@@ -0,0 +1,342 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Emulated USB flash drive for the sandbox host controller
+ *
+ * A bulk-only transport mass-storage device with a single LUN, whose
+ * medium is a host file. Only the SCSI commands the U-Boot storage
+ * driver uses are implemented.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <errno.h>
+#include <malloc.h>
+#include <os.h>
+#include <scsi.h>
+#include <usb.h>
+#include <asm/unaligned.h>
+#include "usb-sandbox.h"
+
+#define FLASH_BLKSZ		512
+#define FLASH_EP_IN		1
+#define FLASH_EP_OUT		2
+
+#define CBW_SIGNATURE		0x43425355
+#define CBW_SIZE		31
+#define CSW_SIGNATURE		0x53425355
+#define CSW_SIZE		13
+
+/* Class requests */
+#define BBB_REQ_RESET		0xff
+#define BBB_REQ_GET_MAX_LUN	0xfe
+
+enum flash_phase {
+	PHASE_CBW,		/* waiting for a command block */
+	PHASE_DATA_IN,
+	PHASE_DATA_OUT,
+	PHASE_CSW,		/* status is ready to be read */
+};
+
+struct sandbox_flash {
+	struct sandbox_usb_emul emul;
+	int fd;
+	ulong blocks;
+	enum flash_phase phase;
+	u32 tag;
+	u32 residue;		/* bytes of the data stage not moved yet */
+	u8 status;
+	u8 sense_key;
+	u8 cmd;
+	uchar reply[36];	/* data of commands other than READ/WRITE */
+	int reply_len;
+};
+
+static const struct usb_device_descriptor flash_dev_desc = {
+	.bLength		= USB_DT_DEVICE_SIZE,
+	.bDescriptorType	= USB_DT_DEVICE,
+	.bcdUSB			= __constant_cpu_to_le16(0x0200),
+	.bMaxPacketSize0	= 64,
+	.idVendor		= __constant_cpu_to_le16(0x1234),
+	.idProduct		= __constant_cpu_to_le16(0x5678),
+	.bcdDevice		= __constant_cpu_to_le16(0x0100),
+	.iManufacturer		= 1,
+	.iProduct		= 2,
+	.iSerialNumber		= 3,
+	.bNumConfigurations	= 1,
+};
+
+static const uchar flash_config[] = {
+	/* configuration */
+	USB_DT_CONFIG_SIZE, USB_DT_CONFIG,
+	USB_DT_CONFIG_SIZE + USB_DT_INTERFACE_SIZE + 2 * USB_DT_ENDPOINT_SIZE,
+	0,
+	1,			/* bNumInterfaces */
+	1,			/* bConfigurationValue */
+	0,			/* iConfiguration */
+	0x80,			/* bmAttributes: bus powered */
+	50,			/* bMaxPower: 100mA */
+	/* interface */
+	USB_DT_INTERFACE_SIZE, USB_DT_INTERFACE,
+	0,			/* bInterfaceNumber */
+	0,			/* bAlternateSetting */
+	2,			/* bNumEndpoints */
+	USB_CLASS_MASS_STORAGE,
+	US_SC_SCSI,
+	US_PR_BULK,
+	0,			/* iInterface */
+	/* bulk in */
+	USB_DT_ENDPOINT_SIZE, USB_DT_ENDPOINT,
+	USB_DIR_IN | FLASH_EP_IN,
+	USB_ENDPOINT_XFER_BULK,
+	0x00, 0x02,		/* wMaxPacketSize: 512 */
+	0,
+	/* bulk out */
+	USB_DT_ENDPOINT_SIZE, USB_DT_ENDPOINT,
+	USB_DIR_OUT | FLASH_EP_OUT,
+	USB_ENDPOINT_XFER_BULK,
+	0x00, 0x02,
+	0,
+};
+
+static const char * const flash_strings[] = {
+	"U-Boot",
+	"Sandbox flash",
+	"2014",
+};
+
+static void sandbox_flash_fail(struct sandbox_flash *priv, u8 sense_key)
+{
+	priv->status = 1;
+	priv->sense_key = sense_key;
+}
+
+/* Start a command from a command block wrapper */
+static int sandbox_flash_cbw(struct sandbox_flash *priv, const uchar *cbw,
+			     int len)
+{
+	const uchar *cb = cbw + 15;
+	u32 datalen;
+	ulong lba, count;
+
+	if (len != CBW_SIZE || get_unaligned_le32(cbw) != CBW_SIGNATURE)
+		return -EPIPE;
+
+	priv->tag = get_unaligned_le32(cbw + 4);
+	datalen = get_unaligned_le32(cbw + 8);
+	priv->residue = datalen;
+	priv->status = 0;
+	priv->cmd = cb[0];
+	priv->reply_len = 0;
+	if (priv->cmd != SCSI_REQ_SENSE)
+		priv->sense_key = SENSE_NO_SENSE;
+
+	switch (priv->cmd) {
+	case SCSI_TST_U_RDY:
+		break;
+	case SCSI_INQUIRY:
+		memset(priv->reply, '\0', 36);
+		priv->reply[1] = 0x80;		/* removable */
+		priv->reply[2] = 2;		/* SCSI-2 */
+		priv->reply[3] = 2;
+		priv->reply[4] = 36 - 5;
+		memcpy(priv->reply + 8, "U-Boot  ", 8);
+		memcpy(priv->reply + 16, "Sandbox flash   ", 16);
+		memcpy(priv->reply + 32, "1.00", 4);
+		priv->reply_len = 36;
+		break;
+	case SCSI_REQ_SENSE:
+		memset(priv->reply, '\0', 18);
+		priv->reply[0] = 0x70;		/* current error */
+		priv->reply[2] = priv->sense_key;
+		priv->reply[7] = 10;
+		priv->reply[12] = priv->sense_key ? 0x20 : 0; /* invalid op */
+		priv->reply_len = 18;
+		priv->sense_key = SENSE_NO_SENSE;
+		break;
+	case SCSI_RD_CAPAC:
+		put_unaligned_be32(priv->blocks - 1, priv->reply);
+		put_unaligned_be32(FLASH_BLKSZ, priv->reply + 4);
+		priv->reply_len = 8;
+		break;
+	case SCSI_READ10:
+	case SCSI_WRITE10:
+		lba = get_unaligned_be32(cb + 2);
+		count = get_unaligned_be16(cb + 7);
+		if (lba + count > priv->blocks ||
+		    count * FLASH_BLKSZ != datalen) {
+			sandbox_flash_fail(priv, SENSE_ILLEGAL_REQUEST);
+			break;
+		}
+		if (os_lseek(priv->fd, (off_t)lba * FLASH_BLKSZ,
+			     OS_SEEK_SET) == -1)
+			sandbox_flash_fail(priv, SENSE_ILLEGAL_REQUEST);
+		break;
+	default:
+		debug("sandbox_flash: unsupported command %02x\n", cb[0]);
+		sandbox_flash_fail(priv, SENSE_ILLEGAL_REQUEST);
+		break;
+	}
+
+	if (!datalen || priv->status)
+		priv->phase = PHASE_CSW;
+	else if (cbw[12] & USB_DIR_IN)
+		priv->phase = PHASE_DATA_IN;
+	else
+		priv->phase = PHASE_DATA_OUT;
+
+	return len;
+}
+
+static int sandbox_flash_data(struct sandbox_flash *priv, int in, void *buf,
+			      int len)
+{
+	ssize_t ret;
+
+	len = min(len, (int)priv->residue);
+	if (priv->cmd == SCSI_READ10 && in)
+		ret = os_read(priv->fd, buf, len);
+	else if (priv->cmd == SCSI_WRITE10 && !in)
+		ret = os_write(priv->fd, buf, len);
+	else if (in)
+		ret = min(len, priv->reply_len);
+	else
+		ret = len;	/* nothing takes data, accept and drop it */
+
+	if (ret < 0) {
+		sandbox_flash_fail(priv, SENSE_ILLEGAL_REQUEST);
+		ret = 0;
+	} else if (in && priv->cmd != SCSI_READ10) {
+		memcpy(buf, priv->reply, ret);
+	}
+	priv->residue -= ret;
+	if (!priv->residue || ret < len)
+		priv->phase = PHASE_CSW;
+
+	return ret;
+}
+
+static int sandbox_flash_csw(struct sandbox_flash *priv, uchar *csw, int len)
+{
+	if (len < CSW_SIZE)
+		return -EPIPE;
+
+	put_unaligned_le32(CSW_SIGNATURE, csw);
+	put_unaligned_le32(priv->tag, csw + 4);
+	put_unaligned_le32(priv->residue, csw + 8);
+	csw[12] = priv->status;
+	priv->phase = PHASE_CBW;
+
+	return CSW_SIZE;
+}
+
+static int sandbox_flash_bulk(struct sandbox_usb_emul *emul, int ep, int in,
+			      void *buf, int len)
+{
+	struct sandbox_flash *priv = emul->priv;
+
+	if (ep != (in ? FLASH_EP_IN : FLASH_EP_OUT))
+		return -EPIPE;
+
+	/*
+	 * There is nothing to send before the data or CSW phase, so an IN
+	 * transfer queued early NAKs until then. An OUT transfer in the
+	 * wrong phase, such as a CBW before the last CSW was read, stalls.
+	 */
+	switch (priv->phase) {
+	case PHASE_CBW:
+		if (in)
+			return -EAGAIN;
+		return sandbox_flash_cbw(priv, buf, len);
+	case PHASE_DATA_IN:
+	case PHASE_DATA_OUT:
+		if (in != (priv->phase == PHASE_DATA_IN))
+			return in ? -EAGAIN : -EPIPE;
+		return sandbox_flash_data(priv, in, buf, len);
+	case PHASE_CSW:
+		if (!in)
+			return -EPIPE;
+		return sandbox_flash_csw(priv, buf, len);
+	}
+
+	return -EPIPE;
+}
+
+static int sandbox_flash_control(struct sandbox_usb_emul *emul,
+				 struct devrequest *req, void *buf, int len)
+{
+	struct sandbox_flash *priv = emul->priv;
+
+	switch (req->request) {
+	case BBB_REQ_GET_MAX_LUN:
+		if (len < 1)
+			return -EPIPE;
+		*(uchar *)buf = 0;
+		return 1;
+	case BBB_REQ_RESET:
+		priv->phase = PHASE_CBW;
+		return 0;
+	}
+
+	return -EPIPE;
+}
+
+static void sandbox_flash_reset(struct sandbox_usb_emul *emul)
+{
+	struct sandbox_flash *priv = emul->priv;
+
+	priv->phase = PHASE_CBW;
+	priv->sense_key = SENSE_NO_SENSE;
+}
+
+static void sandbox_flash_remove(struct sandbox_usb_emul *emul)
+{
+	struct sandbox_flash *priv = emul->priv;
+
+	os_close(priv->fd);
+	free(priv);
+}
+
+static const struct sandbox_usb_emul_ops sandbox_flash_ops = {
+	.control	= sandbox_flash_control,
+	.bulk		= sandbox_flash_bulk,
+	.reset		= sandbox_flash_reset,
+	.remove		= sandbox_flash_remove,
+};
+
+struct sandbox_usb_emul *sandbox_usb_flash_create(const char *fname)
+{
+	struct sandbox_flash *priv;
+	off_t size;
+	int fd;
+
+	fd = os_open(fname, OS_O_RDWR);
+	if (fd < 0) {
+		printf("sandbox_usb: cannot open '%s'\n", fname);
+		return NULL;
+	}
+	size = os_lseek(fd, 0, OS_SEEK_END);
+	if (size < FLASH_BLKSZ) {
+		printf("sandbox_usb: '%s' is smaller than a block\n", fname);
+		os_close(fd);
+		return NULL;
+	}
+	priv = calloc(1, sizeof(*priv));
+	if (!priv) {
+		os_close(fd);
+		return NULL;
+	}
+
+	priv->emul.name = "flash";
+	priv->emul.ops = &sandbox_flash_ops;
+	priv->emul.dev_desc = &flash_dev_desc;
+	priv->emul.config = flash_config;
+	priv->emul.strings = flash_strings;
+	priv->emul.nstrings = ARRAY_SIZE(flash_strings);
+	priv->emul.priv = priv;
+	priv->fd = fd;
+	priv->blocks = size / FLASH_BLKSZ;
+
+	return &priv->emul;
+}
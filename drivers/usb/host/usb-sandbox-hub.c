@@ -0,0 +1,284 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Emulated USB hub for the sandbox host controller
+ *
+ * Ports start powered off. A device behind a port shows up as connected
+ * once the port has been powered for the hub's power-on to power-good
+ * time, and can be talked to at the default address after a port reset,
+ * as with a real hub.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <errno.h>
+#include <malloc.h>
+#include <usb.h>
+#include "usb-sandbox.h"
+
+struct sandbox_hub_port {
+	struct sandbox_usb_emul *child;
+	u16 status;
+	u16 change;
+	ulong power_on;		/* get_timer() when power was switched on */
+};
+
+struct sandbox_hub {
+	struct sandbox_usb_emul emul;
+	int nports;
+	int pgood_ms;
+	struct sandbox_hub_port port[USB_MAXCHILDREN];
+};
+
+static const struct usb_device_descriptor hub_dev_desc = {
+	.bLength		= USB_DT_DEVICE_SIZE,
+	.bDescriptorType	= USB_DT_DEVICE,
+	.bcdUSB			= __constant_cpu_to_le16(0x0200),
+	.bDeviceClass		= USB_CLASS_HUB,
+	.bDeviceProtocol	= 1,	/* single TT */
+	.bMaxPacketSize0	= 64,
+	.idVendor		= __constant_cpu_to_le16(0x1d6b),
+	.idProduct		= __constant_cpu_to_le16(0x0002),
+	.bcdDevice		= __constant_cpu_to_le16(0x0100),
+	.iManufacturer		= 1,
+	.iProduct		= 2,
+	.bNumConfigurations	= 1,
+};
+
+static const uchar hub_config[] = {
+	/* configuration */
+	USB_DT_CONFIG_SIZE, USB_DT_CONFIG,
+	USB_DT_CONFIG_SIZE + USB_DT_INTERFACE_SIZE + USB_DT_ENDPOINT_SIZE, 0,
+	1,			/* bNumInterfaces */
+	1,			/* bConfigurationValue */
+	0,			/* iConfiguration */
+	0xe0,			/* bmAttributes: self powered */
+	0,			/* bMaxPower */
+	/* interface */
+	USB_DT_INTERFACE_SIZE, USB_DT_INTERFACE,
+	0,			/* bInterfaceNumber */
+	0,			/* bAlternateSetting */
+	1,			/* bNumEndpoints */
+	USB_CLASS_HUB, 0, 0,
+	0,			/* iInterface */
+	/* status change endpoint */
+	USB_DT_ENDPOINT_SIZE, USB_DT_ENDPOINT,
+	USB_DIR_IN | 1,
+	USB_ENDPOINT_XFER_INT,
+	2, 0,			/* wMaxPacketSize */
+	12,			/* bInterval */
+};
+
+static const char * const hub_strings[] = {
+	"U-Boot",
+	"Sandbox USB hub",
+};
+
+/* Whatever sits behind a port goes back to square one */
+static void sandbox_hub_port_off(struct sandbox_hub_port *port)
+{
+	if (port->status & USB_PORT_STAT_CONNECTION)
+		port->change |= USB_PORT_STAT_C_CONNECTION;
+	port->status = 0;
+	if (port->child && port->child->ops->reset)
+		port->child->ops->reset(port->child);
+}
+
+static void sandbox_hub_port_update(struct sandbox_hub *hub,
+				    struct sandbox_hub_port *port)
+{
+	if (!port->child || !(port->status & USB_PORT_STAT_POWER) ||
+	    (port->status & USB_PORT_STAT_CONNECTION))
+		return;
+
+	if (get_timer(port->power_on) >= hub->pgood_ms) {
+		port->status |= USB_PORT_STAT_CONNECTION;
+		port->change |= USB_PORT_STAT_C_CONNECTION;
+	}
+}
+
+static int sandbox_hub_port_feature(struct sandbox_hub *hub,
+				    struct sandbox_hub_port *port,
+				    int feature, int set)
+{
+	struct sandbox_usb_emul *child = port->child;
+
+	switch (feature) {
+	case USB_PORT_FEAT_POWER:
+		if (!set) {
+			sandbox_hub_port_off(port);
+		} else if (!(port->status & USB_PORT_STAT_POWER)) {
+			port->status |= USB_PORT_STAT_POWER;
+			port->power_on = get_timer(0);
+		}
+		return 0;
+	case USB_PORT_FEAT_RESET:
+		if (!set)
+			return 0;
+		sandbox_hub_port_update(hub, port);
+		if (!(port->status & USB_PORT_STAT_CONNECTION))
+			return 0;
+		port->status |= USB_PORT_STAT_ENABLE | USB_PORT_STAT_HIGH_SPEED;
+		port->change |= USB_PORT_STAT_C_RESET;
+		child->addr = 0;
+		child->configuration = 0;
+		if (child->ops->reset)
+			child->ops->reset(child);
+		return 0;
+	case USB_PORT_FEAT_ENABLE:
+		if (!set)
+			port->status &= ~USB_PORT_STAT_ENABLE;
+		return 0;
+	case USB_PORT_FEAT_SUSPEND:
+		return 0;
+	case USB_PORT_FEAT_C_CONNECTION:
+	case USB_PORT_FEAT_C_ENABLE:
+	case USB_PORT_FEAT_C_SUSPEND:
+	case USB_PORT_FEAT_C_OVER_CURRENT:
+	case USB_PORT_FEAT_C_RESET:
+		if (!set)
+			port->change &= ~(1 << (feature - 16));
+		return 0;
+	}
+
+	return -EPIPE;
+}
+
+static int sandbox_hub_control(struct sandbox_usb_emul *emul,
+			       struct devrequest *req, void *buf, int len)
+{
+	struct sandbox_hub *hub = container_of(emul, struct sandbox_hub, emul);
+	int index = le16_to_cpu(req->index);
+	int value = le16_to_cpu(req->value);
+	struct sandbox_hub_port *port = NULL;
+	uchar desc[9];
+	u16 *sts = buf;
+
+	if ((req->requesttype & USB_RECIP_MASK) == USB_RECIP_OTHER) {
+		if (index < 1 || index > hub->nports)
+			return -EPIPE;
+		port = &hub->port[index - 1];
+	}
+
+	switch (req->request) {
+	case USB_REQ_GET_DESCRIPTOR:
+		if (value >> 8 != USB_DT_HUB)
+			return -EPIPE;
+		desc[0] = sizeof(desc);
+		desc[1] = USB_DT_HUB;
+		desc[2] = hub->nports;
+		desc[3] = 0x09;		/* per-port power and over-current */
+		desc[4] = 0;
+		desc[5] = DIV_ROUND_UP(hub->pgood_ms, 2);
+		desc[6] = 0;		/* bHubContrCurrent */
+		desc[7] = 0;		/* DeviceRemovable */
+		desc[8] = 0xff;		/* PortPwrCtrlMask */
+		len = min(len, (int)sizeof(desc));
+		memcpy(buf, desc, len);
+		return len;
+	case USB_REQ_GET_STATUS:
+		if (len < 4)
+			return -EPIPE;
+		if (port) {
+			sandbox_hub_port_update(hub, port);
+			sts[0] = cpu_to_le16(port->status);
+			sts[1] = cpu_to_le16(port->change);
+		} else {
+			sts[0] = 0;
+			sts[1] = 0;
+		}
+		return 4;
+	case USB_REQ_SET_FEATURE:
+	case USB_REQ_CLEAR_FEATURE:
+		if (!port)
+			return 0;
+		return sandbox_hub_port_feature(hub, port, value,
+					req->request == USB_REQ_SET_FEATURE);
+	}
+
+	return -EPIPE;
+}
+
+static void sandbox_hub_reset(struct sandbox_usb_emul *emul)
+{
+	struct sandbox_hub *hub = container_of(emul, struct sandbox_hub, emul);
+	int i;
+
+	for (i = 0; i < hub->nports; i++) {
+		sandbox_hub_port_off(&hub->port[i]);
+		hub->port[i].change = 0;
+	}
+}
+
+static struct sandbox_usb_emul *sandbox_hub_find(struct sandbox_usb_emul *emul,
+						 int addr)
+{
+	struct sandbox_hub *hub = container_of(emul, struct sandbox_hub, emul);
+	struct sandbox_usb_emul *child, *found;
+	int i;
+
+	for (i = 0; i < hub->nports; i++) {
+		child = hub->port[i].child;
+		if (!child || !(hub->port[i].status & USB_PORT_STAT_ENABLE))
+			continue;
+		if (child->addr == addr)
+			return child;
+		if (child->ops->find) {
+			found = child->ops->find(child, addr);
+			if (found)
+				return found;
+		}
+	}
+
+	return NULL;
+}
+
+static void sandbox_hub_remove(struct sandbox_usb_emul *emul)
+{
+	struct sandbox_hub *hub = container_of(emul, struct sandbox_hub, emul);
+	struct sandbox_usb_emul *child;
+	int i;
+
+	for (i = 0; i < hub->nports; i++) {
+		child = hub->port[i].child;
+		if (child && child->ops->remove)
+			child->ops->remove(child);
+	}
+	free(hub);
+}
+
+static const struct sandbox_usb_emul_ops sandbox_hub_ops = {
+	.control	= sandbox_hub_control,
+	.reset		= sandbox_hub_reset,
+	.find		= sandbox_hub_find,
+	.remove		= sandbox_hub_remove,
+};
+
+struct sandbox_usb_emul *sandbox_usb_hub_create(int nports,
+					struct sandbox_usb_emul **children,
+					int pgood_ms)
+{
+	struct sandbox_hub *hub;
+	int i;
+
+	if (nports > USB_MAXCHILDREN)
+		return NULL;
+	hub = calloc(1, sizeof(*hub));
+	if (!hub)
+		return NULL;
+
+	hub->emul.name = "hub";
+	hub->emul.ops = &sandbox_hub_ops;
+	hub->emul.dev_desc = &hub_dev_desc;
+	hub->emul.config = hub_config;
+	hub->emul.strings = hub_strings;
+	hub->emul.nstrings = ARRAY_SIZE(hub_strings);
+	hub->emul.priv = hub;
+	hub->nports = nports;
+	hub->pgood_ms = pgood_ms;
+	for (i = 0; i < nports; i++)
+		hub->port[i].child = children[i];
+
+	return &hub->emul;
+}
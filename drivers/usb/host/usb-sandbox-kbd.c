@@ -0,0 +1,278 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Emulated USB keyboard for the sandbox host controllers
+ *
+ * A HID keyboard with the boot protocol report, which types a line of
+ * text: for each character a report with its key down, then one with
+ * the key up, each offered on the interrupt endpoint once the one before
+ * has been taken. In between, the endpoint NAKs, unless SET_IDLE asked
+ * for the last report to be repeated every idle period.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <errno.h>
+#include <malloc.h>
+#include <usb.h>
+#include "usb-sandbox.h"
+
+#define KBD_EP_IN		1
+#define KBD_REPORT_SIZE		8
+/* Idle rate after reset, in 4ms units: 500ms, as the HID spec asks */
+#define KBD_DEFAULT_IDLE	125
+
+/* HID class */
+#define HID_DT_HID		0x21
+#define HID_DT_REPORT		0x22
+#define HID_REQ_GET_REPORT	0x01
+#define HID_REQ_GET_IDLE	0x02
+#define HID_REQ_GET_PROTOCOL	0x03
+#define HID_REQ_SET_REPORT	0x09
+#define HID_REQ_SET_IDLE	0x0a
+#define HID_REQ_SET_PROTOCOL	0x0b
+
+#define KBD_LEFT_SHIFT		(1 << 1)
+#define KBD_USAGE_A		0x04
+#define KBD_USAGE_1		0x1e
+
+struct sandbox_kbd {
+	struct sandbox_usb_emul emul;
+	char *keys;		/* text to type, NULL for none */
+	int pos;		/* next character of keys */
+	bool key_down;		/* the last report holds a key down */
+	uchar report[KBD_REPORT_SIZE];	/* the last report */
+	int idle;		/* idle rate in 4ms units, 0 for infinite */
+	ulong sent;		/* get_timer() when the report was last sent */
+	int protocol;
+	uchar leds;
+};
+
+static const struct usb_device_descriptor kbd_dev_desc = {
+	.bLength		= USB_DT_DEVICE_SIZE,
+	.bDescriptorType	= USB_DT_DEVICE,
+	.bcdUSB			= __constant_cpu_to_le16(0x0200),
+	.bMaxPacketSize0	= 64,
+	.idVendor		= __constant_cpu_to_le16(0x1234),
+	.idProduct		= __constant_cpu_to_le16(0x5679),
+	.bcdDevice		= __constant_cpu_to_le16(0x0100),
+	.iManufacturer		= 1,
+	.iProduct		= 2,
+	.bNumConfigurations	= 1,
+};
+
+static const uchar kbd_config[] = {
+	/* configuration */
+	USB_DT_CONFIG_SIZE, USB_DT_CONFIG,
+	USB_DT_CONFIG_SIZE + USB_DT_INTERFACE_SIZE + 9 + USB_DT_ENDPOINT_SIZE,
+	0,
+	1,			/* bNumInterfaces */
+	1,			/* bConfigurationValue */
+	0,			/* iConfiguration */
+	0xa0,			/* bmAttributes: bus powered, remote wakeup */
+	50,			/* bMaxPower: 100mA */
+	/* interface */
+	USB_DT_INTERFACE_SIZE, USB_DT_INTERFACE,
+	0,			/* bInterfaceNumber */
+	0,			/* bAlternateSetting */
+	1,			/* bNumEndpoints */
+	USB_CLASS_HID,
+	1,			/* bInterfaceSubClass: boot interface */
+	1,			/* bInterfaceProtocol: keyboard */
+	0,			/* iInterface */
+	/* HID */
+	9, HID_DT_HID,
+	0x11, 0x01,		/* bcdHID: 1.11 */
+	0,			/* bCountryCode */
+	1,			/* bNumDescriptors */
+	HID_DT_REPORT,
+	63, 0,			/* wDescriptorLength: the boot keyboard's */
+	/* interrupt in */
+	USB_DT_ENDPOINT_SIZE, USB_DT_ENDPOINT,
+	USB_DIR_IN | KBD_EP_IN,
+	USB_ENDPOINT_XFER_INT,
+	KBD_REPORT_SIZE, 0,	/* wMaxPacketSize */
+	4,			/* bInterval: every 1ms */
+};
+
+static const char * const kbd_strings[] = {
+	"U-Boot",
+	"Sandbox keyboard",
+};
+
+/* Keys from usage 0x1e on, as a US layout types them */
+static const char kbd_keys[] = "1234567890\r\x1b\b\t -=[]\\#;'`,./";
+static const char kbd_keys_shifted[] = "!@#$%^&*()\r\x1b\b\t _+{}|~:\"~<>?";
+
+/* Find the key and modifier which type @c; false if there is none */
+static bool sandbox_kbd_key(char c, uchar *usage, uchar *modifier)
+{
+	const char *p;
+
+	*modifier = 0;
+	if (c >= 'a' && c <= 'z') {
+		*usage = KBD_USAGE_A + c - 'a';
+		return true;
+	}
+	if (c >= 'A' && c <= 'Z') {
+		*usage = KBD_USAGE_A + c - 'A';
+		*modifier = KBD_LEFT_SHIFT;
+		return true;
+	}
+	p = strchr(kbd_keys, c);
+	if (c && p) {
+		*usage = KBD_USAGE_1 + p - kbd_keys;
+		return true;
+	}
+	p = strchr(kbd_keys_shifted, c);
+	if (c && p) {
+		*usage = KBD_USAGE_1 + p - kbd_keys_shifted;
+		*modifier = KBD_LEFT_SHIFT;
+		return true;
+	}
+
+	return false;
+}
+
+/* Move the report on to the next key event; false if there is none */
+static bool sandbox_kbd_advance(struct sandbox_kbd *priv)
+{
+	uchar usage, modifier;
+
+	if (priv->key_down) {
+		memset(priv->report, '\0', sizeof(priv->report));
+		priv->key_down = false;
+		return true;
+	}
+
+	while (priv->keys && priv->keys[priv->pos]) {
+		if (sandbox_kbd_key(priv->keys[priv->pos++], &usage,
+				    &modifier)) {
+			memset(priv->report, '\0', sizeof(priv->report));
+			priv->report[0] = modifier;
+			priv->report[2] = usage;
+			priv->key_down = true;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static int sandbox_kbd_bulk(struct sandbox_usb_emul *emul, int ep, int in,
+			    void *buf, int len)
+{
+	struct sandbox_kbd *priv = emul->priv;
+	int size;
+
+	if (ep != KBD_EP_IN || !in)
+		return -EPIPE;
+
+	if (!sandbox_kbd_advance(priv) &&
+	    (!priv->idle || get_timer(priv->sent) < priv->idle * 4))
+		return -EAGAIN;
+
+	size = min(len, KBD_REPORT_SIZE);
+	memcpy(buf, priv->report, size);
+	priv->sent = get_timer(0);
+
+	return size;
+}
+
+static int sandbox_kbd_control(struct sandbox_usb_emul *emul,
+			       struct devrequest *req, void *buf, int len)
+{
+	struct sandbox_kbd *priv = emul->priv;
+	int value = le16_to_cpu(req->value);
+
+	if ((req->requesttype & USB_TYPE_MASK) != USB_TYPE_CLASS)
+		return -EPIPE;
+
+	switch (req->request) {
+	case HID_REQ_GET_REPORT:
+		sandbox_kbd_advance(priv);
+		len = min(len, KBD_REPORT_SIZE);
+		memcpy(buf, priv->report, len);
+		return len;
+	case HID_REQ_SET_REPORT:
+		if (len < 1)
+			return -EPIPE;
+		priv->leds = *(uchar *)buf;
+		return len;
+	case HID_REQ_GET_IDLE:
+		if (len < 1)
+			return -EPIPE;
+		*(uchar *)buf = priv->idle;
+		return 1;
+	case HID_REQ_SET_IDLE:
+		priv->idle = value >> 8;
+		return 0;
+	case HID_REQ_GET_PROTOCOL:
+		if (len < 1)
+			return -EPIPE;
+		*(uchar *)buf = priv->protocol;
+		return 1;
+	case HID_REQ_SET_PROTOCOL:
+		priv->protocol = value;
+		return 0;
+	}
+
+	return -EPIPE;
+}
+
+/* What has been typed stays typed, the keys come up */
+static void sandbox_kbd_reset(struct sandbox_usb_emul *emul)
+{
+	struct sandbox_kbd *priv = emul->priv;
+
+	memset(priv->report, '\0', sizeof(priv->report));
+	priv->key_down = false;
+	priv->idle = KBD_DEFAULT_IDLE;
+	priv->protocol = 1;
+	priv->leds = 0;
+}
+
+static void sandbox_kbd_remove(struct sandbox_usb_emul *emul)
+{
+	struct sandbox_kbd *priv = emul->priv;
+
+	free(priv->keys);
+	free(priv);
+}
+
+static const struct sandbox_usb_emul_ops sandbox_kbd_ops = {
+	.control	= sandbox_kbd_control,
+	.bulk		= sandbox_kbd_bulk,
+	.reset		= sandbox_kbd_reset,
+	.remove		= sandbox_kbd_remove,
+};
+
+struct sandbox_usb_emul *sandbox_usb_kbd_create(const char *keys)
+{
+	struct sandbox_kbd *priv;
+
+	priv = calloc(1, sizeof(*priv));
+	if (!priv)
+		return NULL;
+	if (keys) {
+		priv->keys = malloc(strlen(keys) + 2);
+		if (!priv->keys) {
+			free(priv);
+			return NULL;
+		}
+		strcpy(priv->keys, keys);
+		strcat(priv->keys, "\r");
+	}
+
+	priv->emul.name = "kbd";
+	priv->emul.ops = &sandbox_kbd_ops;
+	priv->emul.dev_desc = &kbd_dev_desc;
+	priv->emul.config = kbd_config;
+	priv->emul.strings = kbd_strings;
+	priv->emul.nstrings = ARRAY_SIZE(kbd_strings);
+	priv->emul.priv = priv;
+	sandbox_kbd_reset(&priv->emul);
+
+	return &priv->emul;
+}
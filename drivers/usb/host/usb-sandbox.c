@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Sandbox USB host controller
+ *
+ * Instead of talking to hardware, transfers are handed to emulated
+ * devices: a root hub, further hubs, keyboards and mass-storage devices
+ * backed by host files.
+ *
+ * The bus is described by the environment when 'usb start' runs:
+ *
+ *   sandbox_usb		devices on the root hub ports, separated by
+ *			spaces: a host file name for a storage device,
+ *			'kbd' for a keyboard, '-' for an empty port or
+ *			'hub(...)' for a hub with the devices listed inside
+ *   sandbox_usb_kbd	what the keyboards type once polled, an Enter
+ *			following it
+ *   sandbox_usb_latency	extra time each transfer takes, in us
+ *   sandbox_usb_pgood	power-on to power-good time of the emulated
+ *			hubs, in ms (default 100)
+ *   sandbox_usb_max_xfer	largest bulk transfer the controller reports
+ *			to class drivers, in bytes (default: unlimited)
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <errno.h>
+#include <usb.h>
+#include "usb-sandbox.h"
+
+#define SANDBOX_ROOT_PGOOD_MS	20
+#define SANDBOX_HUB_PGOOD_MS	100
+
+static struct sandbox_usb {
+	struct sandbox_usb_emul *root;
+	ulong latency_us;
+	size_t max_xfer;
+	int hub_pgood_ms;
+} sandbox_usb;
+
+/* Parse a list of devices and put a hub above it */
+static struct sandbox_usb_emul *sandbox_usb_parse_list(const char **specp,
+						       int pgood_ms)
+{
+	struct sandbox_usb_emul *children[USB_MAXCHILDREN];
+	struct sandbox_usb_emul *hub;
+	int nports, i;
+
+	nports = sandbox_usb_emul_parse(specp, children, USB_MAXCHILDREN,
+					sandbox_usb.hub_pgood_ms);
+	if (nports < 0)
+		return NULL;
+
+	/* A hub has at least one port, if only an empty one */
+	if (!nports)
+		children[nports++] = NULL;
+	hub = sandbox_usb_hub_create(nports, children, pgood_ms);
+	if (hub)
+		return hub;
+
+	for (i = 0; i < nports; i++)
+		sandbox_usb_emul_remove(children[i]);
+
+	return NULL;
+}
+
+static struct sandbox_usb_emul *sandbox_usb_find(int addr)
+{
+	struct sandbox_usb_emul *root = sandbox_usb.root;
+
+	if (!root)
+		return NULL;
+	if (root->addr == addr)
+		return root;
+
+	return root->ops->find(root, addr);
+}
+
+/* Set the outcome of a transfer the way the real controllers do */
+static int sandbox_usb_complete(struct usb_device *udev, int ret)
+{
+	if (ret == -EPIPE) {
+		udev->act_len = 0;
+		udev->status = USB_ST_STALLED;
+	} else if (ret == -EAGAIN) {
+		udev->act_len = 0;
+		udev->status = USB_ST_NAK_REC;
+	} else if (ret < 0) {
+		udev->act_len = 0;
+		udev->status = USB_ST_CRC_ERR;
+	} else {
+		udev->act_len = ret;
+		udev->status = 0;
+	}
+
+	return 0;
+}
+
+int submit_control_msg(struct usb_device *udev, unsigned long pipe,
+		       void *buffer, int length, struct devrequest *setup)
+{
+	struct sandbox_usb_emul *emul;
+	int ret;
+
+	emul = sandbox_usb_find(usb_pipedevice(pipe));
+	if (!emul) {
+		debug("sandbox_usb: no device at address %ld\n",
+		      usb_pipedevice(pipe));
+		return sandbox_usb_complete(udev, -ETIMEDOUT);
+	}
+	if (sandbox_usb.latency_us)
+		udelay(sandbox_usb.latency_us);
+
+	ret = sandbox_usb_emul_control(emul, setup, buffer, length);
+	debug("sandbox_usb: %s: request %02x type %02x value %04x: %d\n",
+	      emul->name, setup->request, setup->requesttype,
+	      le16_to_cpu(setup->value), ret);
+
+	return sandbox_usb_complete(udev, ret);
+}
+
+int submit_bulk_msg(struct usb_device *udev, unsigned long pipe,
+		    void *buffer, int length)
+{
+	struct sandbox_usb_emul *emul;
+	int ret;
+
+	emul = sandbox_usb_find(usb_pipedevice(pipe));
+	if (!emul || !emul->ops->bulk)
+		return sandbox_usb_complete(udev, -ETIMEDOUT);
+	if (sandbox_usb.latency_us)
+		udelay(sandbox_usb.latency_us);
+
+	ret = emul->ops->bulk(emul, usb_pipeendpoint(pipe), usb_pipein(pipe),
+			      buffer, length);
+
+	return sandbox_usb_complete(udev, ret);
+}
+
+int submit_int_msg(struct usb_device *udev, unsigned long pipe, void *buffer,
+		   int length, int interval)
+{
+	struct sandbox_usb_emul *emul;
+	int ret;
+
+	emul = sandbox_usb_find(usb_pipedevice(pipe));
+	if (!emul || !emul->ops->bulk)
+		return -1;
+
+	/* The endpoint is polled once, a NAK meaning nothing to report */
+	ret = emul->ops->bulk(emul, usb_pipeendpoint(pipe), usb_pipein(pipe),
+			      buffer, length);
+	if (ret < 0)
+		return -1;
+
+	return sandbox_usb_complete(udev, ret);
+}
+
+int usb_get_max_xfer_size(struct usb_device *udev, size_t *size)
+{
+	if (!sandbox_usb.max_xfer)
+		*size = 0x7fffffff;
+	else
+		*size = sandbox_usb.max_xfer;
+
+	return 0;
+}
+
+int usb_lowlevel_init(int index, enum usb_init_type init, void **controller)
+{
+	const char *spec = getenv("sandbox_usb");
+	struct sandbox_usb_emul *root;
+
+	if (init != USB_INIT_HOST)
+		return -ENODEV;
+
+	sandbox_usb.latency_us = getenv_ulong("sandbox_usb_latency", 10, 0);
+	sandbox_usb.max_xfer = getenv_ulong("sandbox_usb_max_xfer", 10, 0);
+	sandbox_usb.hub_pgood_ms = getenv_ulong("sandbox_usb_pgood", 10,
+						SANDBOX_HUB_PGOOD_MS);
+
+	if (!spec)
+		spec = "";
+	/* The root hub is part of the controller, it comes up quickly */
+	root = sandbox_usb_parse_list(&spec, SANDBOX_ROOT_PGOOD_MS);
+	if (!root)
+		return -EINVAL;
+	if (*spec) {
+		printf("sandbox_usb: unexpected '%s'\n", spec);
+		sandbox_usb_emul_remove(root);
+		return -EINVAL;
+	}
+
+	sandbox_usb.root = root;
+	*controller = &sandbox_usb;
+
+	return 0;
+}
+
+int usb_lowlevel_stop(int index)
+{
+	sandbox_usb_emul_remove(sandbox_usb.root);
+	sandbox_usb.root = NULL;
+
+	return 0;
+}
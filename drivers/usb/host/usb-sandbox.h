@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Emulated USB devices behind the sandbox host controller
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef __USB_SANDBOX_H
+#define __USB_SANDBOX_H
+
+#include <usb.h>
+
+struct sandbox_usb_emul;
+
+/**
+ * struct sandbox_usb_emul_ops - what an emulated device model implements
+ *
+ * Standard requests (descriptors, address, configuration, endpoint halt)
+ * are handled by the host controller from the descriptors in
+ * struct sandbox_usb_emul, so models only see their own traffic.
+ *
+ * @control:	handle a class or vendor request. Returns the number of
+ *		bytes transferred in the data stage, or -EPIPE to stall
+ * @bulk:	move up to @len bytes to (@in) or from the bulk or
+ *		interrupt endpoint @ep. Returns the number of bytes moved, -EAGAIN to NAK
+ *		while the device is not ready for it or -EPIPE to stall
+ * @reset:	the port the device sits on was reset (optional)
+ * @find:	return the device with address @addr among the devices
+ *		reachable through this one, if it is a hub (optional)
+ * @remove:	release the model and everything behind it
+ */
+struct sandbox_usb_emul_ops {
+	int (*control)(struct sandbox_usb_emul *emul, struct devrequest *req,
+		       void *buf, int len);
+	int (*bulk)(struct sandbox_usb_emul *emul, int ep, int in, void *buf,
+		    int len);
+	void (*reset)(struct sandbox_usb_emul *emul);
+	struct sandbox_usb_emul *(*find)(struct sandbox_usb_emul *emul,
+					 int addr);
+	void (*remove)(struct sandbox_usb_emul *emul);
+};
+
+/**
+ * struct sandbox_usb_emul - an emulated USB device
+ *
+ * @name:	name used in messages
+ * @ops:	operations of the device model
+ * @dev_desc:	device descriptor, little endian
+ * @config:	configuration descriptor followed by the interface and
+ *		endpoint descriptors, little endian
+ * @strings:	string descriptors, indexed from 1
+ * @nstrings:	number of entries in @strings
+ * @addr:	USB address, 0 while in the default state
+ * @configuration: value of the last SET_CONFIGURATION
+ * @priv:	private data of the device model
+ */
+struct sandbox_usb_emul {
+	const char *name;
+	const struct sandbox_usb_emul_ops *ops;
+	const struct usb_device_descriptor *dev_desc;
+	const void *config;
+	const char * const *strings;
+	int nstrings;
+	int addr;
+	int configuration;
+	void *priv;
+};
+
+/**
+ * sandbox_usb_emul_control() - run a control request on an emulated device
+ *
+ * Standard requests are answered from the descriptors, the others are
+ * passed to the device model.
+ *
+ * @emul:	device the request is for
+ * @req:	the setup packet
+ * @buf:	data stage
+ * @len:	length of the data stage
+ * @return number of bytes transferred in the data stage, or -EPIPE to
+ *	stall
+ */
+int sandbox_usb_emul_control(struct sandbox_usb_emul *emul,
+			     struct devrequest *req, void *buf, int len);
+
+/**
+ * sandbox_usb_emul_remove() - release an emulated device
+ *
+ * @emul:	device to release, with everything behind it; may be NULL
+ */
+void sandbox_usb_emul_remove(struct sandbox_usb_emul *emul);
+
+/**
+ * sandbox_usb_emul_parse() - create the devices of a bus description
+ *
+ * The description lists devices separated by spaces: a host file name
+ * for a storage device, 'kbd' for a keyboard typing the environment
+ * variable sandbox_usb_kbd, '-' for an empty port or 'hub(...)' for a hub
+ * with the devices listed inside.
+ *
+ * @specp:	description, left at the end or at the ')' closing the list
+ * @children:	filled with the devices, NULL for an empty port
+ * @max:	number of entries in @children
+ * @hub_pgood_ms: power-on to power-good time of the hubs created
+ * @return number of devices listed, or -EINVAL with nothing created
+ */
+int sandbox_usb_emul_parse(const char **specp,
+			   struct sandbox_usb_emul **children, int max,
+			   int hub_pgood_ms);
+
+/**
+ * sandbox_usb_hub_create() - create an emulated hub
+ *
+ * @nports:	number of downstream ports
+ * @children:	device on each port, NULL for an empty port
+ * @pgood_ms:	time from port power on to the device being connected
+ * @return new hub, or NULL if out of memory
+ */
+struct sandbox_usb_emul *sandbox_usb_hub_create(int nports,
+					struct sandbox_usb_emul **children,
+					int pgood_ms);
+
+/**
+ * sandbox_usb_flash_create() - create a bulk-only mass-storage device
+ *
+ * @fname:	host file holding the medium, in 512-byte blocks
+ * @return new device, or NULL on error
+ */
+struct sandbox_usb_emul *sandbox_usb_flash_create(const char *fname);
+
+/**
+ * sandbox_usb_kbd_create() - create a boot protocol HID keyboard
+ *
+ * @keys:	text the keyboard types, an Enter following it; may be NULL
+ * @return new device, or NULL if out of memory
+ */
+struct sandbox_usb_emul *sandbox_usb_kbd_create(const char *keys);
+
+#endif
@@ -122,7 +122,7 @@ static void inc_enq(struct xhci_ctrl *ctrl, struct xhci_ring *ring,
 			next->link.control |= cpu_to_le32(chain);
 
 			next->link.control ^= cpu_to_le32(TRB_CYCLE);
-			xhci_flush_cache((uint32_t)next,
+			xhci_flush_cache((uintptr_t)next,
 						sizeof(union xhci_trb));
 		}
 		/* Toggle the cycle bit after the last ring segment. */
@@ -191,7 +191,7 @@ static struct xhci_generic_trb *queue_trb(struct xhci_ctrl *ctrl,
 	for (i = 0; i < 4; i++)
 		trb->field[i] = cpu_to_le32(trb_fields[i]);
 
-	xhci_flush_cache((uint32_t)trb, sizeof(struct xhci_generic_trb));
+	xhci_flush_cache((uintptr_t)trb, sizeof(struct xhci_generic_trb));
 
 	inc_enq(ctrl, ring, more_trbs_coming);
 
@@ -244,7 +244,7 @@ static int prepare_ring(struct xhci_ctrl *ctrl, struct xhci_ring *ep_ring,
 
 		next->link.control ^= cpu_to_le32(TRB_CYCLE);
 
-		xhci_flush_cache((uint32_t)next, sizeof(union xhci_trb));
+		xhci_flush_cache((uintptr_t)next, sizeof(union xhci_trb));
 
 		/* Toggle the cycle bit after the last ring segment. */
 		if (last_trb_on_last_seg(ctrl, ep_ring,
@@ -364,7 +364,7 @@ static void giveback_first_trb(struct usb_device *udev, int ep_index,
 	else
 		start_trb->field[3] &= cpu_to_le32(~TRB_CYCLE);
 
-	xhci_flush_cache((uint32_t)start_trb, sizeof(struct xhci_generic_trb));
+	xhci_flush_cache((uintptr_t)start_trb, sizeof(struct xhci_generic_trb));
 
 	/* Ringing EP doorbell here */
 	xhci_writel(&ctrl->dba->doorbell[udev->slot_id],
@@ -403,7 +403,7 @@ static int event_ready(struct xhci_ctrl *ctrl)
 {
 	union xhci_trb *event;
 
-	xhci_inval_cache((uint32_t)ctrl->event_ring->dequeue,
+	xhci_inval_cache((uintptr_t)ctrl->event_ring->dequeue,
 					sizeof(union xhci_trb));
 
 	event = ctrl->event_ring->dequeue;
@@ -507,156 +507,133 @@ static void abort_td(struct usb_device *udev, int ep_index)
 	xhci_acknowledge_event(ctrl);
 }
 
-static void record_transfer_result(struct usb_device *udev,
-				   union xhci_trb *event, int length)
+/**
+ * Translates the completion code of a transfer event to a USB status
+ *
+ * @param comp	completion code of the event
+ * @return status as for usb_device.status
+ */
+static unsigned long xhci_transfer_status(int comp)
 {
-	udev->act_len = min(length, length -
-		EVENT_TRB_LEN(le32_to_cpu(event->trans_event.transfer_len)));
-
-	switch (GET_COMP_CODE(le32_to_cpu(event->trans_event.transfer_len))) {
+	switch (comp) {
 	case COMP_SUCCESS:
-		BUG_ON(udev->act_len != length);
-		/* fallthrough */
 	case COMP_SHORT_TX:
-		udev->status = 0;
-		break;
+		return 0;
 	case COMP_STALL:
-		udev->status = USB_ST_STALLED;
-		break;
+		return USB_ST_STALLED;
 	case COMP_DB_ERR:
 	case COMP_TRB_ERR:
-		udev->status = USB_ST_BUF_ERR;
-		break;
+		return USB_ST_BUF_ERR;
 	case COMP_BABBLE:
-		udev->status = USB_ST_BABBLE_DET;
-		break;
+		return USB_ST_BABBLE_DET;
+	case COMP_STOP:
+	case COMP_STOP_INVAL:
+		return USB_ST_NAK_REC;	/* cancelled before completion */
 	default:
-		udev->status = 0x80;  /* USB_ST_TOO_LAZY_TO_MAKE_A_NEW_MACRO */
+		return 0x80;  /* USB_ST_TOO_LAZY_TO_MAKE_A_NEW_MACRO */
 	}
 }
 
-/**** Bulk and Control transfer methods ****/
-/**
- * Queues up the BULK Request
- *
- * @param udev		pointer to the USB device structure
- * @param pipe		contains the DIR_IN or OUT , devnum
- * @param length	length of the buffer
- * @param buffer	buffer to be read/written based on the request
- * @return returns 0 if successful else -1 on failure
- */
-int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
-			int length, void *buffer)
+static void record_transfer_result(struct usb_device *udev,
+				   union xhci_trb *event, int length)
 {
-	int num_trbs = 0;
-	struct xhci_generic_trb *start_trb;
-	bool first_trb = 0;
-	int start_cycle;
-	u32 field = 0;
-	u32 length_field = 0;
-	struct xhci_ctrl *ctrl = udev->controller;
-	int slot_id = udev->slot_id;
-	int ep_index;
-	struct xhci_virt_device *virt_dev;
-	struct xhci_ep_ctx *ep_ctx;
-	struct xhci_ring *ring;		/* EP transfer ring */
-	union xhci_trb *event;
-
-	int running_total, trb_buff_len;
-	unsigned int total_packet_count;
-	int maxpacketsize;
-	u64 addr;
-	int ret;
-	u32 trb_fields[4];
-	u64 val_64 = (uintptr_t)buffer;
-
-	debug("dev=%p, pipe=%lx, buffer=%p, length=%d\n",
-		udev, pipe, buffer, length);
+	int comp = GET_COMP_CODE(le32_to_cpu(event->trans_event.transfer_len));
 
-	ep_index = usb_pipe_ep_index(pipe);
-	virt_dev = ctrl->devs[slot_id];
-
-	xhci_inval_cache((uint32_t)virt_dev->out_ctx->bytes,
-					virt_dev->out_ctx->size);
+	udev->act_len = min(length, length -
+		EVENT_TRB_LEN(le32_to_cpu(event->trans_event.transfer_len)));
 
-	ep_ctx = xhci_get_ep_ctx(ctrl, virt_dev->out_ctx, ep_index);
+	BUG_ON(comp == COMP_SUCCESS && udev->act_len != length);
+	udev->status = xhci_transfer_status(comp);
+}
 
-	ring = virt_dev->eps[ep_index].ring;
-	/*
-	 * How much data is (potentially) left before the 64KB boundary?
-	 * XHCI Spec puts restriction( TABLE 49 and 6.4.1 section of XHCI Spec)
-	 * that the buffer should not span 64KB boundary. if so
-	 * we send request in more than 1 TRB by chaining them.
-	 */
-	running_total = TRB_MAX_BUFF_SIZE -
-			(lower_32_bits(val_64) & (TRB_MAX_BUFF_SIZE - 1));
-	trb_buff_len = running_total;
-	running_total &= TRB_MAX_BUFF_SIZE - 1;
+/**** Bulk and Control transfer methods ****/
 
-	/*
-	 * If there's some data on this 64KB chunk, or we have to send a
-	 * zero-length transfer, we need at least one TRB
-	 */
-	if (running_total != 0 || length == 0)
-		num_trbs++;
+/* Most bulk TDs queued on the rings of a device before waiting for them */
+#define XHCI_MAX_BATCH_TDS	64
 
-	/* How many more 64KB chunks to transfer, how many more TRBs? */
-	while (running_total < length) {
-		num_trbs++;
-		running_total += TRB_MAX_BUFF_SIZE;
-	}
+/* A bulk transfer of a batch, as queued on its endpoint ring */
+struct xhci_bulk_td {
+	struct usb_bulk_xfer *xfer;
+	int ep_index;
+	bool ioc;		/* interrupt when the TD completes */
+	bool done;
+	union xhci_trb *first;	/* first and last TRBs of the TD */
+	union xhci_trb *last;
+};
+
+/* The TDs of a batch which are on the rings at the same time */
+struct xhci_bulk_round {
+	struct usb_device *udev;
+	struct xhci_bulk_td tds[XHCI_MAX_BATCH_TDS];
+	int count;
+	int left;		/* TDs not done yet */
+};
 
-	/*
-	 * XXX: Calling routine prepare_ring() called in place of
-	 * prepare_trasfer() as there in 'Linux' since we are not
-	 * maintaining multiple TDs/transfer at the same time.
-	 */
-	ret = prepare_ring(ctrl, ring,
-			   le32_to_cpu(ep_ctx->ep_info) & EP_STATE_MASK);
-	if (ret < 0)
-		return ret;
+/**
+ * Counts the TRBs of a bulk TD: a TRB must not cross a 64KB boundary
+ * (TABLE 49 and section 6.4.1 of the XHCI Spec), and even a zero-length
+ * transfer takes one.
+ *
+ * @param buffer	buffer of the transfer
+ * @param length	length of the buffer
+ * @return number of TRBs
+ */
+static int xhci_bulk_td_trbs(void *buffer, int length)
+{
+	int first = TRB_MAX_BUFF_SIZE -
+		    ((uintptr_t)buffer & (TRB_MAX_BUFF_SIZE - 1));
 
-	/*
-	 * Don't give the first TRB to the hardware (by toggling the cycle bit)
-	 * until we've finished creating all the other TRBs.  The ring's cycle
-	 * state may change as we enqueue the other TRBs, so save it too.
-	 */
-	start_trb = &ring->enqueue->generic;
-	start_cycle = ring->cycle_state;
+	if (length <= first)
+		return 1;
 
-	running_total = 0;
-	maxpacketsize = usb_maxpacket(udev, pipe);
+	return 1 + DIV_ROUND_UP(length - first, TRB_MAX_BUFF_SIZE);
+}
 
-	total_packet_count = DIV_ROUND_UP(length, maxpacketsize);
+/**
+ * Queues the TRBs of a bulk TD on its ring. The ring must have been
+ * prepared with prepare_ring() and have room for the TD.
+ *
+ * @param udev	pointer to the USB device structure
+ * @param td	the TD, whose first and last TRBs are recorded
+ * @param ring	transfer ring of the endpoint
+ * @param hold	don't give the first TRB to the hardware yet, see
+ *		giveback_first_trb()
+ * @return none
+ */
+static void queue_bulk_td(struct usb_device *udev, struct xhci_bulk_td *td,
+			  struct xhci_ring *ring, bool hold)
+{
+	struct xhci_ctrl *ctrl = udev->controller;
+	struct usb_bulk_xfer *xfer = td->xfer;
+	int length = xfer->length;
+	int num_trbs = xhci_bulk_td_trbs(xfer->buffer, length);
+	int maxpacketsize = usb_maxpacket(udev, xfer->pipe);
+	unsigned int total_packet_count = DIV_ROUND_UP(length, maxpacketsize);
+	u64 addr = (uintptr_t)xfer->buffer;
+	int running_total = 0;
+	int trb_buff_len;
+	u32 field, remainder;
+	u32 trb_fields[4];
 
-	/* How much data is in the first TRB? */
-	/*
-	 * How much data is (potentially) left before the 64KB boundary?
-	 * XHCI Spec puts restriction( TABLE 49 and 6.4.1 section of XHCI Spec)
-	 * that the buffer should not span 64KB boundary. if so
-	 * we send request in more than 1 TRB by chaining them.
-	 */
-	addr = val_64;
+	td->first = ring->enqueue;
 
+	/* How much data is (potentially) left before the 64KB boundary? */
+	trb_buff_len = TRB_MAX_BUFF_SIZE -
+		       (lower_32_bits(addr) & (TRB_MAX_BUFF_SIZE - 1));
 	if (trb_buff_len > length)
 		trb_buff_len = length;
 
-	first_trb = true;
-
 	/* flush the buffer before use */
-	xhci_flush_cache((uint32_t)buffer, length);
+	if (length > 0)
+		xhci_flush_cache((uintptr_t)xfer->buffer, length);
 
 	/* Queue the first TRB, even if it's zero-length */
 	do {
-		u32 remainder = 0;
-		field = 0;
+		field = ring->cycle_state;
 		/* Don't change the cycle bit of the first TRB until later */
-		if (first_trb) {
-			first_trb = false;
-			if (start_cycle == 0)
-				field |= TRB_CYCLE;
-		} else {
-			field |= ring->cycle_state;
+		if (hold) {
+			field ^= TRB_CYCLE;
+			hold = false;
 		}
 
 		/*
@@ -665,15 +642,15 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 		 */
 		if (num_trbs > 1)
 			field |= TRB_CHAIN;
-		else
+		else if (td->ioc)
 			field |= TRB_IOC;
 
 		/* Only set interrupt on short packet for IN endpoints */
-		if (usb_pipein(pipe))
+		if (usb_pipein(xfer->pipe))
 			field |= TRB_ISP;
 
 		/* Set the TRB length, TD size, and interrupter fields. */
-		if (HC_VERSION(xhci_readl(&ctrl->hccr->cr_capbase)) < 0x100)
+		if (ctrl->hci_version < 0x100)
 			remainder = xhci_td_remainder(length - running_total);
 		else
 			remainder = xhci_v1_0_td_remainder(running_total,
@@ -682,17 +659,16 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 							   maxpacketsize,
 							   num_trbs - 1);
 
-		length_field = ((trb_buff_len & TRB_LEN_MASK) |
-				remainder |
-				((0 & TRB_INTR_TARGET_MASK) <<
-				TRB_INTR_TARGET_SHIFT));
-
 		trb_fields[0] = lower_32_bits(addr);
 		trb_fields[1] = upper_32_bits(addr);
-		trb_fields[2] = length_field;
+		trb_fields[2] = (trb_buff_len & TRB_LEN_MASK) | remainder |
+				((0 & TRB_INTR_TARGET_MASK) <<
+				TRB_INTR_TARGET_SHIFT);
 		trb_fields[3] = field | (TRB_NORMAL << TRB_TYPE_SHIFT);
 
-		queue_trb(ctrl, ring, (num_trbs > 1), trb_fields);
+		td->last = (union xhci_trb *)queue_trb(ctrl, ring,
+						       (num_trbs > 1),
+						       trb_fields);
 
 		--num_trbs;
 
@@ -702,29 +678,422 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 		addr += trb_buff_len;
 		trb_buff_len = min((length - running_total), TRB_MAX_BUFF_SIZE);
 	} while (running_total < length);
+}
 
-	giveback_first_trb(udev, ep_index, start_cycle, start_trb);
+/**
+ * Puts as many transfers of a batch as the rings take in a round, and
+ * rings the doorbell of each endpoint once.
+ *
+ * The TDs of an endpoint interrupt on completion only when they are the
+ * last one of the round or have moved XHCI_MAX_BULK_TD bytes since the
+ * previous interrupt, so that a wait never covers more than that.
+ *
+ * @param round		the round to fill in
+ * @param xfers		transfers left in the batch
+ * @param count		number of transfers left
+ * @return number of transfers queued, or error code if none could be
+ */
+static int xhci_bulk_queue_round(struct xhci_bulk_round *round,
+				 struct usb_bulk_xfer *xfers, int count)
+{
+	struct usb_device *udev = round->udev;
+	struct xhci_ctrl *ctrl = udev->controller;
+	struct xhci_virt_device *virt_dev = ctrl->devs[udev->slot_id];
+	struct xhci_bulk_td *last_td[MAX_EP_CTX_NUM] = { NULL };
+	union xhci_trb *start_trb[MAX_EP_CTX_NUM] = { NULL };
+	int start_cycle[MAX_EP_CTX_NUM];
+	int used[MAX_EP_CTX_NUM] = { 0 };
+	int bytes[MAX_EP_CTX_NUM] = { 0 };
+	struct xhci_bulk_td *td;
+	struct xhci_ep_ctx *ep_ctx;
+	struct xhci_ring *ring;
+	int ep_index, trbs, room, ret, n;
+
+	xhci_inval_cache((uintptr_t)virt_dev->out_ctx->bytes,
+			 virt_dev->out_ctx->size);
+
+	/* Work out what fits in the rings; nothing is queued yet */
+	for (n = 0; n < count && n < XHCI_MAX_BATCH_TDS; n++) {
+		ep_index = usb_pipe_ep_index(xfers[n].pipe);
+		ring = virt_dev->eps[ep_index].ring;
+		if (!ring) {
+			printf("XHCI bulk transfer to unconfigured ep %d\n",
+			       ep_index);
+			return -ENOENT;
+		}
+		if (!last_td[ep_index]) {
+			ep_ctx = xhci_get_ep_ctx(ctrl, virt_dev->out_ctx,
+						 ep_index);
+			ret = prepare_ring(ctrl, ring,
+					   le32_to_cpu(ep_ctx->ep_info) &
+					   EP_STATE_MASK);
+			if (ret < 0)
+				return ret;
+		}
 
-	event = xhci_wait_for_event(ctrl, TRB_TRANSFER);
-	if (!event) {
-		debug("XHCI bulk transfer timed out, aborting...\n");
-		abort_td(udev, ep_index);
-		udev->status = USB_ST_NAK_REC;  /* closest thing to a timeout */
-		udev->act_len = 0;
-		return -ETIMEDOUT;
+		/*
+		 * Every round starts with an empty ring. Keep one TRB free
+		 * so that the enqueue pointer never comes back to the TRB
+		 * the xHC waits on.
+		 */
+		trbs = xhci_bulk_td_trbs(xfers[n].buffer, xfers[n].length);
+		room = ring->num_segs * (TRBS_PER_SEGMENT - 1) - 1;
+		if (used[ep_index] + trbs > room) {
+			if (n)
+				break;
+			printf("XHCI bulk transfer of %d bytes too big\n",
+			       xfers[n].length);
+			return -EINVAL;
+		}
+		used[ep_index] += trbs;
+
+		td = &round->tds[n];
+		td->xfer = &xfers[n];
+		td->ep_index = ep_index;
+		td->done = false;
+		bytes[ep_index] += xfers[n].length;
+		td->ioc = bytes[ep_index] >= XHCI_MAX_BULK_TD;
+		if (td->ioc)
+			bytes[ep_index] = 0;
+		last_td[ep_index] = td;
 	}
-	field = le32_to_cpu(event->trans_event.flags);
+	for (ep_index = 0; ep_index < MAX_EP_CTX_NUM; ep_index++) {
+		if (last_td[ep_index])
+			last_td[ep_index]->ioc = true;
+	}
+	round->count = n;
+	round->left = n;
 
-	BUG_ON(TRB_TO_SLOT_ID(field) != slot_id);
-	BUG_ON(TRB_TO_EP_INDEX(field) != ep_index);
-	BUG_ON(*(void **)(uintptr_t)le64_to_cpu(event->trans_event.buffer) -
-		buffer > (size_t)length);
+	/*
+	 * Queue all the TDs, holding back the first TRB of each endpoint,
+	 * whose state was checked above.
+	 */
+	for (n = 0; n < round->count; n++) {
+		td = &round->tds[n];
+		ring = virt_dev->eps[td->ep_index].ring;
+		prepare_ring(ctrl, ring, EP_STATE_RUNNING);
+		if (!start_trb[td->ep_index]) {
+			start_trb[td->ep_index] = ring->enqueue;
+			start_cycle[td->ep_index] = ring->cycle_state;
+			queue_bulk_td(udev, td, ring, true);
+		} else {
+			queue_bulk_td(udev, td, ring, false);
+		}
+	}
 
-	record_transfer_result(udev, event, length);
+	for (ep_index = 0; ep_index < MAX_EP_CTX_NUM; ep_index++) {
+		if (start_trb[ep_index])
+			giveback_first_trb(udev, ep_index,
+					   start_cycle[ep_index],
+					   &start_trb[ep_index]->generic);
+	}
+
+	return round->count;
+}
+
+/**
+ * Finds a TRB in a TD, following link TRBs
+ *
+ * @param td		the TD
+ * @param trb		TRB to look for
+ * @param offset	returns the offset in the buffer of the TRB's data
+ * @param trb_len	returns the length of the TRB's data
+ * @return true if the TRB belongs to the TD
+ */
+static bool xhci_bulk_td_has_trb(struct xhci_bulk_td *td, union xhci_trb *trb,
+				 int *offset, int *trb_len)
+{
+	union xhci_trb *cur = td->first;
+
+	*offset = 0;
+	for (;;) {
+		if (TRB_TYPE_LINK_LE32(cur->link.control)) {
+			cur = (union xhci_trb *)(uintptr_t)
+				le64_to_cpu(cur->link.segment_ptr);
+			continue;
+		}
+		*trb_len = le32_to_cpu(cur->generic.field[2]) & TRB_LEN_MASK;
+		if (cur == trb)
+			return true;
+		if (cur == td->last)
+			return false;
+		*offset += *trb_len;
+		cur++;
+	}
+}
+
+/**
+ * Records the outcome of a transfer event in the TD it is for. The TDs
+ * queued before it on the same ring completed without an event of
+ * their own. Events for no TD of the round are ignored.
+ *
+ * @param round	the round in progress
+ * @param event	a transfer event
+ * @return the TD the event completed, or NULL
+ */
+static struct xhci_bulk_td *xhci_bulk_event(struct xhci_bulk_round *round,
+					    union xhci_trb *event)
+{
+	u32 field = le32_to_cpu(event->trans_event.flags);
+	u32 len = le32_to_cpu(event->trans_event.transfer_len);
+	union xhci_trb *trb = (union xhci_trb *)(uintptr_t)
+				le64_to_cpu(event->trans_event.buffer);
+	int ep_index = TRB_TO_EP_INDEX(field);
+	int comp = GET_COMP_CODE(len);
+	struct xhci_bulk_td *td;
+	int i, j, offset, trb_len;
+
+	if (TRB_TO_SLOT_ID(field) != round->udev->slot_id)
+		return NULL;
+
+	for (i = 0; i < round->count; i++) {
+		td = &round->tds[i];
+		if (td->done || td->ep_index != ep_index ||
+		    !xhci_bulk_td_has_trb(td, trb, &offset, &trb_len))
+			continue;
+
+		for (j = 0; j < i; j++) {
+			if (round->tds[j].done ||
+			    round->tds[j].ep_index != ep_index)
+				continue;
+			round->tds[j].xfer->act_len = round->tds[j].xfer->length;
+			round->tds[j].xfer->status = 0;
+			round->tds[j].done = true;
+			round->left--;
+		}
+
+		if (comp != COMP_STOP_INVAL)
+			offset += trb_len - min(EVENT_TRB_LEN(len),
+						(u32)trb_len);
+		td->xfer->act_len = offset;
+		td->xfer->status = xhci_transfer_status(comp);
+		td->done = true;
+		round->left--;
+		return td;
+	}
+
+	debug("XHCI bulk event for no queued TD, skipping...\n");
+	return NULL;
+}
+
+/**
+ * Waits for the completion of a command while TDs of the round may
+ * still complete, handing their transfer events to xhci_bulk_event().
+ * Caller *must* call xhci_acknowledge_event() after it is finished
+ * processing the event.
+ *
+ * @param round	the round in progress
+ * @return pointer to the command completion event
+ */
+static union xhci_trb *xhci_bulk_wait_for_command(struct xhci_bulk_round *round)
+{
+	struct xhci_ctrl *ctrl = round->udev->controller;
+	unsigned long ts = get_timer(0);
+	trb_type type;
+
+	do {
+		union xhci_trb *event = ctrl->event_ring->dequeue;
+
+		if (!event_ready(ctrl))
+			continue;
+
+		type = TRB_FIELD_TO_TYPE(le32_to_cpu(event->event_cmd.flags));
+		if (type == TRB_COMPLETION)
+			return event;
+		if (type == TRB_TRANSFER)
+			xhci_bulk_event(round, event);
+
+		xhci_acknowledge_event(ctrl);
+	} while (get_timer(ts) < XHCI_TIMEOUT);
+
+	printf("XHCI timeout on event type %d... cannot recover.\n",
+	       TRB_COMPLETION);
+	BUG();
+}
+
+/**
+ * Runs a command on an endpoint of the device of the round
+ *
+ * @param round		the round in progress
+ * @param ptr		pointer for the command, if any
+ * @param ep_index	index of the endpoint
+ * @param cmd		command to run
+ * @return completion code of the command
+ */
+static int xhci_bulk_command(struct xhci_bulk_round *round, void *ptr,
+			     int ep_index, trb_type cmd)
+{
+	struct usb_device *udev = round->udev;
+	struct xhci_ctrl *ctrl = udev->controller;
+	union xhci_trb *event;
+	int comp;
+
+	xhci_queue_command(ctrl, ptr, udev->slot_id, ep_index, cmd);
+	event = xhci_bulk_wait_for_command(round);
+	BUG_ON(TRB_TO_SLOT_ID(le32_to_cpu(event->event_cmd.flags))
+		!= udev->slot_id);
+	comp = GET_COMP_CODE(le32_to_cpu(event->event_cmd.status));
 	xhci_acknowledge_event(ctrl);
-	xhci_inval_cache((uint32_t)buffer, length);
 
-	return (udev->status != USB_ST_NOT_PROC) ? 0 : -1;
+	return comp;
+}
+
+/**
+ * Takes the TDs of a round which did not complete off their rings.
+ * Rings which halted are reset and rings still busy stopped, then the
+ * xHC's dequeue pointer is set to our enqueue pointer, as abort_td()
+ * does for a single TD. The cancelled transfers keep USB_ST_NOT_PROC,
+ * or the status the stop gave them.
+ *
+ * @param round	the round in progress
+ * @return none
+ */
+static void xhci_bulk_cancel(struct xhci_bulk_round *round)
+{
+	struct usb_device *udev = round->udev;
+	struct xhci_ctrl *ctrl = udev->controller;
+	struct xhci_virt_device *virt_dev = ctrl->devs[udev->slot_id];
+	u32 busy = 0, used = 0;
+	struct xhci_ep_ctx *ep_ctx;
+	struct xhci_ring *ring;
+	int ep_index, comp, i;
+
+	for (i = 0; i < round->count; i++) {
+		used |= 1 << round->tds[i].ep_index;
+		if (!round->tds[i].done)
+			busy |= 1 << round->tds[i].ep_index;
+	}
+
+	for (ep_index = 0; ep_index < MAX_EP_CTX_NUM; ep_index++) {
+		if (!(used & (1 << ep_index)))
+			continue;
+
+		xhci_inval_cache((uintptr_t)virt_dev->out_ctx->bytes,
+				 virt_dev->out_ctx->size);
+		ep_ctx = xhci_get_ep_ctx(ctrl, virt_dev->out_ctx, ep_index);
+		if ((le32_to_cpu(ep_ctx->ep_info) & EP_STATE_MASK) ==
+				EP_STATE_HALTED) {
+			comp = xhci_bulk_command(round, NULL, ep_index,
+						 TRB_RESET_EP);
+		} else if (busy & (1 << ep_index)) {
+			comp = xhci_bulk_command(round, NULL, ep_index,
+						 TRB_STOP_RING);
+			/* It halted in the meantime */
+			if (comp == COMP_CTX_STATE)
+				comp = xhci_bulk_command(round, NULL, ep_index,
+							 TRB_RESET_EP);
+		} else {
+			continue;
+		}
+		if (comp != COMP_SUCCESS)
+			printf("XHCI failed to stop ep %d: %d\n", ep_index,
+			       comp);
+
+		ring = virt_dev->eps[ep_index].ring;
+		comp = xhci_bulk_command(round, (void *)((uintptr_t)
+					 ring->enqueue | ring->cycle_state),
+					 ep_index, TRB_SET_DEQ);
+		if (comp != COMP_SUCCESS)
+			printf("XHCI failed to set dequeue of ep %d: %d\n",
+			       ep_index, comp);
+	}
+}
+
+/**
+ * Queues up a batch of BULK Requests, see submit_bulk_batch(). Each
+ * round puts as many transfers as the rings take, then collects the
+ * completions. The first failure or timeout cancels the rest.
+ *
+ * @param udev	pointer to the USB device structure
+ * @param xfers	the transfers, which get their act_len and status
+ * @param count	number of transfers
+ * @return 0 if the batch ran, whatever the outcome of the transfers,
+ *	   else error code if it could not be queued
+ */
+int xhci_bulk_batch(struct usb_device *udev, struct usb_bulk_xfer *xfers,
+		    int count)
+{
+	struct xhci_ctrl *ctrl = udev->controller;
+	static struct xhci_bulk_round round;
+	struct xhci_bulk_td *td;
+	union xhci_trb *event;
+	bool failed = false;
+	int i, n;
+
+	debug("dev=%p, %d bulk transfers\n", udev, count);
+
+	for (i = 0; i < count; i++) {
+		xfers[i].act_len = 0;
+		xfers[i].status = USB_ST_NOT_PROC;
+	}
+
+	round.udev = udev;
+	for (; count > 0 && !failed; xfers += n, count -= n) {
+		n = xhci_bulk_queue_round(&round, xfers, count);
+		if (n < 0)
+			return n;
+
+		while (round.left) {
+			event = xhci_wait_for_event(ctrl, TRB_TRANSFER);
+			if (!event) {
+				debug("XHCI bulk transfer timed out, aborting...\n");
+				for (i = 0; round.tds[i].done; i++)
+					;
+				/* closest thing to a timeout */
+				round.tds[i].xfer->status = USB_ST_NAK_REC;
+				failed = true;
+				break;
+			}
+			td = xhci_bulk_event(&round, event);
+			xhci_acknowledge_event(ctrl);
+			if (td && td->xfer->status) {
+				failed = true;
+				break;
+			}
+		}
+		if (round.left)
+			xhci_bulk_cancel(&round);
+
+		for (i = 0; i < n; i++) {
+			if (xfers[i].length > 0)
+				xhci_inval_cache((uintptr_t)xfers[i].buffer,
+						 xfers[i].length);
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Queues up the BULK Request
+ *
+ * @param udev		pointer to the USB device structure
+ * @param pipe		contains the DIR_IN or OUT , devnum
+ * @param length	length of the buffer
+ * @param buffer	buffer to be read/written based on the request
+ * @return returns 0 if successful else error code on failure
+ */
+int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
+			int length, void *buffer)
+{
+	struct usb_bulk_xfer xfer = {
+		.pipe = pipe,
+		.buffer = buffer,
+		.length = length,
+	};
+	int ret;
+
+	debug("dev=%p, pipe=%lx, buffer=%p, length=%d\n",
+		udev, pipe, buffer, length);
+
+	ret = xhci_bulk_batch(udev, &xfer, 1);
+	if (ret < 0)
+		return ret;
+
+	udev->act_len = xfer.act_len;
+	udev->status = xfer.status;
+
+	return (udev->status == USB_ST_NAK_REC) ? -ETIMEDOUT : 0;
 }
 
 /**
@@ -776,7 +1145,7 @@ int xhci_ctrl_tx(struct usb_device *udev, unsigned long pipe,
 			return ret;
 	}
 
-	xhci_inval_cache((uint32_t)virt_dev->out_ctx->bytes,
+	xhci_inval_cache((uintptr_t)virt_dev->out_ctx->bytes,
 				virt_dev->out_ctx->size);
 
 	struct xhci_ep_ctx *ep_ctx = NULL;
@@ -821,7 +1190,7 @@ int xhci_ctrl_tx(struct usb_device *udev, unsigned long pipe,
 		field |= 0x1;
 
 	/* xHCI 1.0 6.4.1.2.1: Transfer Type field */
-	if (HC_VERSION(xhci_readl(&ctrl->hccr->cr_capbase)) == 0x100) {
+	if (ctrl->hci_version == 0x100) {
 		if (length > 0) {
 			if (req->requesttype & USB_DIR_IN)
 				field |= (TRB_DATA_IN << TRB_TX_TYPE_SHIFT);
@@ -874,7 +1243,7 @@ int xhci_ctrl_tx(struct usb_device *udev, unsigned long pipe,
 		trb_fields[2] = length_field;
 		trb_fields[3] = field | ep_ring->cycle_state;
 
-		xhci_flush_cache((uint32_t)buffer, length);
+		xhci_flush_cache((uintptr_t)buffer, length);
 		queue_trb(ctrl, ep_ring, true, trb_fields);
 	}
 
@@ -915,7 +1284,7 @@ int xhci_ctrl_tx(struct usb_device *udev, unsigned long pipe,
 
 	/* Invalidate buffer to make it available to usb-core */
 	if (length > 0)
-		xhci_inval_cache((uint32_t)buffer, length);
+		xhci_inval_cache((uintptr_t)buffer, length);
 
 	if (GET_COMP_CODE(le32_to_cpu(event->trans_event.transfer_len))
 			== COMP_SHORT_TX) {
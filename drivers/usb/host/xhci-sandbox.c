@@ -0,0 +1,762 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Sandbox xHCI host controller
+ *
+ * A model of an xHC, enough for the xHCI driver: its registers react to
+ * the accesses the driver makes through xhci_readl()/xhci_writel(), and
+ * the command and transfer rings it builds in memory are run against the
+ * emulated devices of the sandbox host controller.
+ *
+ * The bus is described by the environment when 'usb start' runs:
+ *
+ *   sandbox_usb		devices on the root ports, separated by spaces:
+ *			a host file name for a storage device or '-' for
+ *			an empty port. There are no hubs
+ *   sandbox_usb_latency	time from a doorbell to the endpoint starting,
+ *			in us
+ *   sandbox_usb_speed	speed of the bus, in KiB/s (default: unlimited)
+ *
+ * Everything happens within the register write which starts it. The
+ * endpoints with TRBs to run take turns until none of them can progress,
+ * a device which is not ready for a transfer NAKing it. Unlike on real
+ * controllers, a STALL doesn't halt ep 0, as the driver cannot recover
+ * from that.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <div64.h>
+#include <errno.h>
+#include <usb.h>
+#include "xhci.h"
+#include "usb-sandbox.h"
+
+#define SANDBOX_XHCI_SLOTS	8
+#define SANDBOX_XHCI_PORTS	CONFIG_SYS_USB_XHCI_MAX_ROOT_PORTS
+/* Room an endpoint needs on the event ring to run a TD */
+#define SANDBOX_XHCI_EVENTS	2
+
+struct sandbox_xhci_regs {
+	struct xhci_hccr cap;
+	u32 cap_rsvd;
+	struct xhci_hcor op;
+	struct xhci_run_regs run __aligned(32);
+	struct xhci_doorbell_array db;
+};
+
+struct sandbox_xhci_ep {
+	union xhci_trb *deq;	/* next TRB to run */
+	int cycle;		/* cycle state of the ring */
+	int state;		/* EP_STATE_... */
+};
+
+struct sandbox_xhci_slot {
+	bool enabled;
+	struct sandbox_usb_emul *emul;	/* once addressed */
+	struct sandbox_xhci_ep eps[MAX_EP_CTX_NUM];
+};
+
+static struct sandbox_xhci {
+	struct sandbox_xhci_regs regs;
+	struct sandbox_usb_emul *ports[SANDBOX_XHCI_PORTS];
+	struct sandbox_xhci_slot slots[SANDBOX_XHCI_SLOTS + 1];
+	union xhci_trb *cmd_deq;
+	int cmd_cycle;
+	struct xhci_erst_entry *erst;	/* NULL until ERSTBA is written */
+	int erst_size;
+	int ev_seg;			/* where the next event goes */
+	int ev_index;
+	int ev_cycle;
+	union xhci_trb *erdp;		/* the driver's dequeue pointer */
+	bool busy;
+	ulong latency_us;
+	ulong speed;
+	u64 bus_ns;			/* bus time not waited for yet */
+} sx;
+
+u32 sandbox_xhci_readl(volatile u32 *reg)
+{
+	return *reg;
+}
+
+static union xhci_trb *sandbox_xhci_event_trb(int seg, int index)
+{
+	return (union xhci_trb *)(uintptr_t)
+		le64_to_cpu(sx.erst[seg].seg_addr) + index;
+}
+
+/* Number of events which can be posted before the event ring is full */
+static int sandbox_xhci_event_room(void)
+{
+	int seg, total = 0, enq = -1, deq = -1;
+	union xhci_trb *first;
+	int size;
+
+	if (!sx.erst)
+		return 0;
+
+	for (seg = 0; seg < sx.erst_size; seg++) {
+		first = sandbox_xhci_event_trb(seg, 0);
+		size = le32_to_cpu(sx.erst[seg].seg_size);
+		if (seg == sx.ev_seg)
+			enq = total + sx.ev_index;
+		if (sx.erdp >= first && sx.erdp < first + size)
+			deq = total + (sx.erdp - first);
+		total += size;
+	}
+	if (deq < 0)
+		return 0;
+
+	return (deq - enq - 1 + total) % total;
+}
+
+static void sandbox_xhci_event(u64 ptr, u32 status, u32 flags)
+{
+	struct xhci_generic_trb *trb;
+
+	if (!sandbox_xhci_event_room()) {
+		puts("sandbox_xhci: event ring full, event lost\n");
+		return;
+	}
+
+	trb = &sandbox_xhci_event_trb(sx.ev_seg, sx.ev_index)->generic;
+	trb->field[0] = cpu_to_le32(lower_32_bits(ptr));
+	trb->field[1] = cpu_to_le32(upper_32_bits(ptr));
+	trb->field[2] = cpu_to_le32(status);
+	/* The cycle bit hands the event over, it goes last */
+	trb->field[3] = cpu_to_le32(flags | sx.ev_cycle);
+
+	if (++sx.ev_index == le32_to_cpu(sx.erst[sx.ev_seg].seg_size)) {
+		sx.ev_index = 0;
+		if (++sx.ev_seg == sx.erst_size) {
+			sx.ev_seg = 0;
+			sx.ev_cycle ^= 1;
+		}
+	}
+
+	sx.regs.op.or_usbsts |= STS_EINT;
+	sx.regs.run.ir_set[0].irq_pending |= 1;
+	sx.regs.run.ir_set[0].erst_dequeue |= ERST_EHB;
+}
+
+static void sandbox_xhci_transfer_event(union xhci_trb *trb, int slot_id,
+					int ep_index, int comp, int residue)
+{
+	sandbox_xhci_event((uintptr_t)trb, comp << 24 | residue,
+			   TRB_TYPE(TRB_TRANSFER) | SLOT_ID_FOR_TRB(slot_id) |
+			   EP_ID_FOR_TRB(ep_index));
+}
+
+static void *sandbox_xhci_out_ctx(int slot_id)
+{
+	__le64 *dcbaa = (__le64 *)(uintptr_t)sx.regs.op.or_dcbaap;
+
+	return (void *)(uintptr_t)le64_to_cpu(dcbaa[slot_id]);
+}
+
+static struct xhci_slot_ctx *sandbox_xhci_slot_ctx(int slot_id)
+{
+	return sandbox_xhci_out_ctx(slot_id);
+}
+
+static struct xhci_ep_ctx *sandbox_xhci_ep_ctx(int slot_id, int ep_index)
+{
+	return sandbox_xhci_out_ctx(slot_id) + (ep_index + 1) * 32;
+}
+
+/* Set the state of an endpoint, with its dequeue pointer in the context */
+static void sandbox_xhci_set_state(int slot_id, int ep_index, int state)
+{
+	struct sandbox_xhci_ep *ep = &sx.slots[slot_id].eps[ep_index];
+	struct xhci_ep_ctx *ctx = sandbox_xhci_ep_ctx(slot_id, ep_index);
+
+	ep->state = state;
+	ctx->ep_info = cpu_to_le32((le32_to_cpu(ctx->ep_info) &
+				    ~EP_STATE_MASK) | state);
+	ctx->deq = cpu_to_le64((uintptr_t)ep->deq | ep->cycle);
+}
+
+/* Start an endpoint at the dequeue pointer of its input context */
+static void sandbox_xhci_add_ep(int slot_id, int ep_index,
+				struct xhci_ep_ctx *in)
+{
+	struct sandbox_xhci_ep *ep = &sx.slots[slot_id].eps[ep_index];
+	u64 deq = le64_to_cpu(in->deq);
+
+	memcpy(sandbox_xhci_ep_ctx(slot_id, ep_index), in, sizeof(*in));
+	ep->deq = (union xhci_trb *)(uintptr_t)(deq & ~(u64)0xf);
+	ep->cycle = deq & 1;
+	sandbox_xhci_set_state(slot_id, ep_index, EP_STATE_RUNNING);
+}
+
+/* Pretend the bus took the time to move @bytes */
+static void sandbox_xhci_bus_time(int bytes)
+{
+	if (!sx.speed)
+		return;
+
+	sx.bus_ns += lldiv((u64)bytes * 1000000000, sx.speed * 1024);
+	if (sx.bus_ns >= 1000) {
+		udelay(lldiv(sx.bus_ns, 1000));
+		sx.bus_ns %= 1000;
+	}
+}
+
+/* Follow the link TRBs at the dequeue pointer; false if no TRB to run */
+static bool sandbox_xhci_owned(struct sandbox_xhci_ep *ep)
+{
+	u32 field;
+
+	for (;;) {
+		field = le32_to_cpu(ep->deq->generic.field[3]);
+		if ((field & TRB_CYCLE) != ep->cycle)
+			return false;
+		if (TRB_FIELD_TO_TYPE(field) != TRB_LINK)
+			return true;
+		ep->deq = (union xhci_trb *)(uintptr_t)
+			le64_to_cpu(ep->deq->link.segment_ptr);
+		if (field & LINK_TOGGLE)
+			ep->cycle ^= 1;
+	}
+}
+
+/* Move past the TRB at the dequeue pointer, or past the rest of its TD */
+static void sandbox_xhci_advance(struct sandbox_xhci_ep *ep, bool whole_td)
+{
+	u32 field;
+
+	do {
+		field = le32_to_cpu(ep->deq->generic.field[3]);
+		ep->deq++;
+	} while (whole_td && (field & TRB_CHAIN) && sandbox_xhci_owned(ep));
+}
+
+/* Run a whole control TD on ep 0 */
+static bool sandbox_xhci_run_control(int slot_id, struct sandbox_xhci_ep *ep)
+{
+	struct sandbox_usb_emul *emul = sx.slots[slot_id].emul;
+	union xhci_trb *setup = ep->deq, *data = NULL, *status;
+	struct devrequest req;
+	void *buf = NULL;
+	u32 field;
+	int len = 0;
+	int ret;
+
+	field = le32_to_cpu(setup->generic.field[3]);
+	if (TRB_FIELD_TO_TYPE(field) != TRB_SETUP) {
+		sandbox_xhci_transfer_event(setup, slot_id, 0, COMP_TRB_ERR, 0);
+		sandbox_xhci_advance(ep, true);
+		return true;
+	}
+	memcpy(&req, (void *)&setup->generic.field[0], sizeof(req));
+
+	sandbox_xhci_advance(ep, false);
+	sandbox_xhci_owned(ep);
+	field = le32_to_cpu(ep->deq->generic.field[3]);
+	if (TRB_FIELD_TO_TYPE(field) == TRB_DATA) {
+		data = ep->deq;
+		buf = (void *)(uintptr_t)(le32_to_cpu(data->generic.field[0]) |
+			(u64)le32_to_cpu(data->generic.field[1]) << 32);
+		len = le32_to_cpu(data->generic.field[2]) & TRB_LEN_MASK;
+		sandbox_xhci_advance(ep, false);
+		sandbox_xhci_owned(ep);
+	}
+	status = ep->deq;
+	sandbox_xhci_advance(ep, false);
+
+	ret = sandbox_usb_emul_control(emul, &req, buf, len);
+	debug("sandbox_xhci: %s: request %02x type %02x value %04x: %d\n",
+	      emul->name, req.request, req.requesttype,
+	      le16_to_cpu(req.value), ret);
+	if (ret < 0) {
+		sandbox_xhci_transfer_event(data ? data : setup, slot_id, 0,
+					    COMP_STALL, len);
+		return true;
+	}
+	sandbox_xhci_bus_time(ret);
+	if (data && (req.requesttype & USB_DIR_IN) && ret < len)
+		sandbox_xhci_transfer_event(data, slot_id, 0, COMP_SHORT_TX,
+					    len - ret);
+	sandbox_xhci_transfer_event(status, slot_id, 0, COMP_SUCCESS, 0);
+
+	return true;
+}
+
+/*
+ * Run the next TRB of an endpoint, or the next TD for ep 0. Returns
+ * false if the endpoint has nothing to run or the device NAKed.
+ */
+static bool sandbox_xhci_run_ep(int slot_id, int ep_index)
+{
+	struct sandbox_usb_emul *emul = sx.slots[slot_id].emul;
+	struct sandbox_xhci_ep *ep = &sx.slots[slot_id].eps[ep_index];
+	union xhci_trb *trb;
+	int in = (ep_index + 1) & 1;
+	u32 field;
+	void *buf;
+	int len, ret;
+
+	if (!sandbox_xhci_owned(ep))
+		return false;
+	if (!ep_index)
+		return sandbox_xhci_run_control(slot_id, ep);
+
+	trb = ep->deq;
+	field = le32_to_cpu(trb->generic.field[3]);
+	if (TRB_FIELD_TO_TYPE(field) != TRB_NORMAL) {
+		sandbox_xhci_transfer_event(trb, slot_id, ep_index,
+					    COMP_TRB_ERR, 0);
+		sandbox_xhci_set_state(slot_id, ep_index, EP_STATE_HALTED);
+		return true;
+	}
+	buf = (void *)(uintptr_t)(le32_to_cpu(trb->generic.field[0]) |
+				  (u64)le32_to_cpu(trb->generic.field[1]) << 32);
+	len = le32_to_cpu(trb->generic.field[2]) & TRB_LEN_MASK;
+
+	ret = emul->ops->bulk ? emul->ops->bulk(emul, (ep_index + 1) / 2, in,
+						buf, len) : -EPIPE;
+	if (ret == -EAGAIN)
+		return false;
+	if (ret < 0) {
+		sandbox_xhci_transfer_event(trb, slot_id, ep_index,
+					    ret == -EPIPE ? COMP_STALL :
+					    COMP_TX_ERR, len);
+		sandbox_xhci_set_state(slot_id, ep_index, EP_STATE_HALTED);
+		return true;
+	}
+	sandbox_xhci_bus_time(ret);
+
+	if (in && ret < len) {
+		if (field & (TRB_ISP | TRB_IOC))
+			sandbox_xhci_transfer_event(trb, slot_id, ep_index,
+						    COMP_SHORT_TX, len - ret);
+		sandbox_xhci_advance(ep, true);
+		return true;
+	}
+	if (field & TRB_IOC)
+		sandbox_xhci_transfer_event(trb, slot_id, ep_index,
+					    COMP_SUCCESS, 0);
+	sandbox_xhci_advance(ep, false);
+
+	return true;
+}
+
+/* Let the running endpoints take turns until none can progress */
+static void sandbox_xhci_schedule(void)
+{
+	bool progress;
+	int slot_id, ep_index;
+
+	do {
+		progress = false;
+		for (slot_id = 1; slot_id <= SANDBOX_XHCI_SLOTS; slot_id++) {
+			if (!sx.slots[slot_id].emul)
+				continue;
+			for (ep_index = 0; ep_index < MAX_EP_CTX_NUM;
+			     ep_index++) {
+				if (sx.slots[slot_id].eps[ep_index].state !=
+						EP_STATE_RUNNING)
+					continue;
+				/* Carry on once the driver takes events */
+				if (sandbox_xhci_event_room() <
+						SANDBOX_XHCI_EVENTS)
+					return;
+				if (sandbox_xhci_run_ep(slot_id, ep_index))
+					progress = true;
+			}
+		}
+	} while (progress);
+}
+
+static int sandbox_xhci_address_device(int slot_id, void *in_ctx)
+{
+	struct xhci_slot_ctx *in_slot = in_ctx + 32;
+	struct xhci_slot_ctx *slot_ctx = sandbox_xhci_slot_ctx(slot_id);
+	struct sandbox_usb_emul *emul = NULL;
+	struct devrequest req;
+	int port;
+
+	port = DEVINFO_TO_ROOT_HUB_PORT(le32_to_cpu(in_slot->dev_info2));
+	if (port >= 1 && port <= SANDBOX_XHCI_PORTS &&
+	    (sx.regs.op.portregs[port - 1].or_portsc & PORT_PE))
+		emul = sx.ports[port - 1];
+	if (!emul)
+		return COMP_TX_ERR;
+
+	memcpy(slot_ctx, in_slot, sizeof(*slot_ctx));
+	slot_ctx->dev_state = cpu_to_le32(SLOT_STATE_ADDRESSED << 27 |
+					  slot_id);
+	sx.slots[slot_id].emul = emul;
+	sandbox_xhci_add_ep(slot_id, 0, in_ctx + 2 * 32);
+
+	req.requesttype = USB_RECIP_DEVICE;
+	req.request = USB_REQ_SET_ADDRESS;
+	req.value = cpu_to_le16(slot_id);
+	req.index = 0;
+	req.length = 0;
+	sandbox_usb_emul_control(emul, &req, NULL, 0);
+
+	return COMP_SUCCESS;
+}
+
+static int sandbox_xhci_configure(int slot_id, void *in_ctx)
+{
+	struct xhci_input_control_ctx *ctrl_ctx = in_ctx;
+	struct xhci_slot_ctx *slot_ctx = sandbox_xhci_slot_ctx(slot_id);
+	u32 add = le32_to_cpu(ctrl_ctx->add_flags);
+	u32 drop = le32_to_cpu(ctrl_ctx->drop_flags);
+	int ep_index;
+
+	for (ep_index = 1; ep_index < MAX_EP_CTX_NUM; ep_index++) {
+		if (drop & (1 << (ep_index + 1)))
+			sandbox_xhci_set_state(slot_id, ep_index,
+					       EP_STATE_DISABLED);
+		if (add & (1 << (ep_index + 1)))
+			sandbox_xhci_add_ep(slot_id, ep_index,
+					    in_ctx + (ep_index + 2) * 32);
+	}
+	slot_ctx->dev_state = cpu_to_le32(SLOT_STATE_CONFIGURED << 27 |
+					  slot_id);
+
+	return COMP_SUCCESS;
+}
+
+static int sandbox_xhci_stop_ep(int slot_id, int ep_index)
+{
+	struct sandbox_xhci_ep *ep = &sx.slots[slot_id].eps[ep_index];
+	int len;
+
+	if (ep->state != EP_STATE_RUNNING)
+		return COMP_CTX_STATE;
+
+	/* Nothing of the TRB in progress was moved */
+	if (sandbox_xhci_owned(ep)) {
+		len = le32_to_cpu(ep->deq->generic.field[2]) & TRB_LEN_MASK;
+		sandbox_xhci_transfer_event(ep->deq, slot_id, ep_index,
+					    COMP_STOP, len);
+	}
+	sandbox_xhci_set_state(slot_id, ep_index, EP_STATE_STOPPED);
+
+	return COMP_SUCCESS;
+}
+
+static int sandbox_xhci_command(union xhci_trb *trb, int *slot_idp)
+{
+	u32 field = le32_to_cpu(trb->generic.field[3]);
+	void *ptr = (void *)(uintptr_t)(le32_to_cpu(trb->generic.field[0]) |
+				(u64)le32_to_cpu(trb->generic.field[1]) << 32);
+	int slot_id = TRB_TO_SLOT_ID(field);
+	int ep_index = TRB_TO_EP_INDEX(field);
+	struct sandbox_xhci_slot *slot;
+	struct sandbox_xhci_ep *ep;
+	struct xhci_ep_ctx *ep_ctx;
+
+	*slot_idp = slot_id;
+	if (TRB_FIELD_TO_TYPE(field) == TRB_ENABLE_SLOT) {
+		for (slot_id = 1; slot_id <= SANDBOX_XHCI_SLOTS; slot_id++) {
+			if (!sx.slots[slot_id].enabled) {
+				memset(&sx.slots[slot_id], '\0',
+				       sizeof(sx.slots[slot_id]));
+				sx.slots[slot_id].enabled = true;
+				*slot_idp = slot_id;
+				return COMP_SUCCESS;
+			}
+		}
+		return COMP_ENOSLOTS;
+	}
+	if (TRB_FIELD_TO_TYPE(field) == TRB_CMD_NOOP)
+		return COMP_SUCCESS;
+
+	if (slot_id < 1 || slot_id > SANDBOX_XHCI_SLOTS ||
+	    !sx.slots[slot_id].enabled)
+		return COMP_EBADSLT;
+	slot = &sx.slots[slot_id];
+	ep = &slot->eps[ep_index < 0 ? 0 : ep_index];
+
+	switch (TRB_FIELD_TO_TYPE(field)) {
+	case TRB_DISABLE_SLOT:
+		slot->enabled = false;
+		slot->emul = NULL;
+		return COMP_SUCCESS;
+	case TRB_ADDR_DEV:
+		return sandbox_xhci_address_device(slot_id, ptr);
+	case TRB_CONFIG_EP:
+		return sandbox_xhci_configure(slot_id, ptr);
+	case TRB_EVAL_CONTEXT:
+		/* Only the max packet size of ep 0 ever changes */
+		if (le32_to_cpu(((struct xhci_input_control_ctx *)ptr)->
+				add_flags) & EP0_FLAG) {
+			ep_ctx = sandbox_xhci_ep_ctx(slot_id, 0);
+			ep_ctx->ep_info2 = ((struct xhci_ep_ctx *)
+					    (ptr + 2 * 32))->ep_info2;
+		}
+		return COMP_SUCCESS;
+	case TRB_RESET_EP:
+		if (ep->state != EP_STATE_HALTED)
+			return COMP_CTX_STATE;
+		sandbox_xhci_set_state(slot_id, ep_index, EP_STATE_STOPPED);
+		return COMP_SUCCESS;
+	case TRB_STOP_RING:
+		return sandbox_xhci_stop_ep(slot_id, ep_index);
+	case TRB_SET_DEQ:
+		if (ep->state != EP_STATE_STOPPED)
+			return COMP_CTX_STATE;
+		ep->deq = (void *)((uintptr_t)ptr & ~0xf);
+		ep->cycle = (uintptr_t)ptr & 1;
+		sandbox_xhci_set_state(slot_id, ep_index, EP_STATE_STOPPED);
+		return COMP_SUCCESS;
+	}
+
+	return COMP_TRB_ERR;
+}
+
+static void sandbox_xhci_run_commands(void)
+{
+	union xhci_trb *trb;
+	int comp, slot_id;
+	u32 field;
+
+	while (sx.cmd_deq &&
+	       sandbox_xhci_event_room() >= SANDBOX_XHCI_EVENTS) {
+		trb = sx.cmd_deq;
+		field = le32_to_cpu(trb->generic.field[3]);
+		if ((field & TRB_CYCLE) != sx.cmd_cycle)
+			break;
+		if (TRB_FIELD_TO_TYPE(field) == TRB_LINK) {
+			sx.cmd_deq = (union xhci_trb *)(uintptr_t)
+				le64_to_cpu(trb->link.segment_ptr);
+			if (field & LINK_TOGGLE)
+				sx.cmd_cycle ^= 1;
+			continue;
+		}
+
+		comp = sandbox_xhci_command(trb, &slot_id);
+		sandbox_xhci_event((uintptr_t)trb, comp << 24,
+				   TRB_TYPE(TRB_COMPLETION) |
+				   SLOT_ID_FOR_TRB(slot_id));
+		sx.cmd_deq++;
+	}
+}
+
+/* Do whatever can be done, after a doorbell or room on the event ring */
+static void sandbox_xhci_work(void)
+{
+	if (sx.busy || (sx.regs.op.or_usbsts & STS_HALT))
+		return;
+
+	sx.busy = true;
+	sandbox_xhci_run_commands();
+	sandbox_xhci_schedule();
+	sx.busy = false;
+}
+
+static void sandbox_xhci_doorbell(int target, u32 val)
+{
+	int ep_index = (val & 0xff) - 1;
+	struct sandbox_xhci_ep *ep;
+
+	if (target && target <= SANDBOX_XHCI_SLOTS &&
+	    sx.slots[target].emul && ep_index >= 0 &&
+	    ep_index < MAX_EP_CTX_NUM) {
+		ep = &sx.slots[target].eps[ep_index];
+		if (ep->state == EP_STATE_STOPPED)
+			sandbox_xhci_set_state(target, ep_index,
+					       EP_STATE_RUNNING);
+		if (sx.latency_us)
+			udelay(sx.latency_us);
+	}
+
+	sandbox_xhci_work();
+}
+
+static void sandbox_xhci_reset_port(int port)
+{
+	struct sandbox_usb_emul *emul = sx.ports[port];
+	volatile u32 *portsc = &sx.regs.op.portregs[port].or_portsc;
+
+	*portsc &= ~(PORT_RESET | PORT_PLS_MASK);
+	*portsc |= PORT_RC;
+	if (emul) {
+		if (emul->ops->reset)
+			emul->ops->reset(emul);
+		emul->addr = 0;
+		emul->configuration = 0;
+		*portsc |= PORT_PE;
+	}
+
+	sx.regs.op.or_usbsts |= STS_PORT;
+	sandbox_xhci_event((u64)(port + 1) << 24, COMP_SUCCESS << 24,
+			   TRB_TYPE(TRB_PORT_STATUS));
+}
+
+static void sandbox_xhci_write_portsc(int port, u32 val)
+{
+	volatile u32 *portsc = &sx.regs.op.portregs[port].or_portsc;
+
+	/* Change bits are write 1 to clear, as is the enable bit */
+	*portsc &= ~(val & (PORT_PE | PORT_CSC | PORT_PEC | PORT_WRC |
+			    PORT_OCC | PORT_RC | PORT_PLC | PORT_CEC));
+	if (val & PORT_RESET)
+		sandbox_xhci_reset_port(port);
+}
+
+static void sandbox_xhci_reset(void)
+{
+	int port;
+
+	memset(&sx.regs.op, '\0', sizeof(sx.regs.op));
+	memset(&sx.regs.run, '\0', sizeof(sx.regs.run));
+	memset(sx.slots, '\0', sizeof(sx.slots));
+	sx.regs.op.or_usbsts = STS_HALT;
+	sx.cmd_deq = NULL;
+	sx.erst = NULL;
+
+	for (port = 0; port < SANDBOX_XHCI_PORTS; port++) {
+		sx.regs.op.portregs[port].or_portsc = PORT_POWER;
+		if (sx.ports[port])
+			sx.regs.op.portregs[port].or_portsc |= PORT_CONNECT |
+				PORT_CSC | XDEV_HS;
+	}
+}
+
+void sandbox_xhci_writel(volatile u32 *reg, u32 val)
+{
+	struct sandbox_xhci_regs *regs = &sx.regs;
+	struct xhci_intr_reg *ir = &regs->run.ir_set[0];
+	volatile u32 *crcr = (volatile u32 *)&regs->op.or_crcr;
+	volatile u32 *erstba = (volatile u32 *)&ir->erst_base;
+	volatile u32 *erdp = (volatile u32 *)&ir->erst_dequeue;
+	uintptr_t offset = (uintptr_t)reg - (uintptr_t)regs;
+	int port;
+
+	/* The driver writes some data structures in memory with this too */
+	if (offset >= sizeof(*regs)) {
+		*reg = val;
+		return;
+	}
+
+	if (reg == &regs->op.or_usbcmd) {
+		if (val & CMD_RESET) {
+			sandbox_xhci_reset();
+			return;
+		}
+		*reg = val;
+		if (val & CMD_RUN)
+			regs->op.or_usbsts &= ~STS_HALT;
+		else
+			regs->op.or_usbsts |= STS_HALT;
+	} else if (reg == &regs->op.or_usbsts) {
+		*reg &= ~(val & (STS_FATAL | STS_EINT | STS_PORT | STS_SRE));
+	} else if (reg == &crcr[0]) {
+		/* Reads as zero, except for the running bit */
+		sx.cmd_cycle = val & 1;
+		sx.cmd_deq = (union xhci_trb *)(uintptr_t)
+			(val & ~CMD_RING_RSVD_BITS);
+	} else if (reg == &crcr[1]) {
+		sx.cmd_deq = (union xhci_trb *)((uintptr_t)sx.cmd_deq |
+						(uintptr_t)((u64)val << 32));
+	} else if (offset >= offsetof(struct sandbox_xhci_regs,
+				      op.portregs) &&
+		   offset < offsetof(struct sandbox_xhci_regs,
+				     op.reserved_4)) {
+		port = (offset - offsetof(struct sandbox_xhci_regs,
+					  op.portregs)) /
+			sizeof(struct xhci_hcor_port_regs);
+		if (reg == &regs->op.portregs[port].or_portsc)
+			sandbox_xhci_write_portsc(port, val);
+		else
+			*reg = val;
+	} else if (reg == &ir->irq_pending) {
+		/* The pending bit is write 1 to clear */
+		*reg = (val & ~1) | (*reg & 1 & ~val);
+	} else if (reg == &erstba[1]) {
+		*reg = val;
+		sx.erst = (struct xhci_erst_entry *)(uintptr_t)
+			(le64_to_cpu(ir->erst_base) & ~(u64)ERST_PTR_MASK);
+		sx.erst_size = le32_to_cpu(ir->erst_size) & 0xffff;
+		sx.ev_seg = 0;
+		sx.ev_index = 0;
+		sx.ev_cycle = 1;
+	} else if (reg == &erdp[0]) {
+		/* The handler busy bit is write 1 to clear */
+		*reg = (val & ~ERST_EHB) | (*reg & ERST_EHB & ~val);
+	} else if (reg == &erdp[1]) {
+		*reg = val;
+		sx.erdp = (union xhci_trb *)(uintptr_t)
+			(le64_to_cpu(ir->erst_dequeue) & ~(u64)ERST_PTR_MASK);
+		sandbox_xhci_work();
+	} else if (offset >= offsetof(struct sandbox_xhci_regs, db)) {
+		sandbox_xhci_doorbell(reg - regs->db.doorbell, val);
+	} else {
+		*reg = val;
+	}
+}
+
+int xhci_hcd_init(int index, struct xhci_hccr **hccr, struct xhci_hcor **hcor)
+{
+	const char *spec = getenv("sandbox_usb");
+	char fname[256];
+	int port = 0;
+	int len;
+
+	sx.latency_us = getenv_ulong("sandbox_usb_latency", 10, 0);
+	sx.speed = getenv_ulong("sandbox_usb_speed", 10, 0);
+	sx.bus_ns = 0;
+
+	while (spec && *spec) {
+		if (*spec == ' ') {
+			spec++;
+			continue;
+		}
+		for (len = 0; spec[len] && spec[len] != ' '; len++)
+			;
+		if (port == SANDBOX_XHCI_PORTS || len >= sizeof(fname) ||
+		    !strncmp(spec, "hub(", 4)) {
+			printf("sandbox_xhci: %d ports, without hubs\n",
+			       SANDBOX_XHCI_PORTS);
+			goto err;
+		}
+		memcpy(fname, spec, len);
+		fname[len] = '\0';
+		spec += len;
+		if (strcmp(fname, "-")) {
+			sx.ports[port] = sandbox_usb_flash_create(fname);
+			if (!sx.ports[port])
+				goto err;
+		}
+		port++;
+	}
+
+	memset(&sx.regs.cap, '\0', sizeof(sx.regs.cap));
+	sx.regs.cap.cr_capbase = 0x100 << 16 |
+		offsetof(struct sandbox_xhci_regs, op);
+	sx.regs.cap.cr_hcsparams1 = SANDBOX_XHCI_PORTS << HCS_MAX_PORTS_SHIFT |
+		1 << 8 | SANDBOX_XHCI_SLOTS;
+	sx.regs.cap.cr_hccparams = 1;	/* 64-bit addressing */
+	sx.regs.cap.cr_dboff = offsetof(struct sandbox_xhci_regs, db);
+	sx.regs.cap.cr_rtsoff = offsetof(struct sandbox_xhci_regs, run);
+	sandbox_xhci_reset();
+
+	*hccr = &sx.regs.cap;
+	*hcor = &sx.regs.op;
+
+	return 0;
+
+err:
+	xhci_hcd_stop(index);
+
+	return -EINVAL;
+}
+
+void xhci_hcd_stop(int index)
+{
+	int port;
+
+	for (port = 0; port < SANDBOX_XHCI_PORTS; port++) {
+		if (sx.ports[port])
+			sx.ports[port]->ops->remove(sx.ports[port]);
+		sx.ports[port] = NULL;
+	}
+}
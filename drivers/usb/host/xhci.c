@@ -256,7 +256,7 @@ static int xhci_configure_endpoints(struct usb_device *udev, bool ctx_change)
 	virt_dev = ctrl->devs[udev->slot_id];
 	in_ctx = virt_dev->in_ctx;
 
-	xhci_flush_cache((uint32_t)in_ctx->bytes, in_ctx->size);
+	xhci_flush_cache((uintptr_t)in_ctx->bytes, in_ctx->size);
 	xhci_queue_command(ctrl, in_ctx->bytes, udev->slot_id, 0,
 			   ctx_change ? TRB_EVAL_CONTEXT : TRB_CONFIG_EP);
 	event = xhci_wait_for_event(ctrl, TRB_COMPLETION);
@@ -325,7 +325,7 @@ static int xhci_set_configuration(struct usb_device *udev)
 			max_ep_flag = ep_flag;
 	}
 
-	xhci_inval_cache((uint32_t)out_ctx->bytes, out_ctx->size);
+	xhci_inval_cache((uintptr_t)out_ctx->bytes, out_ctx->size);
 
 	/* slot context */
 	xhci_slot_copy(ctrl, in_ctx, out_ctx);
@@ -345,8 +345,14 @@ static int xhci_set_configuration(struct usb_device *udev)
 		ep_index = xhci_get_ep_index(endpt_desc);
 		ep_ctx[ep_index] = xhci_get_ep_ctx(ctrl, in_ctx, ep_index);
 
-		/* Allocate the ep rings */
-		virt_dev->eps[ep_index].ring = xhci_ring_alloc(1, true);
+		/*
+		 * Allocate the ep rings, or keep using them if the device
+		 * was configured before: the xHC gets the current enqueue
+		 * pointer as its dequeue pointer below.
+		 */
+		if (!virt_dev->eps[ep_index].ring)
+			virt_dev->eps[ep_index].ring =
+				xhci_ring_alloc(XHCI_EP_RING_SEGS, true);
 		if (!virt_dev->eps[ep_index].ring)
 			return -ENOMEM;
 
@@ -442,7 +448,7 @@ static int xhci_address_device(struct usb_device *udev)
 		 */
 		return ret;
 
-	xhci_inval_cache((uint32_t)virt_dev->out_ctx->bytes,
+	xhci_inval_cache((uintptr_t)virt_dev->out_ctx->bytes,
 				virt_dev->out_ctx->size);
 	slot_ctx = xhci_get_slot_ctx(ctrl, virt_dev->out_ctx);
 
@@ -525,7 +531,7 @@ int xhci_check_maxpacket(struct usb_device *udev)
 	ifdesc = &udev->config.if_desc[0];
 
 	out_ctx = ctrl->devs[slot_id]->out_ctx;
-	xhci_inval_cache((uint32_t)out_ctx->bytes, out_ctx->size);
+	xhci_inval_cache((uintptr_t)out_ctx->bytes, out_ctx->size);
 
 	ep_ctx = xhci_get_ep_ctx(ctrl, out_ctx, ep_index);
 	hw_max_packet_size = MAX_PACKET_DECODED(le32_to_cpu(ep_ctx->ep_info2));
@@ -890,6 +896,53 @@ submit_bulk_msg(struct usb_device *udev, unsigned long pipe, void *buffer,
 	return xhci_bulk_tx(udev, pipe, length, buffer);
 }
 
+/**
+ * submit a batch of BULK requests to the USB Device, see submit_bulk_batch()
+ *
+ * @param udev	pointer to the USB device
+ * @param xfers	the transfers
+ * @param count	number of transfers
+ * @return returns 0 if all transfers succeeded else -1 on failure
+ */
+int submit_bulk_batch(struct usb_device *udev, struct usb_bulk_xfer *xfers,
+		      int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (usb_pipetype(xfers[i].pipe) != PIPE_BULK) {
+			printf("non-bulk pipe (type=%lu)",
+			       usb_pipetype(xfers[i].pipe));
+			return -1;
+		}
+	}
+
+	if (xhci_bulk_batch(udev, xfers, count) < 0)
+		return -1;
+
+	for (i = 0; i < count; i++) {
+		if (xfers[i].status)
+			return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Tells class drivers the largest BULK request to submit
+ *
+ * @param udev	pointer to the USB device
+ * @param size	returns the size in bytes
+ * @return 0
+ */
+int usb_get_max_xfer_size(struct usb_device *udev, size_t *size)
+{
+	/* Several TDs have to fit in a transfer ring for batching */
+	*size = XHCI_MAX_BULK_TD;
+
+	return 0;
+}
+
 /**
  * submit the control type of request to the Root hub/Device based on the devnum
  *
@@ -955,6 +1008,7 @@ int usb_lowlevel_init(int index, enum usb_init_type init, void **controller)
 
 	ctrl->hccr = hccr;
 	ctrl->hcor = hcor;
+	ctrl->hci_version = HC_VERSION(xhci_readl(&hccr->cr_capbase));
 
 	/*
 	 * Program the Number of Device Slots Enabled field in the CONFIG
@@ -994,7 +1048,7 @@ int usb_lowlevel_init(int index, enum usb_init_type init, void **controller)
 	xhci_writel(&ctrl->ir_set->irq_control, 0x0);
 	xhci_writel(&ctrl->ir_set->irq_pending, 0x0);
 
-	reg = HC_VERSION(xhci_readl(&hccr->cr_capbase));
+	reg = ctrl->hci_version;
 	printf("USB XHCI %x.%02x\n", reg >> 8, reg & 0xff);
 
 	*controller = &xhcic[index];
@@ -1000,6 +1000,10 @@ typedef enum {
 /* TRB buffer pointers can't cross 64KB boundaries */
 #define TRB_MAX_BUFF_SHIFT	16
 #define TRB_MAX_BUFF_SIZE	(1 << TRB_MAX_BUFF_SHIFT)
+/* Segments of the transfer rings of endpoints other than ep 0 */
+#define XHCI_EP_RING_SEGS	4
+/* Largest bulk TD, so that a batch of them fits in a transfer ring */
+#define XHCI_MAX_BULK_TD	(1 << 20)
 
 struct xhci_segment {
 	union xhci_trb		*trbs;
@@ -1086,16 +1090,30 @@ struct xhci_virt_device {
 	struct xhci_virt_ep		eps[31];
 };
 
+#ifdef CONFIG_USB_XHCI_SANDBOX
+/* The registers of sandbox's emulated controller react to each access */
+u32 sandbox_xhci_readl(volatile u32 *reg);
+void sandbox_xhci_writel(volatile u32 *reg, u32 val);
+#endif
+
 /* TODO: copied from ehci.h - can be refactored? */
 /* xHCI spec says all registers are little endian */
 static inline unsigned int xhci_readl(uint32_t volatile *regs)
 {
+#ifdef CONFIG_USB_XHCI_SANDBOX
+	return sandbox_xhci_readl(regs);
+#else
 	return readl(regs);
+#endif
 }
 
 static inline void xhci_writel(uint32_t volatile *regs, const unsigned int val)
 {
+#ifdef CONFIG_USB_XHCI_SANDBOX
+	sandbox_xhci_writel(regs, val);
+#else
 	writel(val, regs);
+#endif
 }
 
 /*
@@ -1109,8 +1127,8 @@ static inline void xhci_writel(uint32_t volatile *regs, const unsigned int val)
 static inline u64 xhci_readq(__le64 volatile *regs)
 {
 	__u32 *ptr = (__u32 *)regs;
-	u64 val_lo = readl(ptr);
-	u64 val_hi = readl(ptr + 1);
+	u64 val_lo = xhci_readl(ptr);
+	u64 val_hi = xhci_readl(ptr + 1);
 	return val_lo + (val_hi << 32);
 }
 
@@ -1120,8 +1138,8 @@ static inline void xhci_writeq(__le64 volatile *regs, const u64 val)
 	u32 val_lo = lower_32_bits(val);
 	/* FIXME */
 	u32 val_hi = upper_32_bits(val);
-	writel(val_lo, ptr);
-	writel(val_hi, ptr + 1);
+	xhci_writel(ptr, val_lo);
+	xhci_writel(ptr + 1, val_hi);
 }
 
 int xhci_hcd_init(int index, struct xhci_hccr **ret_hccr,
@@ -1215,6 +1233,7 @@ struct xhci_ctrl {
 	struct xhci_erst_entry entry[ERST_NUM_SEGS];
 	struct xhci_virt_device *devs[MAX_HC_SLOTS];
 	int rootdev;
+	u16 hci_version;	/* HC_VERSION, read once at init */
 };
 
 unsigned long trb_addr(struct xhci_segment *seg, union xhci_trb *trb);
@@ -1239,11 +1258,13 @@ void xhci_acknowledge_event(struct xhci_ctrl *ctrl);
 union xhci_trb *xhci_wait_for_event(struct xhci_ctrl *ctrl, trb_type expected);
 int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 		 int length, void *buffer);
+int xhci_bulk_batch(struct usb_device *udev, struct usb_bulk_xfer *xfers,
+		    int count);
 int xhci_ctrl_tx(struct usb_device *udev, unsigned long pipe,
 		 struct devrequest *req, int length, void *buffer);
 int xhci_check_maxpacket(struct usb_device *udev);
-void xhci_flush_cache(uint32_t addr, u32 type_len);
-void xhci_inval_cache(uint32_t addr, u32 type_len);
+void xhci_flush_cache(uintptr_t addr, u32 type_len);
+void xhci_inval_cache(uintptr_t addr, u32 type_len);
 void xhci_cleanup(struct xhci_ctrl *ctrl);
 struct xhci_ring *xhci_ring_alloc(unsigned int num_segs, bool link_trbs);
 int xhci_alloc_virt_device(struct usb_device *udev);
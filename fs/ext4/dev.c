@@ -47,11 +47,18 @@ void ext4fs_set_blk_dev(block_dev_desc_t *rbdd, disk_partition_t *info)
 
 int ext4fs_devread(lbaint_t sector, int byte_offset, int byte_len, char *buf)
 {
-	unsigned block_len;
+	unsigned block_len, head = 0, tail;
 	int log2blksz = ext4fs_block_dev_desc->log2blksz;
 	ALLOC_CACHE_ALIGN_BUFFER(char, sec_buf, (ext4fs_block_dev_desc ?
 						 ext4fs_block_dev_desc->blksz :
 						 0));
+	ALLOC_CACHE_ALIGN_BUFFER(char, tail_buf, (ext4fs_block_dev_desc ?
+						  ext4fs_block_dev_desc->blksz :
+						  0));
+	struct blk_sg sg[3];
+	lbaint_t blkcnt = 0;
+	int nsg = 0, i;
+
 	if (ext4fs_block_dev_desc == NULL) {
 		printf("** Invalid Block Device Descriptor (NULL)\n");
 		return 0;
@@ -72,66 +79,42 @@ int ext4fs_devread(lbaint_t sector, int byte_offset, int byte_len, char *buf)
 
 	debug(" <" LBAFU ", %d, %d>\n", sector, byte_offset, byte_len);
 
+	/*
+	 * A first and a last part which are not whole sectors go through
+	 * bounce buffers, the sectors in between straight into buf, all in
+	 * a single request.
+	 */
 	if (byte_offset != 0) {
-		/* read first part which isn't aligned with start of sector */
-		if (ext4fs_block_dev_desc->
-		    block_read(ext4fs_block_dev_desc->dev,
-				part_info->start + sector, 1,
-				(unsigned long *) sec_buf) != 1) {
-			printf(" ** ext2fs_devread() read error **\n");
-			return 0;
-		}
-		memcpy(buf, sec_buf + byte_offset,
-			min(ext4fs_block_dev_desc->blksz
-			    - byte_offset, byte_len));
-		buf += min(ext4fs_block_dev_desc->blksz
-			   - byte_offset, byte_len);
-		byte_len -= min(ext4fs_block_dev_desc->blksz
-				- byte_offset, byte_len);
-		sector++;
+		head = min(ext4fs_block_dev_desc->blksz - byte_offset,
+			   (unsigned long)byte_len);
+		sg[nsg].buf = sec_buf;
+		sg[nsg++].blkcnt = 1;
 	}
-
-	if (byte_len == 0)
-		return 1;
-
-	/* read sector aligned part */
-	block_len = byte_len & ~(ext4fs_block_dev_desc->blksz - 1);
-
-	if (block_len == 0) {
-		ALLOC_CACHE_ALIGN_BUFFER(u8, p, ext4fs_block_dev_desc->blksz);
-
-		block_len = ext4fs_block_dev_desc->blksz;
-		ext4fs_block_dev_desc->block_read(ext4fs_block_dev_desc->dev,
-						  part_info->start + sector,
-						  1, (unsigned long *)p);
-		memcpy(buf, p, byte_len);
-		return 1;
+	block_len = (byte_len - head) & ~(ext4fs_block_dev_desc->blksz - 1);
+	if (block_len) {
+		sg[nsg].buf = buf + head;
+		sg[nsg++].blkcnt = block_len >> log2blksz;
+	}
+	tail = byte_len - head - block_len;
+	if (tail) {
+		sg[nsg].buf = tail_buf;
+		sg[nsg++].blkcnt = 1;
 	}
+	if (!nsg)
+		return 1;
 
-	if (ext4fs_block_dev_desc->block_read(ext4fs_block_dev_desc->dev,
-					       part_info->start + sector,
-					       block_len >> log2blksz,
-					       (unsigned long *) buf) !=
-					       block_len >> log2blksz) {
-		printf(" ** %s read error - block\n", __func__);
+	for (i = 0; i < nsg; i++)
+		blkcnt += sg[i].blkcnt;
+	if (blk_read_sg(ext4fs_block_dev_desc, part_info->start + sector,
+			sg, nsg) != blkcnt) {
+		printf(" ** %s read error **\n", __func__);
 		return 0;
 	}
-	block_len = byte_len & ~(ext4fs_block_dev_desc->blksz - 1);
-	buf += block_len;
-	byte_len -= block_len;
-	sector += block_len / ext4fs_block_dev_desc->blksz;
+	if (head)
+		memcpy(buf, sec_buf + byte_offset, head);
+	if (tail)
+		memcpy(buf + head + block_len, tail_buf, tail);
 
-	if (byte_len != 0) {
-		/* read rest of data which are not in whole sector */
-		if (ext4fs_block_dev_desc->
-		    block_read(ext4fs_block_dev_desc->dev,
-				part_info->start + sector, 1,
-				(unsigned long *) sec_buf) != 1) {
-			printf("* %s read error - last part\n", __func__);
-			return 0;
-		}
-		memcpy(buf, sec_buf, byte_len);
-	}
 	return 1;
 }
 
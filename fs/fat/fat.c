@@ -52,6 +52,14 @@ static int disk_read(__u32 block, __u32 nr_blocks, void *buf)
 			cur_part_info.start + block, nr_blocks, buf);
 }
 
+static int disk_read_sg(__u32 block, const struct blk_sg *sg, int nsg)
+{
+	if (!cur_dev || !cur_dev->block_read)
+		return -1;
+
+	return blk_read_sg(cur_dev, cur_part_info.start + block, sg, nsg);
+}
+
 int fat_set_blk_dev(block_dev_desc_t *dev_desc, disk_partition_t *info)
 {
 	ALLOC_CACHE_ALIGN_BUFFER(unsigned char, buffer, dev_desc->blksz);
@@ -258,8 +266,11 @@ static __u32 get_fatent(fsdata *mydata, __u32 entry)
 static int
 get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
 {
+	ALLOC_CACHE_ALIGN_BUFFER(__u8, tmpbuf, mydata->sect_size);
+	struct blk_sg sg[2];
 	__u32 idx = 0;
 	__u32 startsect;
+	int nsg = 0;
 	int ret;
 
 	if (clustnum > 0) {
@@ -272,8 +283,6 @@ get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
 	debug("gc - clustnum: %d, startsect: %d\n", clustnum, startsect);
 
 	if ((unsigned long)buffer & (ARCH_DMA_MINALIGN - 1)) {
-		ALLOC_CACHE_ALIGN_BUFFER(__u8, tmpbuf, mydata->sect_size);
-
 		printf("FAT: Misaligned buffer address (%p)\n", buffer);
 
 		while (size >= mydata->sect_size) {
@@ -287,29 +296,29 @@ get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
 			buffer += mydata->sect_size;
 			size -= mydata->sect_size;
 		}
-	} else {
+	} else if (size >= mydata->sect_size) {
+		/* Whole sectors go straight into the buffer */
 		idx = size / mydata->sect_size;
-		ret = disk_read(startsect, idx, buffer);
-		if (ret != idx) {
-			debug("Error reading data (got %d)\n", ret);
-			return -1;
-		}
-		startsect += idx;
-		idx *= mydata->sect_size;
-		buffer += idx;
-		size -= idx;
+		sg[nsg].buf = buffer;
+		sg[nsg++].blkcnt = idx;
 	}
-	if (size) {
-		ALLOC_CACHE_ALIGN_BUFFER(__u8, tmpbuf, mydata->sect_size);
-
-		ret = disk_read(startsect, 1, tmpbuf);
-		if (ret != 1) {
-			debug("Error reading data (got %d)\n", ret);
-			return -1;
-		}
+	/* A partial last sector through tmpbuf, in the same request */
+	if (size % mydata->sect_size) {
+		sg[nsg].buf = tmpbuf;
+		sg[nsg++].blkcnt = 1;
+		idx++;
+	}
+	if (!nsg)
+		return 0;
 
-		memcpy(buffer, tmpbuf, size);
+	ret = disk_read_sg(startsect, sg, nsg);
+	if (ret != idx) {
+		debug("Error reading data (got %d)\n", ret);
+		return -1;
 	}
+	if (size % mydata->sect_size)
+		memcpy(buffer + size - size % mydata->sect_size, tmpbuf,
+		       size % mydata->sect_size);
 
 	return 0;
 }
@@ -17,9 +17,16 @@
 #define AHCI_RX_FIS_SZ		256
 #define AHCI_CMD_TBL_HDR	0x80
 #define AHCI_CMD_TBL_CDB	0x40
-#define AHCI_CMD_TBL_SZ		AHCI_CMD_TBL_HDR + (AHCI_MAX_SG * 16)
+#define AHCI_CMD_TBL_SZ		(AHCI_CMD_TBL_HDR + (AHCI_MAX_SG * 16))
+/* Command tables per port: one for each command queued with NCQ */
+#ifdef CONFIG_AHCI_NCQ
+#define AHCI_CMD_TBLS		8
+#else
+#define AHCI_CMD_TBLS		1
+#endif
 #define AHCI_PORT_PRIV_DMA_SZ	(AHCI_CMD_SLOT_SZ * AHCI_MAX_CMD_SLOT + \
-				AHCI_CMD_TBL_SZ	+ AHCI_RX_FIS_SZ)
+				AHCI_CMD_TBL_SZ * AHCI_CMD_TBLS + \
+				AHCI_RX_FIS_SZ)
 #define AHCI_CMD_ATAPI		(1 << 5)
 #define AHCI_CMD_WRITE		(1 << 6)
 #define AHCI_CMD_PREFETCH	(1 << 7)
@@ -36,6 +43,10 @@
 #define HOST_VERSION		0x10 /* AHCI spec. version compliancy */
 #define HOST_CAP2		0x24 /* host capabilities, extended */
 
+/* HOST_CAP bits */
+#define HOST_CAP_64		(1 << 31) /* PCI DAC (64-bit DMA) support */
+#define HOST_CAP_NCQ		(1 << 30) /* Native Command Queueing */
+
 /* HOST_CTL bits */
 #define HOST_RESET		(1 << 0)  /* reset controller; self-clear */
 #define HOST_IRQ_EN		(1 << 1)  /* global IRQ enable */
@@ -135,13 +146,14 @@ struct ahci_sg {
 };
 
 struct ahci_ioports {
-	u32	cmd_addr;
-	u32	scr_addr;
-	u32	port_mmio;
+	ulong	cmd_addr;
+	ulong	scr_addr;
+	ulong	port_mmio;
 	struct ahci_cmd_hdr	*cmd_slot;
 	struct ahci_sg		*cmd_tbl_sg;
-	u32	cmd_tbl;
-	u32	rx_fis;
+	ulong	cmd_tbl;
+	ulong	rx_fis;
+	u32	ncq_depth;	/* commands to queue with NCQ, 0 for none */
 };
 
 struct ahci_probe_ent {
@@ -151,7 +163,7 @@ struct ahci_probe_ent {
 	u32	hard_port_no;
 	u32	host_flags;
 	u32	host_set_flags;
-	u32	mmio_base;
+	ulong	mmio_base;
 	u32     pio_mask;
 	u32	udma_mask;
 	u32	flags;
@@ -160,6 +172,12 @@ struct ahci_probe_ent {
 	u32	link_port_map; /*linkup port map*/
 };
 
-int ahci_init(u32 base);
+int ahci_init(ulong base);
+
+#ifdef CONFIG_AHCI_SANDBOX
+/* Register accesses of the driver, which sandbox's controller model takes */
+u32 sandbox_ahci_readl(const volatile void *addr);
+void sandbox_ahci_writel(u32 val, volatile void *addr);
+#endif
 
 #endif
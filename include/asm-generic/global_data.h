@@ -21,6 +21,7 @@
  */
 
 #ifndef __ASSEMBLY__
+#include <dm/uclass-id.h>
 #include <linux/list.h>
 
 typedef struct global_data {
@@ -68,6 +69,8 @@ typedef struct global_data {
 	struct udevice	*dm_root;	/* Root instance for Driver Model */
 	struct udevice	*dm_root_f;	/* Pre-relocation root instance */
 	struct list_head uclass_root;	/* Head of core tree */
+	/* The uclasses in uclass_root, by id */
+	struct uclass	*uclass_table[UCLASS_COUNT];
 #endif
 
 	const void *fdt_blob;	/* Our device tree, NULL if none */
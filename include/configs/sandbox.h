@@ -37,7 +37,9 @@
 
 #define CONFIG_OF_CONTROL
 #define CONFIG_OF_HOSTFILE
+#define CONFIG_FDTDEC_CACHE
 #define CONFIG_OF_LIBFDT
+#define CONFIG_OF_LIBFDT_OVERLAY
 #define CONFIG_LMB
 #define CONFIG_FIT
 #define CONFIG_FIT_SIGNATURE
@@ -57,6 +59,18 @@
 #define CONFIG_HOST_MAX_DEVICES 4
 #define CONFIG_CMD_FS_GENERIC
 
+/* SATA disks behind an emulated AHCI controller */
+#define CONFIG_CMD_SCSI
+#define CONFIG_SCSI_AHCI
+#define CONFIG_SCSI_AHCI_PLAT
+#define CONFIG_AHCI_SANDBOX
+#define CONFIG_AHCI_NCQ
+#define CONFIG_LIBATA
+#define CONFIG_SYS_SCSI_MAX_SCSI_ID	4
+#define CONFIG_SYS_SCSI_MAX_LUN		1
+#define CONFIG_SYS_SCSI_MAX_DEVICE	(CONFIG_SYS_SCSI_MAX_SCSI_ID * \
+					 CONFIG_SYS_SCSI_MAX_LUN)
+
 #define CONFIG_SYS_VSNPRINTF
 
 #define CONFIG_CMD_GPIO
@@ -90,6 +104,7 @@
 
 #define CONFIG_ENV_SIZE		8192
 #define CONFIG_ENV_IS_NOWHERE
+#define CONFIG_ENV_INCREMENTAL
 
 /* SPI */
 #define CONFIG_SANDBOX_SPI
@@ -103,6 +118,50 @@
 #define CONFIG_SPI_FLASH_STMICRO
 #define CONFIG_SPI_FLASH_WINBOND
 
+/* USB, with emulated devices, behind an emulated xHCI or EHCI or not */
+#if defined(CONFIG_USB_XHCI_SANDBOX)
+#define CONFIG_USB_XHCI
+#define CONFIG_SYS_USB_XHCI_MAX_ROOT_PORTS	4
+#elif defined(CONFIG_USB_EHCI_SANDBOX)
+#define CONFIG_USB_EHCI
+#define CONFIG_SYS_USB_EHCI_MAX_ROOT_PORTS	4
+#define CONFIG_USB_KEYBOARD
+#define CONFIG_SYS_USB_EVENT_POLL_VIA_INT_QUEUE
+#define CONFIG_SYS_STDIO_DEREGISTER
+#else
+#define CONFIG_USB_SANDBOX
+#endif
+#define CONFIG_CMD_USB
+#define CONFIG_USB_STORAGE
+
+/* USB gadget, with the host side played by a program on the host */
+#define CONFIG_USB_GADGET
+#define CONFIG_USB_GADGET_SANDBOX
+#define CONFIG_USB_GADGET_DUALSPEED
+#define CONFIG_USB_GADGET_VBUS_DRAW	2
+#define CONFIG_SYS_CACHELINE_SIZE	64
+#define CONFIG_USBDOWNLOAD_GADGET
+#define CONFIG_G_DNL_VENDOR_NUM		0x18d1
+#define CONFIG_G_DNL_PRODUCT_NUM	0x4e30
+#define CONFIG_G_DNL_MANUFACTURER	"U-Boot"
+#define CONFIG_CMD_FASTBOOT
+#define CONFIG_USB_FASTBOOT_BUF_ADDR	0x01000000
+/* Kept small so that tests have to split images */
+#define CONFIG_USB_FASTBOOT_BUF_SIZE	0x00800000
+#define CONFIG_FASTBOOT_FLASH
+#define CONFIG_FASTBOOT_FLASH_IF	"host"
+#define CONFIG_FASTBOOT_FLASH_MMC_DEV	0
+#define CONFIG_CMD_DFU
+#define CONFIG_DFU_FUNCTION
+#define CONFIG_DFU_HOST
+#define CONFIG_CMD_THOR_DOWNLOAD
+#define CONFIG_THOR_FUNCTION
+#define CONFIG_CMD_USB_MASS_STORAGE
+#define CONFIG_USB_GADGET_MASS_STORAGE
+#define CONFIG_USB_GADGET_STORAGE_CACHE_SIZE	(1 << 20)
+/* Small, as the emulated controller stands still while the disk is busy */
+#define CONFIG_USB_GADGET_STORAGE_CACHE_CHUNK	(2 << 10)
+
 /* Memory things - we don't really want a memory test */
 #define CONFIG_SYS_LOAD_ADDR		0x00000000
 #define CONFIG_SYS_MEMTEST_START	0x00100000
@@ -128,9 +187,16 @@
 /* include default commands */
 #include <config_cmd_default.h>
 
-/* We don't have networking support yet */
-#undef CONFIG_CMD_NET
-#undef CONFIG_CMD_NFS
+/* Networking, over emulated ethernet devices */
+#define CONFIG_SANDBOX_ETH
+#define SANDBOX_ETH_SETTINGS		"ethaddr=02:00:11:22:33:00\0" \
+					"eth1addr=02:00:11:22:33:01\0"
+#define CONFIG_IP_DEFRAG
+#define CONFIG_NET_MAXDEFRAG		16384
+#define CONFIG_CMD_NETSINK
+#define CONFIG_CMD_ETHSTATS
+#define CONFIG_NET_PARALLEL
+#define CONFIG_CMD_TIME
 
 #define CONFIG_CMD_HASH
 #define CONFIG_HASH_VERIFY
@@ -172,12 +238,14 @@
 
 #define CONFIG_EXTRA_ENV_SETTINGS	"stdin=serial,cros-ec-keyb\0" \
 					"stdout=serial,lcd\0" \
-					"stderr=serial,lcd\0"
+					"stderr=serial,lcd\0" \
+					SANDBOX_ETH_SETTINGS
 #else
 
 #define CONFIG_EXTRA_ENV_SETTINGS	"stdin=serial\0" \
 					"stdout=serial,lcd\0" \
-					"stderr=serial,lcd\0"
+					"stderr=serial,lcd\0" \
+					SANDBOX_ETH_SETTINGS
 #endif
 
 #define CONFIG_GZIP_COMPRESSED
@@ -62,6 +62,7 @@
 #define CONFIG_SCSI_AHCI
 #define CONFIG_SCSI_AHCI_PLAT
 #define CONFIG_SUNXI_AHCI
+#define CONFIG_AHCI_NCQ
 #define CONFIG_SYS_SCSI_MAX_SCSI_ID	1
 #define CONFIG_SYS_SCSI_MAX_LUN		1
 #define CONFIG_SYS_SCSI_MAX_DEVICE	(CONFIG_SYS_SCSI_MAX_SCSI_ID * \
@@ -215,6 +216,7 @@
 #endif /* CONFIG_VIDEO */
 
 /* Ethernet support */
+#define CONFIG_USE_ARCH_NET_CKSUM	/* ARM version of NetCksum()	*/
 #ifdef CONFIG_SUNXI_EMAC
 #define CONFIG_MII			/* MII PHY management		*/
 #endif
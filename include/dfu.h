@@ -21,6 +21,7 @@ enum dfu_device_type {
 	DFU_DEV_ONENAND,
 	DFU_DEV_NAND,
 	DFU_DEV_RAM,
+	DFU_DEV_HOST,
 };
 
 enum dfu_layout {
@@ -67,11 +68,20 @@ struct ram_internal_data {
 	unsigned int	size;
 };
 
+struct host_internal_data {
+	/* RAW programming */
+	unsigned int lba_start;
+	unsigned int lba_size;
+};
+
 #define DFU_NAME_SIZE			32
 #define DFU_CMD_BUF_SIZE		128
 #ifndef CONFIG_SYS_DFU_DATA_BUF_SIZE
 #define CONFIG_SYS_DFU_DATA_BUF_SIZE		(1024*1024*8)	/* 8 MiB */
 #endif
+#ifndef CONFIG_SYS_DFU_WRITE_SLICE_SIZE
+#define CONFIG_SYS_DFU_WRITE_SLICE_SIZE		(1024*64)	/* 64 KiB */
+#endif
 #ifndef CONFIG_SYS_DFU_MAX_FILE_SIZE
 #define CONFIG_SYS_DFU_MAX_FILE_SIZE CONFIG_SYS_DFU_DATA_BUF_SIZE
 #endif
@@ -94,6 +104,7 @@ struct dfu_entity {
 		struct mmc_internal_data mmc;
 		struct nand_internal_data nand;
 		struct ram_internal_data ram;
+		struct host_internal_data host;
 	} data;
 
 	int (*read_medium)(struct dfu_entity *dfu,
@@ -114,12 +125,18 @@ struct dfu_entity {
 	u8 *i_buf;
 	u8 *i_buf_start;
 	u8 *i_buf_end;
+	/* half buffer being written by dfu_write_poll() */
+	u8 *d_buf;
+	long d_left;
+	int d_ret;
 	long r_left;
 	long b_left;
 
 	u32 bad_skip;	/* for nand use */
 
 	unsigned int inited:1;
+	/* write_medium() may be given a buffer in several pieces */
+	unsigned int write_slices:1;
 };
 
 int dfu_config_entities(char *s, char *interface, int num);
@@ -137,9 +154,12 @@ int dfu_init_env_entities(char *interface, int dev);
 unsigned char *dfu_get_buf(void);
 unsigned char *dfu_free_buf(void);
 unsigned long dfu_get_buf_size(void);
+void dfu_set_write_overlap(bool enable);
+int dfu_write_poll(void);
 
 int dfu_read(struct dfu_entity *de, void *buf, int size, int blk_seq_num);
 int dfu_write(struct dfu_entity *de, void *buf, int size, int blk_seq_num);
+void *dfu_get_write_buf(struct dfu_entity *de, long *room);
 int dfu_flush(struct dfu_entity *de, void *buf, int size, int blk_seq_num);
 /* Device specific */
 #ifdef CONFIG_DFU_MMC
@@ -172,5 +192,15 @@ static inline int dfu_fill_entity_ram(struct dfu_entity *dfu, char *s)
 }
 #endif
 
+#ifdef CONFIG_DFU_HOST
+extern int dfu_fill_entity_host(struct dfu_entity *dfu, char *s);
+#else
+static inline int dfu_fill_entity_host(struct dfu_entity *dfu, char *s)
+{
+	puts("Host support not available!\n");
+	return -1;
+}
+#endif
+
 int dfu_add(struct usb_configuration *c);
 #endif /* __DFU_ENTITY_H_ */
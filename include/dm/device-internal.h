@@ -57,14 +57,32 @@ int device_bind_by_name(struct udevice *parent, bool pre_reloc_only,
 /**
  * device_probe() - Probe a device, activating it
  *
- * Activate a device so that it is ready for use. All its parents are probed
- * first.
+ * Activate a device so that it is ready for use. All its parents, and the
+ * devices its device tree node refers to (through properties such as
+ * 'clocks', 'xxx-gpios' and 'xxx-supply'), are probed first.
+ *
+ * A driver's probe method may return -EAGAIN while its hardware is not
+ * ready yet. It is then called again until it gives another result.
  *
  * @dev: Pointer to device to probe
  * @return 0 if OK, -ve on error
  */
 int device_probe(struct udevice *dev);
 
+/**
+ * device_try_probe() - Probe a device, without waiting for it
+ *
+ * This is device_probe(), except that where the probe method of the device,
+ * or of one that it needs, returns -EAGAIN, it returns -EAGAIN rather than
+ * trying again. Call it again later to carry on. Meanwhile, other devices
+ * can be probed, so that the waits for their hardware overlap.
+ *
+ * @dev: Pointer to device to probe
+ * @return 0 if OK, -EAGAIN if the device is not ready yet, other -ve on
+ * error
+ */
+int device_try_probe(struct udevice *dev);
+
 /**
  * device_remove() - Remove a device, de-activating it
  *
@@ -89,5 +107,6 @@ int device_unbind(struct udevice *dev);
 /* Cast away any volatile pointer */
 #define DM_ROOT_NON_CONST		(((gd_t *)gd)->dm_root)
 #define DM_UCLASS_ROOT_NON_CONST	(((gd_t *)gd)->uclass_root)
+#define DM_UCLASS_TABLE_NON_CONST	(((gd_t *)gd)->uclass_table)
 
 #endif
@@ -26,6 +26,12 @@ struct driver_info;
 /* DM should init this device prior to relocation */
 #define DM_FLAG_PRE_RELOC	(1 << 2)
 
+/* Device is set up, but its probe method asked to be called again */
+#define DM_FLAG_PROBING		(1 << 3)
+
+/* The devices this one needs are being probed */
+#define DM_FLAG_PROBING_DEPS	(1 << 4)
+
 /**
  * struct udevice - An instance of a driver
  *
@@ -114,7 +120,8 @@ struct udevice_id {
  * @of_match: List of compatible strings to match, and any identifying data
  * for each.
  * @bind: Called to bind a device to its driver
- * @probe: Called to probe a device, i.e. activate it
+ * @probe: Called to probe a device, i.e. activate it. This may return
+ * -EAGAIN while the hardware is not ready, to be called again later
  * @remove: Called to remove a device, i.e. de-activate it
  * @unbind: Called to unbind a device from its driver
  * @ofdata_to_platdata: Called before probe to decode device tree data
@@ -87,6 +87,18 @@ int dm_scan_other(bool pre_reloc_only);
  */
 int dm_init_and_scan(bool pre_reloc_only);
 
+/**
+ * dm_probe_all() - Probe all the devices
+ *
+ * Each device is probed after the devices it needs. Where a device's
+ * probe method asks to be called again (by returning -EAGAIN) while its
+ * hardware gets ready, the other devices are probed in the meantime, and
+ * it is called again after them, until it is done.
+ *
+ * @return 0 if OK, -ve on error (the first one, if several devices failed)
+ */
+int dm_probe_all(void);
+
 /**
  * dm_init() - Initialise Driver Model structures
  *
@@ -122,6 +122,9 @@ struct dm_test_state {
 	struct udevice *removed;
 };
 
+/* Time the slow test driver's hardware takes to get ready */
+#define DM_TEST_SLOW_MS		20
+
 /* Test flags for each test */
 enum {
 	DM_TESTF_SCAN_PDATA	= 1 << 0,	/* test needs platform data */
@@ -43,6 +43,18 @@ int uclass_bind_device(struct udevice *dev);
  */
 int uclass_unbind_device(struct udevice *dev);
 
+/**
+ * uclass_set_seq() - Set the sequence number of a device
+ *
+ * Set the device's sequence number, and keep its uclass's index of devices
+ * by sequence number up to date.
+ *
+ * @dev:	Pointer to the device
+ * @seq:	Sequence number, or -1 for none
+ * #return 0 on success, -ve on error
+ */
+int uclass_set_seq(struct udevice *dev, int seq);
+
 /**
  * uclass_post_probe_device() - Deal with a device that has just been probed
  *
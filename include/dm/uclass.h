@@ -29,12 +29,17 @@
  * @dev_head: List of devices in this uclass (devices are attached to their
  * uclass when their bind method is called)
  * @sibling_node: Next uclass in the linked list of uclasses
+ * @seq_dev: Devices in this uclass indexed by sequence number, NULL where
+ * there is none. Only sequence numbers below DM_MAX_SEQ are held here
+ * @seq_count: Number of entries allocated in @seq_dev
  */
 struct uclass {
 	void *priv;
 	struct uclass_driver *uc_drv;
 	struct list_head dev_head;
 	struct list_head sibling_node;
+	struct udevice **seq_dev;
+	int seq_count;
 };
 
 struct udevice;
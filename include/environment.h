@@ -223,6 +223,31 @@ int env_import(const char *buf, int check);
 /* Export from hash table into binary representation */
 int env_export(env_t *env_out);
 
+/*
+ * Record what a copy of the environment in storage (0, or 1 for the
+ * redundant copy) holds after it is read: @env is NULL if it could not be
+ * read, and @current is set if it is what was imported. Only kept with
+ * CONFIG_ENV_INCREMENTAL.
+ */
+void env_shadow_set(int copy, const env_t *env, int current);
+
+/* What a copy in storage holds, or NULL if that is not known */
+env_t *env_shadow_get(int copy);
+
+/* Check whether a copy in storage already holds the environment */
+int env_unchanged(int copy);
+
+/*
+ * Write the blocks of @env_new which differ from what the copy in storage
+ * holds, by calling @write with runs of blocks of @blk_size bytes. All of
+ * it is written if what the copy holds is not known. Returns the number
+ * of blocks written, or -ve on error.
+ */
+int env_write_changed(int copy, const env_t *env_new, uint blk_size,
+		      int (*write)(void *priv, uint start, uint count,
+				   const void *buf),
+		      void *priv);
+
 #endif /* DO_DEPS_ONLY */
 
 #endif /* _ENVIRONMENT_H_ */
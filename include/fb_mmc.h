@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef __FB_MMC_H
+#define __FB_MMC_H
+
+/* The 64 defined bytes plus \0 */
+#define FASTBOOT_RESPONSE_LEN	(64 + 1)
+
+/**
+ * fb_mmc_flash_write() - write a download to a partition
+ *
+ * The partition is looked up by name in the GPT of the fastboot flash
+ * device. Android sparse images are expanded as they are written; the
+ * regions they do not care about are left alone.
+ *
+ * @cmd:		name of the partition
+ * @download_buffer:	downloaded image
+ * @download_bytes:	size of the image
+ * @response:		filled with the fastboot reply, OKAY or FAIL...,
+ *			FASTBOOT_RESPONSE_LEN bytes at most
+ */
+void fb_mmc_flash_write(const char *cmd, void *download_buffer,
+			unsigned int download_bytes, char *response);
+
+#endif
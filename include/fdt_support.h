@@ -45,6 +45,59 @@ int fdt_fixup_memory_banks(void *blob, u64 start[], u64 size[], int banks);
 void fdt_fixup_ethernet(void *fdt);
 int fdt_find_and_setprop(void *fdt, const char *node, const char *prop,
 			 const void *val, int len, int create);
+
+/**
+ * A batch of changes to a device tree, written to the blob in one pass
+ * when committed rather than one at a time (see common/fdt_batch.c)
+ *
+ * Until then the blob is not moved about, so node offsets stay valid, and
+ * reading the tree shows it without the changes. Nodes added in the batch
+ * are given handles above the end of the structure block, which only the
+ * fdt_batch functions accept. Setting a property to a value of the size it
+ * already has is done straight away, as it does not move anything.
+ *
+ * Errors are libfdt ones; -FDT_ERR_NOSPACE also covers running out of
+ * memory for the batch. If committing fails the tree is left as it was,
+ * apart from any values set in place. Committing or discarding a batch
+ * frees it, after which it can be used again on the same blob.
+ */
+struct fdt_batch_edit;
+
+struct fdt_batch {
+	void *fdt;			/* blob being changed */
+	struct fdt_batch_edit *edit;	/* changes recorded */
+	int count;			/* number of changes */
+	int size;			/* number of changes allocated */
+	int nodes;			/* number of nodes added */
+	int end;			/* first handle for nodes added */
+};
+
+int fdt_batch_init(struct fdt_batch *batch, void *fdt);
+int fdt_batch_setprop(struct fdt_batch *batch, int nodeoffset,
+		      const char *name, const void *val, int len);
+int fdt_batch_delprop(struct fdt_batch *batch, int nodeoffset,
+		      const char *name);
+int fdt_batch_add_subnode(struct fdt_batch *batch, int parentoffset,
+			  const char *name);
+int fdt_batch_commit(struct fdt_batch *batch);
+void fdt_batch_discard(struct fdt_batch *batch);
+
+static inline int fdt_batch_setprop_u32(struct fdt_batch *batch,
+					int nodeoffset, const char *name,
+					uint32_t val)
+{
+	fdt32_t tmp = cpu_to_fdt32(val);
+
+	return fdt_batch_setprop(batch, nodeoffset, name, &tmp, sizeof(tmp));
+}
+
+static inline int fdt_batch_setprop_string(struct fdt_batch *batch,
+					   int nodeoffset, const char *name,
+					   const char *str)
+{
+	return fdt_batch_setprop(batch, nodeoffset, name, str,
+				 strlen(str) + 1);
+}
 void fdt_fixup_qe_firmware(void *fdt);
 
 #if defined(CONFIG_HAS_FSL_DR_USB) || defined(CONFIG_HAS_FSL_MPH_USB)
@@ -392,6 +392,44 @@ const char *fdtdec_get_compatible(enum fdt_compat_id id);
  */
 int fdtdec_lookup_phandle(const void *blob, int node, const char *prop_name);
 
+/**
+ * Find a node from its path, or from an alias
+ *
+ * This is fdt_path_offset(), except that with CONFIG_FDTDEC_CACHE the
+ * result is remembered for U-Boot's own device tree.
+ *
+ * @param blob		FDT blob
+ * @param path		Full path of the node, or alias
+ * @return node offset if found, -ve error code on error
+ */
+int fdtdec_path_offset(const void *blob, const char *path);
+
+/**
+ * Find a node from its phandle
+ *
+ * This is fdt_node_offset_by_phandle(), except that with
+ * CONFIG_FDTDEC_CACHE U-Boot's own device tree is looked up in an index.
+ *
+ * @param blob		FDT blob
+ * @param phandle	phandle value
+ * @return node offset if found, -ve error code on error
+ */
+int fdtdec_node_offset_by_phandle(const void *blob, uint32_t phandle);
+
+/**
+ * Find the next node with a compatible string
+ *
+ * This is fdt_node_offset_by_compatible(), except that with
+ * CONFIG_FDTDEC_CACHE U-Boot's own device tree is looked up in an index.
+ *
+ * @param blob		FDT blob
+ * @param startoffset	Only find nodes after this one (-1 to start at root)
+ * @param compatible	Compatible string to look for
+ * @return node offset if found, -FDT_ERR_NOTFOUND if no more
+ */
+int fdtdec_node_offset_by_compatible(const void *blob, int startoffset,
+				     const char *compatible);
+
 /**
  * Look up a property in a node and return its contents in an integer
  * array of given length. The property must have at least enough data for
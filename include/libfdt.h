@@ -116,7 +116,13 @@
 	 * Should never be returned, if it is, it indicates a bug in
 	 * libfdt itself. */
 
-#define FDT_ERR_MAX		13
+/* Errors in device tree overlays */
+#define FDT_ERR_BADOVERLAY	14
+	/* FDT_ERR_BADOVERLAY: The given overlay is not well formed: a
+	 * fragment has no target, or a fixup refers to something which
+	 * is not in the overlay. */
+
+#define FDT_ERR_MAX		14
 
 /**********************************************************************/
 /* Low-level functions (you probably don't need these)                */
@@ -1575,4 +1581,34 @@ int fdt_find_regions(const void *fdt, char * const inc[], int inc_count,
 		     struct fdt_region region[], int max_regions,
 		     char *path, int path_len, int add_string_tab);
 
+/**
+ * fdt_overlay_apply - Merge a device tree overlay into a base tree
+ *
+ * The overlay is a tree built with symbols (dtc -@), whose top-level
+ * fragments each have an __overlay__ node and a "target" phandle or
+ * "target-path" string giving the node of the base tree it goes into.
+ * References from the overlay to labels in the base tree are resolved
+ * through the overlay's __fixups__ and the base tree's __symbols__, and
+ * the overlay's own phandles are moved above those of the base tree using
+ * __local_fixups__. The overlay's symbols are added to the base tree, so
+ * that a later overlay can refer to them.
+ *
+ * The base tree must have room for what is added, see fdt_open_into().
+ * The overlay is changed while it is applied, and is then marked as not
+ * valid, so that it cannot be applied twice. If the overlay turns out to
+ * be wrong, the base tree is left alone; if the base tree runs out of
+ * room part way through, it is left with only some of the overlay.
+ *
+ * @fdt:	Base device tree
+ * @fdto:	Overlay to apply
+ * @return 0 if ok, or
+ *	-FDT_ERR_NOSPACE, if the base tree does not have room
+ *	-FDT_ERR_NOTFOUND, if a label or target is not in the base tree
+ *	-FDT_ERR_BADOVERLAY, if the overlay is not well formed
+ *	-FDT_ERR_BADPHANDLE, if there are too many phandles
+ *	-FDT_ERR_BADMAGIC, -FDT_ERR_BADVERSION, -FDT_ERR_BADSTATE,
+ *	-FDT_ERR_BADLAYOUT, -FDT_ERR_TRUNCATED, standard meanings
+ */
+int fdt_overlay_apply(void *fdt, void *fdto);
+
 #endif /* _LIBFDT_H */
@@ -23,6 +23,17 @@ typedef __be64 fdt64_t;
 #define fdt64_to_cpu(x)		be64_to_cpu(x)
 #define cpu_to_fdt64(x)		cpu_to_be64(x)
 
+/*
+ * libfdt calls this before it writes to a blob, so that U-Boot can drop
+ * anything it has cached about that blob (see fdtdec.c). It is a weak
+ * function since libfdt is built without the board configuration.
+ */
+#ifdef USE_HOSTCC
+#define fdt_blob_written(fdt)
+#else
+void fdt_blob_written(const void *fdt);
+#endif
+
 /* adding a ramdisk needs 0x44 bytes in version 2008.10 */
 #define FDT_RAMDISK_OVERHEAD	0x80
 
@@ -38,6 +38,11 @@
 
 #define PKTALIGN	ARCH_DMA_MINALIGN
 
+/* Largest UDP payload reassembled from IP fragments (CONFIG_IP_DEFRAG) */
+#if defined(CONFIG_IP_DEFRAG) && !defined(CONFIG_NET_MAXDEFRAG)
+# define CONFIG_NET_MAXDEFRAG	16384
+#endif
+
 /* IPv4 addresses are always 32 bits in size */
 typedef __be32		IPaddr_t;
 
@@ -95,6 +100,13 @@ struct eth_device {
 	struct eth_device *next;
 	int index;
 	void *priv;
+	/* Traffic counters, maintained by eth_send() and NetReceive() */
+	ulong tx_packets;
+	ulong rx_packets;
+	u64 tx_bytes;
+	u64 rx_bytes;
+	ulong active_ms;	/* time spent in ETH_STATE_ACTIVE */
+	ulong active_start;
 };
 
 extern int eth_initialize(bd_t *bis);	/* Initialize network subsystem */
@@ -114,6 +126,8 @@ struct eth_device *eth_get_dev(void)
 extern struct eth_device *eth_get_dev_by_name(const char *devname);
 extern struct eth_device *eth_get_dev_by_index(int index); /* get dev @ index */
 extern int eth_get_dev_index(void);		/* get the device index */
+extern void eth_reset_stats(struct eth_device *dev);
+extern void eth_print_stats(struct eth_device *dev);
 extern void eth_parse_enetaddr(const char *addr, uchar *enetaddr);
 extern int eth_getenv_enetaddr(char *name, uchar *enetaddr);
 extern int eth_setenv_enetaddr(char *name, const uchar *enetaddr);
@@ -530,6 +544,8 @@ extern int NetSendUDPPacket(uchar *ether, IPaddr_t dest, int dport,
 
 /* Processes a received packet */
 extern void NetReceive(uchar *, int);
+/* Same, for frames whose IP/UDP checksums the MAC has verified */
+extern void NetReceiveCsumOk(uchar *, int);
 
 #ifdef CONFIG_NETCONSOLE
 void NcStart(void);
@@ -700,6 +716,18 @@ extern unsigned int random_port(void);
 /* Update U-Boot over TFTP */
 extern int update_tftp(ulong addr);
 
+/*
+ * Network download sink (net/sink.c): when active, TFTP and NFS write
+ * the received file to a block device range instead of load_addr.
+ */
+struct block_dev_desc;
+int net_sink_start(struct block_dev_desc *dev, ulong start, ulong blkcnt);
+int net_sink_active(void);
+int net_sink_write(ulong offset, const void *src, ulong len);
+int net_sink_poll(void);
+int net_sink_finish(void);
+void net_sink_stop(void);
+
 /**********************************************************************/
 
 #endif /* __NET_H__ */
@@ -10,6 +10,15 @@
 #include <ide.h>
 #include <common.h>
 
+/*
+ * One fragment of the data of a scatter-gather block transfer: blkcnt
+ * whole blocks at buf. A list of them makes a single request.
+ */
+struct blk_sg {
+	void		*buf;
+	lbaint_t	blkcnt;
+};
+
 typedef struct block_dev_desc {
 	int		if_type;	/* type of the interface */
 	int		dev;		/* device number */
@@ -38,9 +47,46 @@ typedef struct block_dev_desc {
 	unsigned long   (*block_erase)(int dev,
 				       lbaint_t start,
 				       lbaint_t blkcnt);
+	/* Read into several fragments with as few commands as possible */
+	unsigned long	(*block_read_sg)(int dev,
+					 lbaint_t start,
+					 const struct blk_sg *sg,
+					 int nsg);
 	void		*priv;		/* driver private struct pointer */
 }block_dev_desc_t;
 
+/**
+ * blk_read_sg() - Read consecutive blocks into a list of fragments
+ *
+ * Devices without block_read_sg read each fragment on its own.
+ *
+ * @dev_desc:	block device to read from
+ * @start:	first block to read
+ * @sg:		where the blocks go, in order
+ * @nsg:	number of entries in @sg
+ * @return number of blocks read, fewer than in @sg on error
+ */
+static inline unsigned long blk_read_sg(block_dev_desc_t *dev_desc,
+					lbaint_t start,
+					const struct blk_sg *sg, int nsg)
+{
+	unsigned long done = 0, n;
+	int i;
+
+	if (dev_desc->block_read_sg)
+		return dev_desc->block_read_sg(dev_desc->dev, start, sg, nsg);
+
+	for (i = 0; i < nsg; i++) {
+		n = dev_desc->block_read(dev_desc->dev, start + done,
+					 sg[i].blkcnt, sg[i].buf);
+		done += n;
+		if (n != sg[i].blkcnt)
+			break;
+	}
+
+	return done;
+}
+
 #define BLOCK_CNT(size, block_dev_desc) (PAD_COUNT(size, block_dev_desc->blksz))
 #define PAD_TO_BLOCKSIZE(size, block_dev_desc) \
 	(PAD_SIZE(size, block_dev_desc->blksz))
@@ -7,6 +7,8 @@
  #ifndef _SCSI_H
  #define _SCSI_H
 
+struct blk_sg;
+
 typedef struct SCSI_cmd_block{
 	unsigned char		cmd[16];					/* command				   */
 	/* for request sense */
@@ -25,6 +27,10 @@ typedef struct SCSI_cmd_block{
 	unsigned char		sensecmd[6];			/* Sense command			*/
 	unsigned long		contr_stat;				/* Controller Status	*/
 	unsigned long		trans_bytes;			/* tranfered bytes		*/
+	/* The data as a scatter-gather list instead of pdata, if set */
+	const struct blk_sg	*sg;
+	int			sg_count;
+	unsigned long		sg_skip;	/* blocks to skip in sg[0] */
 
 	unsigned int		priv;
 }ccb;
@@ -39,8 +39,9 @@ typedef struct entry {
 	int flags;
 } ENTRY;
 
-/* Opaque type for internal use.  */
+/* Opaque types for internal use.  */
 struct _ENTRY;
+struct _ARENA;
 
 /*
  * Family of hash table handling functions.  The functions also
@@ -53,6 +54,10 @@ struct hsearch_data {
 	struct _ENTRY *table;
 	unsigned int size;
 	unsigned int filled;
+	/* Imported data, which the keys and values may point into */
+	struct _ARENA *arena;
+	/* Count of entries created, changed or deleted, for saving */
+	unsigned int changes;
 /*
  * Callback function which will check whether the given change for variable
  * "item" to "newval" may be applied or not, and possibly apply such change.
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Android sparse image format, as written by img2simg and split by the
+ * fastboot host tool. All fields are little endian.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef __SPARSE_FORMAT_H
+#define __SPARSE_FORMAT_H
+
+#include <linux/types.h>
+
+#define SPARSE_HEADER_MAGIC	0xed26ff3a
+#define SPARSE_HEADER_MAJOR_VER	1
+
+typedef struct sparse_header {
+	__le32	magic;		/* SPARSE_HEADER_MAGIC */
+	__le16	major_version;	/* (0x1) - reject images with higher major */
+	__le16	minor_version;	/* (0x0) - allow images with higher minor */
+	__le16	file_hdr_sz;	/* 28 bytes for first revision */
+	__le16	chunk_hdr_sz;	/* 12 bytes for first revision */
+	__le32	blk_sz;		/* block size in bytes, multiple of 4 */
+	__le32	total_blks;	/* blocks in the output image */
+	__le32	total_chunks;	/* chunks in the sparse input image */
+	__le32	image_checksum;	/* CRC32 of the original data, or 0 */
+} sparse_header_t;
+
+#define CHUNK_TYPE_RAW		0xcac1
+#define CHUNK_TYPE_FILL		0xcac2
+#define CHUNK_TYPE_DONT_CARE	0xcac3
+#define CHUNK_TYPE_CRC32	0xcac4
+
+typedef struct chunk_header {
+	__le16	chunk_type;	/* CHUNK_TYPE_... */
+	__le16	reserved1;
+	__le32	chunk_sz;	/* in blocks of the output image */
+	__le32	total_sz;	/* in bytes of the chunk, header and data */
+} chunk_header_t;
+
+/*
+ * A RAW chunk is followed by chunk_sz * blk_sz bytes of data, a FILL
+ * chunk by the 4-byte value to repeat, a CRC32 chunk by the 4-byte
+ * checksum of the image so far. DONT_CARE chunks have no data.
+ */
+
+#endif
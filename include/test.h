@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Helpers for the test_xxx commands in test/
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef __TEST_H
+#define __TEST_H
+
+#include <command.h>
+
+/*
+ * Check a statement in a test. If it is false, print it, set 'ret' to 1
+ * and go to the 'out' label of the test.
+ */
+#define errcheck(statement) if (!(statement)) { \
+	fprintf(stderr, "\tFailed: %s\n", #statement); \
+	ret = 1; \
+	goto out; \
+}
+
+/* Print the result of one part of a test */
+#define test_result(part, ret) \
+	printf(" %s: %s\n", part, (ret) == 0 ? "ok" : "FAILED")
+
+/*
+ * Declare a command which runs the test 'int name(void)', which returns
+ * the number of parts that failed, and prints the overall result
+ */
+#define TEST_CMD(name, help)						\
+static int do_##name(cmd_tbl_t *cmdtp, int flag, int argc,		\
+		     char * const argv[])				\
+{									\
+	int err = name();						\
+									\
+	printf(#name " %s\n", err == 0 ? "ok" : "FAILED");		\
+									\
+	return err;							\
+}									\
+U_BOOT_CMD(name, 1, 1, do_##name, help, "")
+
+#endif /* __TEST_H */
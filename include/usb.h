@@ -150,7 +150,8 @@ enum usb_init_type {
 	defined(CONFIG_USB_OMAP3) || defined(CONFIG_USB_DA8XX) || \
 	defined(CONFIG_USB_BLACKFIN) || defined(CONFIG_USB_AM35X) || \
 	defined(CONFIG_USB_MUSB_DSPS) || defined(CONFIG_USB_MUSB_AM35X) || \
-	defined(CONFIG_USB_MUSB_OMAP2PLUS) || defined(CONFIG_USB_XHCI)
+	defined(CONFIG_USB_MUSB_OMAP2PLUS) || defined(CONFIG_USB_XHCI) || \
+	defined(CONFIG_USB_SANDBOX)
 
 int usb_lowlevel_init(int index, enum usb_init_type init, void **controller);
 int usb_lowlevel_stop(int index);
@@ -162,6 +163,92 @@ int submit_control_msg(struct usb_device *dev, unsigned long pipe, void *buffer,
 int submit_int_msg(struct usb_device *dev, unsigned long pipe, void *buffer,
 			int transfer_len, int interval);
 
+#ifdef CONFIG_USB_EHCI
+struct int_queue;
+
+/**
+ * create_int_queue() - Start polling an interrupt endpoint
+ *
+ * The controller keeps polling the endpoint into the elements of
+ * @buffer in turn, without waiting for the caller.
+ *
+ * @dev:	USB device the endpoint belongs to
+ * @pipe:	interrupt pipe
+ * @queuesize:	number of transfers kept queued
+ * @elementsize: length of each transfer
+ * @buffer:	room for @queuesize transfers, owned by the caller
+ * @return the queue, or NULL on error
+ */
+struct int_queue *create_int_queue(struct usb_device *dev, unsigned long pipe,
+				   int queuesize, int elementsize,
+				   void *buffer);
+
+/**
+ * poll_int_queue() - Take the next completed transfer of a queue
+ *
+ * This never waits. dev->act_len and dev->status are set from the
+ * transfer.
+ *
+ * @dev:	USB device of the queue
+ * @queue:	the queue
+ * @return the element of the buffer the transfer went to, which stays
+ *	the caller's until the next call, or NULL if none has completed
+ */
+void *poll_int_queue(struct usb_device *dev, struct int_queue *queue);
+
+/**
+ * destroy_int_queue() - Stop polling an interrupt endpoint
+ *
+ * @dev:	USB device of the queue
+ * @queue:	the queue, freed, but not its buffer
+ * @return 0 if OK, -ve on error
+ */
+int destroy_int_queue(struct usb_device *dev, struct int_queue *queue);
+#endif
+
+/**
+ * usb_get_max_xfer_size() - Get the largest bulk transfer of a controller
+ *
+ * @dev:	USB device the transfer is for
+ * @size:	returns the maximum number of bytes submit_bulk_msg() takes
+ * @return 0 if OK, -ENOSYS if the controller driver does not know
+ */
+int usb_get_max_xfer_size(struct usb_device *dev, size_t *size);
+
+/**
+ * struct usb_bulk_xfer - one bulk transfer of a batch
+ *
+ * @pipe:	pipe of the transfer
+ * @buffer:	data to send or room for the data received
+ * @length:	number of bytes to move
+ * @act_len:	number of bytes moved, set by the controller driver
+ * @status:	outcome as for usb_device.status, USB_ST_NOT_PROC for a
+ *		transfer which never ran
+ */
+struct usb_bulk_xfer {
+	unsigned long pipe;
+	void *buffer;
+	int length;
+	int act_len;
+	unsigned long status;
+};
+
+/**
+ * submit_bulk_batch() - Run several bulk transfers to one device
+ *
+ * Transfers on the same pipe run in order. A controller which can keep
+ * transfers in flight queues them all before waiting; others run them
+ * one after the other. Either way, the first failure ends the batch:
+ * the transfers which had not completed are cancelled.
+ *
+ * @dev:	USB device the transfers are for
+ * @xfers:	transfers to run
+ * @count:	number of entries in @xfers
+ * @return 0 if every transfer completed without error, -1 otherwise
+ */
+int submit_bulk_batch(struct usb_device *dev, struct usb_bulk_xfer *xfers,
+		      int count);
+
 /* Defines */
 #define USB_UHCI_VEND_ID	0x8086
 #define USB_UHCI_DEV_ID		0x7112
@@ -400,9 +487,25 @@ struct usb_hub_descriptor {
 } __attribute__ ((packed));
 
 
+/* Where a hub port is in being brought up, see usb_hub_scan() */
+enum usb_hub_port_state {
+	USB_HUB_PORT_IDLE,	/* not being brought up */
+	USB_HUB_PORT_POWER,	/* waiting for port power to be good */
+	USB_HUB_PORT_CONNECT,	/* waiting for a device to connect */
+	USB_HUB_PORT_DEBOUNCE,	/* waiting for the connection to settle */
+};
+
+struct usb_hub_port {
+	enum usb_hub_port_state state;
+	ulong debounce;		/* get_timer() when the connection was seen */
+	int overcurrent;	/* over-currents this port has reported */
+};
+
 struct usb_hub_device {
 	struct usb_device *pusb_dev;
 	struct usb_hub_descriptor desc;
+	ulong power_on;		/* get_timer() when the ports were powered */
+	struct usb_hub_port port[USB_MAXCHILDREN];
 };
 
 int usb_hub_probe(struct usb_device *dev, int ifnum);
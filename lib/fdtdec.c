@@ -6,6 +6,7 @@
 #ifndef USE_HOSTCC
 #include <common.h>
 #include <errno.h>
+#include <malloc.h>
 #include <serial.h>
 #include <libfdt.h>
 #include <fdtdec.h>
@@ -79,6 +80,257 @@ const char *fdtdec_get_compatible(enum fdt_compat_id id)
 	return compat_names[id];
 }
 
+#if defined(CONFIG_FDTDEC_CACHE) && !defined(CONFIG_SPL_BUILD)
+/*
+ * An index of the control FDT, so that looking up a node by phandle, path
+ * or compatible string does not scan the structure block each time. It is
+ * built in one pass on first use after relocation, and dropped when libfdt
+ * writes to the blob. Paths are only remembered once they are asked for,
+ * since there are far more nodes than paths that anyone looks up.
+ */
+#define FDT_CACHE_PATHS		16
+#define FDT_CACHE_PATH_LEN	64
+
+struct fdt_cache_phandle {
+	uint32_t phandle;
+	int offset;
+};
+
+struct fdt_cache_compat {
+	const char *compat;	/* points into the blob */
+	int offset;
+};
+
+struct fdt_cache_path {
+	char path[FDT_CACHE_PATH_LEN];
+	int offset;		/* or -FDT_ERR_NOTFOUND, also worth keeping */
+};
+
+static struct fdt_cache {
+	const void *blob;	/* blob indexed, NULL if none */
+	struct fdt_cache_phandle *phandles;	/* sorted by phandle */
+	int phandle_count;
+	struct fdt_cache_compat *compats;	/* sorted by string, offset */
+	int compat_count;
+	struct fdt_cache_path paths[FDT_CACHE_PATHS];
+	int path_count;
+	int path_next;		/* next entry to replace when full */
+} fdt_cache;
+
+static void fdt_cache_free(void)
+{
+	free(fdt_cache.phandles);
+	free(fdt_cache.compats);
+	memset(&fdt_cache, '\0', sizeof(fdt_cache));
+}
+
+void fdt_blob_written(const void *fdt)
+{
+	if ((gd->flags & GD_FLG_RELOC) && fdt == fdt_cache.blob)
+		fdt_cache_free();
+}
+
+/* Make room for one more entry, doubling the array when it is full */
+static void *fdt_cache_grow(void *array, int count, size_t size)
+{
+	if (count && (count < 16 || (count & (count - 1))))
+		return array;
+
+	return realloc(array, max(count * 2, 16) * size);
+}
+
+static int fdt_cache_phandle_cmp(const void *a, const void *b)
+{
+	const struct fdt_cache_phandle *pa = a, *pb = b;
+
+	if (pa->phandle != pb->phandle)
+		return pa->phandle < pb->phandle ? -1 : 1;
+
+	return pa->offset - pb->offset;
+}
+
+static int fdt_cache_compat_cmp(const void *a, const void *b)
+{
+	const struct fdt_cache_compat *ca = a, *cb = b;
+	int ret;
+
+	ret = strcmp(ca->compat, cb->compat);
+	if (ret)
+		return ret;
+
+	return ca->offset - cb->offset;
+}
+
+static int fdt_cache_build(const void *blob)
+{
+	struct fdt_cache_phandle *phandle;
+	struct fdt_cache_compat *compat;
+	const char *str, *end;
+	uint32_t value;
+	int node, len;
+
+	for (node = 0; node >= 0; node = fdt_next_node(blob, node, NULL)) {
+		value = fdt_get_phandle(blob, node);
+		if (value) {
+			phandle = fdt_cache_grow(fdt_cache.phandles,
+						 fdt_cache.phandle_count,
+						 sizeof(*phandle));
+			if (!phandle)
+				return -ENOMEM;
+			fdt_cache.phandles = phandle;
+			phandle += fdt_cache.phandle_count++;
+			phandle->phandle = value;
+			phandle->offset = node;
+		}
+
+		str = fdt_getprop(blob, node, "compatible", &len);
+		if (!str)
+			continue;
+		for (end = str + len; str < end; str += len + 1) {
+			len = strnlen(str, end - str);
+			if (str + len == end)
+				break;
+			compat = fdt_cache_grow(fdt_cache.compats,
+						fdt_cache.compat_count,
+						sizeof(*compat));
+			if (!compat)
+				return -ENOMEM;
+			fdt_cache.compats = compat;
+			compat += fdt_cache.compat_count++;
+			compat->compat = str;
+			compat->offset = node;
+		}
+	}
+	if (node != -FDT_ERR_NOTFOUND)
+		return node;
+
+	qsort(fdt_cache.phandles, fdt_cache.phandle_count,
+	      sizeof(*fdt_cache.phandles), fdt_cache_phandle_cmp);
+	qsort(fdt_cache.compats, fdt_cache.compat_count,
+	      sizeof(*fdt_cache.compats), fdt_cache_compat_cmp);
+	fdt_cache.blob = blob;
+	debug("%s: %d phandles, %d compatible strings\n", __func__,
+	      fdt_cache.phandle_count, fdt_cache.compat_count);
+
+	return 0;
+}
+
+/**
+ * Get the index ready for a blob
+ *
+ * Only U-Boot's own device tree is indexed, and only after relocation, as
+ * the index lives in BSS and in the heap.
+ *
+ * @param blob		FDT blob to be looked up
+ * @return true if the index can be used, false to use libfdt directly
+ */
+static bool fdt_cache_ready(const void *blob)
+{
+	if (!blob || blob != gd->fdt_blob || !(gd->flags & GD_FLG_RELOC))
+		return false;
+	if (fdt_cache.blob == blob)
+		return true;
+	fdt_cache_free();
+	if (fdt_cache_build(blob)) {
+		fdt_cache_free();
+		return false;
+	}
+
+	return true;
+}
+
+int fdtdec_path_offset(const void *blob, const char *path)
+{
+	struct fdt_cache_path *entry;
+	int i;
+
+	if (!fdt_cache_ready(blob) || strlen(path) >= FDT_CACHE_PATH_LEN)
+		return fdt_path_offset(blob, path);
+	for (i = 0; i < fdt_cache.path_count; i++) {
+		entry = &fdt_cache.paths[i];
+		if (!strcmp(entry->path, path))
+			return entry->offset;
+	}
+
+	entry = &fdt_cache.paths[fdt_cache.path_next];
+	fdt_cache.path_next = (fdt_cache.path_next + 1) % FDT_CACHE_PATHS;
+	if (fdt_cache.path_count < FDT_CACHE_PATHS)
+		fdt_cache.path_count++;
+	strcpy(entry->path, path);
+	entry->offset = fdt_path_offset(blob, path);
+
+	return entry->offset;
+}
+
+int fdtdec_node_offset_by_phandle(const void *blob, uint32_t phandle)
+{
+	const struct fdt_cache_phandle *entry;
+	int lo, hi, mid;
+
+	if (!fdt_cache_ready(blob))
+		return fdt_node_offset_by_phandle(blob, phandle);
+	if (phandle == 0 || phandle == -1)
+		return -FDT_ERR_BADPHANDLE;
+
+	/* Find the first entry with this phandle, as libfdt would */
+	for (lo = 0, hi = fdt_cache.phandle_count; lo < hi;) {
+		mid = (lo + hi) / 2;
+		if (fdt_cache.phandles[mid].phandle < phandle)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	entry = &fdt_cache.phandles[lo];
+	if (lo < fdt_cache.phandle_count && entry->phandle == phandle)
+		return entry->offset;
+
+	return -FDT_ERR_NOTFOUND;
+}
+
+int fdtdec_node_offset_by_compatible(const void *blob, int startoffset,
+				     const char *compatible)
+{
+	const struct fdt_cache_compat *entry;
+	int lo, hi, mid, ret;
+
+	if (!fdt_cache_ready(blob))
+		return fdt_node_offset_by_compatible(blob, startoffset,
+						     compatible);
+
+	/* Find the first node with this string after startoffset */
+	for (lo = 0, hi = fdt_cache.compat_count; lo < hi;) {
+		mid = (lo + hi) / 2;
+		entry = &fdt_cache.compats[mid];
+		ret = strcmp(entry->compat, compatible);
+		if (ret < 0 || (!ret && entry->offset <= startoffset))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	entry = &fdt_cache.compats[lo];
+	if (lo < fdt_cache.compat_count && !strcmp(entry->compat, compatible))
+		return entry->offset;
+
+	return -FDT_ERR_NOTFOUND;
+}
+#else
+int fdtdec_path_offset(const void *blob, const char *path)
+{
+	return fdt_path_offset(blob, path);
+}
+
+int fdtdec_node_offset_by_phandle(const void *blob, uint32_t phandle)
+{
+	return fdt_node_offset_by_phandle(blob, phandle);
+}
+
+int fdtdec_node_offset_by_compatible(const void *blob, int startoffset,
+				     const char *compatible)
+{
+	return fdt_node_offset_by_compatible(blob, startoffset, compatible);
+}
+#endif
+
 fdt_addr_t fdtdec_get_addr_size(const void *blob, int node,
 		const char *prop_name, fdt_size_t *sizep)
 {
@@ -158,7 +410,7 @@ enum fdt_compat_id fdtdec_lookup(const void *blob, int node)
 int fdtdec_next_compatible(const void *blob, int node,
 		enum fdt_compat_id id)
 {
-	return fdt_node_offset_by_compatible(blob, node, compat_names[id]);
+	return fdtdec_node_offset_by_compatible(blob, node, compat_names[id]);
 }
 
 int fdtdec_next_compatible_subnode(const void *blob, int node,
@@ -186,7 +438,7 @@ int fdtdec_next_alias(const void *blob, const char *name,
 	/* snprintf() is not available */
 	assert(strlen(name) < MAX_STR_LEN);
 	sprintf(str, "%.*s%d", MAX_STR_LEN, name, *upto);
-	node = fdt_path_offset(blob, str);
+	node = fdtdec_path_offset(blob, str);
 	if (node < 0)
 		return node;
 	err = fdt_node_check_compatible(blob, node, compat_names[id]);
@@ -219,7 +471,7 @@ int fdtdec_add_aliases_for_id(const void *blob, const char *name,
 	int i, j;
 
 	/* find the alias node if present */
-	alias_node = fdt_path_offset(blob, "/aliases");
+	alias_node = fdtdec_path_offset(blob, "/aliases");
 
 	/*
 	 * start with nothing, and we can assume that the root node can't
@@ -250,7 +502,7 @@ int fdtdec_add_aliases_for_id(const void *blob, const char *name,
 		prop = fdt_get_property_by_offset(blob, offset, NULL);
 		path = fdt_string(blob, fdt32_to_cpu(prop->nameoff));
 		if (prop->len && 0 == strncmp(path, name, name_len))
-			node = fdt_path_offset(blob, prop->data);
+			node = fdtdec_path_offset(blob, prop->data);
 		if (node <= 0)
 			continue;
 
@@ -333,7 +585,7 @@ int fdtdec_get_alias_seq(const void *blob, const char *base, int offset,
 	find_name = fdt_get_name(blob, offset, &find_namelen);
 	debug("Looking for '%s' at %d, name %s\n", base, offset, find_name);
 
-	aliases = fdt_path_offset(blob, "/aliases");
+	aliases = fdtdec_path_offset(blob, "/aliases");
 	for (prop_offset = fdt_first_property_offset(blob, aliases);
 	     prop_offset > 0;
 	     prop_offset = fdt_next_property_offset(blob, prop_offset)) {
@@ -373,11 +625,11 @@ int fdtdec_get_alias_node(const void *blob, const char *name)
 
 	if (!blob)
 		return -FDT_ERR_NOTFOUND;
-	alias_node = fdt_path_offset(blob, "/aliases");
+	alias_node = fdtdec_path_offset(blob, "/aliases");
 	prop = fdt_getprop(blob, alias_node, name, &len);
 	if (!prop)
 		return -FDT_ERR_NOTFOUND;
-	return fdt_path_offset(blob, prop);
+	return fdtdec_path_offset(blob, prop);
 }
 
 int fdtdec_check_fdt(void)
@@ -419,7 +671,7 @@ int fdtdec_lookup_phandle(const void *blob, int node, const char *prop_name)
 	if (!phandle)
 		return -FDT_ERR_NOTFOUND;
 
-	lookup = fdt_node_offset_by_phandle(blob, fdt32_to_cpu(*phandle));
+	lookup = fdtdec_node_offset_by_phandle(blob, fdt32_to_cpu(*phandle));
 	return lookup;
 }
 
@@ -613,7 +865,7 @@ int fdtdec_get_config_int(const void *blob, const char *prop_name,
 	int config_node;
 
 	debug("%s: %s\n", __func__, prop_name);
-	config_node = fdt_path_offset(blob, "/config");
+	config_node = fdtdec_path_offset(blob, "/config");
 	if (config_node < 0)
 		return default_val;
 	return fdtdec_get_int(blob, config_node, prop_name, default_val);
@@ -625,7 +877,7 @@ int fdtdec_get_config_bool(const void *blob, const char *prop_name)
 	const void *prop;
 
 	debug("%s: %s\n", __func__, prop_name);
-	config_node = fdt_path_offset(blob, "/config");
+	config_node = fdtdec_path_offset(blob, "/config");
 	if (config_node < 0)
 		return 0;
 	prop = fdt_get_property(blob, config_node, prop_name, NULL);
@@ -640,7 +892,7 @@ char *fdtdec_get_config_string(const void *blob, const char *prop_name)
 	int len;
 
 	debug("%s: %s\n", __func__, prop_name);
-	nodeoffset = fdt_path_offset(blob, "/config");
+	nodeoffset = fdtdec_path_offset(blob, "/config");
 	if (nodeoffset < 0)
 		return NULL;
 
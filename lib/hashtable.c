@@ -62,10 +62,83 @@ typedef struct _ENTRY {
 	ENTRY entry;
 } _ENTRY;
 
+/*
+ * Imported data is kept in one piece, and the entries made from it point
+ * into it instead of having a copy of each key and value. "users" counts
+ * the keys and values pointing into an arena, which is freed when the
+ * last of them goes.
+ */
+typedef struct _ARENA {
+	struct _ARENA *next;
+	size_t size;
+	unsigned int users;
+	char data[0];
+} _ARENA;
+
 
 static void _hdelete(const char *key, struct hsearch_data *htab, ENTRY *ep,
 	int idx);
 
+/*
+ * Arenas
+ */
+
+static _ARENA *_harena_find(struct hsearch_data *htab, const char *str)
+{
+	_ARENA *ap;
+
+	for (ap = htab->arena; ap != NULL; ap = ap->next) {
+		if (str >= ap->data && str < ap->data + ap->size)
+			return ap;
+	}
+
+	return NULL;
+}
+
+/*
+ * Copy a key or value for an entry. Strings which are already in one of
+ * the table's arenas (such as the value of another variable) are shared.
+ */
+static char *_hstrdup(struct hsearch_data *htab, const char *str)
+{
+	_ARENA *ap = _harena_find(htab, str);
+
+	if (ap == NULL)
+		return strdup(str);
+	++ap->users;
+
+	return (char *)str;
+}
+
+/* Free an arena if nothing points into it any more */
+static void _harena_put(struct hsearch_data *htab, _ARENA *ap)
+{
+	_ARENA **app;
+
+	if (ap->users)
+		return;
+	for (app = &htab->arena; *app != NULL; app = &(*app)->next) {
+		if (*app == ap) {
+			*app = ap->next;
+			break;
+		}
+	}
+	free(ap);
+}
+
+/* Free a key or value made by _hstrdup() */
+static void _hfree(struct hsearch_data *htab, const char *str)
+{
+	_ARENA *ap = _harena_find(htab, str);
+
+	if (ap == NULL) {
+		free((void *)str);
+		return;
+	}
+	--ap->users;
+	_harena_put(htab, ap);
+}
+
 /*
  * hcreate()
  */
@@ -151,14 +224,21 @@ void hdestroy_r(struct hsearch_data *htab)
 		if (htab->table[i].used > 0) {
 			ENTRY *ep = &htab->table[i].entry;
 
-			free((void *)ep->key);
-			free(ep->data);
+			_hfree(htab, ep->key);
+			_hfree(htab, ep->data);
 		}
 	}
 	free(htab->table);
+	while (htab->arena != NULL) {
+		_ARENA *ap = htab->arena;
+
+		htab->arena = ap->next;
+		free(ap);
+	}
 
 	/* the sign for an existing table is an value != NULL in htable */
 	htab->table = NULL;
+	++htab->changes;
 }
 
 /*
@@ -188,7 +268,8 @@ void hdestroy_r(struct hsearch_data *htab)
  *   works with NUL terminated strings only.
  * - Instead of storing just pointers to the original objects, we
  *   create local copies so the caller does not need to care about the
- *   data any more.
+ *   data any more. Strings which are already held by the table, in the
+ *   data kept by himport_r(), are shared rather than copied.
  * - The standard implementation does not provide a way to update an
  *   existing entry.  This version will create a new entry or update an
  *   existing one when both "action == ENTER" and "item.data != NULL".
@@ -226,6 +307,8 @@ static inline int _compare_and_overwrite_entry(ENTRY item, ACTION action,
 	ENTRY **retval, struct hsearch_data *htab, int flag,
 	unsigned int hval, unsigned int idx)
 {
+	char *data;
+
 	if (htab->table[idx].used == hval
 	    && strcmp(item.key, htab->table[idx].entry.key) == 0) {
 		/* Overwrite existing value? */
@@ -252,13 +335,15 @@ static inline int _compare_and_overwrite_entry(ENTRY item, ACTION action,
 				return 0;
 			}
 
-			free(htab->table[idx].entry.data);
-			htab->table[idx].entry.data = strdup(item.data);
-			if (!htab->table[idx].entry.data) {
+			data = _hstrdup(htab, item.data);
+			if (!data) {
 				__set_errno(ENOMEM);
 				*retval = NULL;
 				return 0;
 			}
+			_hfree(htab, htab->table[idx].entry.data);
+			htab->table[idx].entry.data = data;
+			++htab->changes;
 		}
 		/* return found entry */
 		*retval = &htab->table[idx].entry;
@@ -359,14 +444,15 @@ int hsearch_r(ENTRY item, ACTION action, ENTRY ** retval,
 
 		/*
 		 * Create new entry;
-		 * create copies of item.key and item.data
+		 * create copies of item.key and item.data, unless they
+		 * are in an arena
 		 */
 		if (first_deleted)
 			idx = first_deleted;
 
 		htab->table[idx].used = hval;
-		htab->table[idx].entry.key = strdup(item.key);
-		htab->table[idx].entry.data = strdup(item.data);
+		htab->table[idx].entry.key = _hstrdup(htab, item.key);
+		htab->table[idx].entry.data = _hstrdup(htab, item.data);
 		if (!htab->table[idx].entry.key ||
 		    !htab->table[idx].entry.data) {
 			__set_errno(ENOMEM);
@@ -375,6 +461,7 @@ int hsearch_r(ENTRY item, ACTION action, ENTRY ** retval,
 		}
 
 		++htab->filled;
+		++htab->changes;
 
 		/* This is a new entry, so look up a possible callback */
 		env_callback_init(&htab->table[idx].entry);
@@ -430,13 +517,14 @@ static void _hdelete(const char *key, struct hsearch_data *htab, ENTRY *ep,
 {
 	/* free used ENTRY */
 	debug("hdelete: DELETING key \"%s\"\n", key);
-	free((void *)ep->key);
-	free(ep->data);
+	_hfree(htab, ep->key);
+	_hfree(htab, ep->data);
 	ep->callback = NULL;
 	ep->flags = 0;
 	htab->table[idx].used = -1;
 
 	--htab->filled;
+	++htab->changes;
 }
 
 int hdelete_r(const char *key, struct hsearch_data *htab, int flag)
@@ -739,6 +827,22 @@ static int drop_var_from_set(const char *name, int nvars, char * vars[])
 	return res;
 }
 
+/*
+ * The length of the data to import: up to the empty entry which ends
+ * NUL separated data, or up to the first NUL in text.
+ */
+static size_t himport_len(const char *env, size_t size, const char sep)
+{
+	size_t len;
+
+	if (sep != '\0')
+		return strnlen(env, size);
+	for (len = 0; len < size && env[len]; ++len)
+		len += strnlen(env + len, size - len);
+
+	return len < size ? len : size;
+}
+
 /*
  * Import linearized data into hash table.
  *
@@ -780,6 +884,8 @@ int himport_r(struct hsearch_data *htab,
 {
 	char *data, *sp, *dp, *name, *value;
 	char *localvars[nvars];
+	_ARENA *arena;
+	size_t len;
 	int i;
 
 	/* Test for correct arguments.  */
@@ -788,13 +894,24 @@ int himport_r(struct hsearch_data *htab,
 		return 0;
 	}
 
-	/* we allocate new space to make sure we can write to the array */
-	if ((data = malloc(size)) == NULL) {
-		debug("himport_r: can't malloc %zu bytes\n", size);
+	/*
+	 * We copy the data to make sure we can write to it, and then keep
+	 * it as an arena: the names and values are terminated where they
+	 * are and the new entries point to them. Only what is used is
+	 * copied, with two NULs after it for the parser to stop at.
+	 */
+	len = himport_len(env, size, sep);
+	arena = malloc(sizeof(_ARENA) + len + 2);
+	if (arena == NULL) {
+		debug("himport_r: can't malloc %zu bytes\n", len + 2);
 		__set_errno(ENOMEM);
 		return 0;
 	}
-	memcpy(data, env, size);
+	arena->size = len + 2;
+	arena->users = 1;	/* the parser's, until it is done */
+	data = arena->data;
+	memcpy(data, env, len);
+	data[len] = data[len + 1] = '\0';
 	dp = data;
 
 	/* make a local copy of the list of variables */
@@ -836,13 +953,19 @@ int himport_r(struct hsearch_data *htab,
 		debug("Create Hash Table: N=%d\n", nent);
 
 		if (hcreate_r(nent, htab) == 0) {
-			free(data);
+			free(arena);
 			return 0;
 		}
 	}
 
-	if(!size)
+	if(!size) {
+		free(arena);
 		return 1;		/* everything OK */
+	}
+	arena->next = htab->arena;
+	htab->arena = arena;
+	size = arena->size;
+
 	if(crlf_is_lf) {
 		/* Remove Carriage Returns in front of Line Feeds */
 		unsigned ignored_crs = 0;
@@ -905,6 +1028,8 @@ int himport_r(struct hsearch_data *htab,
 
 		if (*name == 0) {
 			debug("INSERT: unable to use an empty key\n");
+			--arena->users;
+			_harena_put(htab, arena);
 			__set_errno(EINVAL);
 			return 0;
 		}
@@ -927,8 +1052,10 @@ int himport_r(struct hsearch_data *htab,
 			rv, name, value);
 	} while ((dp < data + size) && *dp);	/* size check needed for text */
 						/* without '\0' termination */
-	debug("INSERT: free(data = %p)\n", data);
-	free(data);
+	debug("INSERT: arena %p used by %u keys and values\n", arena,
+	      arena->users - 1);
+	--arena->users;
+	_harena_put(htab, arena);
 
 	/* process variables which were not considered */
 	for (i = 0; i < nvars; i++) {
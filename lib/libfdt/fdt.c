@@ -204,6 +204,13 @@ int fdt_move(const void *fdt, void *buf, int bufsize)
 	if (fdt_totalsize(fdt) > bufsize)
 		return -FDT_ERR_NOSPACE;
 
+	fdt_blob_written(buf);
 	memmove(buf, fdt, fdt_totalsize(fdt));
 	return 0;
 }
+
+#ifndef USE_HOSTCC
+__weak void fdt_blob_written(const void *fdt)
+{
+}
+#endif
@@ -0,0 +1,435 @@
+/*
+ * libfdt - Flat Device Tree manipulation
+ * Applying device tree overlays
+ * Copyright (C) 2026 agent <agent@local>
+ * SPDX-License-Identifier:	GPL-2.0+ BSD-2-Clause
+ */
+#include "libfdt_env.h"
+
+#ifndef USE_HOSTCC
+#include <fdt.h>
+#include <libfdt.h>
+#else
+#include "fdt_host.h"
+#endif
+
+#include "libfdt_internal.h"
+
+/* Longest path a symbol from an overlay can have in the base tree */
+#define FDT_OVERLAY_PATH_MAX	256
+
+/* Cells in fixed-up properties need not be aligned */
+static uint32_t _fdt_overlay_get_cell(const void *p)
+{
+	fdt32_t val;
+
+	memcpy(&val, p, sizeof(val));
+	return fdt32_to_cpu(val);
+}
+
+static void _fdt_overlay_set_cell(void *p, uint32_t val)
+{
+	fdt32_t tmp = cpu_to_fdt32(val);
+
+	memcpy(p, &tmp, sizeof(tmp));
+}
+
+static int _fdt_overlay_max_phandle(const void *fdt, uint32_t *maxp)
+{
+	uint32_t phandle;
+	int node;
+
+	*maxp = 0;
+	for (node = 0; node >= 0; node = fdt_next_node(fdt, node, NULL)) {
+		phandle = fdt_get_phandle(fdt, node);
+		if (phandle != (uint32_t)-1 && phandle > *maxp)
+			*maxp = phandle;
+	}
+
+	return node == -FDT_ERR_NOTFOUND ? 0 : node;
+}
+
+/* Move the overlay's phandles above those of the base tree */
+static int _fdt_overlay_adjust_phandles(void *fdto, uint32_t delta)
+{
+	static const char * const names[] = { "phandle", "linux,phandle" };
+	uint32_t phandle;
+	void *val;
+	int node, len, i;
+
+	for (node = 0; node >= 0; node = fdt_next_node(fdto, node, NULL)) {
+		for (i = 0; i < 2; i++) {
+			val = fdt_getprop_w(fdto, node, names[i], &len);
+			if (!val)
+				continue;
+			if (len != sizeof(fdt32_t))
+				return -FDT_ERR_BADPHANDLE;
+			phandle = _fdt_overlay_get_cell(val);
+			if (!phandle || phandle == (uint32_t)-1)
+				continue;
+			if (phandle > (uint32_t)-2 - delta)
+				return -FDT_ERR_BADPHANDLE;
+			_fdt_overlay_set_cell(val, phandle + delta);
+		}
+	}
+
+	return node == -FDT_ERR_NOTFOUND ? 0 : node;
+}
+
+/*
+ * Adjust the references to the overlay's own phandles. The __local_fixups__
+ * node mirrors the overlay: each of its properties lists the offsets, in the
+ * property of that name in the matching overlay node, of the phandles to
+ * adjust.
+ */
+static int _fdt_overlay_local_fixups(void *fdto, int node, int fixups,
+				     uint32_t delta)
+{
+	const fdt32_t *offsets;
+	const char *name;
+	char *val;
+	uint32_t off;
+	int prop, sub, child;
+	int count, len, namelen, i, err;
+
+	for (prop = fdt_first_property_offset(fdto, fixups); prop >= 0;
+	     prop = fdt_next_property_offset(fdto, prop)) {
+		offsets = fdt_getprop_by_offset(fdto, prop, &name, &count);
+		if (!offsets)
+			return count;
+		if (count % sizeof(fdt32_t))
+			return -FDT_ERR_BADOVERLAY;
+		val = fdt_getprop_w(fdto, node, name, &len);
+		if (!val)
+			return len == -FDT_ERR_NOTFOUND ? -FDT_ERR_BADOVERLAY :
+				len;
+		for (i = 0; i < count / sizeof(fdt32_t); i++) {
+			off = fdt32_to_cpu(offsets[i]);
+			if (len < sizeof(fdt32_t) ||
+			    off > len - sizeof(fdt32_t))
+				return -FDT_ERR_BADOVERLAY;
+			_fdt_overlay_set_cell(val + off,
+					      _fdt_overlay_get_cell(val + off) +
+					      delta);
+		}
+	}
+	if (prop != -FDT_ERR_NOTFOUND)
+		return prop;
+
+	for (sub = fdt_first_subnode(fdto, fixups); sub >= 0;
+	     sub = fdt_next_subnode(fdto, sub)) {
+		name = fdt_get_name(fdto, sub, &namelen);
+		child = fdt_subnode_offset_namelen(fdto, node, name, namelen);
+		if (child < 0)
+			return child == -FDT_ERR_NOTFOUND ?
+				-FDT_ERR_BADOVERLAY : child;
+		err = _fdt_overlay_local_fixups(fdto, child, sub, delta);
+		if (err)
+			return err;
+	}
+
+	return sub == -FDT_ERR_NOTFOUND ? 0 : sub;
+}
+
+/* Like fdt_path_offset(), but the path need not be terminated */
+static int _fdt_overlay_path_offset(const void *fdto, const char *path,
+				    int len)
+{
+	const char *end = path + len;
+	const char *p = path, *q;
+	int offset = 0;
+
+	if (!len || *path != '/')
+		return -FDT_ERR_BADOVERLAY;
+	while (p < end) {
+		while (p < end && *p == '/')
+			p++;
+		if (p == end)
+			break;
+		q = memchr(p, '/', end - p);
+		if (!q)
+			q = end;
+		offset = fdt_subnode_offset_namelen(fdto, offset, p, q - p);
+		if (offset < 0)
+			return offset == -FDT_ERR_NOTFOUND ?
+				-FDT_ERR_BADOVERLAY : offset;
+		p = q;
+	}
+
+	return offset;
+}
+
+/* Write a phandle where one "path:property:offset" fixup says */
+static int _fdt_overlay_fixup_one(void *fdto, const char *fixup, int len,
+				  uint32_t phandle)
+{
+	const char *end = fixup + len;
+	const char *sep1, *sep2, *p;
+	char *val;
+	int node, vlen;
+	uint32_t off = 0;
+
+	sep1 = memchr(fixup, ':', len);
+	if (!sep1)
+		return -FDT_ERR_BADOVERLAY;
+	sep2 = memchr(sep1 + 1, ':', end - sep1 - 1);
+	if (!sep2 || sep2 == sep1 + 1 || sep2 + 1 == end)
+		return -FDT_ERR_BADOVERLAY;
+	for (p = sep2 + 1; p < end; p++) {
+		if (*p < '0' || *p > '9' || off > 0x0fffffff)
+			return -FDT_ERR_BADOVERLAY;
+		off = off * 10 + *p - '0';
+	}
+
+	node = _fdt_overlay_path_offset(fdto, fixup, sep1 - fixup);
+	if (node < 0)
+		return node;
+	val = (char *)fdt_getprop_namelen(fdto, node, sep1 + 1,
+					  sep2 - sep1 - 1, &vlen);
+	if (!val)
+		return vlen == -FDT_ERR_NOTFOUND ? -FDT_ERR_BADOVERLAY : vlen;
+	if (vlen < sizeof(fdt32_t) || off > vlen - sizeof(fdt32_t))
+		return -FDT_ERR_BADOVERLAY;
+	_fdt_overlay_set_cell(val + off, phandle);
+
+	return 0;
+}
+
+/*
+ * Resolve the overlay's references to the base tree. Each property of
+ * __fixups__ is named after a label in the base tree's __symbols__, and
+ * lists the places in the overlay where its phandle goes.
+ */
+static int _fdt_overlay_fixups(const void *fdt, void *fdto)
+{
+	const char *list, *end, *label, *path, *next;
+	uint32_t phandle;
+	int fixups, symbols, prop, node;
+	int len, err;
+
+	fixups = fdt_subnode_offset(fdto, 0, "__fixups__");
+	if (fixups < 0)
+		return fixups == -FDT_ERR_NOTFOUND ? 0 : fixups;
+	symbols = fdt_subnode_offset(fdt, 0, "__symbols__");
+
+	for (prop = fdt_first_property_offset(fdto, fixups); prop >= 0;
+	     prop = fdt_next_property_offset(fdto, prop)) {
+		list = fdt_getprop_by_offset(fdto, prop, &label, &len);
+		if (!list)
+			return len;
+		if (symbols < 0)
+			return symbols;
+		path = fdt_getprop(fdt, symbols, label, NULL);
+		if (!path)
+			return -FDT_ERR_NOTFOUND;
+		node = fdt_path_offset(fdt, path);
+		if (node < 0)
+			return node;
+		phandle = fdt_get_phandle(fdt, node);
+		if (!phandle)
+			return -FDT_ERR_NOTFOUND;
+
+		if (!len || list[len - 1])
+			return -FDT_ERR_BADOVERLAY;
+		for (end = list + len; list < end; list = next + 1) {
+			next = memchr(list, '\0', end - list);
+			err = _fdt_overlay_fixup_one(fdto, list,
+						     next - list, phandle);
+			if (err)
+				return err;
+		}
+	}
+
+	return prop == -FDT_ERR_NOTFOUND ? 0 : prop;
+}
+
+/* The node of the base tree that a fragment goes into */
+static int _fdt_overlay_target(const void *fdt, const void *fdto,
+			       int fragment)
+{
+	const fdt32_t *val;
+	const char *path;
+	int len;
+
+	val = fdt_getprop(fdto, fragment, "target", &len);
+	if (val) {
+		if (len != sizeof(*val))
+			return -FDT_ERR_BADOVERLAY;
+		return fdt_node_offset_by_phandle(fdt, fdt32_to_cpu(*val));
+	}
+	if (len != -FDT_ERR_NOTFOUND)
+		return len;
+
+	path = fdt_getprop(fdto, fragment, "target-path", &len);
+	if (!path)
+		return len == -FDT_ERR_NOTFOUND ? -FDT_ERR_BADOVERLAY : len;
+
+	return fdt_path_offset(fdt, path);
+}
+
+/* Copy an __overlay__ node's properties and subnodes into the target */
+static int _fdt_overlay_merge(void *fdt, int target, const void *fdto,
+			      int node)
+{
+	const void *val;
+	const char *name;
+	int prop, sub, child;
+	int len, err;
+
+	for (prop = fdt_first_property_offset(fdto, node); prop >= 0;
+	     prop = fdt_next_property_offset(fdto, prop)) {
+		val = fdt_getprop_by_offset(fdto, prop, &name, &len);
+		if (!val)
+			return len;
+		err = fdt_setprop(fdt, target, name, val, len);
+		if (err)
+			return err;
+	}
+	if (prop != -FDT_ERR_NOTFOUND)
+		return prop;
+
+	for (sub = fdt_first_subnode(fdto, node); sub >= 0;
+	     sub = fdt_next_subnode(fdto, sub)) {
+		name = fdt_get_name(fdto, sub, &len);
+		child = fdt_add_subnode_namelen(fdt, target, name, len);
+		if (child == -FDT_ERR_EXISTS)
+			child = fdt_subnode_offset_namelen(fdt, target, name,
+							   len);
+		if (child < 0)
+			return child;
+		err = _fdt_overlay_merge(fdt, child, fdto, sub);
+		if (err)
+			return err;
+	}
+
+	return sub == -FDT_ERR_NOTFOUND ? 0 : sub;
+}
+
+/*
+ * Apply each fragment in turn. When @check is set nothing is written:
+ * the fragments' targets are just looked up, so that a wrong overlay is
+ * caught before the base tree is changed.
+ */
+static int _fdt_overlay_fragments(void *fdt, const void *fdto, int check)
+{
+	int fragment, overlay, target;
+	int err;
+
+	for (fragment = fdt_first_subnode(fdto, 0); fragment >= 0;
+	     fragment = fdt_next_subnode(fdto, fragment)) {
+		overlay = fdt_subnode_offset(fdto, fragment, "__overlay__");
+		if (overlay == -FDT_ERR_NOTFOUND)
+			continue;
+		if (overlay < 0)
+			return overlay;
+		target = _fdt_overlay_target(fdt, fdto, fragment);
+		if (target < 0)
+			return target;
+		if (check)
+			continue;
+		err = _fdt_overlay_merge(fdt, target, fdto, overlay);
+		if (err)
+			return err;
+	}
+
+	return fragment == -FDT_ERR_NOTFOUND ? 0 : fragment;
+}
+
+/*
+ * Add the overlay's symbols to the base tree. They point into fragments,
+ * as "/fragment/__overlay__/rest", and become the target's path plus rest.
+ */
+static int _fdt_overlay_symbols(void *fdt, const void *fdto)
+{
+	char buf[FDT_OVERLAY_PATH_MAX];
+	const char *path, *name, *frag_end, *rest;
+	int ov_symbols, symbols, prop, fragment, target;
+	int len, plen, rlen, err;
+
+	ov_symbols = fdt_subnode_offset(fdto, 0, "__symbols__");
+	if (ov_symbols < 0)
+		return ov_symbols == -FDT_ERR_NOTFOUND ? 0 : ov_symbols;
+	symbols = fdt_subnode_offset(fdt, 0, "__symbols__");
+	if (symbols == -FDT_ERR_NOTFOUND)
+		symbols = fdt_add_subnode(fdt, 0, "__symbols__");
+	if (symbols < 0)
+		return symbols;
+
+	for (prop = fdt_first_property_offset(fdto, ov_symbols); prop >= 0;
+	     prop = fdt_next_property_offset(fdto, prop)) {
+		path = fdt_getprop_by_offset(fdto, prop, &name, &len);
+		if (!path)
+			return len;
+		if (len < 2 || path[len - 1] || path[0] != '/')
+			return -FDT_ERR_BADOVERLAY;
+
+		/* Symbols outside the fragments mean nothing in the base */
+		frag_end = strchr(path + 1, '/');
+		if (!frag_end || strncmp(frag_end, "/__overlay__", 12) ||
+		    (frag_end[12] && frag_end[12] != '/'))
+			continue;
+		fragment = fdt_subnode_offset_namelen(fdto, 0, path + 1,
+						      frag_end - path - 1);
+		if (fragment < 0)
+			return -FDT_ERR_BADOVERLAY;
+		target = _fdt_overlay_target(fdt, fdto, fragment);
+		if (target < 0)
+			return target;
+
+		err = fdt_get_path(fdt, target, buf, sizeof(buf));
+		if (err)
+			return err;
+		plen = strlen(buf);
+		rest = frag_end + 12;
+		rlen = strlen(rest);
+		if (plen == 1 && rlen)
+			plen = 0;
+		if (plen + rlen >= sizeof(buf))
+			return -FDT_ERR_NOSPACE;
+		memcpy(buf + plen, rest, rlen + 1);
+
+		err = fdt_setprop(fdt, symbols, name, buf, plen + rlen + 1);
+		if (err)
+			return err;
+	}
+
+	return prop == -FDT_ERR_NOTFOUND ? 0 : prop;
+}
+
+int fdt_overlay_apply(void *fdt, void *fdto)
+{
+	uint32_t delta;
+	int fixups;
+	int err;
+
+	FDT_CHECK_HEADER(fdt);
+	FDT_CHECK_HEADER(fdto);
+	fdt_blob_written(fdto);
+
+	/* Prepare the overlay, then check it all fits the base tree */
+	err = _fdt_overlay_max_phandle(fdt, &delta);
+	if (!err)
+		err = _fdt_overlay_adjust_phandles(fdto, delta);
+	if (!err) {
+		fixups = fdt_subnode_offset(fdto, 0, "__local_fixups__");
+		if (fixups >= 0)
+			err = _fdt_overlay_local_fixups(fdto, 0, fixups, delta);
+		else if (fixups != -FDT_ERR_NOTFOUND)
+			err = fixups;
+	}
+	if (!err)
+		err = _fdt_overlay_fixups(fdt, fdto);
+	if (!err)
+		err = _fdt_overlay_fragments(fdt, fdto, 1);
+
+	/* Only now is the base tree changed */
+	if (!err)
+		err = _fdt_overlay_fragments(fdt, fdto, 0);
+	if (!err)
+		err = _fdt_overlay_symbols(fdt, fdto);
+
+	/* The phandles have moved, so the overlay cannot be used again */
+	fdt_set_magic(fdto, ~0);
+
+	return err;
+}
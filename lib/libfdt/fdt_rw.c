@@ -37,6 +37,7 @@ static int _fdt_rw_check_header(void *fdt)
 		return -FDT_ERR_BADLAYOUT;
 	if (fdt_version(fdt) > 17)
 		fdt_set_version(fdt, 17);
+	fdt_blob_written(fdt);
 
 	return 0;
 }
@@ -413,6 +414,7 @@ int fdt_open_into(const void *fdt, void *buf, int bufsize)
 
 	if (bufsize < newsize)
 		return -FDT_ERR_NOSPACE;
+	fdt_blob_written(buf);
 
 	/* First attempt to build converted tree at beginning of buffer */
 	tmp = buf;
@@ -47,6 +47,7 @@ int fdt_create(void *buf, int bufsize)
 	if (bufsize < sizeof(struct fdt_header))
 		return -FDT_ERR_NOSPACE;
 
+	fdt_blob_written(buf);
 	memset(buf, 0, bufsize);
 
 	fdt_set_magic(fdt, FDT_SW_MAGIC);
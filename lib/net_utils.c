@@ -32,3 +32,57 @@ IPaddr_t string_to_ip(const char *s)
 
 	return (htonl(addr));
 }
+
+int NetCksumOk(uchar *ptr, int len)
+{
+	return !((NetCksum(ptr, len) + 1) & 0xfffe);
+}
+
+/* SPL builds do not have the architecture's version */
+#if !defined(CONFIG_USE_ARCH_NET_CKSUM) || defined(CONFIG_SPL_BUILD)
+/*
+ * Internet checksum over 'len' 16-bit words, without the final
+ * complement.
+ *
+ * The data is summed 32 bits at a time into a 64-bit accumulator, so
+ * carries only need to be folded back in once at the end. Since
+ * 2^16 == 1 in ones' complement arithmetic this gives the same result
+ * as adding up the individual 16-bit words.
+ */
+unsigned NetCksum(uchar *ptr, int len)
+{
+	const u32 *p;
+	u64 sum = 0;
+
+	if (len <= 0)
+		return 0;
+
+	/* IP headers follow the 14-byte ethernet header */
+	if ((ulong)ptr & 2) {
+		sum = *(ushort *)ptr;
+		ptr += 2;
+		len--;
+	}
+
+	p = (const u32 *)ptr;
+	while (len >= 8) {
+		sum += p[0];
+		sum += p[1];
+		sum += p[2];
+		sum += p[3];
+		p += 4;
+		len -= 8;
+	}
+	while (len >= 2) {
+		sum += *p++;
+		len -= 2;
+	}
+	if (len)
+		sum += *(ushort *)p;
+
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+
+	return sum;
+}
+#endif
@@ -48,6 +48,28 @@ void ArpInit(void)
 	NetArpTxPacket -= (ulong)NetArpTxPacket % PKTALIGN;
 }
 
+#ifdef CONFIG_NET_PARALLEL
+void arp_wait_save(struct arp_wait *wait)
+{
+	wait->packet_ip = NetArpWaitPacketIP;
+	wait->reply_ip = NetArpWaitReplyIP;
+	wait->packet_mac = NetArpWaitPacketMAC;
+	wait->tx_packet_size = NetArpWaitTxPacketSize;
+	wait->timer_start = NetArpWaitTimerStart;
+	wait->try = NetArpWaitTry;
+}
+
+void arp_wait_load(const struct arp_wait *wait)
+{
+	NetArpWaitPacketIP = wait->packet_ip;
+	NetArpWaitReplyIP = wait->reply_ip;
+	NetArpWaitPacketMAC = wait->packet_mac;
+	NetArpWaitTxPacketSize = wait->tx_packet_size;
+	NetArpWaitTimerStart = wait->timer_start;
+	NetArpWaitTry = wait->try;
+}
+#endif
+
 void arp_raw_request(IPaddr_t sourceIP, const uchar *targetEther,
 	IPaddr_t targetIP)
 {
@@ -20,11 +20,23 @@ extern int NetArpWaitTxPacketSize;
 extern ulong NetArpWaitTimerStart;
 extern int NetArpWaitTry;
 
+/* A pending ARP request, for a download over several interfaces */
+struct arp_wait {
+	IPaddr_t packet_ip;
+	IPaddr_t reply_ip;
+	uchar *packet_mac;
+	int tx_packet_size;
+	ulong timer_start;
+	int try;
+};
+
 void ArpInit(void);
 void ArpRequest(void);
 void arp_raw_request(IPaddr_t sourceIP, const uchar *targetEther,
 	IPaddr_t targetIP);
 void ArpTimeoutCheck(void);
 void ArpReceive(struct ethernet_hdr *et, struct ip_udp_hdr *ip, int len);
+void arp_wait_save(struct arp_wait *wait);
+void arp_wait_load(const struct arp_wait *wait);
 
 #endif /* __ARP_H__ */
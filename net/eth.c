@@ -8,6 +8,7 @@
 #include <common.h>
 #include <command.h>
 #include <net.h>
+#include <div64.h>
 #include <miiphy.h>
 #include <phy.h>
 #include <asm/errno.h>
@@ -223,6 +224,7 @@ int eth_register(struct eth_device *dev)
 	dev->state = ETH_STATE_INIT;
 	dev->next  = eth_devices;
 	dev->index = index++;
+	eth_reset_stats(dev);
 
 	return 0;
 }
@@ -403,6 +405,7 @@ int eth_init(bd_t *bis)
 
 		if (eth_current->init(eth_current, bis) >= 0) {
 			eth_current->state = ETH_STATE_ACTIVE;
+			eth_current->active_start = get_timer(0);
 
 			return 0;
 		}
@@ -421,6 +424,8 @@ void eth_halt(void)
 
 	eth_current->halt(eth_current);
 
+	if (eth_current->state == ETH_STATE_ACTIVE)
+		eth_current->active_ms += get_timer(eth_current->active_start);
 	eth_current->state = ETH_STATE_PASSIVE;
 }
 
@@ -429,6 +434,9 @@ int eth_send(void *packet, int length)
 	if (!eth_current)
 		return -1;
 
+	eth_current->tx_packets++;
+	eth_current->tx_bytes += length;
+
 	return eth_current->send(eth_current, packet, length);
 }
 
@@ -440,6 +448,40 @@ int eth_rx(void)
 	return eth_current->recv(eth_current);
 }
 
+void eth_reset_stats(struct eth_device *dev)
+{
+	dev->tx_packets = 0;
+	dev->rx_packets = 0;
+	dev->tx_bytes = 0;
+	dev->rx_bytes = 0;
+	dev->active_ms = 0;
+	dev->active_start = get_timer(0);
+}
+
+void eth_print_stats(struct eth_device *dev)
+{
+	ulong ms = dev->active_ms;
+
+	if (dev->state == ETH_STATE_ACTIVE)
+		ms += get_timer(dev->active_start);
+
+	printf("%s:\n", dev->name);
+	printf("  rx: %lu packets, ", dev->rx_packets);
+	print_size(dev->rx_bytes, "");
+	printf("\n  tx: %lu packets, ", dev->tx_packets);
+	print_size(dev->tx_bytes, "");
+	printf("\n  active: %lu ms", ms);
+	if (ms) {
+		printf(", rx ");
+		print_size(lldiv(dev->rx_bytes * 1000, ms), "/s");
+		printf(" (%llu pkts/s), tx ",
+		       lldiv(dev->rx_packets * 1000ULL, ms));
+		print_size(lldiv(dev->tx_bytes * 1000, ms), "/s");
+		printf(" (%llu pkts/s)", lldiv(dev->tx_packets * 1000ULL, ms));
+	}
+	putc('\n');
+}
+
 #ifdef CONFIG_API
 static void eth_save_packet(void *packet, int length)
 {
@@ -83,6 +83,7 @@
 #include <common.h>
 #include <command.h>
 #include <environment.h>
+#include <malloc.h>
 #include <net.h>
 #if defined(CONFIG_STATUS_LED)
 #include <miiphy.h>
@@ -98,6 +99,9 @@
 #endif
 #include "link_local.h"
 #include "nfs.h"
+#ifdef CONFIG_NET_PARALLEL
+#include "parallel.h"
+#endif
 #include "ping.h"
 #include "rarp.h"
 #if defined(CONFIG_CMD_SNTP)
@@ -333,6 +337,10 @@ int NetLoop(enum proto_t protocol)
 
 	bootstage_mark_name(BOOTSTAGE_ID_ETH_START, "eth_start");
 	net_init();
+#ifdef CONFIG_NET_PARALLEL
+	if (protocol == NFS && getenv("ethparallel"))
+		return net_parallel_loop(protocol);
+#endif
 	if (eth_is_on_demand_init() || protocol != NETCONS) {
 		eth_halt();
 		eth_set_current();
@@ -592,6 +600,13 @@ void NetStartAgain(void)
 	int retry_forever = 0;
 	unsigned long retrycnt = 0;
 
+#ifdef CONFIG_NET_PARALLEL
+	/* Each interface only has its own part of the file to fetch */
+	if (net_parallel) {
+		net_set_state(NETLOOP_FAIL);
+		return;
+	}
+#endif
 	nretry = getenv("netretry");
 	if (nretry) {
 		if (!strcmp(nretry, "yes"))
@@ -631,6 +646,52 @@ void NetStartAgain(void)
 	}
 }
 
+#ifdef CONFIG_NET_PARALLEL
+void net_link_save(struct net_link *link)
+{
+	link->dev = eth_current;
+	memcpy(link->our_ether, NetOurEther, 6);
+	link->our_ip = NetOurIP;
+	link->server_ip = NetServerIP;
+	memcpy(link->server_ether, NetServerEther, 6);
+	link->tx_packet = NetTxPacket;
+	link->state = net_state;
+	link->xfer_size = NetBootFileXferSize;
+	link->time_handler = timeHandler;
+	link->time_start = timeStart;
+	link->time_delta = timeDelta;
+	arp_wait_save(&link->arp);
+}
+
+void net_link_load(const struct net_link *link)
+{
+	eth_current = link->dev;
+	memcpy(NetOurEther, link->our_ether, 6);
+	NetOurIP = link->our_ip;
+	NetServerIP = link->server_ip;
+	memcpy(NetServerEther, link->server_ether, 6);
+	NetTxPacket = link->tx_packet;
+	net_state = link->state;
+	NetBootFileXferSize = link->xfer_size;
+	timeHandler = link->time_handler;
+	timeStart = link->time_start;
+	timeDelta = link->time_delta;
+	arp_wait_load(&link->arp);
+}
+
+void net_link_poll(void)
+{
+	eth_rx();
+	ArpTimeoutCheck();
+	if (timeHandler && ((get_timer(0) - timeStart) > timeDelta)) {
+		thand_f *x = timeHandler;
+
+		timeHandler = (thand_f *)0;
+		(*x)();
+	}
+}
+#endif
+
 /**********************************************************************/
 /*
  *	Miscelaneous bits.
@@ -746,15 +807,23 @@ int NetSendUDPPacket(uchar *ether, IPaddr_t dest, int dport, int sport,
 
 #ifdef CONFIG_IP_DEFRAG
 /*
- * This function collects fragments in a single packet, according
- * to the algorithm in RFC815. It returns NULL or the pointer to
- * a complete packet, in static storage
+ * This function collects fragments according to the algorithm in RFC815.
+ * Several datagrams can be reassembled at the same time, each in its own
+ * slot of a small table: a large TFTP block may still be in flight when
+ * the server retransmits it, and NFS replies can overtake each other.
+ * A datagram whose fragments stop arriving is dropped after
+ * CONFIG_NET_DEFRAG_TIMEOUT ms, or earlier if its slot is needed for a
+ * new one. It returns NULL or the pointer to a complete packet, which
+ * stays valid until the next fragment is received.
  */
-#ifndef CONFIG_NET_MAXDEFRAG
-#define CONFIG_NET_MAXDEFRAG 16384
+#ifndef CONFIG_NET_DEFRAG_SLOTS
+#define CONFIG_NET_DEFRAG_SLOTS		4
+#endif
+#ifndef CONFIG_NET_DEFRAG_TIMEOUT
+#define CONFIG_NET_DEFRAG_TIMEOUT	2000
 #endif
 /*
- * MAXDEFRAG, above, is chosen in the config file and  is real data
+ * MAXDEFRAG is chosen in the config file and  is real data
  * so we need to add the NFS overhead, which is more than TFTP.
  * To use sizeof in the internal unnamed structures, we need a real
  * instance (can't do "sizeof(struct rpc_t.u.reply))", unfortunately).
@@ -766,134 +835,175 @@ static struct rpc_t rpc_specimen;
 #define IP_MAXUDP (IP_PKTSIZE - IP_HDR_SIZE)
 
 /*
- * this is the packet being assembled, either data or frag control.
- * Fragments go by 8 bytes, so this union must be 8 bytes long
+ * The holes of a datagram being assembled are kept as a linked list of
+ * descriptors stored in the payload buffer itself, at the start of each
+ * hole. Fragments go by 8 bytes, so this structure must be 8 bytes long
  */
 struct hole {
 	/* first_byte is address of this structure */
 	u16 last_byte;	/* last byte in this hole + 1 (begin of next hole) */
-	u16 next_hole;	/* index of next (in 8-b blocks), 0 == none */
-	u16 prev_hole;	/* index of prev, 0 == none */
-	u16 unused;
+	u16 next_hole;	/* index of next (in 8-b blocks), HOLE_NONE == none */
+	u32 unused;
 };
 
+#define HOLE_NONE	0xffff
+
+struct defrag_slot {
+	uchar *buf;		/* IP header followed by the payload */
+	ulong time;		/* get_timer() when the first fragment came */
+	u16 first_hole;		/* HOLE_NONE once all holes are filled */
+	u16 total_len;		/* payload size, 0 until the last fragment */
+	int used;
+};
+
+static struct defrag_slot defrag_slots[CONFIG_NET_DEFRAG_SLOTS];
+
+/*
+ * Find the slot collecting the datagram @ip belongs to, or set up a new
+ * one for it: a free or timed out slot if there is one, the oldest
+ * otherwise.
+ */
+static struct defrag_slot *defrag_get_slot(struct ip_udp_hdr *ip)
+{
+	struct defrag_slot *slot, *free = NULL, *oldest = NULL;
+	struct ip_udp_hdr *localip;
+	struct hole *payload;
+
+	for (slot = defrag_slots;
+	     slot < defrag_slots + CONFIG_NET_DEFRAG_SLOTS; slot++) {
+		if (slot->used &&
+		    get_timer(slot->time) > CONFIG_NET_DEFRAG_TIMEOUT) {
+			debug("defrag: datagram %d timed out\n",
+			      ntohs(((struct ip_udp_hdr *)slot->buf)->ip_id));
+			slot->used = 0;
+		}
+		if (!slot->used) {
+			if (!free)
+				free = slot;
+			continue;
+		}
+
+		localip = (struct ip_udp_hdr *)slot->buf;
+		if (localip->ip_id == ip->ip_id && localip->ip_p == ip->ip_p &&
+		    !memcmp(&localip->ip_src, &ip->ip_src,
+			    2 * sizeof(IPaddr_t)))
+			return slot;
+		if (!oldest || slot->time < oldest->time)
+			oldest = slot;
+	}
+
+	slot = free ? free : oldest;
+	if (!slot->buf) {
+		/* Room for a hole descriptor behind a ragged last fragment */
+		slot->buf = memalign(PKTALIGN, IP_PKTSIZE + sizeof(struct hole));
+		if (!slot->buf)
+			return NULL;
+	}
+
+	/* new packet, reset structs */
+	slot->used = 1;
+	slot->time = get_timer(0);
+	slot->total_len = 0;
+	slot->first_hole = 0;
+	payload = (struct hole *)(slot->buf + IP_HDR_SIZE);
+	payload[0].last_byte = ~0;
+	payload[0].next_hole = HOLE_NONE;
+	/* any IP header will work, copy the first we received */
+	memcpy(slot->buf, ip, IP_HDR_SIZE);
+
+	return slot;
+}
+
 static struct ip_udp_hdr *__NetDefragment(struct ip_udp_hdr *ip, int *lenp)
 {
-	static uchar pkt_buff[IP_PKTSIZE] __aligned(PKTALIGN);
-	static u16 first_hole, total_len;
-	struct hole *payload, *thisfrag, *h, *newh;
-	struct ip_udp_hdr *localip = (struct ip_udp_hdr *)pkt_buff;
+	struct defrag_slot *slot;
+	struct ip_udp_hdr *localip;
+	struct hole *payload, *h, *newh;
 	uchar *indata = (uchar *)ip;
-	int offset8, start, len, done = 0;
+	int start, end, len, hfirst, hlast, more;
 	u16 ip_off = ntohs(ip->ip_off);
+	u16 *link, idx;
 
-	/* payload starts after IP header, this fragment is in there */
-	payload = (struct hole *)(pkt_buff + IP_HDR_SIZE);
-	offset8 =  (ip_off & IP_OFFS);
-	thisfrag = payload + offset8;
-	start = offset8 * 8;
+	start = (ip_off & IP_OFFS) * 8;
 	len = ntohs(ip->ip_len) - IP_HDR_SIZE;
+	end = start + len;
+	more = ip_off & IP_FLAGS_MFRAG;
 
-	if (start + len > IP_MAXUDP) /* fragment extends too far */
+	if (len <= 0 || end > IP_MAXUDP) /* fragment extends too far */
+		return NULL;
+	if (more && (len & 7)) /* only the last fragment may be ragged */
 		return NULL;
 
-	if (!total_len || localip->ip_id != ip->ip_id) {
-		/* new (or different) packet, reset structs */
-		total_len = 0xffff;
-		payload[0].last_byte = ~0;
-		payload[0].next_hole = 0;
-		payload[0].prev_hole = 0;
-		first_hole = 0;
-		/* any IP header will work, copy the first we received */
-		memcpy(localip, ip, IP_HDR_SIZE);
-	}
-
-	/*
-	 * What follows is the reassembly algorithm. We use the payload
-	 * array as a linked list of hole descriptors, as each hole starts
-	 * at a multiple of 8 bytes. However, last byte can be whatever value,
-	 * so it is represented as byte count, not as 8-byte blocks.
-	 */
-
-	h = payload + first_hole;
-	while (h->last_byte < start) {
-		if (!h->next_hole) {
-			/* no hole that far away */
-			return NULL;
-		}
-		h = payload + h->next_hole;
-	}
-
-	/* last fragment may be 1..7 bytes, the "+7" forces acceptance */
-	if (offset8 + ((len + 7) / 8) <= h - payload) {
-		/* no overlap with holes (dup fragment?) */
+	slot = defrag_get_slot(ip);
+	if (!slot)
 		return NULL;
-	}
+	localip = (struct ip_udp_hdr *)slot->buf;
+	payload = (struct hole *)(slot->buf + IP_HDR_SIZE);
 
-	if (!(ip_off & IP_FLAGS_MFRAG)) {
-		/* no more fragmentss: truncate this (last) hole */
-		total_len = start + len;
-		h->last_byte = start + len;
+	if (slot->total_len &&
+	    (end > slot->total_len || (!more && end != slot->total_len))) {
+		/* disagrees with the last fragment we got: drop it all */
+		slot->used = 0;
+		return NULL;
 	}
+	if (!more)
+		slot->total_len = end;
 
 	/*
-	 * There is some overlap: fix the hole list. This code doesn't
-	 * deal with a fragment that overlaps with two different holes
-	 * (thus being a superset of a previously-received fragment).
+	 * What follows is the reassembly algorithm. Each hole starts at a
+	 * multiple of 8 bytes, but its last byte can be whatever value, so
+	 * it is represented as byte count, not as 8-byte blocks. A fragment
+	 * may fill several holes (e.g. a retransmission with a different
+	 * fragmentation), so walk the whole list: every hole touched by the
+	 * fragment is removed, and what is left of it before and after the
+	 * fragment is put back. The descriptor for the part after the
+	 * fragment can always be placed there, as only the last fragment
+	 * may end off the 8-byte grid.
 	 */
-
-	if ((h >= thisfrag) && (h->last_byte <= start + len)) {
-		/* complete overlap with hole: remove hole */
-		if (!h->prev_hole && !h->next_hole) {
-			/* last remaining hole */
-			done = 1;
-		} else if (!h->prev_hole) {
-			/* first hole */
-			first_hole = h->next_hole;
-			payload[h->next_hole].prev_hole = 0;
-		} else if (!h->next_hole) {
-			/* last hole */
-			payload[h->prev_hole].next_hole = 0;
-		} else {
-			/* in the middle of the list */
-			payload[h->next_hole].prev_hole = h->prev_hole;
-			payload[h->prev_hole].next_hole = h->next_hole;
+	link = &slot->first_hole;
+	while (*link != HOLE_NONE) {
+		idx = *link;
+		h = payload + idx;
+		hfirst = idx * 8;
+		hlast = h->last_byte;
+		if (!more && hlast > end)
+			hlast = end;	/* nothing past the last fragment */
+
+		if (hfirst < hlast && (end <= hfirst || start >= hlast)) {
+			/* no overlap with this hole */
+			h->last_byte = hlast;
+			link = &h->next_hole;
+			continue;
 		}
 
-	} else if (h->last_byte <= start + len) {
-		/* overlaps with final part of the hole: shorten this hole */
-		h->last_byte = start;
-
-	} else if (h >= thisfrag) {
-		/* overlaps with initial part of the hole: move this hole */
-		newh = thisfrag + (len / 8);
-		*newh = *h;
-		h = newh;
-		if (h->next_hole)
-			payload[h->next_hole].prev_hole = (h - payload);
-		if (h->prev_hole)
-			payload[h->prev_hole].next_hole = (h - payload);
-		else
-			first_hole = (h - payload);
-
-	} else {
-		/* fragment sits in the middle: split the hole */
-		newh = thisfrag + (len / 8);
-		*newh = *h;
-		h->last_byte = start;
-		h->next_hole = (newh - payload);
-		newh->prev_hole = (h - payload);
-		if (newh->next_hole)
-			payload[newh->next_hole].prev_hole = (newh - payload);
+		*link = h->next_hole;
+		if (hfirst >= hlast)
+			continue;
+		if (end < hlast) {
+			/* fragment ends inside the hole: keep the tail */
+			newh = payload + end / 8;
+			newh->last_byte = hlast;
+			newh->next_hole = *link;
+			*link = end / 8;
+		}
+		if (start > hfirst) {
+			/* fragment starts inside the hole: keep the head */
+			h->last_byte = start;
+			h->next_hole = *link;
+			*link = idx;
+		}
+		/* the pieces put back don't overlap, they get skipped */
 	}
 
 	/* finally copy this fragment and possibly return whole packet */
-	memcpy((uchar *)thisfrag, indata + IP_HDR_SIZE, len);
-	if (!done)
+	memcpy((uchar *)payload + start, indata + IP_HDR_SIZE, len);
+	if (slot->first_hole != HOLE_NONE)
 		return NULL;
 
-	localip->ip_len = htons(total_len);
-	*lenp = total_len + IP_HDR_SIZE;
+	slot->used = 0;
+	localip->ip_len = htons(slot->total_len + IP_HDR_SIZE);
+	localip->ip_off = 0;
+	*lenp = slot->total_len + IP_HDR_SIZE;
 	return localip;
 }
 
@@ -948,6 +1058,19 @@ static void receive_icmp(struct ip_udp_hdr *ip, int len,
 	}
 }
 
+/*
+ * Set while processing a frame whose IPv4 header and UDP checksums
+ * were already verified by the ethernet controller.
+ */
+static int net_rx_csum_ok;
+
+void NetReceiveCsumOk(uchar *inpkt, int len)
+{
+	net_rx_csum_ok = 1;
+	NetReceive(inpkt, len);
+	net_rx_csum_ok = 0;
+}
+
 void
 NetReceive(uchar *inpkt, int len)
 {
@@ -967,6 +1090,11 @@ NetReceive(uchar *inpkt, int len)
 	NetRxPacketLen = len;
 	et = (struct ethernet_hdr *)inpkt;
 
+	if (eth_get_dev()) {
+		eth_get_dev()->rx_packets++;
+		eth_get_dev()->rx_bytes += len;
+	}
+
 	/* too small packet? */
 	if (len < ETHER_HDR_SIZE)
 		return;
@@ -1085,7 +1213,8 @@ NetReceive(uchar *inpkt, int len)
 		if ((ip->ip_hl_v & 0x0f) > 0x05)
 			return;
 		/* Check the Checksum of the header */
-		if (!NetCksumOk((uchar *)ip, IP_HDR_SIZE / 2)) {
+		if (!net_rx_csum_ok &&
+		    !NetCksumOk((uchar *)ip, IP_HDR_SIZE / 2)) {
 			debug("checksum bad\n");
 			return;
 		}
@@ -1104,6 +1233,9 @@ NetReceive(uchar *inpkt, int len)
 		 * a fragment, and either the complete packet or NULL if
 		 * it is a fragment (if !CONFIG_IP_DEFRAG, it returns NULL)
 		 */
+		/* The MAC cannot check the payload of a fragmented datagram */
+		if (ntohs(ip->ip_off) & (IP_OFFS | IP_FLAGS_MFRAG))
+			net_rx_csum_ok = 0;
 		ip = NetDefragment(ip, &len);
 		if (!ip)
 			return;
@@ -1140,9 +1272,8 @@ NetReceive(uchar *inpkt, int len)
 			&dst_ip, &src_ip, len);
 
 #ifdef CONFIG_UDP_CHECKSUM
-		if (ip->udp_xsum != 0) {
+		if (ip->udp_xsum != 0 && !net_rx_csum_ok) {
 			ulong   xsum;
-			ushort *sumptr;
 			ushort  sumlen;
 
 			xsum  = ip->ip_p;
@@ -1153,19 +1284,13 @@ NetReceive(uchar *inpkt, int len)
 			xsum += (ntohl(ip->ip_dst) >>  0) & 0x0000ffff;
 
 			sumlen = ntohs(ip->udp_len);
-			sumptr = (ushort *) &(ip->udp_src);
-
-			while (sumlen > 1) {
+			/* ones' complement sums are byte order independent */
+			xsum += ntohs(NetCksum((uchar *)&ip->udp_src,
+					       sumlen / 2));
+			if (sumlen & 1) {
 				ushort sumdata;
 
-				sumdata = *sumptr++;
-				xsum += ntohs(sumdata);
-				sumlen -= 2;
-			}
-			if (sumlen > 0) {
-				ushort sumdata;
-
-				sumdata = *(unsigned char *) sumptr;
+				sumdata = *((uchar *)&ip->udp_src + sumlen - 1);
 				sumdata = (sumdata << 8) & 0xff00;
 				xsum += sumdata;
 			}
@@ -1289,27 +1414,6 @@ common:
 }
 /**********************************************************************/
 
-int
-NetCksumOk(uchar *ptr, int len)
-{
-	return !((NetCksum(ptr, len) + 1) & 0xfffe);
-}
-
-
-unsigned
-NetCksum(uchar *ptr, int len)
-{
-	ulong	xsum;
-	ushort *p = (ushort *)ptr;
-
-	xsum = 0;
-	while (len-- > 0)
-		xsum += *p++;
-	xsum = (xsum & 0xffff) + (xsum >> 16);
-	xsum = (xsum & 0xffff) + (xsum >> 16);
-	return xsum & 0xffff;
-}
-
 int
 NetEthHdrSize(void)
 {
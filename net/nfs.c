@@ -26,6 +26,7 @@
 #include <command.h>
 #include <net.h>
 #include <malloc.h>
+#include <asm/io.h>
 #include "nfs.h"
 #include "bootp.h"
 
@@ -40,22 +41,8 @@
 #define NFS_RPC_ERR	1
 #define NFS_RPC_DROP	124
 
-static int fs_mounted;
-static unsigned long rpc_id;
-static int nfs_offset = -1;
-static int nfs_len;
 static ulong nfs_timeout = NFS_TIMEOUT;
 
-static char dirfh[NFS_FHSIZE];	/* file handle of directory */
-static char filefh[NFS_FHSIZE]; /* file handle of kernel image */
-
-static enum net_loop_state nfs_download_state;
-static IPaddr_t NfsServerIP;
-static int	NfsSrvMountPort;
-static int	NfsSrvNfsPort;
-static int	NfsOurPort;
-static int	NfsTimeoutCount;
-static int	NfsState;
 #define STATE_PRCLOOKUP_PROG_MOUNT_REQ	1
 #define STATE_PRCLOOKUP_PROG_NFS_REQ	2
 #define STATE_MOUNT_REQ			3
@@ -64,10 +51,43 @@ static int	NfsState;
 #define STATE_READ_REQ			6
 #define STATE_READLINK_REQ		7
 
+/*
+ * The state of a download. A parallel one (CONFIG_NET_PARALLEL) has one
+ * on each interface, each of them fetching its part of the file.
+ */
+struct nfs_session {
+	int fs_mounted;
+	unsigned long rpc_id;
+	int offset;
+	int len;
+	int end;		/* where our part of the file ends, -1 for EOF */
+	int part;		/* the part of the file we fetch */
+	int parts;		/* out of how many */
+	int size;		/* size of the file, from its lookup */
+
+	char dirfh[NFS_FHSIZE];	/* file handle of directory */
+	char filefh[NFS_FHSIZE]; /* file handle of kernel image */
+
+	enum net_loop_state download_state;
+	IPaddr_t server_ip;
+	int srv_mount_port;
+	int srv_nfs_port;
+	int our_port;
+	int timeout_count;
+	int state;
+
+	char *filename;
+	char *path;
+	char path_buff[2048];
+};
+
+static struct nfs_session nfs_default = {
+	.offset = -1,
+	.parts = 1,
+};
+static struct nfs_session *nfs = &nfs_default;
+
 static char default_filename[64];
-static char *nfs_filename;
-static char *nfs_path;
-static char nfs_path_buff[2048];
 
 static inline int
 store_block(uchar *src, unsigned offset, unsigned len)
@@ -92,8 +112,17 @@ store_block(uchar *src, unsigned offset, unsigned len)
 		}
 	} else
 #endif /* CONFIG_SYS_DIRECT_FLASH_NFS */
+#ifdef CONFIG_CMD_NETSINK
+	if (net_sink_active()) {
+		if (net_sink_write(offset, src, len))
+			return -1;
+	} else
+#endif
 	{
-		(void)memcpy((void *)(load_addr + offset), src, len);
+		void *ptr = map_sysmem(load_addr + offset, len);
+
+		memcpy(ptr, src, len);
+		unmap_sysmem(ptr);
 	}
 
 	if (NetBootFileXferSize < (offset+len))
@@ -131,7 +160,7 @@ dirname(char *path)
 /**************************************************************************
 RPC_ADD_CREDENTIALS - Add RPC authentication/verifier entries
 **************************************************************************/
-static long *rpc_add_credentials(long *p)
+static uint32_t *rpc_add_credentials(uint32_t *p)
 {
 	int hl;
 	int hostnamelen;
@@ -183,7 +212,7 @@ rpc_req(int rpc_prog, int rpc_proc, uint32_t *data, int datalen)
 	int pktlen;
 	int sport;
 
-	id = ++rpc_id;
+	id = ++nfs->rpc_id;
 	pkt.u.call.id = htonl(id);
 	pkt.u.call.type = htonl(MSG_CALL);
 	pkt.u.call.rpcvers = htonl(2);	/* use RPC version 2 */
@@ -203,11 +232,11 @@ rpc_req(int rpc_prog, int rpc_proc, uint32_t *data, int datalen)
 	if (rpc_prog == PROG_PORTMAP)
 		sport = SUNRPC_PORT;
 	else if (rpc_prog == PROG_MOUNT)
-		sport = NfsSrvMountPort;
+		sport = nfs->srv_mount_port;
 	else
-		sport = NfsSrvNfsPort;
+		sport = nfs->srv_nfs_port;
 
-	NetSendUDPPacket(NetServerEther, NfsServerIP, sport, NfsOurPort,
+	NetSendUDPPacket(NetServerEther, nfs->server_ip, sport, nfs->our_port,
 		pktlen);
 }
 
@@ -243,7 +272,7 @@ nfs_mount_req(char *path)
 	pathlen = strlen(path);
 
 	p = &(data[0]);
-	p = (uint32_t *)rpc_add_credentials((long *)p);
+	p = rpc_add_credentials(p);
 
 	*p++ = htonl(pathlen);
 	if (pathlen & 3)
@@ -266,12 +295,12 @@ nfs_umountall_req(void)
 	uint32_t *p;
 	int len;
 
-	if ((NfsSrvMountPort == -1) || (!fs_mounted))
+	if ((nfs->srv_mount_port == -1) || (!nfs->fs_mounted))
 		/* Nothing mounted, nothing to umount */
 		return;
 
 	p = &(data[0]);
-	p = (uint32_t *)rpc_add_credentials((long *)p);
+	p = rpc_add_credentials(p);
 
 	len = (uint32_t *)p - (uint32_t *)&(data[0]);
 
@@ -293,9 +322,9 @@ nfs_readlink_req(void)
 	int len;
 
 	p = &(data[0]);
-	p = (uint32_t *)rpc_add_credentials((long *)p);
+	p = rpc_add_credentials(p);
 
-	memcpy(p, filefh, NFS_FHSIZE);
+	memcpy(p, nfs->filefh, NFS_FHSIZE);
 	p += (NFS_FHSIZE / 4);
 
 	len = (uint32_t *)p - (uint32_t *)&(data[0]);
@@ -317,9 +346,9 @@ nfs_lookup_req(char *fname)
 	fnamelen = strlen(fname);
 
 	p = &(data[0]);
-	p = (uint32_t *)rpc_add_credentials((long *)p);
+	p = rpc_add_credentials(p);
 
-	memcpy(p, dirfh, NFS_FHSIZE);
+	memcpy(p, nfs->dirfh, NFS_FHSIZE);
 	p += (NFS_FHSIZE / 4);
 	*p++ = htonl(fnamelen);
 	if (fnamelen & 3)
@@ -343,9 +372,9 @@ nfs_read_req(int offset, int readlen)
 	int len;
 
 	p = &(data[0]);
-	p = (uint32_t *)rpc_add_credentials((long *)p);
+	p = rpc_add_credentials(p);
 
-	memcpy(p, filefh, NFS_FHSIZE);
+	memcpy(p, nfs->filefh, NFS_FHSIZE);
 	p += (NFS_FHSIZE / 4);
 	*p++ = htonl(offset);
 	*p++ = htonl(readlen);
@@ -365,7 +394,7 @@ NfsSend(void)
 {
 	debug("%s\n", __func__);
 
-	switch (NfsState) {
+	switch (nfs->state) {
 	case STATE_PRCLOOKUP_PROG_MOUNT_REQ:
 		rpc_lookup_req(PROG_MOUNT, 1);
 		break;
@@ -373,16 +402,16 @@ NfsSend(void)
 		rpc_lookup_req(PROG_NFS, 2);
 		break;
 	case STATE_MOUNT_REQ:
-		nfs_mount_req(nfs_path);
+		nfs_mount_req(nfs->path);
 		break;
 	case STATE_UMOUNT_REQ:
 		nfs_umountall_req();
 		break;
 	case STATE_LOOKUP_REQ:
-		nfs_lookup_req(nfs_filename);
+		nfs_lookup_req(nfs->filename);
 		break;
 	case STATE_READ_REQ:
-		nfs_read_req(nfs_offset, nfs_len);
+		nfs_read_req(nfs->offset, nfs->len);
 		break;
 	case STATE_READLINK_REQ:
 		nfs_readlink_req();
@@ -403,9 +432,9 @@ rpc_lookup_reply(int prog, uchar *pkt, unsigned len)
 
 	debug("%s\n", __func__);
 
-	if (ntohl(rpc_pkt.u.reply.id) > rpc_id)
+	if (ntohl(rpc_pkt.u.reply.id) > nfs->rpc_id)
 		return -NFS_RPC_ERR;
-	else if (ntohl(rpc_pkt.u.reply.id) < rpc_id)
+	else if (ntohl(rpc_pkt.u.reply.id) < nfs->rpc_id)
 		return -NFS_RPC_DROP;
 
 	if (rpc_pkt.u.reply.rstatus  ||
@@ -415,10 +444,10 @@ rpc_lookup_reply(int prog, uchar *pkt, unsigned len)
 
 	switch (prog) {
 	case PROG_MOUNT:
-		NfsSrvMountPort = ntohl(rpc_pkt.u.reply.data[0]);
+		nfs->srv_mount_port = ntohl(rpc_pkt.u.reply.data[0]);
 		break;
 	case PROG_NFS:
-		NfsSrvNfsPort = ntohl(rpc_pkt.u.reply.data[0]);
+		nfs->srv_nfs_port = ntohl(rpc_pkt.u.reply.data[0]);
 		break;
 	}
 
@@ -434,9 +463,9 @@ nfs_mount_reply(uchar *pkt, unsigned len)
 
 	memcpy((unsigned char *)&rpc_pkt, pkt, len);
 
-	if (ntohl(rpc_pkt.u.reply.id) > rpc_id)
+	if (ntohl(rpc_pkt.u.reply.id) > nfs->rpc_id)
 		return -NFS_RPC_ERR;
-	else if (ntohl(rpc_pkt.u.reply.id) < rpc_id)
+	else if (ntohl(rpc_pkt.u.reply.id) < nfs->rpc_id)
 		return -NFS_RPC_DROP;
 
 	if (rpc_pkt.u.reply.rstatus  ||
@@ -445,8 +474,8 @@ nfs_mount_reply(uchar *pkt, unsigned len)
 	    rpc_pkt.u.reply.data[0])
 		return -1;
 
-	fs_mounted = 1;
-	memcpy(dirfh, rpc_pkt.u.reply.data + 1, NFS_FHSIZE);
+	nfs->fs_mounted = 1;
+	memcpy(nfs->dirfh, rpc_pkt.u.reply.data + 1, NFS_FHSIZE);
 
 	return 0;
 }
@@ -460,9 +489,9 @@ nfs_umountall_reply(uchar *pkt, unsigned len)
 
 	memcpy((unsigned char *)&rpc_pkt, pkt, len);
 
-	if (ntohl(rpc_pkt.u.reply.id) > rpc_id)
+	if (ntohl(rpc_pkt.u.reply.id) > nfs->rpc_id)
 		return -NFS_RPC_ERR;
-	else if (ntohl(rpc_pkt.u.reply.id) < rpc_id)
+	else if (ntohl(rpc_pkt.u.reply.id) < nfs->rpc_id)
 		return -NFS_RPC_DROP;
 
 	if (rpc_pkt.u.reply.rstatus  ||
@@ -470,8 +499,8 @@ nfs_umountall_reply(uchar *pkt, unsigned len)
 	    rpc_pkt.u.reply.astatus)
 		return -1;
 
-	fs_mounted = 0;
-	memset(dirfh, 0, sizeof(dirfh));
+	nfs->fs_mounted = 0;
+	memset(nfs->dirfh, 0, sizeof(nfs->dirfh));
 
 	return 0;
 }
@@ -485,9 +514,9 @@ nfs_lookup_reply(uchar *pkt, unsigned len)
 
 	memcpy((unsigned char *)&rpc_pkt, pkt, len);
 
-	if (ntohl(rpc_pkt.u.reply.id) > rpc_id)
+	if (ntohl(rpc_pkt.u.reply.id) > nfs->rpc_id)
 		return -NFS_RPC_ERR;
-	else if (ntohl(rpc_pkt.u.reply.id) < rpc_id)
+	else if (ntohl(rpc_pkt.u.reply.id) < nfs->rpc_id)
 		return -NFS_RPC_DROP;
 
 	if (rpc_pkt.u.reply.rstatus  ||
@@ -496,7 +525,9 @@ nfs_lookup_reply(uchar *pkt, unsigned len)
 	    rpc_pkt.u.reply.data[0])
 		return -1;
 
-	memcpy(filefh, rpc_pkt.u.reply.data + 1, NFS_FHSIZE);
+	memcpy(nfs->filefh, rpc_pkt.u.reply.data + 1, NFS_FHSIZE);
+	/* The file handle is followed by type, mode, nlink, uid, gid, size */
+	nfs->size = ntohl(rpc_pkt.u.reply.data[1 + NFS_FHSIZE / 4 + 5]);
 
 	return 0;
 }
@@ -511,9 +542,9 @@ nfs_readlink_reply(uchar *pkt, unsigned len)
 
 	memcpy((unsigned char *)&rpc_pkt, pkt, len);
 
-	if (ntohl(rpc_pkt.u.reply.id) > rpc_id)
+	if (ntohl(rpc_pkt.u.reply.id) > nfs->rpc_id)
 		return -NFS_RPC_ERR;
-	else if (ntohl(rpc_pkt.u.reply.id) < rpc_id)
+	else if (ntohl(rpc_pkt.u.reply.id) < nfs->rpc_id)
 		return -NFS_RPC_DROP;
 
 	if (rpc_pkt.u.reply.rstatus  ||
@@ -526,14 +557,14 @@ nfs_readlink_reply(uchar *pkt, unsigned len)
 
 	if (*((char *)&(rpc_pkt.u.reply.data[2])) != '/') {
 		int pathlen;
-		strcat(nfs_path, "/");
-		pathlen = strlen(nfs_path);
-		memcpy(nfs_path + pathlen, (uchar *)&(rpc_pkt.u.reply.data[2]),
+		strcat(nfs->path, "/");
+		pathlen = strlen(nfs->path);
+		memcpy(nfs->path + pathlen, (uchar *)&(rpc_pkt.u.reply.data[2]),
 			rlen);
-		nfs_path[pathlen + rlen] = 0;
+		nfs->path[pathlen + rlen] = 0;
 	} else {
-		memcpy(nfs_path, (uchar *)&(rpc_pkt.u.reply.data[2]), rlen);
-		nfs_path[rlen] = 0;
+		memcpy(nfs->path, (uchar *)&(rpc_pkt.u.reply.data[2]), rlen);
+		nfs->path[rlen] = 0;
 	}
 	return 0;
 }
@@ -548,9 +579,9 @@ nfs_read_reply(uchar *pkt, unsigned len)
 
 	memcpy((uchar *)&rpc_pkt, pkt, sizeof(rpc_pkt.u.reply));
 
-	if (ntohl(rpc_pkt.u.reply.id) > rpc_id)
+	if (ntohl(rpc_pkt.u.reply.id) > nfs->rpc_id)
 		return -NFS_RPC_ERR;
-	else if (ntohl(rpc_pkt.u.reply.id) < rpc_id)
+	else if (ntohl(rpc_pkt.u.reply.id) < nfs->rpc_id)
 		return -NFS_RPC_DROP;
 
 	if (rpc_pkt.u.reply.rstatus  ||
@@ -564,20 +595,47 @@ nfs_read_reply(uchar *pkt, unsigned len)
 		return -ntohl(rpc_pkt.u.reply.data[0]);
 	}
 
-	if ((nfs_offset != 0) && !((nfs_offset) %
+	if ((nfs->offset != 0) && !((nfs->offset) %
 			(NFS_READ_SIZE / 2 * 10 * HASHES_PER_LINE)))
 		puts("\n\t ");
-	if (!(nfs_offset % ((NFS_READ_SIZE / 2) * 10)))
+	if (!(nfs->offset % ((NFS_READ_SIZE / 2) * 10)))
 		putc('#');
 
 	rlen = ntohl(rpc_pkt.u.reply.data[18]);
 	if (store_block((uchar *)pkt + sizeof(rpc_pkt.u.reply),
-			nfs_offset, rlen))
+			nfs->offset, rlen))
 		return -9999;
 
 	return rlen;
 }
 
+/*
+ * Start reading our part of the file: all of it, or for a parallel
+ * download, a run of blocks ending where the next part starts
+ */
+static void nfs_start_read(void)
+{
+	int blocks = DIV_ROUND_UP(nfs->size, NFS_READ_SIZE);
+
+	nfs->state = STATE_READ_REQ;
+	nfs->offset = 0;
+	nfs->end = -1;
+	nfs->len = NFS_READ_SIZE;
+	if (nfs->parts == 1)
+		return;
+
+	nfs->offset = blocks * nfs->part / nfs->parts * NFS_READ_SIZE;
+	if (nfs->part < nfs->parts - 1) {
+		nfs->end = blocks * (nfs->part + 1) / nfs->parts *
+			NFS_READ_SIZE;
+		if (nfs->offset == nfs->end) {
+			/* The file is too small to have a part for us */
+			nfs->download_state = NETLOOP_SUCCESS;
+			nfs->state = STATE_UMOUNT_REQ;
+		}
+	}
+}
+
 /**************************************************************************
 Interfaces of U-BOOT
 **************************************************************************/
@@ -585,12 +643,12 @@ Interfaces of U-BOOT
 static void
 NfsTimeout(void)
 {
-	if (++NfsTimeoutCount > NFS_RETRY_COUNT) {
+	if (++nfs->timeout_count > NFS_RETRY_COUNT) {
 		puts("\nRetry count exceeded; starting again\n");
 		NetStartAgain();
 	} else {
 		puts("T ");
-		NetSetTimeout(nfs_timeout + NFS_TIMEOUT * NfsTimeoutCount,
+		NetSetTimeout(nfs_timeout + NFS_TIMEOUT * nfs->timeout_count,
 			      NfsTimeout);
 		NfsSend();
 	}
@@ -604,21 +662,21 @@ NfsHandler(uchar *pkt, unsigned dest, IPaddr_t sip, unsigned src, unsigned len)
 
 	debug("%s\n", __func__);
 
-	if (dest != NfsOurPort)
+	if (dest != nfs->our_port)
 		return;
 
-	switch (NfsState) {
+	switch (nfs->state) {
 	case STATE_PRCLOOKUP_PROG_MOUNT_REQ:
 		if (rpc_lookup_reply(PROG_MOUNT, pkt, len) == -NFS_RPC_DROP)
 			break;
-		NfsState = STATE_PRCLOOKUP_PROG_NFS_REQ;
+		nfs->state = STATE_PRCLOOKUP_PROG_NFS_REQ;
 		NfsSend();
 		break;
 
 	case STATE_PRCLOOKUP_PROG_NFS_REQ:
 		if (rpc_lookup_reply(PROG_NFS, pkt, len) == -NFS_RPC_DROP)
 			break;
-		NfsState = STATE_MOUNT_REQ;
+		nfs->state = STATE_MOUNT_REQ;
 		NfsSend();
 		break;
 
@@ -629,10 +687,10 @@ NfsHandler(uchar *pkt, unsigned dest, IPaddr_t sip, unsigned src, unsigned len)
 		else if (reply == -NFS_RPC_ERR) {
 			puts("*** ERROR: Cannot mount\n");
 			/* just to be sure... */
-			NfsState = STATE_UMOUNT_REQ;
+			nfs->state = STATE_UMOUNT_REQ;
 			NfsSend();
 		} else {
-			NfsState = STATE_LOOKUP_REQ;
+			nfs->state = STATE_LOOKUP_REQ;
 			NfsSend();
 		}
 		break;
@@ -646,7 +704,7 @@ NfsHandler(uchar *pkt, unsigned dest, IPaddr_t sip, unsigned src, unsigned len)
 			net_set_state(NETLOOP_FAIL);
 		} else {
 			puts("\ndone\n");
-			net_set_state(nfs_download_state);
+			net_set_state(nfs->download_state);
 		}
 		break;
 
@@ -656,12 +714,10 @@ NfsHandler(uchar *pkt, unsigned dest, IPaddr_t sip, unsigned src, unsigned len)
 			break;
 		else if (reply == -NFS_RPC_ERR) {
 			puts("*** ERROR: File lookup fail\n");
-			NfsState = STATE_UMOUNT_REQ;
+			nfs->state = STATE_UMOUNT_REQ;
 			NfsSend();
 		} else {
-			NfsState = STATE_READ_REQ;
-			nfs_offset = 0;
-			nfs_len = NFS_READ_SIZE;
+			nfs_start_read();
 			NfsSend();
 		}
 		break;
@@ -672,14 +728,14 @@ NfsHandler(uchar *pkt, unsigned dest, IPaddr_t sip, unsigned src, unsigned len)
 			break;
 		else if (reply == -NFS_RPC_ERR) {
 			puts("*** ERROR: Symlink fail\n");
-			NfsState = STATE_UMOUNT_REQ;
+			nfs->state = STATE_UMOUNT_REQ;
 			NfsSend();
 		} else {
-			debug("Symlink --> %s\n", nfs_path);
-			nfs_filename = basename(nfs_path);
-			nfs_path     = dirname(nfs_path);
+			debug("Symlink --> %s\n", nfs->path);
+			nfs->filename = basename(nfs->path);
+			nfs->path     = dirname(nfs->path);
 
-			NfsState = STATE_MOUNT_REQ;
+			nfs->state = STATE_MOUNT_REQ;
 			NfsSend();
 		}
 		break;
@@ -688,16 +744,25 @@ NfsHandler(uchar *pkt, unsigned dest, IPaddr_t sip, unsigned src, unsigned len)
 		rlen = nfs_read_reply(pkt, len);
 		NetSetTimeout(nfs_timeout, NfsTimeout);
 		if (rlen > 0) {
-			nfs_offset += rlen;
+			nfs->offset += rlen;
+			if (nfs->end != -1 && nfs->offset >= nfs->end) {
+				nfs->download_state = NETLOOP_SUCCESS;
+				nfs->state = STATE_UMOUNT_REQ;
+			}
 			NfsSend();
+#ifdef CONFIG_CMD_NETSINK
+			/* Program the device while the next reply is on its way */
+			if (net_sink_poll())
+				net_set_state(NETLOOP_FAIL);
+#endif
 		} else if ((rlen == -NFSERR_ISDIR) || (rlen == -NFSERR_INVAL)) {
 			/* symbolic link */
-			NfsState = STATE_READLINK_REQ;
+			nfs->state = STATE_READLINK_REQ;
 			NfsSend();
 		} else {
 			if (!rlen)
-				nfs_download_state = NETLOOP_SUCCESS;
-			NfsState = STATE_UMOUNT_REQ;
+				nfs->download_state = NETLOOP_SUCCESS;
+			nfs->state = STATE_UMOUNT_REQ;
 			NfsSend();
 		}
 		break;
@@ -709,12 +774,12 @@ void
 NfsStart(void)
 {
 	debug("%s\n", __func__);
-	nfs_download_state = NETLOOP_FAIL;
+	nfs->download_state = NETLOOP_FAIL;
 
-	NfsServerIP = NetServerIP;
-	nfs_path = (char *)nfs_path_buff;
+	nfs->server_ip = NetServerIP;
+	nfs->path = (char *)nfs->path_buff;
 
-	if (nfs_path == NULL) {
+	if (nfs->path == NULL) {
 		net_set_state(NETLOOP_FAIL);
 		puts("*** ERROR: Fail allocate memory\n");
 		return;
@@ -726,31 +791,31 @@ NfsStart(void)
 			(NetOurIP >>  8) & 0xFF,
 			(NetOurIP >> 16) & 0xFF,
 			(NetOurIP >> 24) & 0xFF);
-		strcpy(nfs_path, default_filename);
+		strcpy(nfs->path, default_filename);
 
 		printf("*** Warning: no boot file name; using '%s'\n",
-			nfs_path);
+			nfs->path);
 	} else {
 		char *p = BootFile;
 
 		p = strchr(p, ':');
 
 		if (p != NULL) {
-			NfsServerIP = string_to_ip(BootFile);
+			nfs->server_ip = string_to_ip(BootFile);
 			++p;
-			strcpy(nfs_path, p);
+			strcpy(nfs->path, p);
 		} else {
-			strcpy(nfs_path, BootFile);
+			strcpy(nfs->path, BootFile);
 		}
 	}
 
-	nfs_filename = basename(nfs_path);
-	nfs_path     = dirname(nfs_path);
+	nfs->filename = basename(nfs->path);
+	nfs->path     = dirname(nfs->path);
 
 	printf("Using %s device\n", eth_get_name());
 
 	printf("File transfer via NFS from server %pI4"
-		"; our IP address is %pI4", &NfsServerIP, &NetOurIP);
+		"; our IP address is %pI4", &nfs->server_ip, &NetOurIP);
 
 	/* Check if we need to send across this subnet */
 	if (NetOurGatewayIP && NetOurSubnetMask) {
@@ -761,7 +826,9 @@ NfsStart(void)
 			printf("; sending through gateway %pI4",
 				&NetOurGatewayIP);
 	}
-	printf("\nFilename '%s/%s'.", nfs_path, nfs_filename);
+	printf("\nFilename '%s/%s'.", nfs->path, nfs->filename);
+	if (nfs->parts > 1)
+		printf(" Part %d of %d.", nfs->part + 1, nfs->parts);
 
 	if (NetBootFileSize) {
 		printf(" Size is 0x%x Bytes = ", NetBootFileSize<<9);
@@ -773,15 +840,37 @@ NfsStart(void)
 	NetSetTimeout(nfs_timeout, NfsTimeout);
 	net_set_udp_handler(NfsHandler);
 
-	NfsTimeoutCount = 0;
-	NfsState = STATE_PRCLOOKUP_PROG_MOUNT_REQ;
+	nfs->timeout_count = 0;
+	nfs->state = STATE_PRCLOOKUP_PROG_MOUNT_REQ;
 
-	/*NfsOurPort = 4096 + (get_ticks() % 3072);*/
+	/*nfs->our_port = 4096 + (get_ticks() % 3072);*/
 	/*FIX ME !!!*/
-	NfsOurPort = 1000;
+	nfs->our_port = 1000;
 
 	/* zero out server ether in case the server ip has changed */
 	memset(NetServerEther, 0, 6);
 
 	NfsSend();
 }
+
+#ifdef CONFIG_NET_PARALLEL
+/* A download of part @part of @parts of the file, for NfsStart() */
+struct nfs_session *nfs_new_session(int part, int parts)
+{
+	struct nfs_session *session = calloc(1, sizeof(*session));
+
+	if (session) {
+		session->offset = -1;
+		session->part = part;
+		session->parts = parts;
+	}
+
+	return session;
+}
+
+/* Make @session the current download, NULL for the usual one */
+void nfs_set_session(struct nfs_session *session)
+{
+	nfs = session ? session : &nfs_default;
+}
+#endif
@@ -71,6 +71,13 @@ struct rpc_t {
 };
 extern void NfsStart(void);	/* Begin NFS */
 
+#ifdef CONFIG_NET_PARALLEL
+struct nfs_session;
+
+struct nfs_session *nfs_new_session(int part, int parts);
+void nfs_set_session(struct nfs_session *session);
+#endif
+
 
 /**********************************************************************/
 
@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Download of one file over several network interfaces at once. Each
+ * interface fetches its own range of the file into the load address,
+ * so the parts land in one buffer. Only NFS can read a range of a file,
+ * so TFTP downloads still use a single interface.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <div64.h>
+#include <malloc.h>
+#include <net.h>
+#include <watchdog.h>
+#include "nfs.h"
+#include "parallel.h"
+
+DECLARE_GLOBAL_DATA_PTR;
+
+#ifndef CONFIG_NET_PARALLEL_MAX
+#define CONFIG_NET_PARALLEL_MAX	4
+#endif
+
+int net_parallel;
+
+/* An address for the interface with index @index, e.g. "eth1ipaddr" */
+static IPaddr_t parallel_getenv_ip(const char *name, int index)
+{
+	char var[20];
+	IPaddr_t ip = 0;
+
+	if (index) {
+		sprintf(var, "eth%d%s", index, name);
+		ip = getenv_IPaddr(var);
+	}
+	if (!ip) {
+		strcpy(var, name);
+		ip = getenv_IPaddr(var);
+	}
+
+	return ip;
+}
+
+/* Look up the devices in the "ethparallel" list, return how many */
+static int parallel_get_devs(struct eth_device **devs)
+{
+	char list[CONFIG_NET_PARALLEL_MAX * 16], *next, *name;
+	int count = 0;
+
+	snprintf(list, sizeof(list), "%s", getenv("ethparallel"));
+	next = list;
+	while ((name = strsep(&next, " ,")) != NULL) {
+		if (!*name)
+			continue;
+		if (count == CONFIG_NET_PARALLEL_MAX) {
+			printf("*** ERROR: More than %d interfaces\n",
+			       CONFIG_NET_PARALLEL_MAX);
+			return -1;
+		}
+		devs[count] = eth_get_dev_by_name(name);
+		if (!devs[count]) {
+			printf("*** ERROR: No ethernet device '%s'\n", name);
+			return -1;
+		}
+		count++;
+	}
+	if (!count)
+		puts("*** ERROR: No interfaces in 'ethparallel'\n");
+
+	return count ? count : -1;
+}
+
+/* Start the download of part @part of @parts over @dev */
+static int parallel_start(struct net_link *link, struct eth_device *dev,
+			  int part, int parts)
+{
+	struct arp_wait arp_idle = { 0 };
+
+	link->tx_packet = memalign(PKTALIGN, PKTSIZE_ALIGN);
+	link->nfs = nfs_new_session(part, parts);
+	if (!link->tx_packet || !link->nfs) {
+		puts("*** ERROR: Fail allocate memory\n");
+		return -1;
+	}
+
+	eth_current = dev;
+	NetTxPacket = link->tx_packet;
+	NetOurIP = parallel_getenv_ip("ipaddr", dev->index);
+	NetServerIP = parallel_getenv_ip("serverip", dev->index);
+	NetBootFileXferSize = 0;
+	arp_wait_load(&arp_idle);
+	net_set_state(NETLOOP_CONTINUE);
+	NetSetTimeout(0, NULL);
+	if (!NetOurIP || !NetServerIP) {
+		printf("*** ERROR: No IP addresses for %s\n", dev->name);
+		return -1;
+	}
+
+	if (eth_init(gd->bd) < 0 || eth_current != dev) {
+		printf("*** ERROR: Cannot start %s\n", dev->name);
+		eth_current = dev;
+		return -1;
+	}
+	memcpy(NetOurEther, dev->enetaddr, 6);
+
+	nfs_set_session(link->nfs);
+	NfsStart();
+	net_link_save(link);
+
+	return 0;
+}
+
+/* Run the downloads until each has finished, return the number that failed */
+static int parallel_run(struct net_link *links, int count)
+{
+	int busy, failed, i;
+
+	do {
+		WATCHDOG_RESET();
+		busy = 0;
+		failed = 0;
+		for (i = 0; i < count; i++) {
+			if (links[i].state == NETLOOP_CONTINUE) {
+				net_link_load(&links[i]);
+				nfs_set_session(links[i].nfs);
+				net_link_poll();
+				net_link_save(&links[i]);
+			}
+			if (links[i].state == NETLOOP_CONTINUE)
+				busy = 1;
+			else if (links[i].state != NETLOOP_SUCCESS)
+				failed++;
+		}
+
+		if (ctrlc()) {
+			puts("\nAbort\n");
+			return count;
+		}
+	} while (busy);
+
+	return failed;
+}
+
+static void parallel_print_stats(struct net_link *links, int count,
+				 u64 *rx_bytes, ulong ms)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		u64 bytes = links[i].dev->rx_bytes - rx_bytes[i];
+
+		printf("%s: ", links[i].dev->name);
+		print_size(bytes, "");
+		if (ms) {
+			printf(" at ");
+			print_size(lldiv(bytes * 1000, ms), "/s");
+		}
+		putc('\n');
+	}
+}
+
+int net_parallel_loop(enum proto_t protocol)
+{
+	struct eth_device *devs[CONFIG_NET_PARALLEL_MAX];
+	struct net_link links[CONFIG_NET_PARALLEL_MAX], outer;
+	u64 rx_bytes[CONFIG_NET_PARALLEL_MAX];
+	ulong size = 0, start;
+	int count, started, i;
+	int ret = -1;
+
+	if (protocol != NFS)
+		return -1;
+#ifdef CONFIG_CMD_NETSINK
+	if (net_sink_active()) {
+		puts("*** ERROR: Cannot write to a device in parallel\n");
+		return -1;
+	}
+#endif
+	count = parallel_get_devs(devs);
+	if (count < 0)
+		return -1;
+
+	memset(links, '\0', sizeof(links));
+	net_link_save(&outer);
+	net_parallel = 1;
+	start = get_timer(0);
+	for (started = 0; started < count; started++) {
+		rx_bytes[started] = devs[started]->rx_bytes;
+		if (parallel_start(&links[started], devs[started], started,
+				   count)) {
+			links[started].dev = devs[started];
+			started++;
+			goto halt;
+		}
+	}
+
+	if (!parallel_run(links, count)) {
+		for (i = 0; i < count; i++)
+			size = max(size, links[i].xfer_size);
+		ret = size;
+	}
+
+halt:
+	for (i = 0; i < started; i++) {
+		eth_current = links[i].dev;
+		eth_halt();
+		free(links[i].tx_packet);
+		free(links[i].nfs);
+	}
+	net_link_load(&outer);
+	nfs_set_session(NULL);
+	net_set_udp_handler(NULL);
+	NetSetTimeout(0, NULL);
+	net_parallel = 0;
+
+	if (ret < 0) {
+		/* Invalidate the last protocol */
+		eth_set_last_protocol(BOOTP);
+		return ret;
+	}
+
+	printf("Bytes transferred = %ld (%lx hex)\n", size, size);
+	setenv_hex("filesize", size);
+	setenv_hex("fileaddr", load_addr);
+	eth_set_last_protocol(protocol);
+	parallel_print_stats(links, count, rx_bytes, get_timer(start));
+
+	return ret;
+}
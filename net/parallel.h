@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Download of one file over several network interfaces at once
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+#include <common.h>
+#include <net.h>
+#include "arp.h"
+
+struct nfs_session;
+
+/*
+ * The state of the network loop for one interface. The loop works on
+ * globals, so the state of each interface is loaded into them before
+ * its packets are handled, and saved again afterwards.
+ */
+struct net_link {
+	struct eth_device *dev;
+	uchar our_ether[6];
+	IPaddr_t our_ip;
+	IPaddr_t server_ip;
+	uchar server_ether[6];
+	uchar *tx_packet;
+	enum net_loop_state state;
+	ulong xfer_size;
+	thand_f *time_handler;
+	ulong time_start;
+	ulong time_delta;
+	struct arp_wait arp;
+	struct nfs_session *nfs;
+};
+
+/* Non-zero while a parallel download is running */
+extern int net_parallel;
+
+void net_link_save(struct net_link *link);
+void net_link_load(const struct net_link *link);
+
+/* Receive packets and run timeouts for the interface that is loaded */
+void net_link_poll(void);
+
+/*
+ * Download the file over the interfaces named in the "ethparallel"
+ * variable, one part of it over each
+ *
+ * @protocol:	the protocol of the download, only NFS is supported
+ * @return the size of the file, or -1 on error
+ */
+int net_parallel_loop(enum proto_t protocol);
+
+#endif /* __PARALLEL_H__ */
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Stream network downloads straight into a block device
+ *
+ * Instead of being copied to load_addr, the data received by TFTP or
+ * NFS is collected in one of two bounded staging buffers. When a buffer
+ * fills up the protocol carries on with the other one, and the full
+ * buffer is written out from net_sink_poll(), which the protocols call
+ * right after they have asked the server for more data.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <malloc.h>
+#include <net.h>
+#include <part.h>
+
+#ifndef CONFIG_NET_SINK_BUF_SIZE
+#define CONFIG_NET_SINK_BUF_SIZE	(1 << 20)
+#endif
+
+static struct net_sink {
+	block_dev_desc_t *dev;
+	ulong start;		/* first block of the destination range */
+	ulong blkcnt;		/* number of blocks in the range */
+	ulong size;		/* size of each staging buffer in bytes */
+	uchar *buf[2];
+	int cur;		/* buffer currently being filled */
+	ulong base;		/* stream offset of buf[cur][0] */
+	ulong fill;		/* bytes held in buf[cur] */
+	int pending;		/* buf[!cur] is full and not yet written */
+	ulong pending_base;	/* stream offset of buf[!cur][0] */
+	int error;
+} sink;
+
+int net_sink_active(void)
+{
+	return sink.dev != NULL;
+}
+
+static int net_sink_write_blocks(ulong offset, const uchar *buf, ulong len)
+{
+	block_dev_desc_t *dev = sink.dev;
+	ulong blk = offset / dev->blksz;
+	ulong cnt = len / dev->blksz;
+
+	if (blk + cnt > sink.blkcnt) {
+		printf("\nnetsink: image exceeds destination (%lu blocks)\n",
+		       sink.blkcnt);
+		return -1;
+	}
+
+	if (dev->block_write(dev->dev, sink.start + blk, cnt, buf) != cnt) {
+		printf("\nnetsink: write error at block %lx\n",
+		       sink.start + blk);
+		return -1;
+	}
+
+	return 0;
+}
+
+int net_sink_poll(void)
+{
+	if (!sink.pending || sink.error)
+		return sink.error;
+
+	sink.pending = 0;
+	if (net_sink_write_blocks(sink.pending_base, sink.buf[!sink.cur],
+				  sink.size))
+		sink.error = -1;
+
+	return sink.error;
+}
+
+int net_sink_write(ulong offset, const void *src, ulong len)
+{
+	const uchar *p = src;
+
+	if (sink.error)
+		return sink.error;
+
+	/* The transfer was restarted, start over */
+	if (offset == 0) {
+		sink.base = 0;
+		sink.fill = 0;
+		sink.pending = 0;
+	}
+
+	if (offset != sink.base + sink.fill) {
+		printf("\nnetsink: out of order data at offset %#lx\n", offset);
+		sink.error = -1;
+		return sink.error;
+	}
+
+	while (len) {
+		ulong n = min(len, sink.size - sink.fill);
+
+		memcpy(sink.buf[sink.cur] + sink.fill, p, n);
+		sink.fill += n;
+		p += n;
+		len -= n;
+
+		if (sink.fill < sink.size)
+			break;
+
+		/* Nobody polled since the last swap, write it out now */
+		if (sink.pending && net_sink_poll())
+			return sink.error;
+
+		sink.pending = 1;
+		sink.pending_base = sink.base;
+		sink.base += sink.size;
+		sink.fill = 0;
+		sink.cur = !sink.cur;
+	}
+
+	return 0;
+}
+
+/*
+ * Write out whatever is still buffered. A trailing partial block is
+ * merged with the data already on the device so that nothing past the
+ * end of the image is clobbered.
+ */
+int net_sink_finish(void)
+{
+	block_dev_desc_t *dev = sink.dev;
+	ulong full, rem, blk;
+	uchar *tail;
+
+	if (net_sink_poll())
+		return sink.error;
+
+	full = sink.fill - sink.fill % dev->blksz;
+	rem = sink.fill - full;
+
+	if (full && net_sink_write_blocks(sink.base, sink.buf[sink.cur],
+					  full))
+		return -1;
+
+	if (!rem)
+		return 0;
+
+	/* buf[!cur] is idle now, use it to read back the last block */
+	tail = sink.buf[!sink.cur];
+	blk = (sink.base + full) / dev->blksz;
+	if (blk >= sink.blkcnt) {
+		printf("\nnetsink: image exceeds destination (%lu blocks)\n",
+		       sink.blkcnt);
+		return -1;
+	}
+	if (dev->block_read(dev->dev, sink.start + blk, 1, tail) != 1) {
+		printf("\nnetsink: read error at block %lx\n",
+		       sink.start + blk);
+		return -1;
+	}
+	memcpy(tail, sink.buf[sink.cur] + full, rem);
+
+	return net_sink_write_blocks(sink.base + full, tail, dev->blksz);
+}
+
+int net_sink_start(block_dev_desc_t *dev, ulong start, ulong blkcnt)
+{
+	ulong size = CONFIG_NET_SINK_BUF_SIZE;
+
+	size -= size % dev->blksz;
+	if (!size)
+		size = dev->blksz;
+
+	memset(&sink, '\0', sizeof(sink));
+	sink.buf[0] = memalign(ARCH_DMA_MINALIGN, size);
+	sink.buf[1] = memalign(ARCH_DMA_MINALIGN, size);
+	if (!sink.buf[0] || !sink.buf[1]) {
+		free(sink.buf[0]);
+		free(sink.buf[1]);
+		sink.buf[0] = NULL;
+		sink.buf[1] = NULL;
+		return -ENOMEM;
+	}
+
+	sink.dev = dev;
+	sink.start = start;
+	sink.blkcnt = blkcnt;
+	sink.size = size;
+
+	return 0;
+}
+
+void net_sink_stop(void)
+{
+	free(sink.buf[0]);
+	free(sink.buf[1]);
+	memset(&sink, '\0', sizeof(sink));
+}
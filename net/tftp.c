@@ -9,6 +9,7 @@
 #include <common.h>
 #include <command.h>
 #include <net.h>
+#include <asm/io.h>
 #include "tftp.h"
 #include "bootp.h"
 #ifdef CONFIG_SYS_DIRECT_FLASH_TFTP
@@ -127,6 +128,19 @@ static char tftp_filename[MAX_LEN];
 #define TFTP_MTU_BLOCKSIZE 1468
 #endif
 
+/*
+ * RFC 2348 allows blocks of up to 65464 bytes. Anything larger than a
+ * frame arrives fragmented, so it must also fit the reassembly buffer,
+ * and without one it must fit a frame.
+ */
+#if !defined(CONFIG_IP_DEFRAG)
+#define TFTP_MAX_BLOCKSIZE TFTP_MTU_BLOCKSIZE
+#elif CONFIG_NET_MAXDEFRAG < 65464
+#define TFTP_MAX_BLOCKSIZE CONFIG_NET_MAXDEFRAG
+#else
+#define TFTP_MAX_BLOCKSIZE 65464
+#endif
+
 static unsigned short TftpBlkSize = TFTP_BLOCK_SIZE;
 static unsigned short TftpBlkSizeOption = TFTP_MTU_BLOCKSIZE;
 
@@ -183,8 +197,19 @@ store_block(int block, uchar *src, unsigned len)
 		}
 	} else
 #endif /* CONFIG_SYS_DIRECT_FLASH_TFTP */
+#ifdef CONFIG_CMD_NETSINK
+	if (net_sink_active()) {
+		if (net_sink_write(offset, src, len)) {
+			net_set_state(NETLOOP_FAIL);
+			return;
+		}
+	} else
+#endif
 	{
-		(void)memcpy((void *)(load_addr + offset), src, len);
+		void *ptr = map_sysmem(load_addr + offset, len);
+
+		memcpy(ptr, src, len);
+		unmap_sysmem(ptr);
 	}
 #ifdef CONFIG_MCAST_TFTP
 	if (Multicast)
@@ -220,9 +245,12 @@ static int load_block(unsigned block, uchar *dst, unsigned len)
 	/* We may want to get the final block from the previous set */
 	ulong offset = ((int)block - 1) * len + TftpBlockWrapOffset;
 	ulong tosend = len;
+	void *ptr;
 
 	tosend = min(NetBootFileXferSize - offset, tosend);
-	(void)memcpy(dst, (void *)(save_addr + offset), tosend);
+	ptr = map_sysmem(save_addr + offset, tosend);
+	memcpy(dst, ptr, tosend);
+	unmap_sysmem(ptr);
 	debug("%s: block=%d, offset=%ld, len=%d, tosend=%ld\n", __func__,
 		block, offset, len, tosend);
 	return tosend;
@@ -629,6 +657,12 @@ TftpHandler(uchar *pkt, unsigned dest, IPaddr_t sip, unsigned src,
 #endif
 		TftpSend();
 
+#ifdef CONFIG_CMD_NETSINK
+		/* Program the device while the next block is on its way */
+		if (net_sink_poll())
+			net_set_state(NETLOOP_FAIL);
+#endif
+
 #ifdef CONFIG_MCAST_TFTP
 		if (Multicast) {
 			if (MasterClient && (TftpBlock >= TftpEndingBlock)) {
@@ -694,8 +728,17 @@ void TftpStart(enum proto_t protocol)
 	 * TFTP protocol has a minimal timeout of 1 second.
 	 */
 	ep = getenv("tftpblocksize");
-	if (ep != NULL)
-		TftpBlkSizeOption = simple_strtol(ep, NULL, 10);
+	if (ep != NULL) {
+		ulong blksize = simple_strtoul(ep, NULL, 10);
+
+		if (blksize > TFTP_MAX_BLOCKSIZE) {
+			printf("TFTP blocksize (%lu) too high, "
+				"set maximum = %d\n",
+				blksize, TFTP_MAX_BLOCKSIZE);
+			blksize = TFTP_MAX_BLOCKSIZE;
+		}
+		TftpBlkSizeOption = blksize;
+	}
 
 	ep = getenv("tftptimeout");
 	if (ep != NULL)
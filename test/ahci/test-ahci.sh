@@ -0,0 +1,167 @@
+# Copyright (C) 2026 agent <agent@local>
+#
+# SPDX-License-Identifier:	GPL-2.0+
+#
+
+# Simple test script for SATA disks behind sandbox's emulated AHCI
+# controller
+
+OUTPUT_DIR=sandbox
+
+fail() {
+	echo "Test failed: $1"
+	rm -rf ${tmp} ${img1} ${img2} ${img3} ${dir}
+	exit 1
+}
+
+build_uboot() {
+	echo "Build sandbox"
+	OPTS="O=${OUTPUT_DIR}"
+	NUM_CPUS=$(grep -c processor /proc/cpuinfo)
+	make ${OPTS} sandbox_config
+	make ${OPTS} -s -j${NUM_CPUS}
+}
+
+# Two disks, read whole and written to, with queued reads or without
+run_ahci() {
+	echo "Run AHCI with NCQ $1"
+	./${OUTPUT_DIR}/u-boot <<END
+	setenv sandbox_ahci "${img1} ${img2}"
+	setenv sandbox_ahci_ncq $1
+	scsi reset
+	scsi dev 0
+	scsi read 1000 0 a000
+	hash sha256 1000 1400000
+	scsi dev 1
+	scsi read 1000 0 800
+	hash sha256 1000 100000
+	scsi write 1000 800 800
+	reset
+END
+}
+
+# An ext4 file system, whose files are loaded with scatter-gather reads
+run_fs() {
+	echo "Run file system"
+	./${OUTPUT_DIR}/u-boot <<END
+	setenv sandbox_ahci "${img3}"
+	scsi reset
+	ext4load scsi 0 1000 /file
+	hash sha256 1000 \${filesize}
+	ext4load scsi 0 1000 /small
+	hash sha256 1000 \${filesize}
+	reset
+END
+}
+
+# Each command takes 1ms: queued, they take it side by side
+run_timing() {
+	echo "Run timing"
+	./${OUTPUT_DIR}/u-boot <<END
+	setenv sandbox_ahci "${img1}"
+	setenv sandbox_ahci_latency 1000
+	scsi reset
+	time scsi read 1000 0 a000
+	setenv sandbox_ahci_ncq 0
+	scsi reset
+	time scsi read 1000 0 a000
+	reset
+END
+}
+
+# Two disks whose links take 150ms, and two empty ports: brought up
+# together, rather than one after the other
+run_bringup() {
+	echo "Run bring-up"
+	./${OUTPUT_DIR}/u-boot <<END
+	setenv sandbox_ahci "${img1} - ${img2} -"
+	setenv sandbox_ahci_linkup 150
+	time scsi reset
+	reset
+END
+}
+
+check_results() {
+	echo "Check results"
+
+	if ! grep -q "Found 2 device(s)" ${tmp}; then
+		fail "scan error"
+	fi
+
+	# Both reads must match what is in the files
+	sum1=$(head -c 20971520 ${img1} | sha256sum | cut -d' ' -f1)
+	sum2=$(head -c 1048576 ${img2} | sha256sum | cut -d' ' -f1)
+	if ! grep -q "==> ${sum1}" ${tmp} || ! grep -q "==> ${sum2}" ${tmp}
+	then
+		fail "read error"
+	fi
+
+	# The write put the start of the second disk in its second half
+	if ! cmp -s -n 1048576 -i 0:1048576 ${img2} ${img2}; then
+		fail "write error"
+	fi
+}
+
+check_bringup() {
+	echo "Check bring-up"
+
+	if ! grep -q "Found 2 device(s)" ${tmp}; then
+		fail "scan error with empty ports"
+	fi
+
+	# One port after the other, it takes 700ms
+	ms=$(awk '/^time:/ { printf "%d", $2 * 1000 }' ${tmp})
+	echo "Four ports brought up in ${ms}ms"
+	if [ -z "${ms}" ] || [ ${ms} -gt 450 ]; then
+		fail "bring-up too slow"
+	fi
+}
+
+check_fs() {
+	echo "Check file system"
+
+	sum1=$(sha256sum ${dir}/file | cut -d' ' -f1)
+	sum2=$(sha256sum ${dir}/small | cut -d' ' -f1)
+	if ! grep -q "==> ${sum1}" ${tmp} || ! grep -q "==> ${sum2}" ${tmp}
+	then
+		fail "file read error"
+	fi
+}
+
+check_timing() {
+	echo "Check timing"
+
+	ms=$(awk '/^time:/ { printf "%d ", $2 * 1000 }' ${tmp})
+	set -- ${ms}
+	echo "20MB read in ${1}ms with NCQ, ${2}ms without"
+	if [ -z "$2" ] || [ $(($1 * 3)) -gt $2 ]; then
+		fail "queued reads too slow"
+	fi
+}
+
+echo "Simple AHCI test using sandbox"
+echo
+tmp="$(mktemp)"
+img1="$(mktemp)"
+img2="$(mktemp)"
+img3="$(mktemp)"
+dir="$(mktemp -d)"
+dd if=/dev/urandom of=${dir}/file bs=1000 count=5678 2>/dev/null
+dd if=/dev/urandom of=${dir}/small bs=100 count=1 2>/dev/null
+dd if=/dev/zero of=${img3} bs=1M count=16 2>/dev/null
+mkfs.ext4 -q -F -b 1024 -d ${dir} ${img3}
+build_uboot
+for ncq in 1 0; do
+	dd if=/dev/urandom of=${img1} bs=1M count=20 2>/dev/null
+	dd if=/dev/urandom of=${img2} bs=1M count=2 2>/dev/null
+	run_ahci ${ncq} >${tmp}
+	check_results
+done
+run_bringup >${tmp}
+check_bringup
+run_fs >${tmp}
+check_fs
+run_timing >${tmp}
+check_timing
+rm -r ${tmp} ${img1} ${img2} ${img3} ${dir}
+echo "Test passed"
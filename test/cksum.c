@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Test and benchmark of the Internet checksum routine
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <div64.h>
+#include <net.h>
+#include <test.h>
+
+#define TEST_BUFFER_SIZE	2048
+#define BENCH_PACKET_SIZE	1500
+#define BENCH_LOOPS		20000
+
+/* The plain 16-bit loop NetCksum() used to be */
+static unsigned ref_cksum(uchar *ptr, int len)
+{
+	ulong xsum = 0;
+	ushort *p = (ushort *)ptr;
+
+	while (len-- > 0)
+		xsum += *p++;
+	xsum = (xsum & 0xffff) + (xsum >> 16);
+	xsum = (xsum & 0xffff) + (xsum >> 16);
+
+	return xsum & 0xffff;
+}
+
+static uchar buf[TEST_BUFFER_SIZE + 4] __aligned(4);
+
+static int test_vectors(void)
+{
+	/* RFC 1071, section 3 */
+	static const uchar rfc1071[] __aligned(4) = {
+		0x00, 0x01, 0xf2, 0x03, 0xf4, 0xf5, 0xf6, 0xf7,
+	};
+	/* A real IPv4 header with its checksum filled in */
+	static const uchar iphdr[] __aligned(4) = {
+		0x45, 0x00, 0x00, 0x73, 0x00, 0x00, 0x40, 0x00,
+		0x40, 0x11, 0xb8, 0x61, 0xc0, 0xa8, 0x00, 0x01,
+		0xc0, 0xa8, 0x00, 0xc7,
+	};
+	int ret = 0;
+
+	errcheck(ntohs(NetCksum((uchar *)rfc1071, 4)) == 0xddf2);
+	errcheck(NetCksumOk((uchar *)iphdr, sizeof(iphdr) / 2));
+	errcheck(NetCksum(buf, 0) == 0);
+
+	memset(buf, '\0', sizeof(buf));
+	errcheck(NetCksum(buf, 100) == 0);
+	memset(buf, 0xff, sizeof(buf));
+	errcheck(NetCksum(buf, 100) == 0xffff);
+
+out:
+	test_result("vectors", ret);
+
+	return ret;
+}
+
+static int test_random(void)
+{
+	unsigned int seed = 1;
+	int ret = 0;
+	int off, len, i;
+
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = rand_r(&seed);
+
+	for (off = 0; off <= 2; off += 2) {
+		for (len = 0; len <= TEST_BUFFER_SIZE / 2; len++) {
+			uchar *p = buf + off;
+
+			errcheck(NetCksum(p, len) == ref_cksum(p, len));
+		}
+	}
+
+out:
+	test_result("random", ret);
+
+	return ret;
+}
+
+static ulong bench(const char *name, unsigned (*cksum)(uchar *, int),
+		   int off)
+{
+	ulong start, ms;
+	unsigned sum = 0;
+	int i;
+
+	start = get_timer(0);
+	for (i = 0; i < BENCH_LOOPS; i++)
+		sum += cksum(buf + off, BENCH_PACKET_SIZE / 2);
+	ms = get_timer(start);
+	if (!ms)
+		ms = 1;
+
+	printf(" %s, offset %d: %lu ms, %llu packets/s (%x)\n", name, off, ms,
+	       lldiv(BENCH_LOOPS * 1000ULL, ms), sum);
+
+	return ms;
+}
+
+static int test_cksum(void)
+{
+	int err = 0;
+
+	err += test_vectors();
+	err += test_random();
+
+	bench("reference", ref_cksum, 0);
+	bench("NetCksum", NetCksum, 0);
+	bench("NetCksum", NetCksum, 2);
+
+	return err;
+}
+
+TEST_CMD(test_cksum, "Test and benchmark the Internet checksum routine");
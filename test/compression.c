@@ -9,6 +9,7 @@
 #include <common.h>
 #include <command.h>
 #include <malloc.h>
+#include <test.h>
 
 #include <u-boot/zlib.h>
 #include <bzlib.h>
@@ -224,12 +225,6 @@ static int uncompress_using_lzo(void *in, unsigned long in_size,
 	return (ret != LZO_E_OK);
 }
 
-#define errcheck(statement) if (!(statement)) { \
-	fprintf(stderr, "\tFailed: %s\n", #statement); \
-	ret = 1; \
-	goto out; \
-}
-
 static int run_test(char *name, mutate_func compress, mutate_func uncompress)
 {
 	ulong orig_size, compressed_size, uncompressed_size;
@@ -304,7 +299,7 @@ static int run_test(char *name, mutate_func compress, mutate_func uncompress)
 	ret = 0;
 
 out:
-	printf(" %s: %s\n", name, ret == 0 ? "ok" : "FAILED");
+	test_result(name, ret);
 
 	free(compare_buf);
 	free(uncompressed_buf);
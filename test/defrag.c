@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Test of IP datagram reassembly, with fragments that arrive out of order,
+ * overlap or disagree with each other
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <net.h>
+#include <test.h>
+
+#define TEST_PAYLOAD		3000	/* UDP payload of each datagram */
+#define TEST_DGRAM		(UDP_HDR_SIZE + TEST_PAYLOAD)
+#define TEST_PORT		1234
+
+static IPaddr_t test_src, test_dst;
+
+/* Two datagrams, each a UDP header followed by the payload */
+static uchar dgram[2][TEST_DGRAM];
+static uchar frame[PKTSIZE_ALIGN] __aligned(PKTALIGN);
+
+/* What the UDP handler was given */
+static uchar received[TEST_PAYLOAD];
+static int received_len;
+static int received_count;
+
+static void test_handler(uchar *pkt, unsigned dport, IPaddr_t sip,
+			 unsigned sport, unsigned len)
+{
+	if (dport != TEST_PORT || len > TEST_PAYLOAD)
+		return;
+	memcpy(received, pkt, len);
+	received_len = len;
+	received_count++;
+}
+
+/*
+ * Pass the bytes @start to @end of datagram @which to NetReceive(), in a
+ * fragment that is the last one unless @more. It must fit in one frame.
+ */
+static void send_frag(int which, int start, int end, int more)
+{
+	struct ethernet_hdr *et = (struct ethernet_hdr *)frame;
+	struct ip_hdr *ip = (struct ip_hdr *)(frame + ETHER_HDR_SIZE);
+	int len = end - start;
+
+	memcpy(et->et_dest, NetOurEther, 6);
+	memset(et->et_src, 0x55, 6);
+	et->et_protlen = htons(PROT_IP);
+
+	ip->ip_hl_v = 0x45;
+	ip->ip_tos = 0;
+	ip->ip_len = htons(IP_HDR_SIZE + len);
+	ip->ip_id = htons(100 + which);
+	ip->ip_off = htons(start / 8 | (more ? IP_FLAGS_MFRAG : 0));
+	ip->ip_ttl = 255;
+	ip->ip_p = IPPROTO_UDP;
+	ip->ip_sum = 0;
+	NetCopyIP((void *)&ip->ip_src, &test_src);
+	NetCopyIP((void *)&ip->ip_dst, &test_dst);
+	ip->ip_sum = ~NetCksum((uchar *)ip, IP_HDR_SIZE >> 1);
+	memcpy((uchar *)ip + IP_HDR_SIZE, dgram[which] + start, len);
+
+	NetReceive(frame, ETHER_HDR_SIZE + IP_HDR_SIZE + len);
+}
+
+/* Check that datagram @which, and nothing else, came out since the last */
+static int check_received(int which)
+{
+	int ok = received_count == 1 && received_len == TEST_PAYLOAD &&
+		!memcmp(received, dgram[which] + UDP_HDR_SIZE, TEST_PAYLOAD);
+
+	received_count = 0;
+	received_len = 0;
+
+	return ok;
+}
+
+static int test_order(void)
+{
+	int ret = 0;
+
+	/* In order */
+	send_frag(0, 0, 1480, 1);
+	send_frag(0, 1480, 2960, 1);
+	errcheck(!received_count);
+	send_frag(0, 2960, TEST_DGRAM, 0);
+	errcheck(check_received(0));
+
+	/* Backwards, so the size is known from the first fragment */
+	send_frag(0, 2960, TEST_DGRAM, 0);
+	send_frag(0, 1480, 2960, 1);
+	errcheck(!received_count);
+	send_frag(0, 0, 1480, 1);
+	errcheck(check_received(0));
+
+	/* Shuffled, with the first fragment last */
+	send_frag(0, 1480, 2960, 1);
+	send_frag(0, 2960, TEST_DGRAM, 0);
+	send_frag(0, 0, 1480, 1);
+	errcheck(check_received(0));
+
+	/* A fragment that comes twice */
+	send_frag(0, 1480, 2960, 1);
+	send_frag(0, 1480, 2960, 1);
+	send_frag(0, 0, 1480, 1);
+	errcheck(!received_count);
+	send_frag(0, 2960, TEST_DGRAM, 0);
+	errcheck(check_received(0));
+
+out:
+	test_result("order", ret);
+
+	return ret;
+}
+
+static int test_overlap(void)
+{
+	int ret = 0;
+
+	/* Each fragment covers part of the one before */
+	send_frag(0, 0, 1200, 1);
+	send_frag(0, 800, 2000, 1);
+	errcheck(!received_count);
+	send_frag(0, 1600, TEST_DGRAM, 0);
+	errcheck(check_received(0));
+
+	/* One fragment fills two holes, and overlaps what is around them */
+	send_frag(0, 0, 400, 1);
+	send_frag(0, 1000, 1400, 1);
+	send_frag(0, 1600, TEST_DGRAM, 0);
+	errcheck(!received_count);
+	send_frag(0, 200, 1680, 1);
+	errcheck(check_received(0));
+
+	/*
+	 * A retransmission, fragmented differently, over the first half of
+	 * the datagram
+	 */
+	send_frag(0, 0, 1480, 1);
+	send_frag(0, 0, 1000, 1);
+	send_frag(0, 1000, 2000, 1);
+	errcheck(!received_count);
+	send_frag(0, 2000, TEST_DGRAM, 0);
+	errcheck(check_received(0));
+
+	/* The last fragment, starting inside data that is already there */
+	send_frag(0, 0, 1480, 1);
+	send_frag(0, 1480, 2960, 1);
+	errcheck(!received_count);
+	send_frag(0, 2400, TEST_DGRAM, 0);
+	errcheck(check_received(0));
+
+out:
+	test_result("overlap", ret);
+
+	return ret;
+}
+
+static int test_interleave(void)
+{
+	int ret = 0;
+
+	/* Two datagrams at once, their fragments mixed */
+	send_frag(1, 2960, TEST_DGRAM, 0);
+	send_frag(0, 1480, 2960, 1);
+	send_frag(1, 0, 1480, 1);
+	send_frag(0, 0, 1480, 1);
+	send_frag(0, 2960, TEST_DGRAM, 0);
+	errcheck(check_received(0));
+	send_frag(1, 1480, 2960, 1);
+	errcheck(check_received(1));
+
+out:
+	test_result("interleave", ret);
+
+	return ret;
+}
+
+static int test_bad(void)
+{
+	int ret = 0;
+
+	/* Only the last fragment may have a length off the 8-byte grid */
+	send_frag(0, 0, 1001, 1);
+	send_frag(0, 1000, 2000, 1);
+	send_frag(0, 2000, TEST_DGRAM, 0);
+	errcheck(!received_count);
+	send_frag(0, 0, 1000, 1);
+	errcheck(check_received(0));
+
+	/*
+	 * Two last fragments that disagree: the datagram is dropped, and
+	 * the fragments after that start it afresh
+	 */
+	send_frag(0, 2960, TEST_DGRAM, 0);
+	send_frag(0, 1480, 2000, 0);
+	send_frag(0, 0, 1480, 1);
+	send_frag(0, 1480, 2960, 1);
+	errcheck(!received_count);
+	send_frag(0, 2960, TEST_DGRAM, 0);
+	errcheck(check_received(0));
+
+	/* Data past the end of the last fragment: dropped too */
+	send_frag(1, 1480, 2000, 0);
+	send_frag(1, 1480, 2960, 1);
+	send_frag(1, 0, 1480, 1);
+	errcheck(!received_count);
+
+out:
+	test_result("bad", ret);
+
+	return ret;
+}
+
+static int test_defrag(void)
+{
+	IPaddr_t our_ip = NetOurIP;
+	unsigned int seed = 1;
+	int err = 0;
+	int i, j;
+
+	for (i = 0; i < 2; i++) {
+		__be16 *udp = (__be16 *)dgram[i];
+
+		udp[0] = htons(TEST_PORT + 1);
+		udp[1] = htons(TEST_PORT);
+		udp[2] = htons(TEST_DGRAM);
+		udp[3] = 0;	/* no checksum */
+		for (j = UDP_HDR_SIZE; j < TEST_DGRAM; j++)
+			dgram[i][j] = rand_r(&seed);
+	}
+
+	net_init();
+	test_src = string_to_ip("10.0.0.1");
+	test_dst = string_to_ip("10.0.0.2");
+	NetOurIP = test_dst;
+	net_set_udp_handler(test_handler);
+	received_count = 0;
+
+	err += test_order();
+	err += test_overlap();
+	err += test_interleave();
+	err += test_bad();
+
+	net_set_udp_handler(NULL);
+	NetOurIP = our_ip;
+
+	return err;
+}
+
+TEST_CMD(test_defrag, "Test reassembly of fragmented IP datagrams");
@@ -107,6 +107,18 @@ static int do_dm_dump_uclass(cmd_tbl_t *cmdtp, int flag, int argc,
 	return 0;
 }
 
+static int do_dm_probe(cmd_tbl_t *cmdtp, int flag, int argc,
+		       char * const argv[])
+{
+	ulong start = get_timer(0);
+	int ret;
+
+	ret = dm_probe_all();
+	printf("Probed in %lu ms\n", get_timer(start));
+
+	return ret ? CMD_RET_FAILURE : 0;
+}
+
 #ifdef CONFIG_DM_TEST
 static int do_dm_test(cmd_tbl_t *cmdtp, int flag, int argc,
 			  char * const argv[])
@@ -121,6 +133,7 @@ static int do_dm_test(cmd_tbl_t *cmdtp, int flag, int argc,
 static cmd_tbl_t test_commands[] = {
 	U_BOOT_CMD_MKENT(tree, 0, 1, do_dm_dump_all, "", ""),
 	U_BOOT_CMD_MKENT(uclass, 1, 1, do_dm_dump_uclass, "", ""),
+	U_BOOT_CMD_MKENT(probe, 0, 1, do_dm_probe, "", ""),
 #ifdef CONFIG_DM_TEST
 	U_BOOT_CMD_MKENT(test, 1, 1, do_dm_test, "", ""),
 #endif
@@ -149,6 +162,7 @@ U_BOOT_CMD(
 	dm,	2,	1,	do_dm,
 	"Driver model low level access",
 	"tree         Dump driver model tree ('*' = activated)\n"
-	"dm uclass        Dump list of instances for each uclass"
+	"dm uclass        Dump list of instances for each uclass\n"
+	"dm probe         Probe all devices"
 	TEST_HELP
 );
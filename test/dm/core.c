@@ -67,6 +67,11 @@ static struct driver_info driver_info_pre_reloc = {
 	.platdata = &test_pdata_manual,
 };
 
+static struct driver_info driver_info_slow = {
+	.name = "test_slow_drv",
+	.platdata = &test_pdata_manual,
+};
+
 /* Test that binding with platdata occurs correctly */
 static int dm_test_autobind(struct dm_test_state *dms)
 {
@@ -554,6 +559,109 @@ static int dm_test_children(struct dm_test_state *dms)
 }
 DM_TEST(dm_test_children, 0);
 
+#define LOOKUP_COUNT	500
+
+/* Test and time uclass lookups with hundreds of devices */
+static int dm_test_uclass_lookup(struct dm_test_state *dms)
+{
+	struct udevice *child[LOOKUP_COUNT];
+	struct udevice *dev;
+	ulong start, by_seq, by_id;
+	int ret;
+	int i;
+
+	dms->skip_post_probe = 1;
+	ut_assertok(create_children(dms, dms->root, LOOKUP_COUNT, 0, child));
+	for (ret = uclass_first_device(UCLASS_TEST, &dev);
+	     dev;
+	     ret = uclass_next_device(&dev))
+		;
+	ut_assertok(ret);
+
+	start = timer_get_us();
+	for (i = 0; i < LOOKUP_COUNT; i++) {
+		ut_assertok(uclass_get_device_by_seq(UCLASS_TEST, i, &dev));
+		ut_asserteq_ptr(child[i], dev);
+	}
+	by_seq = timer_get_us() - start;
+	ut_asserteq(-ENODEV, uclass_find_device_by_seq(UCLASS_TEST,
+						       LOOKUP_COUNT, false,
+						       &dev));
+
+	start = timer_get_us();
+	for (i = 0; i < LOOKUP_COUNT * UCLASS_COUNT; i++)
+		ut_assert(uclass_find(i % UCLASS_COUNT) || i % UCLASS_COUNT);
+	by_id = timer_get_us() - start;
+
+	printf("%d devices: by seq %luus, %d uclass lookups %luus\n",
+	       LOOKUP_COUNT, by_seq, LOOKUP_COUNT * UCLASS_COUNT, by_id);
+
+	/* A removed device gives up its number, and gets it back again */
+	ut_assertok(device_remove(child[5]));
+	ut_asserteq(-ENODEV, uclass_find_device_by_seq(UCLASS_TEST, 5, false,
+						       &dev));
+	ut_assertok(uclass_get_device_by_seq(UCLASS_TEST, 6, &dev));
+	ut_asserteq_ptr(child[6], dev);
+	ut_assertok(device_probe(child[5]));
+	ut_assertok(uclass_find_device_by_seq(UCLASS_TEST, 5, false, &dev));
+	ut_asserteq_ptr(child[5], dev);
+
+	return 0;
+}
+DM_TEST(dm_test_uclass_lookup, 0);
+
+#define SLOW_COUNT	5
+
+/* Test that devices slow to get ready are probed side by side */
+static int dm_test_probe_all(struct dm_test_state *dms)
+{
+	struct udevice *slow[SLOW_COUNT];
+	struct udevice *child;
+	ulong start, one, all;
+	int i;
+
+	dms->skip_post_probe = 1;
+	for (i = 0; i < SLOW_COUNT; i++) {
+		ut_assertok(device_bind_by_name(dms->root, false,
+						&driver_info_slow, &slow[i]));
+	}
+	ut_assertok(device_bind_by_name(slow[0], false, &driver_info_manual,
+					&child));
+
+	/* Not ready yet, nor is its child: removing it frees its memory */
+	ut_asserteq(-EAGAIN, device_try_probe(slow[0]));
+	ut_assert(slow[0]->flags & DM_FLAG_PROBING);
+	ut_assert(slow[0]->priv);
+	ut_asserteq(-EAGAIN, device_try_probe(child));
+	ut_assert(!device_active(child));
+	ut_assertok(device_remove(slow[0]));
+	ut_assert(!(slow[0]->flags & DM_FLAG_PROBING));
+	ut_asserteq_ptr(NULL, slow[0]->priv);
+
+	/* device_probe() waits for it */
+	start = get_timer(0);
+	ut_assertok(device_probe(slow[0]));
+	one = get_timer(start);
+	ut_assert(device_active(slow[0]));
+	ut_assert(one >= DM_TEST_SLOW_MS);
+	ut_assertok(device_remove(slow[0]));
+
+	/* dm_probe_all() waits for all of them together */
+	start = get_timer(0);
+	ut_assertok(dm_probe_all());
+	all = get_timer(start);
+	for (i = 0; i < SLOW_COUNT; i++)
+		ut_assert(device_active(slow[i]));
+	ut_assert(device_active(child));
+
+	printf("%d devices taking %dms: one %lums, all %lums\n", SLOW_COUNT,
+	       DM_TEST_SLOW_MS, one, all);
+	ut_assert(all < DM_TEST_SLOW_MS * SLOW_COUNT / 2);
+
+	return 0;
+}
+DM_TEST(dm_test_probe_all, 0);
+
 /* Test that pre-relocation devices work as expected */
 static int dm_test_pre_reloc(struct dm_test_state *dms)
 {
@@ -574,11 +682,15 @@ DM_TEST(dm_test_pre_reloc, 0);
 static int dm_test_uclass_before_ready(struct dm_test_state *dms)
 {
 	struct uclass *uc;
+	gd_t gd_backup;
 
 	ut_assertok(uclass_get(UCLASS_TEST, &uc));
 
+	/* Put gd back afterwards, for the tests that follow */
+	memcpy(&gd_backup, gd, sizeof(*gd));
 	memset(gd, '\0', sizeof(*gd));
 	ut_asserteq_ptr(NULL, uclass_find(UCLASS_TEST));
+	memcpy(gd, &gd_backup, sizeof(*gd));
 
 	return 0;
 }
@@ -155,3 +155,34 @@ U_BOOT_DRIVER(test_pre_reloc_drv) = {
 	.unbind	= test_manual_unbind,
 	.flags	= DM_FLAG_PRE_RELOC,
 };
+
+/* Private data for the slow test driver */
+struct test_slow_priv {
+	bool started;
+	ulong start;
+};
+
+/* Hardware which takes DM_TEST_SLOW_MS to be ready after it is started */
+static int test_slow_probe(struct udevice *dev)
+{
+	struct test_slow_priv *priv = dev_get_priv(dev);
+
+	if (!priv->started) {
+		priv->started = true;
+		priv->start = get_timer(0);
+	}
+	if (get_timer(priv->start) < DM_TEST_SLOW_MS)
+		return -EAGAIN;
+	dm_testdrv_op_count[DM_TEST_OP_PROBE]++;
+
+	return 0;
+}
+
+U_BOOT_DRIVER(test_slow_drv) = {
+	.name	= "test_slow_drv",
+	.id	= UCLASS_TEST,
+	.ops	= &test_manual_ops,
+	.probe	= test_slow_probe,
+	.remove	= test_manual_remove,
+	.priv_auto_alloc_size = sizeof(struct test_slow_priv),
+};
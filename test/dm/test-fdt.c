@@ -10,6 +10,8 @@
 #include <fdtdec.h>
 #include <malloc.h>
 #include <asm/io.h>
+#include <dm/device-internal.h>
+#include <dm/lists.h>
 #include <dm/test.h>
 #include <dm/root.h>
 #include <dm/ut.h>
@@ -230,6 +232,224 @@ static int dm_test_fdt_uclass_seq(struct dm_test_state *dms)
 }
 DM_TEST(dm_test_fdt_uclass_seq, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
 
+/* Test that probing a device probes the devices its node refers to */
+static int dm_test_fdt_probe_deps(struct dm_test_state *dms)
+{
+	const void *blob = gd->fdt_blob;
+	struct udevice *dev, *gpio_a, *gpio_b;
+
+	ut_assertok(uclass_find_device(UCLASS_GPIO, 0, &gpio_a));
+	ut_assertok(uclass_find_device(UCLASS_GPIO, 1, &gpio_b));
+	ut_asserteq_str("base-gpios", gpio_a->name);
+	ut_asserteq_str("extra-gpios", gpio_b->name);
+	ut_assert(!device_active(gpio_a));
+
+	/* d-test has test-gpios = <&gpio_a 3 0> */
+	ut_assertok(uclass_get_device_by_of_offset(UCLASS_TEST_FDT,
+			fdt_path_offset(blob, "/d-test"), &dev));
+	ut_assert(device_active(gpio_a));
+	ut_assert(!device_active(gpio_b));
+
+	/* b-test needs nothing more */
+	ut_assertok(device_remove(gpio_a));
+	ut_assertok(uclass_get_device_by_of_offset(UCLASS_TEST_FDT,
+			fdt_path_offset(blob, "/b-test"), &dev));
+	ut_assert(!device_active(gpio_a));
+
+	return 0;
+}
+DM_TEST(dm_test_fdt_probe_deps, DM_TESTF_SCAN_FDT);
+
+/* Test that devices which need each other fail to probe, and do not hang */
+static int dm_test_fdt_probe_cycle(struct dm_test_state *dms)
+{
+	const void *blob = gd->fdt_blob;
+	struct udevice *dev, *other;
+	int node;
+
+	ut_assertok(uclass_find_device(UCLASS_GPIO, 3, &other));
+	ut_asserteq_str("cycle-d-gpios", other->name);
+
+	/* cycle-c needs cycle-d, which needs cycle-c */
+	node = fdt_path_offset(blob, "/cycle-c-gpios");
+	ut_asserteq(-ELOOP, uclass_get_device_by_of_offset(UCLASS_GPIO, node,
+							   &dev));
+	ut_assert(!device_active(other));
+
+	/* Nothing is left marked, so the second attempt fails the same way */
+	ut_asserteq(-ELOOP, uclass_get_device_by_of_offset(UCLASS_GPIO, node,
+							   &dev));
+	ut_asserteq(-ELOOP, device_probe(other));
+	ut_assert(!device_active(other));
+
+	return 0;
+}
+DM_TEST(dm_test_fdt_probe_cycle, DM_TESTF_SCAN_FDT);
+
+#define BIND_COUNT	1000
+
+/* Find a node's driver by checking each driver in turn */
+static struct driver *search_compatible(const void *blob, int node)
+{
+	struct driver *driver = ll_entry_start(struct driver, driver);
+	const int n_ents = ll_entry_count(struct driver, driver);
+	const struct udevice_id *of_match;
+	struct driver *entry;
+
+	for (entry = driver; entry != driver + n_ents; entry++) {
+		for (of_match = entry->of_match; of_match &&
+		     of_match->compatible; of_match++) {
+			if (!fdt_node_check_compatible(blob, node,
+						       of_match->compatible))
+				return entry;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Test that the compatible string index binds the drivers that searching
+ * them one by one would, and time the two
+ */
+static int dm_test_fdt_compat_index(struct dm_test_state *dms)
+{
+	const void *blob = gd->fdt_blob;
+	ulong start, indexed, searched;
+	struct udevice *dev;
+	int node;
+	int count, i;
+
+	ut_assertok(dm_scan_fdt(blob, false));
+	count = 0;
+	list_for_each_entry(dev, &dms->root->child_head, sibling_node) {
+		ut_asserteq_ptr(search_compatible(blob, dev->of_offset),
+				dev->driver);
+		count++;
+	}
+	for (node = fdt_first_subnode(blob, 0); node > 0;
+	     node = fdt_next_subnode(blob, node)) {
+		if (search_compatible(blob, node))
+			count--;
+	}
+	ut_asserteq(0, count);
+
+	/* A node which matches no driver costs the most to look up */
+	node = fdt_path_offset(blob, "/junk");
+	ut_assert(node > 0);
+	start = timer_get_us();
+	for (i = 0; i < BIND_COUNT; i++)
+		ut_assertok(lists_bind_fdt(dms->root, blob, node));
+	indexed = timer_get_us() - start;
+
+	start = timer_get_us();
+	for (i = 0; i < BIND_COUNT; i++)
+		ut_asserteq_ptr(NULL, search_compatible(blob, node));
+	searched = timer_get_us() - start;
+
+	printf("%d lookups of %d drivers: indexed %luus, searched %luus\n",
+	       BIND_COUNT, ll_entry_count(struct driver, driver), indexed,
+	       searched);
+
+	return 0;
+}
+DM_TEST(dm_test_fdt_compat_index, 0);
+
+#define CACHE_COUNT	1000
+
+/* Check that every node with this string is found, in the same order */
+static int check_cache_compat(struct dm_test_state *dms, const void *blob,
+			      const char *compat)
+{
+	int node, cached;
+
+	node = -1;
+	do {
+		cached = fdtdec_node_offset_by_compatible(blob, node, compat);
+		node = fdt_node_offset_by_compatible(blob, node, compat);
+		ut_asserteq(node, cached);
+	} while (node >= 0);
+
+	return 0;
+}
+
+/*
+ * Test that cached lookups give what libfdt does, that a write to the blob
+ * is seen, and time the two
+ */
+static int dm_test_fdt_cache(struct dm_test_state *dms)
+{
+	static const char * const paths[] = {
+		"/aliases", "/some-bus/c-test@1", "console", "testfdt6",
+		"/nothing", "/some-bus/nothing",
+	};
+	static const char * const compats[] = {
+		"denx,u-boot-fdt-test", "google,another-fdt-test",
+		"sandbox,gpio", "not,compatible", "nothing",
+	};
+	void *blob = (void *)gd->fdt_blob;
+	ulong start, cached, searched;
+	uint32_t phandle;
+	int node, i;
+
+	for (node = 0; node >= 0; node = fdt_next_node(blob, node, NULL)) {
+		phandle = fdt_get_phandle(blob, node);
+		if (!phandle)
+			continue;
+		ut_asserteq(node, fdtdec_node_offset_by_phandle(blob, phandle));
+	}
+	ut_asserteq(-FDT_ERR_NOTFOUND,
+		    fdtdec_node_offset_by_phandle(blob, 0x1234));
+	ut_asserteq(-FDT_ERR_BADPHANDLE,
+		    fdtdec_node_offset_by_phandle(blob, 0));
+
+	/* Look each path up twice, the second time from the cache */
+	for (i = 0; i < 2 * ARRAY_SIZE(paths); i++) {
+		const char *path = paths[i % ARRAY_SIZE(paths)];
+
+		ut_asserteq(fdt_path_offset(blob, path),
+			    fdtdec_path_offset(blob, path));
+	}
+	for (i = 0; i < ARRAY_SIZE(compats); i++)
+		ut_assertok(check_cache_compat(dms, blob, compats[i]));
+
+	/* Rename d-test's compatible string in place, then put it back */
+	node = fdt_path_offset(blob, "/d-test");
+	ut_assert(node > 0);
+	ut_assertok(fdt_setprop_inplace(blob, node, "compatible",
+					"google,another-fdt-tesx", 24));
+	ut_asserteq(node, fdtdec_node_offset_by_compatible(blob, -1,
+					"google,another-fdt-tesx"));
+	ut_assert(fdtdec_node_offset_by_compatible(blob, -1,
+					"google,another-fdt-test") > node);
+	ut_assertok(fdt_setprop_inplace(blob, node, "compatible",
+					"google,another-fdt-test", 24));
+	ut_assertok(check_cache_compat(dms, blob, "google,another-fdt-test"));
+
+	/* A path near the end of the tree, and a phandle, cost the most */
+	phandle = fdt_get_phandle(blob, fdt_path_offset(blob, "/base-gpios"));
+	ut_assert(phandle);
+	start = timer_get_us();
+	for (i = 0; i < CACHE_COUNT; i++) {
+		ut_assert(fdtdec_path_offset(blob, "testfdt6") > 0);
+		ut_assert(fdtdec_node_offset_by_phandle(blob, phandle) > 0);
+	}
+	cached = timer_get_us() - start;
+
+	start = timer_get_us();
+	for (i = 0; i < CACHE_COUNT; i++) {
+		ut_assert(fdt_path_offset(blob, "testfdt6") > 0);
+		ut_assert(fdt_node_offset_by_phandle(blob, phandle) > 0);
+	}
+	searched = timer_get_us() - start;
+
+	printf("%d path and phandle lookups: cached %luus, searched %luus\n",
+	       CACHE_COUNT, cached, searched);
+
+	return 0;
+}
+DM_TEST(dm_test_fdt_cache, 0);
+
 /* Test that we can find a device by device tree offset */
 static int dm_test_fdt_offset(struct dm_test_state *dms)
 {
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Test of saving only the changed blocks of the environment
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <environment.h>
+#include <malloc.h>
+#include <test.h>
+
+#define TEST_BLK_SIZE		512
+#define TEST_BLKS		DIV_ROUND_UP(CONFIG_ENV_SIZE, TEST_BLK_SIZE)
+
+/* Storage for one copy of the environment, in RAM */
+struct test_store {
+	char data[CONFIG_ENV_SIZE];
+	int writes;		/* number of calls to test_write() */
+	uint first;		/* first block of the first write */
+	uint last;		/* first block of the last write */
+	int fail;		/* fail the write when this reaches 0 */
+};
+
+static int test_write(void *priv, uint start, uint count, const void *buf)
+{
+	struct test_store *store = priv;
+	uint offset = start * TEST_BLK_SIZE;
+
+	if (store->fail >= 0 && !store->fail--)
+		return -EIO;
+	if (!store->writes++)
+		store->first = start;
+	store->last = start;
+	memcpy(store->data + offset, buf,
+	       min(count * TEST_BLK_SIZE, CONFIG_ENV_SIZE - offset));
+
+	return 0;
+}
+
+/* Export the environment and save it to @store */
+static int save(struct test_store *store, env_t *env_new)
+{
+	store->writes = 0;
+	if (env_export(env_new))
+		return -1;
+
+	return env_write_changed(0, env_new, TEST_BLK_SIZE, test_write, store);
+}
+
+static int test_save(struct test_store *store, env_t *env_new)
+{
+	char pad[TEST_BLK_SIZE + 100];
+	int start, ret = 0;
+
+	start = mallinfo().uordblks;
+	env_shadow_set(0, NULL, 0);
+	store->fail = -1;
+
+	/* With nothing known of the storage, all of it is written */
+	errcheck(!env_unchanged(0));
+	errcheck(!env_shadow_get(0));
+	memset(pad, 'x', sizeof(pad) - 1);
+	pad[sizeof(pad) - 1] = '\0';
+	errcheck(!setenv("testpad", pad));
+	errcheck(!setenv("testvar", "1"));
+	errcheck(save(store, env_new) == TEST_BLKS);
+	errcheck(store->writes == 1);
+	errcheck(!memcmp(store->data, env_new, CONFIG_ENV_SIZE));
+	errcheck(env_unchanged(0));
+
+	/*
+	 * A value of the same length, which is past the first block, changes
+	 * that block and the first, which is written last
+	 */
+	errcheck(!setenv("testvar", "2"));
+	errcheck(!env_unchanged(0));
+	errcheck(save(store, env_new) == 2);
+	errcheck(store->writes == 2);
+	errcheck(store->first > 0 && store->last == 0);
+	errcheck(!memcmp(store->data, env_new, CONFIG_ENV_SIZE));
+	errcheck(env_unchanged(0));
+
+	/* Nothing changed, so nothing is written */
+	errcheck(!save(store, env_new));
+	errcheck(!store->writes);
+
+	/* Setting a variable to what it was is a change, but writes nothing */
+	errcheck(!setenv("testvar", "2"));
+	errcheck(!env_unchanged(0));
+	errcheck(!save(store, env_new));
+	errcheck(env_unchanged(0));
+
+	/* After a failed write, the storage is not known */
+	errcheck(!setenv("testvar", "3"));
+	store->fail = 1;
+	errcheck(save(store, env_new) == -EIO);
+	errcheck(!env_shadow_get(0));
+	errcheck(!env_unchanged(0));
+	store->fail = -1;
+	errcheck(save(store, env_new) == TEST_BLKS);
+	errcheck(!memcmp(store->data, env_new, CONFIG_ENV_SIZE));
+
+	/* The other copy is kept apart */
+	errcheck(!env_shadow_get(1));
+	errcheck(!env_unchanged(1));
+
+out:
+	setenv("testvar", NULL);
+	setenv("testpad", NULL);
+	env_shadow_set(0, NULL, 0);
+	if (mallinfo().uordblks != start)
+		ret = 1;
+	test_result("save", ret);
+
+	return ret;
+}
+
+static int test_env_save(void)
+{
+	struct test_store *store;
+	env_t *env_new;
+	int err = 1;
+
+	store = malloc(sizeof(*store));
+	env_new = malloc(CONFIG_ENV_SIZE);
+	if (store && env_new)
+		err = test_save(store, env_new);
+	free(store);
+	free(env_new);
+
+	return err;
+}
+
+TEST_CMD(test_env_save,
+	 "Test saving only the changed blocks of the environment");
@@ -0,0 +1,251 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Test and benchmark of batched device tree changes
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <fdt_support.h>
+#include <malloc.h>
+#include <libfdt.h>
+#include <test.h>
+
+#define TEST_TREE_SIZE		(256 << 10)
+#define TEST_NODES		40
+#define BENCH_NODES		500
+
+/* A tree with some nodes for the fixups to find */
+static int make_tree(void *fdt, int nodes)
+{
+	char name[20];
+	int i, node;
+
+	if (fdt_create_empty_tree(fdt, TEST_TREE_SIZE) ||
+	    fdt_setprop_string(fdt, 0, "compatible", "test,board"))
+		return -1;
+	for (i = nodes - 1; i >= 0; i--) {
+		sprintf(name, "node@%x", i);
+		node = fdt_add_subnode(fdt, 0, name);
+		if (node < 0 ||
+		    fdt_setprop_u32(fdt, node, "reg", i) ||
+		    fdt_setprop_string(fdt, node, "compatible", "test,node"))
+			return -1;
+	}
+
+	return 0;
+}
+
+static const char * const status[] = { "okay", "disabled", "fail" };
+
+/*
+ * The fixups, made with libfdt. Each change moves the rest of the tree,
+ * so the node after this one must be found from this one's offset.
+ */
+static int fixup_libfdt(void *fdt)
+{
+	fdt64_t reg;
+	int node, sub;
+	int i;
+
+	for (node = fdt_node_offset_by_compatible(fdt, -1, "test,node"), i = 0;
+	     node >= 0;
+	     node = fdt_node_offset_by_compatible(fdt, node, "test,node"),
+	     i++) {
+		if (fdt_setprop_u32(fdt, node, "clock-frequency", i) ||
+		    fdt_setprop_u32(fdt, node, "reg", i + 1) ||
+		    fdt_setprop_string(fdt, node, "status", status[i % 2]))
+			return -1;
+		if (!(i % 3)) {
+			reg = cpu_to_fdt64(i);
+			if (fdt_setprop(fdt, node, "reg", &reg, sizeof(reg)))
+				return -1;
+		}
+		if (!(i % 5) && (fdt_delprop(fdt, node, "clock-frequency") ||
+				 fdt_setprop_u32(fdt, node, "clock-frequency",
+						 i * 2)))
+			return -1;
+		if (!(i % 7)) {
+			sub = fdt_add_subnode(fdt, node, "extra");
+			if (sub < 0 ||
+			    fdt_setprop_string(fdt, sub, "status", status[2]))
+				return -1;
+			sub = fdt_add_subnode(fdt, sub, "deeper");
+			if (sub < 0 || fdt_setprop_u32(fdt, sub, "level", 2))
+				return -1;
+		}
+		if (!(i % 11) && fdt_setprop_string(fdt, node, "status",
+						     status[2]))
+			return -1;
+	}
+
+	return node == -FDT_ERR_NOTFOUND ? 0 : -1;
+}
+
+/* The same fixups in a batch, with the tree staying where it is */
+static int fixup_batch(void *fdt)
+{
+	struct fdt_batch batch;
+	fdt64_t reg;
+	int node, sub;
+	int i;
+
+	if (fdt_batch_init(&batch, fdt))
+		return -1;
+	for (node = fdt_node_offset_by_compatible(fdt, -1, "test,node"), i = 0;
+	     node >= 0;
+	     node = fdt_node_offset_by_compatible(fdt, node, "test,node"),
+	     i++) {
+		if (fdt_batch_setprop_u32(&batch, node, "clock-frequency", i) ||
+		    fdt_batch_setprop_u32(&batch, node, "reg", i + 1) ||
+		    fdt_batch_setprop_string(&batch, node, "status",
+					     status[i % 2]))
+			goto err;
+		if (!(i % 3)) {
+			reg = cpu_to_fdt64(i);
+			if (fdt_batch_setprop(&batch, node, "reg", &reg,
+					      sizeof(reg)))
+				goto err;
+		}
+		if (!(i % 5) &&
+		    (fdt_batch_delprop(&batch, node, "clock-frequency") ||
+		     fdt_batch_setprop_u32(&batch, node, "clock-frequency",
+					   i * 2)))
+			goto err;
+		if (!(i % 7)) {
+			sub = fdt_batch_add_subnode(&batch, node, "extra");
+			if (sub < 0 ||
+			    fdt_batch_setprop_string(&batch, sub, "status",
+						     status[2]))
+				goto err;
+			sub = fdt_batch_add_subnode(&batch, sub, "deeper");
+			if (sub < 0 ||
+			    fdt_batch_setprop_u32(&batch, sub, "level", 2))
+				goto err;
+		}
+		if (!(i % 11) && fdt_batch_setprop_string(&batch, node,
+							  "status", status[2]))
+			goto err;
+	}
+
+	return fdt_batch_commit(&batch) ? -1 : 0;
+err:
+	fdt_batch_discard(&batch);
+	return -1;
+}
+
+/*
+ * Check that two trees are the same, tag by tag. The padding after values
+ * is not compared, since libfdt leaves whatever was there before.
+ */
+static int same_tree(const void *a, const void *b)
+{
+	const struct fdt_property *pa, *pb;
+	int offset, next, len;
+	uint32_t tag;
+
+	for (offset = 0; ; offset = next) {
+		tag = fdt_next_tag(a, offset, &next);
+		if (next < 0 || tag != fdt_next_tag(b, offset, &len) ||
+		    len != next)
+			return 0;
+		if (tag == FDT_BEGIN_NODE &&
+		    strcmp(fdt_get_name(a, offset, NULL),
+			   fdt_get_name(b, offset, NULL)))
+			return 0;
+		if (tag == FDT_PROP) {
+			pa = fdt_get_property_by_offset(a, offset, &len);
+			pb = fdt_get_property_by_offset(b, offset, NULL);
+			if (pa->nameoff != pb->nameoff || pa->len != pb->len ||
+			    memcmp(pa->data, pb->data, len))
+				return 0;
+		}
+		if (tag == FDT_END)
+			break;
+	}
+
+	return fdt_size_dt_strings(a) == fdt_size_dt_strings(b) &&
+		!memcmp((char *)a + fdt_off_dt_strings(a),
+			(char *)b + fdt_off_dt_strings(b),
+			fdt_size_dt_strings(a));
+}
+
+static int test_batch(void *a, void *b)
+{
+	struct fdt_batch batch;
+	int ret = 0;
+	int node;
+
+	errcheck(!make_tree(a, TEST_NODES));
+	memcpy(b, a, TEST_TREE_SIZE);
+	errcheck(!fixup_libfdt(a));
+	errcheck(!fixup_batch(b));
+	errcheck(!fdt_check_header(b));
+	errcheck(same_tree(a, b));
+
+	/* Mistakes are caught as libfdt would catch them */
+	errcheck(!fdt_batch_init(&batch, b));
+	node = fdt_path_offset(b, "/node@7");
+	errcheck(node > 0);
+	errcheck(fdt_batch_add_subnode(&batch, node, "extra") ==
+		 -FDT_ERR_EXISTS);
+	errcheck(fdt_batch_delprop(&batch, node, "nothing") ==
+		 -FDT_ERR_NOTFOUND);
+	errcheck(fdt_batch_setprop_u32(&batch, node + 1, "reg", 0) ==
+		 -FDT_ERR_BADOFFSET);
+	errcheck(fdt_batch_setprop_u32(&batch, batch.end, "reg", 0) ==
+		 -FDT_ERR_BADOFFSET);
+	errcheck(!fdt_batch_commit(&batch));
+
+	/* A tree with no room to grow is left as it was */
+	errcheck(!fdt_pack(b));
+	memcpy(a, b, fdt_totalsize(b));
+	errcheck(!fdt_batch_init(&batch, b));
+	errcheck(!fdt_batch_setprop_u32(&batch, node, "new-property", 1));
+	errcheck(fdt_batch_commit(&batch) == -FDT_ERR_NOSPACE);
+	errcheck(!memcmp(a, b, fdt_totalsize(b)));
+
+out:
+	test_result("batch", ret);
+
+	return ret;
+}
+
+static ulong bench(const char *name, int (*fixup)(void *), void *fdt)
+{
+	ulong start, us;
+
+	if (make_tree(fdt, BENCH_NODES))
+		return 0;
+	start = timer_get_us();
+	if (fixup(fdt))
+		printf(" %s: failed\n", name);
+	us = timer_get_us() - start;
+	printf(" %s, %d nodes: %lu us, tree %d bytes\n", name, BENCH_NODES, us,
+	       fdt_size_dt_struct(fdt) + fdt_size_dt_strings(fdt));
+
+	return us;
+}
+
+static int test_fdt_batch(void)
+{
+	void *a, *b;
+	int err = 1;
+
+	a = malloc(TEST_TREE_SIZE);
+	b = malloc(TEST_TREE_SIZE);
+	if (a && b) {
+		err = test_batch(a, b);
+		bench("libfdt", fixup_libfdt, a);
+		bench("batch", fixup_batch, b);
+		if (!same_tree(a, b))
+			err++;
+	}
+	free(a);
+	free(b);
+
+	return err;
+}
+
+TEST_CMD(test_fdt_batch, "Test and benchmark batched device tree changes");
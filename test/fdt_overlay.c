@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Test of device tree overlays
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <command.h>
+#include <malloc.h>
+#include <libfdt.h>
+#include <test.h>
+#include <asm/io.h>
+
+#define TEST_TREE_SIZE		(16 << 10)
+
+/* fdt_property() of a list of strings, given with their terminators */
+#define property_list(fdt, name, list) \
+	fdt_property(fdt, name, list, sizeof(list))
+
+/*
+ * / {
+ *	gpio: gpio { phandle = <1>; };
+ *	serial { status = "disabled"; };
+ *	__symbols__ { gpio = "/gpio"; };
+ * };
+ */
+static int make_base(void *fdt)
+{
+	if (fdt_create(fdt, TEST_TREE_SIZE) ||
+	    fdt_finish_reservemap(fdt) ||
+	    fdt_begin_node(fdt, "") ||
+	    fdt_property_string(fdt, "compatible", "test,board") ||
+	    fdt_begin_node(fdt, "gpio") ||
+	    fdt_property_cell(fdt, "phandle", 1) ||
+	    fdt_property_cell(fdt, "#gpio-cells", 2) ||
+	    fdt_end_node(fdt) ||
+	    fdt_begin_node(fdt, "serial") ||
+	    fdt_property_string(fdt, "status", "disabled") ||
+	    fdt_end_node(fdt) ||
+	    fdt_begin_node(fdt, "__symbols__") ||
+	    fdt_property_string(fdt, "gpio", "/gpio") ||
+	    fdt_end_node(fdt) ||
+	    fdt_end_node(fdt) ||
+	    fdt_finish(fdt))
+		return -1;
+
+	return fdt_open_into(fdt, fdt, TEST_TREE_SIZE);
+}
+
+/*
+ * What dtc -@ makes of:
+ *
+ * &gpio { gpio-line-names = "a", "b"; };
+ * &{/} { cape: cape { compatible = "test,cape";
+ *		       gpios = <&gpio 3 0>; self = <&cape>; }; };
+ * &{/serial} { status = "okay"; };
+ *
+ * with @label naming a label which the fixups refer to.
+ */
+static int make_overlay(void *fdt, const char *label)
+{
+	fdt32_t gpios[] = { cpu_to_fdt32(~0), cpu_to_fdt32(3), 0 };
+
+	if (fdt_create(fdt, TEST_TREE_SIZE) ||
+	    fdt_finish_reservemap(fdt) ||
+	    fdt_begin_node(fdt, "") ||
+	    fdt_begin_node(fdt, "fragment@0") ||
+	    fdt_property_cell(fdt, "target", ~0) ||
+	    fdt_begin_node(fdt, "__overlay__") ||
+	    property_list(fdt, "gpio-line-names", "a\0b") ||
+	    fdt_end_node(fdt) ||
+	    fdt_end_node(fdt) ||
+	    fdt_begin_node(fdt, "fragment@1") ||
+	    fdt_property_string(fdt, "target-path", "/") ||
+	    fdt_begin_node(fdt, "__overlay__") ||
+	    fdt_begin_node(fdt, "cape") ||
+	    fdt_property_string(fdt, "compatible", "test,cape") ||
+	    fdt_property(fdt, "gpios", gpios, sizeof(gpios)) ||
+	    fdt_property_cell(fdt, "self", 1) ||
+	    fdt_property_cell(fdt, "phandle", 1) ||
+	    fdt_end_node(fdt) ||
+	    fdt_end_node(fdt) ||
+	    fdt_end_node(fdt) ||
+	    fdt_begin_node(fdt, "fragment@2") ||
+	    fdt_property_string(fdt, "target-path", "/serial") ||
+	    fdt_begin_node(fdt, "__overlay__") ||
+	    fdt_property_string(fdt, "status", "okay") ||
+	    fdt_end_node(fdt) ||
+	    fdt_end_node(fdt) ||
+	    fdt_begin_node(fdt, "__symbols__") ||
+	    fdt_property_string(fdt, "cape", "/fragment@1/__overlay__/cape") ||
+	    fdt_end_node(fdt) ||
+	    fdt_begin_node(fdt, "__fixups__") ||
+	    property_list(fdt, label, "/fragment@0:target:0\0"
+			  "/fragment@1/__overlay__/cape:gpios:0") ||
+	    fdt_end_node(fdt) ||
+	    fdt_begin_node(fdt, "__local_fixups__") ||
+	    fdt_begin_node(fdt, "fragment@1") ||
+	    fdt_begin_node(fdt, "__overlay__") ||
+	    fdt_begin_node(fdt, "cape") ||
+	    fdt_property_cell(fdt, "self", 0) ||
+	    fdt_end_node(fdt) ||
+	    fdt_end_node(fdt) ||
+	    fdt_end_node(fdt) ||
+	    fdt_end_node(fdt) ||
+	    fdt_end_node(fdt) ||
+	    fdt_finish(fdt))
+		return -1;
+
+	return 0;
+}
+
+/* A second overlay, which adds to the cape put in by the first */
+static int make_stacked(void *fdt)
+{
+	if (fdt_create(fdt, TEST_TREE_SIZE) ||
+	    fdt_finish_reservemap(fdt) ||
+	    fdt_begin_node(fdt, "") ||
+	    fdt_begin_node(fdt, "fragment@0") ||
+	    fdt_property_cell(fdt, "target", ~0) ||
+	    fdt_begin_node(fdt, "__overlay__") ||
+	    fdt_property_cell(fdt, "extra", 5) ||
+	    fdt_begin_node(fdt, "led") ||
+	    fdt_property_cell(fdt, "phandle", 1) ||
+	    fdt_end_node(fdt) ||
+	    fdt_end_node(fdt) ||
+	    fdt_end_node(fdt) ||
+	    fdt_begin_node(fdt, "__fixups__") ||
+	    fdt_property_string(fdt, "cape", "/fragment@0:target:0") ||
+	    fdt_end_node(fdt) ||
+	    fdt_end_node(fdt) ||
+	    fdt_finish(fdt))
+		return -1;
+
+	return 0;
+}
+
+static int getprop_u32(const void *fdt, const char *path, const char *name,
+		       int index)
+{
+	const fdt32_t *val;
+	int len;
+
+	val = fdt_getprop(fdt, fdt_path_offset(fdt, path), name, &len);
+	if (!val || len < (index + 1) * sizeof(*val))
+		return -1;
+
+	return fdt32_to_cpu(val[index]);
+}
+
+static int test_overlay(void *base, void *overlay, void *copy)
+{
+	const char *str;
+	char cmd[80];
+	int ret = 0;
+	int len;
+
+	errcheck(!make_base(base));
+	errcheck(!make_overlay(overlay, "gpio"));
+	errcheck(!fdt_overlay_apply(base, overlay));
+	errcheck(!fdt_check_header(base));
+
+	/* The fragments went where their targets said */
+	str = fdt_getprop(base, fdt_path_offset(base, "/gpio"),
+			  "gpio-line-names", &len);
+	errcheck(str && len == 4 && !memcmp(str, "a\0b", 4));
+	str = fdt_getprop(base, fdt_path_offset(base, "/serial"), "status",
+			  NULL);
+	errcheck(str && !strcmp(str, "okay"));
+	str = fdt_getprop(base, fdt_path_offset(base, "/cape"), "compatible",
+			  NULL);
+	errcheck(str && !strcmp(str, "test,cape"));
+
+	/* The cape's phandle moved above the gpio's, and so did its uses */
+	errcheck(getprop_u32(base, "/cape", "phandle", 0) == 2);
+	errcheck(getprop_u32(base, "/cape", "self", 0) == 2);
+	errcheck(getprop_u32(base, "/cape", "gpios", 0) == 1);
+	errcheck(getprop_u32(base, "/cape", "gpios", 1) == 3);
+	str = fdt_getprop(base, fdt_path_offset(base, "/__symbols__"), "cape",
+			  NULL);
+	errcheck(str && !strcmp(str, "/cape"));
+
+	/* An overlay is used up once applied */
+	errcheck(fdt_check_header(overlay));
+	errcheck(fdt_overlay_apply(base, overlay) == -FDT_ERR_BADMAGIC);
+
+	/* A later overlay can use the labels of an earlier one */
+	errcheck(!make_stacked(overlay));
+	errcheck(!fdt_overlay_apply(base, overlay));
+	errcheck(getprop_u32(base, "/cape", "extra", 0) == 5);
+	errcheck(getprop_u32(base, "/cape/led", "phandle", 0) == 3);
+
+	/* A label which is not there leaves the base tree alone */
+	memcpy(copy, base, TEST_TREE_SIZE);
+	errcheck(!make_overlay(overlay, "nothing"));
+	errcheck(fdt_overlay_apply(base, overlay) == -FDT_ERR_NOTFOUND);
+	errcheck(!memcmp(copy, base, TEST_TREE_SIZE));
+
+	/* As does a fragment with nowhere to go */
+	errcheck(!make_overlay(overlay, "gpio"));
+	errcheck(!fdt_delprop(overlay, fdt_path_offset(overlay, "/fragment@2"),
+			      "target-path"));
+	errcheck(fdt_overlay_apply(base, overlay) == -FDT_ERR_BADOVERLAY);
+	errcheck(!memcmp(copy, base, TEST_TREE_SIZE));
+
+	/* And the fdt command does the same as the function */
+	errcheck(!make_base(base));
+	errcheck(!make_overlay(overlay, "gpio"));
+	sprintf(cmd, "fdt addr %lx", (ulong)map_to_sysmem(base));
+	errcheck(!run_command(cmd, 0));
+	sprintf(cmd, "fdt apply %lx", (ulong)map_to_sysmem(overlay));
+	errcheck(!run_command(cmd, 0));
+	errcheck(getprop_u32(base, "/cape", "gpios", 0) == 1);
+	errcheck(run_command(cmd, 0));
+
+out:
+	test_result("overlay", ret);
+
+	return ret;
+}
+
+static int test_fdt_overlay(void)
+{
+	void *base, *overlay, *copy;
+	int err = 1;
+
+	base = malloc(TEST_TREE_SIZE);
+	overlay = malloc(TEST_TREE_SIZE);
+	copy = malloc(TEST_TREE_SIZE);
+	if (base && overlay && copy)
+		err = test_overlay(base, overlay, copy);
+	free(base);
+	free(overlay);
+	free(copy);
+
+	return err;
+}
+
+TEST_CMD(test_fdt_overlay, "Test device tree overlays");
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Test and benchmark of environment import into the hash table
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <malloc.h>
+#include <search.h>
+#include <test.h>
+
+#define TEST_ENV_SIZE		(64 << 10)
+#define TEST_ENTRIES		4096
+
+/* A NUL separated environment of about TEST_ENV_SIZE, as stored in flash */
+static int make_env(char *env, const char *value)
+{
+	char *p = env;
+	int i;
+
+	for (i = 0; p + 64 < env + TEST_ENV_SIZE; i++)
+		p += sprintf(p, "var%d=%s %d", i, value, i) + 1;
+	*p = '\0';
+
+	return i;
+}
+
+static const char *find(struct hsearch_data *htab, const char *key)
+{
+	ENTRY e, *ep;
+
+	e.key = key;
+	e.data = NULL;
+	hsearch_r(e, FIND, &ep, htab, 0);
+
+	return ep ? ep->data : NULL;
+}
+
+static int enter(struct hsearch_data *htab, const char *key, const char *data)
+{
+	ENTRY e, *ep;
+
+	e.key = key;
+	e.data = (char *)data;
+	hsearch_r(e, ENTER, &ep, htab, 0);
+
+	return ep ? 0 : -1;
+}
+
+static int test_import(char *env)
+{
+	struct hsearch_data htab;
+	int start, table, ret = 0;
+	char *res = NULL;
+	const char *val;
+	char key[20];
+	ssize_t len;
+	int count, i;
+
+	memset(&htab, '\0', sizeof(htab));
+	start = mallinfo().uordblks;
+	errcheck(hcreate_r(TEST_ENTRIES, &htab));
+	table = mallinfo().uordblks;
+
+	/* The whole import is a single copy of the environment */
+	count = make_env(env, "value");
+	errcheck(himport_r(&htab, env, TEST_ENV_SIZE, '\0', H_NOCLEAR, 0, 0,
+			   NULL));
+	errcheck(htab.filled == count);
+	errcheck(mallinfo().uordblks - table < TEST_ENV_SIZE + 64);
+	val = find(&htab, "var7");
+	errcheck(val && !strcmp(val, "value 7"));
+
+	/* Entries can be changed and copied, and deleted */
+	errcheck(!enter(&htab, "var7", "changed"));
+	errcheck(!enter(&htab, "copy", find(&htab, "var8")));
+	errcheck(hdelete_r("var9", &htab, 0));
+	val = find(&htab, "var7");
+	errcheck(val && !strcmp(val, "changed"));
+	val = find(&htab, "copy");
+	errcheck(val && !strcmp(val, "value 8"));
+	errcheck(!find(&htab, "var9"));
+
+	/* A second import only replaces what it has */
+	errcheck(himport_r(&htab, "var1=again\0var9=back\0\0", 32, '\0',
+			   H_NOCLEAR, 0, 0, NULL));
+	val = find(&htab, "var1");
+	errcheck(val && !strcmp(val, "again"));
+	val = find(&htab, "var9");
+	errcheck(val && !strcmp(val, "back"));
+	val = find(&htab, "var2");
+	errcheck(val && !strcmp(val, "value 2"));
+
+	/* Exporting and importing again gives back the same */
+	len = hexport_r(&htab, '\0', 0, &res, 0, 0, NULL);
+	errcheck(len > 0);
+	hdestroy_r(&htab);
+	errcheck(hcreate_r(TEST_ENTRIES, &htab));
+	errcheck(himport_r(&htab, res, len, '\0', H_NOCLEAR, 0, 0, NULL));
+	free(res);
+	res = NULL;
+	len = hexport_r(&htab, '\n', 0, &res, 0, 0, NULL);
+	errcheck(len > 0);
+	hdestroy_r(&htab);
+	errcheck(hcreate_r(TEST_ENTRIES, &htab));
+	errcheck(himport_r(&htab, res, len, '\n', H_NOCLEAR, 0, 0, NULL));
+	errcheck(htab.filled == count + 1);
+	val = find(&htab, "var7");
+	errcheck(val && !strcmp(val, "changed"));
+
+	/* The imported data goes once nothing uses it */
+	for (i = 0; i < count; i++) {
+		sprintf(key, "var%d", i);
+		errcheck(hdelete_r(key, &htab, 0));
+	}
+	errcheck(hdelete_r("copy", &htab, 0));
+	errcheck(!htab.filled);
+	errcheck(!htab.arena);
+
+	/* An import which deletes an entry it has just made */
+	errcheck(himport_r(&htab, "a=1\na\nb=2\n", 10, '\n', H_NOCLEAR, 0, 0,
+			   NULL));
+	errcheck(!find(&htab, "a"));
+	val = find(&htab, "b");
+	errcheck(val && !strcmp(val, "2"));
+	errcheck(hdelete_r("b", &htab, 0));
+	errcheck(!htab.arena);
+
+out:
+	free(res);
+	hdestroy_r(&htab);
+	if (mallinfo().uordblks != start)
+		ret = 1;
+	test_result("import", ret);
+
+	return ret;
+}
+
+/* Importing, against entering the variables one by one */
+static void bench(char *env)
+{
+	struct hsearch_data htab;
+	ulong start, us;
+	int count, used, pass;
+	char *p, *value;
+
+	memset(&htab, '\0', sizeof(htab));
+	count = make_env(env, "a typical value for a variable");
+
+	/* The first pass just warms up the malloc() pool */
+	for (pass = 0; pass < 2; pass++) {
+		hcreate_r(TEST_ENTRIES, &htab);
+		used = mallinfo().uordblks;
+		start = timer_get_us();
+		himport_r(&htab, env, TEST_ENV_SIZE, '\0', H_NOCLEAR, 0, 0,
+			  NULL);
+		us = timer_get_us() - start;
+		used = mallinfo().uordblks - used;
+		hdestroy_r(&htab);
+	}
+	printf(" %d variables imported: %lu us, %d bytes\n", count, us, used);
+
+	hcreate_r(TEST_ENTRIES, &htab);
+	used = mallinfo().uordblks;
+	start = timer_get_us();
+	for (p = env; *p; p = value + strlen(value) + 1) {
+		value = strchr(p, '=');
+		*value++ = '\0';
+		if (enter(&htab, p, value))
+			break;
+	}
+	us = timer_get_us() - start;
+	used = mallinfo().uordblks - used;
+	hdestroy_r(&htab);
+	printf(" %d variables entered one by one: %lu us, %d bytes\n", count,
+	       us, used);
+}
+
+static int test_hashtable(void)
+{
+	char *env;
+	int err = 1;
+
+	env = malloc(TEST_ENV_SIZE);
+	if (env) {
+		err = test_import(env);
+		bench(env);
+	}
+	free(env);
+
+	return err;
+}
+
+TEST_CMD(test_hashtable, "Test and benchmark environment import");
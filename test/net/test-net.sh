@@ -0,0 +1,150 @@
+# Copyright (C) 2026 agent <agent@local>
+#
+# SPDX-License-Identifier:	GPL-2.0+
+#
+
+# Simple test script for downloads over sandbox's emulated ethernet
+
+OUTPUT_DIR=sandbox
+
+fail() {
+	echo "Test failed: $1"
+	rm -rf ${tmp} ${dir} ${img}
+	exit 1
+}
+
+build_uboot() {
+	echo "Build sandbox"
+	OPTS="O=${OUTPUT_DIR}"
+	NUM_CPUS=$(grep -c processor /proc/cpuinfo)
+	make ${OPTS} sandbox_config
+	make ${OPTS} -s -j${NUM_CPUS}
+}
+
+# Run the commands in $1 with the server and addresses set up
+run_net() {
+	timeout 120 ./${OUTPUT_DIR}/u-boot -c "
+	setenv sandbox_eth_root ${dir}
+	setenv ipaddr 10.0.0.2
+	setenv eth1ipaddr 10.0.1.2
+	setenv serverip 10.0.0.1
+	$1"
+}
+
+# The file over TFTP, with one frame per block and with fragmented ones,
+# and over NFS
+run_download() {
+	echo "Run download"
+	run_net "
+	tftpboot 1000000 file
+	hash sha256 1000000 \${filesize}
+	setenv tftpblocksize 16000
+	tftpboot 1000000 file
+	hash sha256 1000000 \${filesize}
+	nfs 1000000 /file
+	hash sha256 1000000 \${filesize}"
+}
+
+# Half of the file over each interface, then each part on its own when
+# the file is too small to split
+run_parallel() {
+	echo "Run parallel download"
+	run_net "
+	setenv ethparallel sb_eth0,sb_eth1
+	nfs 1000000 /file
+	hash sha256 1000000 \${filesize}
+	nfs 1000000 /small
+	hash sha256 1000000 \${filesize}"
+}
+
+# The file written straight to a host block device, over TFTP and NFS,
+# then to a place where it does not fit
+run_sink() {
+	echo "Run netsink"
+	run_net "
+	sb bind 0 ${img}
+	netsink host 0 10 tftpboot file
+	netsink host 0 2000 nfs /file
+	netsink host 0 3ff0 tftpboot file"
+}
+
+# Each reply takes 1ms: over two interfaces, they arrive side by side
+run_timing() {
+	echo "Run timing"
+	run_net "
+	setenv sandbox_eth_latency 1000
+	time nfs 1000000 /file
+	setenv ethparallel sb_eth0,sb_eth1
+	time nfs 1000000 /file"
+}
+
+check_download() {
+	echo "Check download"
+
+	sum=$(sha256sum ${dir}/file | cut -d' ' -f1)
+	if [ $(grep -c "==> ${sum}" ${tmp}) -ne 3 ]; then
+		fail "download error"
+	fi
+}
+
+check_parallel() {
+	echo "Check parallel download"
+
+	sum1=$(sha256sum ${dir}/file | cut -d' ' -f1)
+	sum2=$(sha256sum ${dir}/small | cut -d' ' -f1)
+	if ! grep -q "==> ${sum1}" ${tmp} || ! grep -q "==> ${sum2}" ${tmp}
+	then
+		fail "parallel download error"
+	fi
+	if ! grep -q "^sb_eth1: 1.6 MiB" ${tmp}; then
+		fail "second interface not used"
+	fi
+}
+
+check_sink() {
+	echo "Check netsink"
+
+	# At blocks 0x10 and 0x2000, the rest of the last block untouched
+	if ! cmp -s -n 3000000 -i 8192:0 ${img} ${dir}/file ||
+	   ! cmp -s -n 3000000 -i 4194304:0 ${img} ${dir}/file; then
+		fail "netsink write error"
+	fi
+	if [ -n "$(tail -c +3008193 ${img} | head -c 320 | tr -d '\0')" ]
+	then
+		fail "netsink wrote past the file"
+	fi
+	if ! grep -q "image exceeds destination (16 blocks)" ${tmp}; then
+		fail "netsink overflow not caught"
+	fi
+}
+
+check_timing() {
+	echo "Check timing"
+
+	ms=$(awk '/^time:/ { printf "%d ", $2 * 1000 }' ${tmp})
+	set -- ${ms}
+	echo "3MB fetched in ${1}ms over one interface, ${2}ms over two"
+	if [ -z "$2" ] || [ $(($2 * 3)) -gt $(($1 * 2)) ]; then
+		fail "parallel download too slow"
+	fi
+}
+
+echo "Simple network test using sandbox"
+echo
+tmp="$(mktemp)"
+dir="$(mktemp -d)"
+img="$(mktemp)"
+dd if=/dev/urandom of=${dir}/file bs=1000 count=3000 2>/dev/null
+dd if=/dev/urandom of=${dir}/small bs=100 count=10 2>/dev/null
+dd if=/dev/zero of=${img} bs=1M count=8 2>/dev/null
+build_uboot
+run_download >${tmp}
+check_download
+run_parallel >${tmp}
+check_parallel
+run_sink >${tmp}
+check_sink
+run_timing >${tmp}
+check_timing
+rm -r ${tmp} ${dir} ${img}
+echo "Test passed"
@@ -0,0 +1,188 @@
+#!/usr/bin/python
+#
+# Copyright (C) 2026 agent <agent@local>
+#
+# Test of DFU downloads, with this script as the DFU host
+#
+# SPDX-License-Identifier:	GPL-2.0+
+#
+# To run this:
+#
+# make O=sandbox sandbox_config
+# make O=sandbox
+# ./test/usb/test-dfu.py -u sandbox/u-boot
+#
+# U-Boot runs 'dfu' on sandbox's emulated device controller, to a raw area
+# of a disk. The bus and the disk are both slowed down to the same speed,
+# so that writing the disk while the next blocks come in shows: the
+# download has to take less than the two one after the other.
+
+from __future__ import print_function
+
+from optparse import OptionParser
+import os
+import random
+import re
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+import zlib
+
+sys.path.append(os.path.dirname(os.path.abspath(sys.argv[0])))
+import udc_host
+
+MB = 1 << 20
+DISK_SIZE = 4 * MB
+AREA_START = 1 * MB
+IMAGE_SIZE = 1 * MB
+BACKGROUND = b'\x5a'
+# KiB/s of both the bus and the disk
+SPEED = 512
+# One DFU block
+BLOCK_SIZE = 4096
+# An eighth of the image in each half of the buffer
+BUF_SIZE = IMAGE_SIZE // 4
+# The disk is written a little at a time, so that the host rarely waits
+SLICE_SIZE = 1024
+
+USB_TYPE_CLASS = 0x20
+USB_RECIP_INTERFACE = 1
+USB_REQ_SET_INTERFACE = 11
+DFU_DETACH, DFU_DNLOAD, DFU_GETSTATUS = 0, 1, 3
+DFU_STATE_IDLE, DFU_STATE_DNLOAD_IDLE = 2, 5
+DFU_STATE_MANIFEST = 7
+
+class DfuError(Exception):
+    pass
+
+class Dfu(object):
+    """The host side of the DFU protocol"""
+    def __init__(self, host, intfs):
+        for intf in intfs:
+            if (intf.cls, intf.subclass, intf.protocol) == (0xfe, 1, 2):
+                break
+        else:
+            raise ValueError('no DFU interface')
+        self.host = host
+        self.intf = intf.number
+        host.control(USB_RECIP_INTERFACE, USB_REQ_SET_INTERFACE, 0,
+                     self.intf)
+
+    def request(self, request, value=0, data=b'', length=0):
+        reqtype = USB_TYPE_CLASS | USB_RECIP_INTERFACE
+        if length:
+            reqtype |= udc_host.USB_DIR_IN
+        return self.host.control(reqtype, request, value, self.intf, data,
+                                 length)
+
+    def get_status(self):
+        """Return bState, after waiting as long as the device asked"""
+        status = self.request(DFU_GETSTATUS, length=6)
+        poll_timeout = struct.unpack('<I', status[1:4] + b'\0')[0]
+        if status[0:1] != b'\0':
+            raise DfuError('status %d' % ord(status[0:1]))
+        time.sleep(poll_timeout / 1000.0)
+        return ord(status[4:5])
+
+    def download(self, data):
+        blk = 0
+        for pos in range(0, len(data), BLOCK_SIZE):
+            self.request(DFU_DNLOAD, blk & 0xffff,
+                         data[pos:pos + BLOCK_SIZE])
+            if self.get_status() != DFU_STATE_DNLOAD_IDLE:
+                raise DfuError('block %d not taken' % blk)
+            blk += 1
+        # The empty block that ends the download is numbered like the rest
+        self.request(DFU_DNLOAD, blk & 0xffff)
+        if self.get_status() != DFU_STATE_MANIFEST:
+            raise DfuError('no manifestation')
+        if self.get_status() != DFU_STATE_IDLE:
+            raise DfuError('not back to idle')
+
+    def detach(self):
+        self.request(DFU_DETACH)
+
+def random_bytes(size):
+    return bytes(bytearray(random.getrandbits(8) for i in range(size)))
+
+def fail(msg, log):
+    with open(log) as fd:
+        print(fd.read())
+    raise ValueError('Test failed: %s' % msg)
+
+def run_dfu_test(u_boot, base_dir):
+    disk = os.path.join(base_dir, 'disk.img')
+    log = os.path.join(base_dir, 'u-boot.log')
+    with open(disk, 'wb') as fd:
+        fd.write(BACKGROUND * DISK_SIZE)
+
+    host = udc_host.UdcHost(os.path.join(base_dir, 'udc'))
+    cmd = ('sb bind 0 %s; setenv dfu_alt_info "image raw %#x %#x"; '
+           'setenv dfu_hash_algo crc32; setenv dfu_bufsiz %x; '
+           'setenv dfu_slicesiz %x; setenv sandbox_udc %s; '
+           'setenv sandbox_udc_speed %d; setenv sandbox_host_speed %d; '
+           'dfu 0 host 0' %
+           (disk, AREA_START // 512, (DISK_SIZE - AREA_START) // 512,
+            BUF_SIZE, SLICE_SIZE, host.prefix, SPEED, SPEED))
+    with open(log, 'w') as out:
+        proc = subprocess.Popen([u_boot, '-c', cmd], stdin=open(os.devnull),
+                                stdout=out, stderr=subprocess.STDOUT)
+    image = random_bytes(IMAGE_SIZE)
+    try:
+        host.connect()
+        dfu = Dfu(host, host.enumerate())
+        start = time.time()
+        dfu.download(image)
+        took = time.time() - start
+        dfu.detach()
+    except:
+        proc.kill()
+        raise
+    finally:
+        host.close()
+    if proc.wait():
+        fail('U-Boot exited with %d' % proc.returncode, log)
+
+    # Each of the bus and the disk needs this long on its own
+    one = float(IMAGE_SIZE) / (SPEED * 1024)
+    print('%d MB downloaded in %.2fs, %.2fs for the bus or the disk alone' %
+          (IMAGE_SIZE // MB, took, one))
+    with open(disk, 'rb') as fd:
+        fd.seek(AREA_START)
+        got = fd.read(IMAGE_SIZE)
+        rest = fd.read()
+    if got != image or rest != BACKGROUND * len(rest):
+        fail('disk is wrong', log)
+    with open(log) as fd:
+        crc = re.search('DFU complete crc32: (0x[0-9a-f]+)', fd.read())
+    if not crc or int(crc.group(1), 16) != zlib.crc32(image) & 0xffffffff:
+        fail('wrong or no crc32 reported', log)
+    if took >= 2 * one:
+        fail('disk writes did not overlap the download', log)
+
+def run_tests():
+    """Parse options, run the DFU test and print the result"""
+    parser = OptionParser()
+    parser.add_option('-u', '--u-boot', default='sandbox/u-boot',
+            help='Select U-Boot sandbox binary')
+    parser.add_option('-k', '--keep', action='store_true',
+            help="Don't delete temporary directory even when tests pass")
+    (options, args) = parser.parse_args()
+
+    base_dir = tempfile.mkdtemp()
+    random.seed(1)
+    title = 'DFU Tests'
+    print(title, '\n', '=' * len(title))
+
+    run_dfu_test(options.u_boot, base_dir)
+
+    print('\nTests passed')
+    if options.keep:
+        print("Output files are in '%s'" % base_dir)
+    else:
+        shutil.rmtree(base_dir)
+
+run_tests()
@@ -0,0 +1,240 @@
+#!/usr/bin/python
+#
+# Copyright (C) 2026 agent <agent@local>
+#
+# Test of fastboot flashing, with this script as the fastboot host
+#
+# SPDX-License-Identifier:	GPL-2.0+
+#
+# To run this:
+#
+# make O=sandbox sandbox_config
+# make O=sandbox
+# ./test/usb/test-fastboot.py -u sandbox/u-boot
+#
+# U-Boot gets a disk with a GPT and runs 'fastboot' on sandbox's emulated
+# device controller. A raw image and a sparse image bigger than the
+# download buffer, which has to be split as the fastboot tool does, are
+# flashed, then the disk is checked.
+
+from __future__ import print_function
+
+from optparse import OptionParser
+import os
+import random
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+sys.path.append(os.path.dirname(os.path.abspath(sys.argv[0])))
+import udc_host
+
+MB = 1 << 20
+DISK_SIZE = 20 * MB
+BOOT_START, BOOT_SIZE = 1 * MB, 1 * MB
+SYSTEM_START, SYSTEM_SIZE = 2 * MB, 16 * MB
+BACKGROUND = b'\x5a'
+
+SPARSE_MAGIC = 0xed26ff3a
+SPARSE_BLK_SZ = 4096
+CHUNK_RAW, CHUNK_FILL, CHUNK_DONT_CARE = 0xcac1, 0xcac2, 0xcac3
+
+gpt = ('uuid_disk=5d5c1e42-4f3b-4a3e-9b5e-0e2c4a6f1d01;'
+       'name=boot,start=%#x,size=%#x,uuid=5d5c1e42-4f3b-4a3e-9b5e-0e2c4a6f1d02;'
+       'name=system,start=%#x,size=%#x,uuid=5d5c1e42-4f3b-4a3e-9b5e-0e2c4a6f1d03'
+       % (BOOT_START, BOOT_SIZE, SYSTEM_START, SYSTEM_SIZE))
+
+class FastbootError(Exception):
+    pass
+
+class Fastboot(object):
+    """The host side of the fastboot protocol"""
+    def __init__(self, host, intfs):
+        for intf in intfs:
+            if (intf.cls, intf.subclass, intf.protocol) == (0xff, 0x42, 3):
+                break
+        else:
+            raise ValueError('no fastboot interface')
+        self.host = host
+        self.ep_in = intf.ep(True)
+        self.ep_out = intf.ep(False)
+
+    def command(self, cmd, data=None):
+        """Send a command and return what follows OKAY, or raise on FAIL"""
+        self.host.bulk_out(self.ep_out, cmd.encode())
+        while True:
+            reply = self.host.bulk_in(self.ep_in).decode()
+            if reply.startswith('INFO'):
+                print('(bootloader)', reply[4:])
+            elif reply.startswith('DATA'):
+                self.host.bulk_out(self.ep_out, data)
+            elif reply.startswith('OKAY'):
+                return reply[4:]
+            else:
+                raise FastbootError(reply[4:])
+
+    def flash(self, partition, data):
+        self.command('download:%08x' % len(data), data)
+        self.command('flash:%s' % partition)
+
+def sparse_image(chunks, total_blks):
+    """Make an Android sparse image from (type, blocks, data) chunks"""
+    img = struct.pack('<IHHHHIIII', SPARSE_MAGIC, 1, 0, 28, 12,
+                      SPARSE_BLK_SZ, total_blks, len(chunks), 0)
+    for ctype, blks, data in chunks:
+        img += struct.pack('<HHII', ctype, 0, blks, 12 + len(data)) + data
+    return img
+
+def split_sparse(chunks, total_blks, max_size):
+    """Split chunks in sparse images of at most max_size bytes each
+
+    Like the fastboot tool, each image covers the whole partition, what the
+    others write being DONT_CARE in it.
+    """
+    limit = max_size - 28 - 2 * 12
+    pieces = []
+    cur, size, start, pos = [], 0, 0, 0
+    for chunk in chunks:
+        csize = 12 + len(chunk[2])
+        if cur and size + csize > limit:
+            pieces.append((start, pos, cur))
+            cur, size, start = [], 0, pos
+        cur.append(chunk)
+        size += csize
+        pos += chunk[1]
+    pieces.append((start, pos, cur))
+
+    images = []
+    for start, end, cur in pieces:
+        if start:
+            cur = [(CHUNK_DONT_CARE, start, b'')] + cur
+        if end < total_blks:
+            cur = cur + [(CHUNK_DONT_CARE, total_blks - end, b'')]
+        images.append(sparse_image(cur, total_blks))
+    return images
+
+def random_bytes(size):
+    return bytes(bytearray(random.getrandbits(8) for i in range(size)))
+
+def make_system():
+    """Make chunks for the system partition and what it should end up as"""
+    raw = lambda mb: (CHUNK_RAW, mb * MB // SPARSE_BLK_SZ,
+                      random_bytes(mb * MB))
+    skip = lambda mb: (CHUNK_DONT_CARE, mb * MB // SPARSE_BLK_SZ, b'')
+    fill = (CHUNK_FILL, MB // SPARSE_BLK_SZ, struct.pack('<I', 0xdeadbeef))
+
+    chunks = [raw(4), skip(1), fill, raw(4), skip(2), raw(3), skip(1)]
+    expect = b''
+    for ctype, blks, data in chunks:
+        if ctype == CHUNK_RAW:
+            expect += data
+        elif ctype == CHUNK_FILL:
+            expect += data * (blks * SPARSE_BLK_SZ // 4)
+        else:
+            expect += BACKGROUND * blks * SPARSE_BLK_SZ
+    return chunks, expect
+
+def fail(msg, log):
+    with open(log) as fd:
+        print(fd.read())
+    raise ValueError('Test failed: %s' % msg)
+
+def run_fastboot_test(u_boot, base_dir):
+    disk = os.path.join(base_dir, 'disk.img')
+    log = os.path.join(base_dir, 'u-boot.log')
+    with open(disk, 'wb') as fd:
+        fd.write(BACKGROUND * DISK_SIZE)
+
+    host = udc_host.UdcHost(os.path.join(base_dir, 'udc'))
+    cmd = ('sb bind 0 %s; gpt write host 0 "%s"; setenv sandbox_udc %s; '
+           'fastboot' % (disk, gpt, host.prefix))
+    with open(log, 'w') as out:
+        proc = subprocess.Popen([u_boot, '-c', cmd], stdin=open(os.devnull),
+                                stdout=out, stderr=subprocess.STDOUT)
+    try:
+        host.connect()
+        fb = Fastboot(host, host.enumerate())
+        print('Bootloader version', fb.command('getvar:version'))
+        max_size = int(fb.command('getvar:max-download-size'), 0)
+
+        print('Raw image')
+        boot = random_bytes(700 * 1024)
+        fb.flash('boot', boot)
+        try:
+            fb.flash('boot', random_bytes(BOOT_SIZE + 512))
+            fail('raw image too big for its partition accepted', log)
+        except FastbootError:
+            pass
+        try:
+            fb.flash('nothere', boot)
+            fail('missing partition not reported', log)
+        except FastbootError:
+            pass
+
+        # A file header longer than the image, then a chunk longer than
+        # what follows it and one shorter than its own header
+        good = sparse_image([(CHUNK_RAW, 1, random_bytes(SPARSE_BLK_SZ))], 1)
+        for bad in (good[:8] + struct.pack('<H', 0xffff) + good[10:],
+                    good[:36] + struct.pack('<I', 0xfffffff0) + good[40:],
+                    good[:36] + struct.pack('<I', 4) + good[40:]):
+            try:
+                fb.flash('system', bad)
+                fail('bad sparse image accepted', log)
+            except FastbootError:
+                pass
+
+        chunks, system = make_system()
+        images = split_sparse(chunks, SYSTEM_SIZE // SPARSE_BLK_SZ, max_size)
+        print('Sparse image in %d parts' % len(images))
+        if len(images) < 2:
+            fail('sparse image not split', log)
+        start = time.time()
+        for img in images:
+            fb.flash('system', img)
+        print('%d MB flashed in %.2fs' % (SYSTEM_SIZE // MB,
+                                          time.time() - start))
+        fb.command('reboot')
+    except:
+        proc.kill()
+        raise
+    finally:
+        host.close()
+    if proc.wait():
+        fail('U-Boot exited with %d' % proc.returncode, log)
+
+    with open(disk, 'rb') as fd:
+        fd.seek(BOOT_START)
+        got = fd.read(BOOT_SIZE)
+        fd.seek(SYSTEM_START)
+        got_system = fd.read(SYSTEM_SIZE)
+    if got != boot + BACKGROUND * (BOOT_SIZE - len(boot)):
+        fail('boot partition is wrong', log)
+    if got_system != system:
+        fail('system partition is wrong', log)
+
+def run_tests():
+    """Parse options, run the fastboot test and print the result"""
+    parser = OptionParser()
+    parser.add_option('-u', '--u-boot', default='sandbox/u-boot',
+            help='Select U-Boot sandbox binary')
+    parser.add_option('-k', '--keep', action='store_true',
+            help="Don't delete temporary directory even when tests pass")
+    (options, args) = parser.parse_args()
+
+    base_dir = tempfile.mkdtemp()
+    random.seed(1)
+    title = 'Fastboot Tests'
+    print(title, '\n', '=' * len(title))
+
+    run_fastboot_test(options.u_boot, base_dir)
+
+    print('\nTests passed')
+    if options.keep:
+        print("Output files are in '%s'" % base_dir)
+    else:
+        shutil.rmtree(base_dir)
+
+run_tests()
@@ -0,0 +1,82 @@
+# Copyright (C) 2026 agent <agent@local>
+#
+# SPDX-License-Identifier:	GPL-2.0+
+#
+
+# Test of a USB keyboard and storage behind sandbox's emulated EHCI
+# controller
+
+OUTPUT_DIR=sandbox_ehci
+
+fail() {
+	echo "Test failed: $1"
+	rm -f ${tmp} ${img}
+	exit 1
+}
+
+build_uboot() {
+	echo "Build sandbox with EHCI"
+	OPTS="O=${OUTPUT_DIR}"
+	NUM_CPUS=$(grep -c processor /proc/cpuinfo)
+	make ${OPTS} sandbox_ehci_config
+	make ${OPTS} -s -j${NUM_CPUS}
+}
+
+# A drive and, behind a hub, a keyboard. What the keyboard types runs a
+# command which checks for Ctrl-C on every line, polling the keyboard each
+# time, then gives the console back to the serial port. The same command
+# then runs from serial in a second U-Boot, on its own: with input queued
+# behind it, its Ctrl-C checks would eat that input
+run_usb() {
+	echo "Run USB"
+	timeout 120 ./${OUTPUT_DIR}/u-boot <<END
+	setenv sandbox_usb "${img} hub(kbd)"
+	setenv sandbox_usb_kbd "echo kbd-ok; time md.b 0 8000; setenv stdin serial"
+	usb start
+	usb read 1000 0 800
+	hash sha256 1000 100000
+	setenv stdin usbkbd
+	usb stop
+	reset
+END
+	timeout 120 ./${OUTPUT_DIR}/u-boot -c "time md.b 0 8000" </dev/null
+}
+
+check_results() {
+	echo "Check results"
+
+	if ! grep -q "1 Storage Device(s) found" ${tmp}; then
+		fail "enumeration error"
+	fi
+	sum=$(sha256sum ${img} | cut -d' ' -f1)
+	if ! grep -q "==> ${sum}" ${tmp}; then
+		fail "read error"
+	fi
+	if ! grep -q "^kbd-ok" ${tmp}; then
+		fail "keyboard input error"
+	fi
+	if [ $(grep -c "^00007ff0:" ${tmp}) -ne 2 ]; then
+		fail "dump interrupted"
+	fi
+
+	# Polling the keyboard has to cost little next to the output itself
+	set -- $(awk '/^time:/ { printf "%d\n", $2 * 1000 }' ${tmp})
+	if [ $# -ne 2 ]; then
+		fail "command error"
+	fi
+	echo "Dump took ${1}ms from the keyboard, ${2}ms from serial"
+	if [ ${1} -gt $((${2} * 2 + 500)) ]; then
+		fail "keyboard polling too slow"
+	fi
+}
+
+echo "USB keyboard test using sandbox's EHCI controller"
+echo
+tmp="$(mktemp)"
+img="$(mktemp)"
+dd if=/dev/urandom of=${img} bs=1M count=1 2>/dev/null
+build_uboot
+run_usb >${tmp}
+check_results
+rm ${tmp} ${img}
+echo "Test passed"
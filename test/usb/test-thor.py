@@ -0,0 +1,192 @@
+#!/usr/bin/python
+#
+# Copyright (C) 2026 agent <agent@local>
+#
+# Test of THOR downloads, with this script as the THOR host
+#
+# SPDX-License-Identifier:	GPL-2.0+
+#
+# To run this:
+#
+# make O=sandbox sandbox_config
+# make O=sandbox
+# ./test/usb/test-thor.py -u sandbox/u-boot
+#
+# U-Boot runs 'thordown' on sandbox's emulated device controller, to a raw
+# area of a disk. The bus and the disk are both slowed down to the same
+# speed, so that writing a chunk of packets while the next ones come in
+# shows: the download has to take clearly less than the two one after the
+# other.
+
+from __future__ import print_function
+
+from optparse import OptionParser
+import os
+import random
+import re
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+sys.path.append(os.path.dirname(os.path.abspath(sys.argv[0])))
+import udc_host
+
+MB = 1 << 20
+DISK_SIZE = 16 * MB
+AREA_START = 1 * MB
+IMAGE_SIZE = 8 * MB
+BACKGROUND = b'\x5a'
+# KiB/s of both the bus and the disk
+SPEED = 16384
+# Two packets in each half of the buffer
+BUF_SIZE = 4 * MB
+SLICE_SIZE = 64 * 1024
+
+RQT_CMD, RQT_DL = 201, 202
+RQT_CMD_REBOOT = 1
+RQT_DL_INIT, RQT_DL_FILE_INFO, RQT_DL_FILE_START = 1, 2, 3
+RQT_DL_FILE_END, RQT_DL_EXIT = 4, 5
+FILE_TYPE_NORMAL = 0
+RSP_SIZE, DATA_RSP_SIZE = 128, 8
+
+class ThorError(Exception):
+    pass
+
+class Thor(object):
+    """The host side of the THOR protocol"""
+    def __init__(self, host, intfs):
+        for intf in intfs:
+            if intf.cls == 0x0a:
+                break
+        else:
+            raise ValueError('no THOR data interface')
+        self.host = host
+        self.ep_in = intf.ep(True)
+        self.ep_out = intf.ep(False)
+
+    def handshake(self):
+        self.host.bulk_out(self.ep_out, b'THOR')
+        if self.host.bulk_in(self.ep_in) != b'ROHT':
+            raise ThorError('no ROHT')
+
+    def request(self, rqt, rqt_data, ints=(), name=b''):
+        """Send a request and return the int_data of the response"""
+        ints = list(ints) + [0] * (14 - len(ints))
+        self.host.bulk_out(self.ep_out, struct.pack('<ii14i32s128x32x', rqt,
+                                                    rqt_data, *(ints + [name])))
+        rsp = self.host.bulk_in(self.ep_in)
+        if len(rsp) != RSP_SIZE:
+            raise ThorError('bad response size %d' % len(rsp))
+        fields = struct.unpack('<iii5i', rsp[:32])
+        if fields[:2] != (rqt, rqt_data):
+            raise ThorError('response to the wrong request')
+        if fields[2]:
+            raise ThorError('request %d/%d failed: %d' % (rqt, rqt_data,
+                                                          fields[2]))
+        return fields[3:]
+
+    def download(self, name, data):
+        self.request(RQT_DL, RQT_DL_INIT, [len(data)])
+        packet_size = self.request(RQT_DL, RQT_DL_FILE_INFO,
+                                   [FILE_TYPE_NORMAL, len(data)],
+                                   name.encode())[0]
+        self.request(RQT_DL, RQT_DL_FILE_START)
+        # The last packet is padded, as the real host does
+        for count, pos in enumerate(range(0, len(data), packet_size)):
+            packet = data[pos:pos + packet_size]
+            packet += b'\0' * (packet_size - len(packet))
+            self.host.bulk_out(self.ep_out, packet)
+            ack, got = struct.unpack('<ii', self.host.bulk_in(self.ep_in))
+            if ack or got != count + 1:
+                raise ThorError('packet %d not taken' % count)
+        self.request(RQT_DL, RQT_DL_FILE_END)
+
+    def finish(self):
+        self.request(RQT_DL, RQT_DL_EXIT)
+        self.request(RQT_CMD, RQT_CMD_REBOOT)
+
+def random_bytes(size):
+    return bytes(bytearray(random.getrandbits(8) for i in range(size)))
+
+def fail(msg, log):
+    with open(log) as fd:
+        print(fd.read())
+    raise ValueError('Test failed: %s' % msg)
+
+def run_thor_test(u_boot, base_dir):
+    disk = os.path.join(base_dir, 'disk.img')
+    log = os.path.join(base_dir, 'u-boot.log')
+    with open(disk, 'wb') as fd:
+        fd.write(BACKGROUND * DISK_SIZE)
+
+    host = udc_host.UdcHost(os.path.join(base_dir, 'udc'))
+    cmd = ('sb bind 0 %s; setenv dfu_alt_info "rootfs raw %#x %#x"; '
+           'setenv dfu_bufsiz %x; setenv dfu_slicesiz %x; '
+           'setenv sandbox_udc %s; setenv sandbox_udc_speed %d; '
+           'setenv sandbox_host_speed %d; thordown 0 host 0' %
+           (disk, AREA_START // 512, (DISK_SIZE - AREA_START) // 512,
+            BUF_SIZE, SLICE_SIZE, host.prefix, SPEED, SPEED))
+    with open(log, 'w') as out:
+        proc = subprocess.Popen([u_boot, '-c', cmd], stdin=open(os.devnull),
+                                stdout=out, stderr=subprocess.STDOUT)
+    # Not a whole number of packets
+    image = random_bytes(IMAGE_SIZE - 1000)
+    try:
+        host.connect()
+        thor = Thor(host, host.enumerate())
+        thor.handshake()
+        start = time.time()
+        thor.download('rootfs', image)
+        took = time.time() - start
+        thor.finish()
+    except:
+        proc.kill()
+        raise
+    finally:
+        host.close()
+    if proc.wait():
+        fail('U-Boot exited with %d' % proc.returncode, log)
+
+    # Each of the bus and the disk needs this long on its own
+    one = float(len(image)) / (SPEED * 1024)
+    print('%d MB downloaded in %.2fs, %.2fs for the bus or the disk alone' %
+          (IMAGE_SIZE // MB, took, one))
+    with open(disk, 'rb') as fd:
+        fd.seek(AREA_START)
+        got = fd.read(len(image))
+    if got != image:
+        fail('disk is wrong', log)
+    with open(log) as fd:
+        report = re.search(r'rootfs: (\d+) bytes in \d+ ms \(\d+ KiB/s\)',
+                           fd.read())
+    if not report or int(report.group(1)) != len(image):
+        fail('no throughput reported', log)
+    if took >= 1.5 * one:
+        fail('disk writes did not overlap the download', log)
+
+def run_tests():
+    """Parse options, run the THOR test and print the result"""
+    parser = OptionParser()
+    parser.add_option('-u', '--u-boot', default='sandbox/u-boot',
+            help='Select U-Boot sandbox binary')
+    parser.add_option('-k', '--keep', action='store_true',
+            help="Don't delete temporary directory even when tests pass")
+    (options, args) = parser.parse_args()
+
+    base_dir = tempfile.mkdtemp()
+    random.seed(1)
+    title = 'THOR Tests'
+    print(title, '\n', '=' * len(title))
+
+    run_thor_test(options.u_boot, base_dir)
+
+    print('\nTests passed')
+    if options.keep:
+        print("Output files are in '%s'" % base_dir)
+    else:
+        shutil.rmtree(base_dir)
+
+run_tests()
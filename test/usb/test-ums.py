@@ -0,0 +1,211 @@
+#!/usr/bin/python
+#
+# Copyright (C) 2026 agent <agent@local>
+#
+# Test of the USB mass storage gadget, with this script as the SCSI
+# initiator
+#
+# SPDX-License-Identifier:	GPL-2.0+
+#
+# To run this:
+#
+# make O=sandbox sandbox_config
+# make O=sandbox
+# ./test/usb/test-ums.py -u sandbox/u-boot
+#
+# U-Boot runs 'ums' on sandbox's emulated device controller, exporting a
+# disk. The bus and the disk are both slowed down to the same speed. An
+# area is written and read back sequentially, with the Bulk-Only
+# Transport as a host would, first with no cache in the gadget, then with
+# read-ahead and write-back, which have to make both faster.
+
+from __future__ import print_function
+
+from optparse import OptionParser
+import os
+import random
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+sys.path.append(os.path.dirname(os.path.abspath(sys.argv[0])))
+import udc_host
+
+MB = 1 << 20
+DISK_SIZE = 8 * MB
+AREA_SIZE = 2 * MB
+BACKGROUND = b'\x5a'
+SECTOR = 512
+# KiB/s of both the bus and the disk
+SPEED = 4096
+# Data of each READ or WRITE
+XFER_SIZE = 16 * 1024
+CACHE_SIZE = 1 * MB
+
+CBW_SIGNATURE, CSW_SIGNATURE = 0x43425355, 0x53425355
+READ_CAPACITY, READ_10, WRITE_10 = 0x25, 0x28, 0x2a
+SYNCHRONIZE_CACHE = 0x35
+
+class ScsiError(Exception):
+    pass
+
+class BulkOnly(object):
+    """The host side of the Bulk-Only Transport"""
+    def __init__(self, host, intfs):
+        for intf in intfs:
+            if (intf.cls, intf.subclass, intf.protocol) == (8, 6, 0x50):
+                break
+        else:
+            raise ValueError('no mass storage interface')
+        self.host = host
+        self.ep_in = intf.ep(True)
+        self.ep_out = intf.ep(False)
+        self.tag = 0
+
+    def command(self, cdb, data_in=0, data_out=b''):
+        """Run a command, returning the data it read"""
+        self.tag += 1
+        length = data_in or len(data_out)
+        flags = udc_host.USB_DIR_IN if data_in else 0
+        self.host.bulk_out(self.ep_out, struct.pack('<IIIBBB16s',
+                CBW_SIGNATURE, self.tag, length, flags, 0, len(cdb), cdb))
+        data = b''
+        if data_out:
+            self.host.bulk_out(self.ep_out, data_out)
+        while len(data) < data_in:
+            data += self.host.bulk_in(self.ep_in)
+        csw = self.host.bulk_in(self.ep_in)
+        sig, tag, residue, status = struct.unpack('<IIIB', csw)
+        if sig != CSW_SIGNATURE or tag != self.tag:
+            raise ScsiError('bad CSW')
+        if status:
+            raise ScsiError('command %02x failed' % ord(cdb[0:1]))
+        return data
+
+    def capacity(self):
+        last, size = struct.unpack('>II', self.command(
+                struct.pack('>B9x', READ_CAPACITY), data_in=8))
+        return last + 1, size
+
+    def read(self, lba, count):
+        return self.command(struct.pack('>BxIxHx', READ_10, lba, count),
+                            data_in=count * SECTOR)
+
+    def write(self, lba, data):
+        self.command(struct.pack('>BxIxHx', WRITE_10, lba,
+                                 len(data) // SECTOR), data_out=data)
+
+    def sync(self):
+        self.command(struct.pack('>B9x', SYNCHRONIZE_CACHE))
+
+def random_bytes(size):
+    return bytes(bytearray(random.getrandbits(8) for i in range(size)))
+
+def fail(msg, log):
+    with open(log) as fd:
+        print(fd.read())
+    raise ValueError('Test failed: %s' % msg)
+
+def run_ums(u_boot, base_dir, area, image, cache_size):
+    """Write image at area, sync and read it back
+
+    Returns:
+        (write MB/s, read MB/s)
+    """
+    disk = os.path.join(base_dir, 'disk.img')
+    log = os.path.join(base_dir, 'u-boot.log')
+    with open(disk, 'wb') as fd:
+        fd.write(BACKGROUND * DISK_SIZE)
+
+    prefix = os.path.join(base_dir, 'udc')
+    for suffix in ('h2d', 'd2h'):
+        if os.path.exists('%s.%s' % (prefix, suffix)):
+            os.unlink('%s.%s' % (prefix, suffix))
+    host = udc_host.UdcHost(prefix)
+    cmd = ('sb bind 0 %s; setenv ums_cachesiz %x; setenv sandbox_udc %s; '
+           'setenv sandbox_udc_speed %d; setenv sandbox_host_speed %d; '
+           'ums 0 host 0' %
+           (disk, cache_size, host.prefix, SPEED, SPEED))
+    with open(log, 'w') as out:
+        proc = subprocess.Popen([u_boot, '-c', cmd], stdin=open(os.devnull),
+                                stdout=out, stderr=subprocess.STDOUT)
+    try:
+        host.connect()
+        ums = BulkOnly(host, host.enumerate())
+        if ums.capacity() != (DISK_SIZE // SECTOR, SECTOR):
+            fail('wrong capacity', log)
+        lba = area // SECTOR
+        count = XFER_SIZE // SECTOR
+
+        start = time.time()
+        for pos in range(0, len(image), XFER_SIZE):
+            ums.write(lba + pos // SECTOR, image[pos:pos + XFER_SIZE])
+        ums.sync()
+        write_took = time.time() - start
+
+        start = time.time()
+        got = b''
+        for pos in range(0, len(image), XFER_SIZE):
+            got += ums.read(lba + pos // SECTOR, count)
+        read_took = time.time() - start
+        if got != image:
+            fail('read back wrong data', log)
+        # Out of sequence, so not read ahead
+        if ums.read(lba + 3, 1) != image[3 * SECTOR:4 * SECTOR]:
+            fail('read back wrong data', log)
+    finally:
+        proc.kill()
+        proc.wait()
+        host.close()
+
+    with open(disk, 'rb') as fd:
+        before = fd.read(area)
+        got = fd.read(len(image))
+        rest = fd.read()
+    if (got != image or before != BACKGROUND * len(before) or
+            rest != BACKGROUND * len(rest)):
+        fail('disk is wrong', log)
+
+    mb = float(len(image)) / MB
+    return mb / write_took, mb / read_took
+
+def run_ums_test(u_boot, base_dir):
+    image = random_bytes(AREA_SIZE)
+    area = 1 * MB
+    print('Bus and disk at %.1f MB/s' % (SPEED / 1024.0))
+    plain = run_ums(u_boot, base_dir, area, image, 0)
+    print('No cache: write %.2f MB/s, read %.2f MB/s' % plain)
+    cached = run_ums(u_boot, base_dir, area, image, CACHE_SIZE)
+    print('Cache:    write %.2f MB/s, read %.2f MB/s' % cached)
+    log = os.path.join(base_dir, 'u-boot.log')
+    if cached[0] < plain[0] * 1.2:
+        fail('write-back did not speed writes up', log)
+    if cached[1] < plain[1] * 1.2:
+        fail('read-ahead did not speed reads up', log)
+
+def run_tests():
+    """Parse options, run the mass storage test and print the result"""
+    parser = OptionParser()
+    parser.add_option('-u', '--u-boot', default='sandbox/u-boot',
+            help='Select U-Boot sandbox binary')
+    parser.add_option('-k', '--keep', action='store_true',
+            help="Don't delete temporary directory even when tests pass")
+    (options, args) = parser.parse_args()
+
+    base_dir = tempfile.mkdtemp()
+    random.seed(1)
+    title = 'USB Mass Storage Tests'
+    print(title, '\n', '=' * len(title))
+
+    run_ums_test(options.u_boot, base_dir)
+
+    print('\nTests passed')
+    if options.keep:
+        print("Output files are in '%s'" % base_dir)
+    else:
+        shutil.rmtree(base_dir)
+
+run_tests()
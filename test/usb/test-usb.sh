@@ -0,0 +1,140 @@
+# Copyright (C) 2026 agent <agent@local>
+#
+# SPDX-License-Identifier:	GPL-2.0+
+#
+
+# Simple test script for USB storage with sandbox's emulated bus
+
+OUTPUT_DIR=sandbox
+
+fail() {
+	echo "Test failed: $1"
+	rm -rf ${tmp} ${img1} ${img2} ${img3} ${dir}
+	exit 1
+}
+
+build_uboot() {
+	echo "Build sandbox"
+	OPTS="O=${OUTPUT_DIR}"
+	NUM_CPUS=$(grep -c processor /proc/cpuinfo)
+	make ${OPTS} sandbox_config
+	make ${OPTS} -s -j${NUM_CPUS}
+}
+
+# One drive on the root hub, another behind an external hub
+run_usb() {
+	echo "Run USB"
+	./${OUTPUT_DIR}/u-boot <<END
+	setenv sandbox_usb "${img1} hub(- ${img2})"
+	usb start
+	usb tree
+	usb dev 0
+	usb read 1000 0 1000
+	hash sha256 1000 200000
+	usb dev 1
+	usb read 1000 0 800
+	hash sha256 1000 100000
+	usb dev 0
+	usb write 1000 1000 800
+	usb stop
+	reset
+END
+}
+
+# A tree of hubs three deep with the default 100ms power-on to power-good
+# time. All ports come up together so this should take little more than
+# the deepest hub's delays, not the sum over all ports
+run_timing() {
+	echo "Run enumeration timing"
+	./${OUTPUT_DIR}/u-boot <<END
+	setenv sandbox_usb "${img2} hub(${img2} hub(${img2} -) -) - -"
+	time usb start
+	reset
+END
+}
+
+# An ext4 file system, with files which are not whole numbers of sectors:
+# their ends, and the parts of blocks holding inodes, go through bounce
+# buffers in the same requests as the rest
+run_fs() {
+	echo "Run file system"
+	./${OUTPUT_DIR}/u-boot <<END
+	setenv sandbox_usb "${img3}"
+	usb start
+	ext4load usb 0 1000 /file
+	hash sha256 1000 \${filesize}
+	ext4load usb 0 1000 /small
+	hash sha256 1000 \${filesize}
+	usb stop
+	reset
+END
+}
+
+check_results() {
+	echo "Check results"
+
+	if [ $(grep -c "Storage Device(s) found" ${tmp}) -ne 1 ] ||
+	   ! grep -q "2 Storage Device(s) found" ${tmp}; then
+		fail "enumeration error"
+	fi
+
+	# Both reads must match what is in the files
+	sum1=$(head -c 2097152 ${img1} | sha256sum | cut -d' ' -f1)
+	sum2=$(sha256sum ${img2} | cut -d' ' -f1)
+	if ! grep -q "==> ${sum1}" ${tmp} || ! grep -q "==> ${sum2}" ${tmp}
+	then
+		fail "read error"
+	fi
+
+	# The write put the second drive's contents on the first one
+	if ! cmp -s -n 1048576 -i 0:2097152 ${img2} ${img1}; then
+		fail "write error"
+	fi
+}
+
+check_fs() {
+	echo "Check file system"
+
+	sum1=$(sha256sum ${dir}/file | cut -d' ' -f1)
+	sum2=$(sha256sum ${dir}/small | cut -d' ' -f1)
+	if ! grep -q "==> ${sum1}" ${tmp} || ! grep -q "==> ${sum2}" ${tmp}
+	then
+		fail "file read error"
+	fi
+}
+
+check_timing() {
+	echo "Check timing"
+
+	if ! grep -q "3 Storage Device(s) found" ${tmp}; then
+		fail "enumeration error"
+	fi
+	ms=$(awk '/^time:/ { printf "%d", $2 * 1000 }' ${tmp})
+	echo "usb start took ${ms}ms"
+	if [ -z "${ms}" ] || [ ${ms} -gt 3000 ]; then
+		fail "enumeration too slow"
+	fi
+}
+
+echo "Simple USB storage test using sandbox"
+echo
+tmp="$(mktemp)"
+img1="$(mktemp)"
+img2="$(mktemp)"
+img3="$(mktemp)"
+dir="$(mktemp -d)"
+dd if=/dev/urandom of=${img1} bs=1M count=4 2>/dev/null
+dd if=/dev/urandom of=${img2} bs=1M count=1 2>/dev/null
+dd if=/dev/urandom of=${dir}/file bs=1000 count=1234 2>/dev/null
+dd if=/dev/urandom of=${dir}/small bs=100 count=1 2>/dev/null
+dd if=/dev/zero of=${img3} bs=1M count=8 2>/dev/null
+mkfs.ext4 -q -F -b 1024 -d ${dir} ${img3}
+build_uboot
+run_usb >${tmp}
+check_results
+run_fs >${tmp}
+check_fs
+run_timing >${tmp}
+check_timing
+rm -r ${tmp} ${img1} ${img2} ${img3} ${dir}
+echo "Test passed"
@@ -0,0 +1,112 @@
+# Copyright (C) 2026 agent <agent@local>
+#
+# SPDX-License-Identifier:	GPL-2.0+
+#
+
+# Test of USB storage behind sandbox's emulated xHCI controller
+
+OUTPUT_DIR=sandbox_xhci
+
+# 2ms from each doorbell to the transfers starting, on an 8 MiB/s bus
+LATENCY=2000
+SPEED=8192
+
+fail() {
+	echo "Test failed: $1"
+	rm -f ${tmp} ${img1} ${img2}
+	exit 1
+}
+
+build_uboot() {
+	echo "Build sandbox with xHCI"
+	OPTS="O=${OUTPUT_DIR}"
+	NUM_CPUS=$(grep -c processor /proc/cpuinfo)
+	make ${OPTS} sandbox_xhci_config
+	make ${OPTS} -s -j${NUM_CPUS}
+}
+
+# A drive on each of two root ports
+run_usb() {
+	echo "Run USB"
+	./${OUTPUT_DIR}/u-boot <<END
+	setenv sandbox_usb "${img1} - ${img2}"
+	usb start
+	usb dev 0
+	usb read 1000 0 1000
+	hash sha256 1000 200000
+	usb dev 1
+	usb read 1000 0 800
+	hash sha256 1000 100000
+	usb dev 0
+	usb write 1000 1000 800
+	usb stop
+	reset
+END
+}
+
+# 4 MiB each way. Commands are as large as the driver takes, with their
+# CBW, data and CSW queued together, so the doorbell latency hardly shows.
+# The emulated drive stalls a CBW sent before the last CSW was read.
+run_timing() {
+	echo "Run transfer timing"
+	./${OUTPUT_DIR}/u-boot <<END
+	setenv sandbox_usb "${img1}"
+	setenv sandbox_usb_latency ${LATENCY}
+	setenv sandbox_usb_speed ${SPEED}
+	usb start
+	time usb read 1000 0 2000
+	time usb write 1000 0 2000
+	reset
+END
+}
+
+check_results() {
+	echo "Check results"
+
+	if ! grep -q "2 Storage Device(s) found" ${tmp}; then
+		fail "enumeration error"
+	fi
+
+	# Both reads must match what is in the files
+	sum1=$(head -c 2097152 ${img1} | sha256sum | cut -d' ' -f1)
+	sum2=$(sha256sum ${img2} | cut -d' ' -f1)
+	if ! grep -q "==> ${sum1}" ${tmp} || ! grep -q "==> ${sum2}" ${tmp}
+	then
+		fail "read error"
+	fi
+
+	# The write put the second drive's contents on the first one
+	if ! cmp -s -n 1048576 -i 0:2097152 ${img2} ${img1}; then
+		fail "write error"
+	fi
+}
+
+check_timing() {
+	echo "Check timing"
+
+	if [ $(grep -c "8192 blocks .*: OK" ${tmp}) -ne 2 ]; then
+		fail "transfer error"
+	fi
+	# The bus alone needs 500ms for each
+	for ms in $(awk '/^time:/ { printf "%d\n", $2 * 1000 }' ${tmp}); do
+		echo "4 MiB took ${ms}ms"
+		if [ ${ms} -gt 750 ]; then
+			fail "transfers too slow"
+		fi
+	done
+}
+
+echo "USB storage test using sandbox's xHCI controller"
+echo
+tmp="$(mktemp)"
+img1="$(mktemp)"
+img2="$(mktemp)"
+dd if=/dev/urandom of=${img1} bs=1M count=4 2>/dev/null
+dd if=/dev/urandom of=${img2} bs=1M count=1 2>/dev/null
+build_uboot
+run_usb >${tmp}
+check_results
+run_timing >${tmp}
+check_timing
+rm ${tmp} ${img1} ${img2}
+echo "Test passed"
@@ -0,0 +1,192 @@
+#
+# Copyright (C) 2026 agent <agent@local>
+#
+# The USB host side of sandbox's emulated device controller
+#
+# SPDX-License-Identifier:	GPL-2.0+
+#
+# drivers/usb/gadget/sandbox_udc.c describes the messages exchanged over
+# the two named pipes. Tests create a UdcHost, start U-Boot with the
+# sandbox_udc environment variable set to its prefix, then call
+# connect() and enumerate() before talking to the gadget's functions.
+
+import errno
+import fcntl
+import os
+import select
+import struct
+import time
+
+USB_DIR_IN = 0x80
+USB_DT_DEVICE = 1
+USB_DT_CONFIG = 2
+USB_DT_INTERFACE = 4
+USB_DT_ENDPOINT = 5
+USB_REQ_SET_ADDRESS = 5
+USB_REQ_GET_DESCRIPTOR = 6
+USB_REQ_SET_CONFIGURATION = 9
+
+# Seconds to wait for the device to connect or answer, before giving up
+READ_TIMEOUT = 10
+
+class Stall(Exception):
+    """The device stalled an endpoint"""
+    def __init__(self, ep):
+        Exception.__init__(self, 'endpoint %02x stalled' % ep)
+        self.ep = ep
+
+class Timeout(Exception):
+    """The device did not answer in time"""
+    pass
+
+class Interface(object):
+    """An interface from the configuration descriptor
+
+    Properties:
+        number: bInterfaceNumber
+        cls, subclass, protocol: its class triple
+        eps: list of (bEndpointAddress, bmAttributes)
+    """
+    def __init__(self, desc):
+        (self.number, self.alt, num_eps, self.cls, self.subclass,
+         self.protocol) = struct.unpack('<BBBBBB', desc[2:8])
+        self.eps = []
+
+    def ep(self, dir_in, attr=2):
+        """Return the address of the first endpoint of this direction/type"""
+        for addr, attributes in self.eps:
+            if bool(addr & USB_DIR_IN) == dir_in and (attributes & 3) == attr:
+                return addr
+        raise ValueError('interface %d has no such endpoint' % self.number)
+
+class UdcHost(object):
+    def __init__(self, prefix, timeout=READ_TIMEOUT):
+        self.prefix = prefix
+        self.timeout = timeout
+        self.out = None
+        self.inp = None
+        for suffix in ('h2d', 'd2h'):
+            os.mkfifo('%s.%s' % (prefix, suffix))
+
+    def connect(self):
+        """Wait for the gadget to register, U-Boot opens the pipes then"""
+        deadline = time.time() + self.timeout
+        while True:
+            try:
+                fd = os.open(self.prefix + '.h2d', os.O_WRONLY | os.O_NONBLOCK)
+                break
+            except OSError as e:
+                if e.errno != errno.ENXIO:
+                    raise
+                if time.time() > deadline:
+                    raise Timeout('device did not connect in %ds' %
+                                  self.timeout)
+                time.sleep(0.01)
+        fcntl.fcntl(fd, fcntl.F_SETFL,
+                    fcntl.fcntl(fd, fcntl.F_GETFL) & ~os.O_NONBLOCK)
+        self.out = os.fdopen(fd, 'wb', 0)
+        self.inp = open(self.prefix + '.d2h', 'rb', 0)
+
+    def close(self):
+        """Disconnect by closing the pipes"""
+        for f in (self.out, self.inp):
+            if f:
+                f.close()
+        self.out = self.inp = None
+
+    def _read(self, size):
+        data = b''
+        while len(data) < size:
+            ready = select.select([self.inp], [], [], self.timeout)[0]
+            if not ready:
+                raise Timeout('no answer from the device in %ds' %
+                              self.timeout)
+            part = os.read(self.inp.fileno(), size - len(data))
+            if not part:
+                raise EOFError('device went away')
+            data += part
+        return data
+
+    def _write(self, data):
+        self.out.write(data)
+        self.out.flush()
+
+    def read_msg(self):
+        """Read a message from the device
+
+        Returns:
+            (type, endpoint, data), type being 'C', 'I' or 'X'
+        """
+        mtype = self._read(1)
+        ep = 0
+        if mtype != b'C':
+            ep = struct.unpack('<B', self._read(1))[0]
+        if mtype == b'X':
+            return 'X', ep, b''
+        size = struct.unpack('<I', self._read(4))[0]
+        return mtype.decode(), ep, self._read(size)
+
+    def control(self, reqtype, request, value, index, data=b'', length=0):
+        """Run a control transfer
+
+        Args:
+            data: the data stage of an OUT transfer
+            length: how much to ask for in an IN transfer
+        Returns:
+            The data stage of an IN transfer
+        """
+        if reqtype & USB_DIR_IN:
+            size = length
+        else:
+            size = len(data)
+        self._write(b'S' + struct.pack('<BBHHH', reqtype, request, value,
+                                       index, size) + data)
+        mtype, ep, reply = self.read_msg()
+        if mtype == 'X':
+            raise Stall(0)
+        if mtype != 'C':
+            raise ValueError("expected a control reply, got '%s'" % mtype)
+        return reply
+
+    def bulk_out(self, ep, data):
+        self._write(b'O' + struct.pack('<BI', ep, len(data)))
+        # Large transfers go in pieces, the pipe only holds so much
+        for pos in range(0, len(data), 1 << 20):
+            self._write(data[pos:pos + (1 << 20)])
+
+    def bulk_in(self, ep):
+        mtype, msg_ep, data = self.read_msg()
+        if mtype == 'X':
+            raise Stall(msg_ep)
+        if mtype != 'I' or msg_ep != ep:
+            raise ValueError('expected data from endpoint %02x' % ep)
+        return data
+
+    def enumerate(self):
+        """Do what a host does with a new device
+
+        Returns:
+            List of Interface objects of the configuration selected
+        """
+        get_desc = USB_DIR_IN, USB_REQ_GET_DESCRIPTOR
+        self.control(*get_desc, value=USB_DT_DEVICE << 8, index=0, length=18)
+        self.control(0, USB_REQ_SET_ADDRESS, 1, 0)
+        config = self.control(*get_desc, value=USB_DT_CONFIG << 8, index=0,
+                              length=9)
+        total, = struct.unpack('<H', config[2:4])
+        config = self.control(*get_desc, value=USB_DT_CONFIG << 8, index=0,
+                              length=total)
+        value = struct.unpack('<B', config[5:6])[0]
+
+        intfs = []
+        pos = 0
+        while pos < len(config):
+            size, dtype = struct.unpack('<BB', config[pos:pos + 2])
+            desc = config[pos:pos + size]
+            if dtype == USB_DT_INTERFACE:
+                intfs.append(Interface(desc))
+            elif dtype == USB_DT_ENDPOINT:
+                intfs[-1].eps.append(struct.unpack('<BB', desc[2:4]))
+            pos += size
+        self.control(0, USB_REQ_SET_CONFIGURATION, value, 0)
+        return intfs